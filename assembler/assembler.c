@@ -0,0 +1,599 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <errno.h>
+
+#include "utils.h"
+#include "vnsasm.h"
+#include "parser.tab.h"
+
+/**
+ * Report an error of the file being assembled, prefixed with its path.
+ * Assembly of that file is aborted by the caller, other files are not
+ * affected.
+ */
+void asm_error(vnsasm_context *ctx, const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    fprintf(ctx->err, "Error: %s: ", ctx->infile_name);
+    vfprintf(ctx->err, fmt, args);
+    va_end(args);
+
+    ctx->failed = TRUE;
+}
+
+/**
+ * Report an error at *line* of the file being assembled as
+ * "path:line: message", see asm_error().
+ */
+void asm_error_at(vnsasm_context *ctx, int line, const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    fprintf(ctx->err, "Error: %s:%i: ", ctx->infile_name, line);
+    vfprintf(ctx->err, fmt, args);
+    va_end(args);
+
+    ctx->failed = TRUE;
+}
+
+/**
+ * Report a problem that does not stop the assembly of the file.
+ */
+void asm_warning(vnsasm_context *ctx, const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    fprintf(ctx->err, "Warning: %s: ", ctx->infile_name);
+    vfprintf(ctx->err, fmt, args);
+    va_end(args);
+}
+
+/**
+ * Report a failed system call on path, like perror(3).
+ */
+static void asm_perror(vnsasm_context *ctx, const char *path)
+{
+    fprintf(ctx->err, "%s: %s\n", path, strerror(errno));
+    ctx->failed = TRUE;
+}
+
+static int lineno(vnsasm_context *ctx)
+{
+    return yyget_lineno(ctx->scanner);
+}
+
+void yyerror(YYLTYPE *lloc, yyscan_t scanner, vnsasm_context *ctx,
+             const char *error)
+{
+    asm_error_at(ctx, lloc->first_line, "%s\n", error);
+}
+
+/**
+ * Encode the program as container image with all bytes emitted by the
+ * source as load segments, the entry address and the label table. The
+ * allocated image is stored in *data* and *size*.
+ */
+int asm_encode(vnsasm_context *ctx, uint8_t **data, size_t *size)
+{
+    vnsasm_program *program = &ctx->program;
+    symtab *st = &program->symbols;
+    img_symbol *symbols;
+    unsigned int count;
+    int result;
+
+    symbols = malloc(sizeof(img_symbol) * (st->label_count + 1));
+    if (NULL == symbols) {
+        asm_error(ctx, "Out of memory\n");
+        return FALSE;
+    }
+
+    for (count = 0; count < st->label_count; count++) {
+        symbols[count].name = st->labels[count]->name;
+        symbols[count].addr = st->labels[count]->addr;
+    }
+
+    result = img_encode_banked(program->data, program->used,
+                               program->bank_count, program->entry,
+                               symbols, count, data, size);
+    free(symbols);
+
+    if (!result) {
+        asm_error(ctx, "Out of memory\n");
+    }
+
+    return result;
+}
+
+/**
+ * Write the program to ctx->outfile_name, "-" is standard output.
+ */
+static int write_program(vnsasm_context *ctx)
+{
+    uint8_t *data = ctx->program.data;
+    size_t size = MEMORY_UNIT_SIZE;
+    FILE *outfile;
+    int result;
+
+    if (IMG_CONTAINER == ctx->config->image_format) {
+        if (!asm_encode(ctx, &data, &size)) {
+            return FALSE;
+        }
+    } else if (ctx->program.bank_count > 1) {
+        asm_error(ctx, "Banked programs need the container format "
+                       "(-f vns)\n");
+        return FALSE;
+    } else if (ctx->config->strip_trailing_zeros) {
+        while (size > 1 && 0 == data[size - 1]) {
+            --size;
+        }
+    }
+
+    if (NULL == (outfile = util_fopen(ctx->outfile_name, "w"))) {
+        result = FALSE;
+    } else {
+        result = (1 == fwrite(data, size, 1, outfile));
+        result = (0 == util_fclose(outfile)) && result;
+    }
+
+    if (!result) {
+        asm_perror(ctx, ctx->outfile_name);
+    }
+
+    if (data != ctx->program.data) {
+        free(data);
+    }
+
+    return result;
+}
+
+const char *asm_intern(vnsasm_context *ctx, const char *str)
+{
+    const char *result = sym_intern(&ctx->program.symbols, str);
+
+    if (NULL == result) {
+        asm_error_at(ctx, lineno(ctx), "Out of memory\n");
+    }
+
+    return result;
+}
+
+/**
+ * Find the label called name or add it as pending, reporting an error
+ * if out of memory.
+ */
+static vnsasm_label *get_label(vnsasm_context *ctx, const char *name)
+{
+    vnsasm_label *label = sym_label(&ctx->program.symbols, name);
+
+    if (NULL == label) {
+        asm_error_at(ctx, lineno(ctx), "Out of memory\n");
+    }
+
+    return label;
+}
+
+static int declare_label(vnsasm_context *ctx, const char *name, uint8_t addr)
+{
+    vnsasm_label *label;
+
+    if (NULL == (label = get_label(ctx, name))) {
+        return FALSE;
+    }
+
+    if (-1 != label->addr) {
+        asm_error_at(ctx, lineno(ctx), "Duplicated label declaration: %s\n",
+                     name);
+        return FALSE;
+    }
+
+    /* we've found the declaration for a pending label */
+    label->addr = addr;
+    sym_backpatch(&ctx->program.symbols, label, ctx->program.data);
+
+    return TRUE;
+}
+
+/**
+ * Store the position of the byte at the location counter in
+ * program->data in *pos*. The windows of banks 1 and up follow the
+ * memory unit, their bytes must lie inside the bank window.
+ */
+static int data_pos(vnsasm_context *ctx, unsigned int *pos)
+{
+    vnsasm_program *program = &ctx->program;
+
+    if (0 == program->bank) {
+        *pos = program->counter;
+        return TRUE;
+    }
+
+    if (program->counter < IMG_BANK_BASE) {
+        asm_error_at(ctx, lineno(ctx), "address 0x%.2X of bank %i is "
+                     "outside the bank window\n", program->counter,
+                     program->bank);
+        return FALSE;
+    }
+
+    if (program->bank >= program->bank_count) {
+        program->bank_count = program->bank + 1;
+    }
+    *pos = MEMORY_UNIT_SIZE + (program->bank - 1) * IMG_BANK_SIZE +
+           program->counter - IMG_BANK_BASE;
+
+    return TRUE;
+}
+
+static int resolve_label(vnsasm_context *ctx, const char *name)
+{
+    vnsasm_label *label;
+    unsigned int pos;
+
+    if (NULL == (label = get_label(ctx, name)) || !data_pos(ctx, &pos)) {
+        return FALSE;
+    }
+
+    if (-1 != label->addr) {
+        ctx->program.data[pos] = label->addr;
+    } else if (!sym_add_fixup(&ctx->program.symbols, label, pos)) {
+        /* label is pending, the position of the current byte is lost */
+        asm_error_at(ctx, lineno(ctx), "Out of memory\n");
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static int finalize_labels(vnsasm_context *ctx)
+{
+    symtab *st = &ctx->program.symbols;
+    vnsasm_label *label;
+    unsigned int i;
+
+    for (i = 0; i < st->label_count; i++) {
+        label = st->labels[i];
+        if (-1 == label->addr) {
+            asm_error(ctx, "Could not resolve label: %s\n", label->name);
+            return FALSE;
+        }
+        if (ctx->config->print_resolved_labels) {
+            fprintf(ctx->out, " -> Label '%s' resolved to address "
+                    "0x%.2x (%i)\n", label->name, label->addr, label->addr);
+        }
+    }
+
+    /* only debug files and in-memory assembly use the labels */
+    if (NULL == ctx->debugfile_name && !ctx->config->debug_labels) {
+        return TRUE;
+    }
+
+    for (i = 0; i < st->label_count; i++) {
+        label = st->labels[i];
+        if (!dbg_add_label(&ctx->program.debug, label->name, label->addr)) {
+            asm_warning(ctx, "debug information only holds the first %u "
+                        "labels\n", i);
+            break;
+        }
+    }
+
+    return TRUE;
+}
+
+/**
+ * Append an item to the instruction stream. The stream is only needed
+ * by the optimizer and not recorded without -O.
+ */
+static int add_item(vnsasm_context *ctx, uint8_t kind, uint8_t value,
+                    const vns_instruction *ins, const char *label, int line)
+{
+    vnsasm_program *program = &ctx->program;
+    vnsasm_item *items;
+    unsigned int size;
+
+    if (!ctx->config->optimize) {
+        return TRUE;
+    }
+
+    if (program->item_count == program->item_size) {
+        size = program->item_size ? 2 * program->item_size : 64;
+        items = realloc(program->items, sizeof(*items) * size);
+        if (NULL == items) {
+            asm_error(ctx, "Out of memory\n");
+            return FALSE;
+        }
+        program->items = items;
+        program->item_size = size;
+    }
+
+    items = &program->items[program->item_count++];
+    items->kind = kind;
+    items->value = value;
+    items->ins = ins;
+    items->label = label;
+    items->line = line;
+
+    return TRUE;
+}
+
+static int push_byte(vnsasm_context *ctx, uint8_t byte)
+{
+    unsigned int pos;
+
+    if (!data_pos(ctx, &pos)) {
+        return FALSE;
+    }
+
+    ctx->program.data[pos] = byte;
+    ctx->program.used[pos] = TRUE;
+    ctx->program.counter++;
+
+    return TRUE;
+}
+
+static int skip_byte(vnsasm_context *ctx)
+{
+    unsigned int pos;
+
+    if (!data_pos(ctx, &pos)) {
+        return FALSE;
+    }
+
+    ctx->program.used[pos] = TRUE;
+    ctx->program.counter++;
+
+    return TRUE;
+}
+
+int prc_label_decl(vnsasm_context *ctx, const char *name)
+{
+    return declare_label(ctx, name, ctx->program.counter) &&
+           add_item(ctx, ASM_ITEM_LABEL, 0, NULL, name, 0);
+}
+
+int prc_ins(vnsasm_context *ctx, const char *mnemonic,
+            argtype at1, argtype at2,
+            uint8_t i, const char *s, int line)
+{
+    const vns_instruction *ins;
+    const char *label = NULL;
+    
+    ins = is_find_mnemonic(mnemonic, at1, at2);
+
+    if (NULL == ins) {
+        if (!is_lookup_mnemonic_name(mnemonic)) {
+            asm_error_at(ctx, lineno(ctx), "Unknown instruction '%s'\n",
+                         mnemonic);
+        } else if (at1 == AT_NONE) {
+            asm_error_at(ctx, lineno(ctx), "missing argument for '%s'\n",
+                         mnemonic);
+        } else {
+            asm_error_at(ctx, lineno(ctx), "invalid arguments for '%s' "
+                         "(found %x, %x)\n", mnemonic, at1, at2);
+        }
+        return FALSE;
+    }
+
+    if (0 == ctx->program.bank) {
+        /* debug information only covers bank 0 */
+        ctx->program.debug.line[ctx->program.counter] = line;
+    }
+    if (!push_byte(ctx, ins->opcode)) {
+        return FALSE;
+    }
+
+    if (NULL != s && ((ins->at1 & AT_LABEL) || (ins->at2 & AT_LABEL))) {
+        if (!resolve_label(ctx, s) || !skip_byte(ctx)) {
+            return FALSE;
+        }
+        label = s;
+    } else
+    if ((ins->at1 & AT_INT) || (ins->at2 & AT_INT)) {
+        if (!push_byte(ctx, i)) {
+            return FALSE;
+        }
+    }
+
+    return add_item(ctx, ASM_ITEM_INS, i, ins, label, line);
+}
+
+int prc_byte(vnsasm_context *ctx, uint8_t value)
+{
+    return push_byte(ctx, value) &&
+           add_item(ctx, ASM_ITEM_BYTE, value, NULL, NULL, 0);
+}
+
+int prc_offset(vnsasm_context *ctx, uint8_t offset)
+{
+    ctx->program.counter = offset;
+    return add_item(ctx, ASM_ITEM_OFFSET, offset, NULL, NULL, 0);
+}
+
+int prc_entry(vnsasm_context *ctx, const char *label, uint8_t addr)
+{
+    if (-1 != ctx->program.entry || NULL != ctx->program.entry_label) {
+        asm_error_at(ctx, lineno(ctx), "Duplicated entry declaration\n");
+        return FALSE;
+    }
+
+    if (NULL != label) {
+        /* resolved after all labels are known */
+        ctx->program.entry_label = label;
+    } else {
+        ctx->program.entry = addr;
+    }
+
+    return TRUE;
+}
+
+/**
+ * Emit the following bytes into *bank*. Bytes of banks other than 0 go
+ * to the bank window, the location counter is not changed.
+ */
+int prc_bank(vnsasm_context *ctx, uint8_t bank)
+{
+    if (bank >= IMG_MAX_BANKS) {
+        asm_error_at(ctx, lineno(ctx), "bank %i out of range, the maximum "
+                     "is %i\n", bank, IMG_MAX_BANKS - 1);
+        return FALSE;
+    }
+
+    ctx->program.bank = bank;
+
+    return TRUE;
+}
+
+static int finalize_entry(vnsasm_context *ctx)
+{
+    vnsasm_label *label;
+    vnsasm_program *program = &ctx->program;
+
+    if (NULL != program->entry_label) {
+        label = sym_find(&program->symbols, program->entry_label);
+        if (NULL == label) {
+            asm_error(ctx, "Could not resolve entry label: %s\n",
+                      program->entry_label);
+            return FALSE;
+        }
+        program->entry = label->addr;
+    }
+
+    if (-1 == program->entry) {
+        program->entry = 0;
+    } else if (IMG_RAW == ctx->config->image_format && 0 != program->entry) {
+        asm_warning(ctx, "raw images always start at 0x00, entry 0x%.2X "
+                    "is not stored\n", program->entry);
+    }
+
+    return TRUE;
+}
+
+/**
+ * Start an empty program in ctx, to be released with asm_release().
+ */
+void asm_init(vnsasm_context *ctx)
+{
+    vnsasm_program *program = &ctx->program;
+
+    memset(program, 0, sizeof(*program));
+    sym_init(&program->symbols);
+    program->entry = -1;
+    program->bank_count = 1;
+    dbg_init(&program->debug, ctx->infile_name);
+}
+
+/**
+ * The optimizer lays out a single memory unit, banked programs are
+ * left as written.
+ */
+static int skip_optimizer(vnsasm_context *ctx)
+{
+    if (ctx->program.bank_count > 1) {
+        asm_warning(ctx, "banked programs are not optimized\n");
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+/**
+ * Parse the source *infile* into ctx->program and resolve all labels
+ * and the entry. The symbol table is kept for asm_encode() until
+ * asm_release(). Returns TRUE on success, errors are written to
+ * ctx->err.
+ */
+int asm_parse(vnsasm_context *ctx, FILE *infile)
+{
+    int result;
+
+    asm_init(ctx);
+
+    if (0 != yylex_init_extra(ctx, &ctx->scanner)) {
+        asm_perror(ctx, ctx->infile_name);
+        return FALSE;
+    }
+    yyset_in(infile, ctx->scanner);
+
+    result = 0 == yyparse(ctx->scanner, ctx) &&
+             (!ctx->config->optimize || skip_optimizer(ctx) ||
+              asm_optimize(ctx)) &&
+             finalize_labels(ctx) &&
+             finalize_entry(ctx);
+
+    yylex_destroy(ctx->scanner);
+    ctx->scanner = NULL;
+
+    if (!result) {
+        /* parser errors may have been reported already */
+        ctx->failed = TRUE;
+    }
+
+    return result;
+}
+
+void asm_release(vnsasm_context *ctx)
+{
+    sym_destroy(&ctx->program.symbols);
+    free(ctx->program.items);
+    ctx->program.items = NULL;
+}
+
+/**
+ * Assemble the input file of ctx into its output file, "-" stands for
+ * standard input and output. Returns TRUE on success, errors are
+ * written to ctx->err.
+ */
+int assemble(vnsasm_context *ctx)
+{
+    FILE *infile;
+    int result;
+
+    if (NULL == (infile = util_fopen(ctx->infile_name, "r"))) {
+        asm_perror(ctx, ctx->infile_name);
+        return FALSE;
+    }
+
+    fprintf(ctx->out, "Assembling %s into %s...\n",
+            util_basename(ctx->infile_name),
+            util_basename(ctx->outfile_name));
+
+    result = asm_parse(ctx, infile) && write_program(ctx);
+
+    if (result && NULL != ctx->debugfile_name) {
+        result = dbg_write(ctx->debugfile_name, &ctx->program.debug);
+    }
+
+    asm_release(ctx);
+    util_fclose(infile);
+
+    if (!result) {
+        ctx->failed = TRUE;
+        return FALSE;
+    }
+
+    fprintf(ctx->out, "Finished.\n");
+
+    return TRUE;
+}
@@ -0,0 +1,617 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+/**
+ * Peephole optimizer working on the instruction stream of a parsed
+ * program. Every rewrite is local to a basic block and is only done
+ * when the instruction set metadata proves it safe: instructions are
+ * removed or shortened only if the registers and flags they write are
+ * overwritten before anybody reads them. At block boundaries (labels,
+ * offsets, data and control flow) everything is assumed to be live.
+ *
+ * Shrinking code moves everything behind it, which is fine for all
+ * addresses taken from labels. Numeric addresses pointing into code
+ * (jumps, LDA/STA, MVI L or LXI SP) pin their whole segment to its
+ * layout, as does overwriting code by .offset. Instructions at labels
+ * that are used as data are never touched.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "vnsasm.h"
+
+/* registers an instruction reads or writes, flags use the IS_F_* bits */
+#define OPT_A           0x0100
+#define OPT_L           0x0200
+#define OPT_SP          0x0400
+#define OPT_MEM         0x0800
+#define OPT_OTHER       0x1000  // I/O, interrupts, halting, control flow
+#define OPT_REGS        (OPT_A | OPT_L | IS_F_ALL)
+
+/* per item state */
+#define OPT_LOCKED      0x01    // may not change in size
+#define OPT_PINNED      0x02    // read or written as data, keep as is
+
+#define OPT_MAX_PASSES  8
+#define OPT_MAX_HOPS    16
+
+/* opcodes the rewrites look for or produce */
+#define OP_MVI_A        0x3e
+#define OP_MVI_L        0x2e
+#define OP_MOV_A_L      0x7d
+#define OP_MOV_L_A      0x6f
+#define OP_XRA_A        0xaf
+#define OP_SUB_A        0x97
+#define OP_JMP          0xc3
+#define OP_RET          0xc9
+#define OP_LDA          0x3a
+#define OP_STA          0x32
+#define OP_LXI_SP       0x31
+
+typedef struct _optimizer {
+    vnsasm_context *ctx;
+    vnsasm_item *items;
+    unsigned int count;
+    uint8_t *state;
+    int *segment;
+    int *label_item;            // LABEL item of each symbol table label
+    unsigned int bytes;
+    unsigned int cycles;
+    unsigned int rewrites;
+} optimizer;
+
+/* known content of a register while walking a block forwards */
+typedef struct _opt_value {
+    int known;
+    uint8_t value;
+    const char *label;
+} opt_value;
+
+static unsigned int reg_of(argtype at)
+{
+    switch (at) {
+        case AT_REG_A:  return OPT_A;
+        case AT_REG_L:  return OPT_L;
+        case AT_REG_FL: return IS_F_ALL;
+        case AT_REG_SP: return OPT_SP;
+        case AT_MEM:    return OPT_MEM | OPT_L;
+    }
+    return 0;
+}
+
+/**
+ * Find out what *ins* reads and writes. Flags come from the
+ * instruction set, registers from the kind of instruction and its
+ * arguments. Control flow reads everything the target might use.
+ */
+static void effects(const vns_instruction *ins,
+                    unsigned int *reads, unsigned int *writes)
+{
+    const char *m = ins->mnemonic;
+    unsigned int r = 0, w = 0;
+
+    if (IS_FLOW_NONE != ins->flow) {
+        r = OPT_REGS | OPT_SP | OPT_MEM | OPT_OTHER;
+        w = OPT_OTHER;
+        if (IS_FLOW_CALL == ins->flow || IS_FLOW_COND_CALL == ins->flow) {
+            w |= OPT_REGS | OPT_SP | OPT_MEM;
+        }
+    } else if (0 == strcmp(m, "MOV") || 0 == strcmp(m, "MVI")) {
+        r = reg_of(ins->at2);
+        if (AT_MEM == ins->at1) {
+            r |= OPT_L;
+            w = OPT_MEM;
+        } else {
+            w = reg_of(ins->at1);
+        }
+    } else if (0 == strcmp(m, "LDA")) {
+        r = OPT_MEM;
+        w = OPT_A;
+    } else if (0 == strcmp(m, "STA")) {
+        r = OPT_A;
+        w = OPT_MEM;
+    } else if (0 == strcmp(m, "LXI")) {
+        w = OPT_SP;
+    } else if (0 == strcmp(m, "PUSH")) {
+        r = reg_of(ins->at1) | OPT_SP;
+        w = OPT_SP | OPT_MEM;
+    } else if (0 == strcmp(m, "POP")) {
+        r = OPT_SP | OPT_MEM;
+        w = reg_of(ins->at1) | OPT_SP;
+    } else if (0 == strcmp(m, "IN")) {
+        r = OPT_OTHER;
+        w = OPT_A | OPT_OTHER;
+    } else if (0 == strcmp(m, "OUT")) {
+        r = OPT_A | OPT_OTHER;
+        w = OPT_OTHER;
+    } else if (0 == strcmp(m, "INR") || 0 == strcmp(m, "DCR")) {
+        r = reg_of(ins->at1);
+        w = r;
+    } else if (0 == strcmp(m, "CMP") || 0 == strcmp(m, "CPI")) {
+        r = OPT_A | reg_of(ins->at1);
+    } else if (0 == strcmp(m, "NOP")) {
+        /* nothing at all */
+    } else if (0 == strcmp(m, "EI") || 0 == strcmp(m, "DI")) {
+        w = OPT_OTHER;
+    } else if (OP_XRA_A == ins->opcode || OP_SUB_A == ins->opcode) {
+        /* clears A whatever it held */
+        w = OPT_A;
+    } else {
+        /* arithmetic and logic on the accumulator */
+        r = OPT_A | reg_of(ins->at1);
+        w = OPT_A;
+    }
+
+    *reads = r | ins->flags_read;
+    *writes = w | ins->flags_written;
+}
+
+/**
+ * Numeric operands that are used as memory or code addresses.
+ */
+static int is_address(const vnsasm_item *item)
+{
+    const vns_instruction *ins = item->ins;
+
+    return 2 == ins->length && NULL == item->label &&
+           (IS_FLOW_NONE != ins->flow || OP_LDA == ins->opcode ||
+            OP_STA == ins->opcode || OP_MVI_L == ins->opcode ||
+            OP_LXI_SP == ins->opcode);
+}
+
+static int next_item(optimizer *opt, int i)
+{
+    for (i++; i < (int)opt->count; i++) {
+        if (ASM_ITEM_NONE != opt->items[i].kind) {
+            break;
+        }
+    }
+    return i;
+}
+
+/**
+ * The instruction at *label*, -1 if it is followed by data, an offset
+ * or nothing.
+ */
+static int target(optimizer *opt, const char *label)
+{
+    symtab *st = &opt->ctx->program.symbols;
+    int i = opt->label_item[sym_find(st, label)->index];
+
+    do {
+        i = next_item(opt, i);
+    } while (i < (int)opt->count && ASM_ITEM_LABEL == opt->items[i].kind);
+
+    return i < (int)opt->count && ASM_ITEM_INS == opt->items[i].kind ? i : -1;
+}
+
+static void saved(optimizer *opt, unsigned int bytes, unsigned int cycles)
+{
+    opt->bytes += bytes;
+    opt->cycles += cycles;
+    opt->rewrites++;
+}
+
+static int may_shrink(optimizer *opt, int i)
+{
+    return !(opt->state[i] & (OPT_LOCKED | OPT_PINNED));
+}
+
+/**
+ * Lay out the stream once to check that no byte is written twice and
+ * to find the segments and the item owning each byte. Numeric
+ * addresses into a segment lock it, labels used as data pin the
+ * instruction they point at. Returns FALSE if the program cannot be
+ * optimized.
+ */
+static int analyze(optimizer *opt)
+{
+    vnsasm_program *program = &opt->ctx->program;
+    symtab *st = &program->symbols;
+    int owner[MEMORY_UNIT_SIZE];
+    unsigned int i, j, pos = 0, seg = 0, len;
+    vnsasm_item *item;
+    int addr, t;
+
+    memset(owner, 0xff, sizeof(owner));
+
+    for (i = 0; i < opt->count; i++) {
+        item = &opt->items[i];
+        len = 0;
+        switch (item->kind) {
+            case ASM_ITEM_OFFSET:
+                pos = item->value;
+                seg++;
+                break;
+            case ASM_ITEM_LABEL:
+                opt->label_item[sym_find(st, item->label)->index] = i;
+                break;
+            case ASM_ITEM_BYTE:
+                len = 1;
+                break;
+            case ASM_ITEM_INS:
+                len = item->ins->length;
+                break;
+        }
+        opt->segment[i] = seg;
+        for (j = 0; j < len; j++, pos++) {
+            if (pos >= MEMORY_UNIT_SIZE || -1 != owner[pos]) {
+                return FALSE;
+            }
+            owner[pos] = i;
+        }
+    }
+
+    for (i = 0; i <= opt->count; i++) {
+        addr = -1;
+        if (i == opt->count) {
+            addr = NULL == program->entry_label ? program->entry : -1;
+        } else if (ASM_ITEM_INS == opt->items[i].kind &&
+                   is_address(&opt->items[i])) {
+            addr = opt->items[i].value;
+        }
+        if (-1 == addr || -1 == owner[addr]) {
+            continue;
+        }
+        seg = opt->segment[owner[addr]];
+        for (j = 0; j < opt->count; j++) {
+            if (opt->segment[j] == (int)seg) {
+                opt->state[j] |= OPT_LOCKED;
+            }
+        }
+    }
+
+    for (i = 0; i < opt->count; i++) {
+        item = &opt->items[i];
+        if (ASM_ITEM_INS == item->kind && NULL != item->label &&
+                IS_FLOW_NONE == item->ins->flow &&
+                -1 != (t = target(opt, item->label))) {
+            opt->state[t] |= OPT_PINNED;
+        }
+    }
+
+    return TRUE;
+}
+
+/**
+ * The jump taking the place of *ins* in a tail call.
+ */
+static const vns_instruction *tail_jump(const vns_instruction *ins)
+{
+    char name[IS_MNEMONIC_MAX + 1];
+
+    if (IS_FLOW_CALL == ins->flow) {
+        return is_find_opcode(OP_JMP);
+    }
+
+    /* CZ -> JZ, CNC -> JNC, ... */
+    snprintf(name, sizeof(name), "J%s", ins->mnemonic + 1);
+    return is_find_mnemonic(name, ins->at1, ins->at2);
+}
+
+/**
+ * Control flow rewrites: thread jumps to jumps, replace jumps to RET
+ * by RET, drop jumps to the next instruction and turn a call followed
+ * by RET into a jump.
+ */
+static int optimize_flow(optimizer *opt)
+{
+    const vns_instruction *ins, *jump, *jmp = is_find_opcode(OP_JMP);
+    const char *label;
+    int i, n, t, hops, changed = FALSE;
+    vnsasm_item *item;
+
+    for (i = 0; i < (int)opt->count; i++) {
+        item = &opt->items[i];
+        if (ASM_ITEM_INS != item->kind || IS_FLOW_NONE == item->ins->flow ||
+                (opt->state[i] & OPT_PINNED)) {
+            continue;
+        }
+        ins = item->ins;
+
+        if (NULL != item->label) {
+            /* jump threading, give up on loops */
+            label = item->label;
+            for (hops = 0; hops < OPT_MAX_HOPS; hops++) {
+                t = target(opt, label);
+                if (-1 == t || t == i || OP_JMP != opt->items[t].ins->opcode ||
+                        NULL == opt->items[t].label ||
+                        (opt->state[t] & OPT_PINNED)) {
+                    break;
+                }
+                label = opt->items[t].label;
+            }
+            if (hops > 0 && hops < OPT_MAX_HOPS) {
+                item->label = label;
+                saved(opt, 0, hops * jmp->cycles);
+                changed = TRUE;
+            }
+
+            t = target(opt, item->label);
+            if (OP_JMP == ins->opcode && -1 != t &&
+                    OP_RET == opt->items[t].ins->opcode && may_shrink(opt, i)) {
+                item->ins = opt->items[t].ins;
+                item->label = NULL;
+                saved(opt, ins->length - item->ins->length, ins->cycles);
+                changed = TRUE;
+                continue;
+            }
+        }
+
+        if ((IS_FLOW_JUMP == ins->flow || IS_FLOW_COND_JUMP == ins->flow) &&
+                NULL != item->label && may_shrink(opt, i)) {
+            for (n = next_item(opt, i); n < (int)opt->count &&
+                    ASM_ITEM_LABEL == opt->items[n].kind; n = next_item(opt, n)) {
+                if (opt->items[n].label == item->label) {
+                    item->kind = ASM_ITEM_NONE;
+                    saved(opt, ins->length, ins->cycles);
+                    changed = TRUE;
+                    break;
+                }
+            }
+            continue;
+        }
+
+        n = next_item(opt, i);
+        if ((IS_FLOW_CALL == ins->flow || IS_FLOW_COND_CALL == ins->flow) &&
+                n < (int)opt->count && ASM_ITEM_INS == opt->items[n].kind &&
+                OP_RET == opt->items[n].ins->opcode &&
+                !(opt->state[n] & OPT_PINNED) &&
+                NULL != (jump = tail_jump(ins))) {
+            /* the callee returns to our caller directly */
+            item->ins = jump;
+            saved(opt, 0, ins->cycles - jump->cycles +
+                          opt->items[n].ins->cycles);
+            if (IS_FLOW_CALL == ins->flow && may_shrink(opt, n)) {
+                opt->items[n].kind = ASM_ITEM_NONE;
+                opt->bytes += opt->items[n].ins->length;
+            }
+            changed = TRUE;
+        }
+    }
+
+    return changed;
+}
+
+static int same_value(const opt_value *v, const vnsasm_item *item)
+{
+    return v->known && v->label == item->label &&
+           (NULL != item->label || v->value == item->value);
+}
+
+/**
+ * Walk each block forwards and drop loads of constants a register
+ * already holds.
+ */
+static int optimize_loads(optimizer *opt)
+{
+    opt_value a = {FALSE, 0, NULL}, l = {FALSE, 0, NULL}, *v;
+    unsigned int i, reads, writes;
+    int changed = FALSE;
+    vnsasm_item *item;
+
+    for (i = 0; i < opt->count; i++) {
+        item = &opt->items[i];
+        if (ASM_ITEM_NONE == item->kind) {
+            continue;
+        }
+        if (ASM_ITEM_INS != item->kind || (opt->state[i] & OPT_PINNED)) {
+            /* pinned instructions may be patched at run time */
+            a.known = l.known = FALSE;
+            continue;
+        }
+
+        switch (item->ins->opcode) {
+            case OP_MVI_A:
+            case OP_MVI_L:
+                v = OP_MVI_A == item->ins->opcode ? &a : &l;
+                if (same_value(v, item) && may_shrink(opt, i)) {
+                    item->kind = ASM_ITEM_NONE;
+                    saved(opt, item->ins->length, item->ins->cycles);
+                    changed = TRUE;
+                } else {
+                    v->known = TRUE;
+                    v->value = item->value;
+                    v->label = item->label;
+                }
+                break;
+            case OP_MOV_A_L:
+                a = l;
+                break;
+            case OP_MOV_L_A:
+                l = a;
+                break;
+            case OP_XRA_A:
+            case OP_SUB_A:
+                a.known = TRUE;
+                a.value = 0;
+                a.label = NULL;
+                break;
+            default:
+                effects(item->ins, &reads, &writes);
+                if (writes & OPT_A) {
+                    a.known = FALSE;
+                }
+                if (writes & OPT_L) {
+                    l.known = FALSE;
+                }
+        }
+    }
+
+    return changed;
+}
+
+/**
+ * Walk each block backwards tracking which registers and flags are
+ * still read later on. Instructions whose results are all dead are
+ * removed, MVI A,0 becomes XRA A if nobody reads the flags.
+ */
+static int optimize_stores(optimizer *opt)
+{
+    const vns_instruction *xra = is_find_opcode(OP_XRA_A);
+    unsigned int reads, writes, live = OPT_REGS;
+    int i, changed = FALSE;
+    vnsasm_item *item;
+
+    for (i = opt->count - 1; i >= 0; i--) {
+        item = &opt->items[i];
+        if (ASM_ITEM_NONE == item->kind) {
+            continue;
+        }
+        if (ASM_ITEM_INS != item->kind || (opt->state[i] & OPT_PINNED)) {
+            live = OPT_REGS;
+            continue;
+        }
+
+        effects(item->ins, &reads, &writes);
+
+        /* NOPs are kept, they are usually room for patches or timing */
+        if (0 != writes && !(writes & ~OPT_REGS) && !(reads & OPT_OTHER) &&
+                !(writes & live) && may_shrink(opt, i)) {
+            item->kind = ASM_ITEM_NONE;
+            saved(opt, item->ins->length, item->ins->cycles);
+            changed = TRUE;
+            continue;
+        }
+
+        if (OP_MVI_A == item->ins->opcode && NULL == item->label &&
+                0 == item->value && !(live & IS_F_ALL) && may_shrink(opt, i)) {
+            saved(opt, item->ins->length - xra->length,
+                  item->ins->cycles - xra->cycles);
+            item->ins = xra;
+            effects(item->ins, &reads, &writes);
+            changed = TRUE;
+        }
+
+        live = ((live & ~writes) | reads) & OPT_REGS;
+    }
+
+    return changed;
+}
+
+/**
+ * Assign the final addresses to all labels and emit the stream into
+ * the program memory, replacing what the parser emitted.
+ */
+static void layout(optimizer *opt)
+{
+    vnsasm_program *program = &opt->ctx->program;
+    symtab *st = &program->symbols;
+    uint8_t pos = 0;
+    vnsasm_item *item;
+    unsigned int i;
+
+    for (i = 0; i < opt->count; i++) {
+        item = &opt->items[i];
+        switch (item->kind) {
+            case ASM_ITEM_OFFSET: pos = item->value;                    break;
+            case ASM_ITEM_LABEL:  sym_find(st, item->label)->addr = pos; break;
+            case ASM_ITEM_BYTE:   pos++;                                break;
+            case ASM_ITEM_INS:    pos += item->ins->length;             break;
+        }
+    }
+
+    memset(program->data, 0, sizeof(program->data));
+    memset(program->used, 0, sizeof(program->used));
+    memset(program->debug.line, 0, sizeof(program->debug.line));
+
+    for (i = 0, pos = 0; i < opt->count; i++) {
+        item = &opt->items[i];
+        switch (item->kind) {
+            case ASM_ITEM_OFFSET:
+                pos = item->value;
+                break;
+            case ASM_ITEM_BYTE:
+                program->data[pos] = item->value;
+                program->used[pos++] = TRUE;
+                break;
+            case ASM_ITEM_INS:
+                program->debug.line[pos] = item->line;
+                program->data[pos] = item->ins->opcode;
+                program->used[pos++] = TRUE;
+                if (2 == item->ins->length) {
+                    program->data[pos] = NULL != item->label ?
+                        sym_find(st, item->label)->addr : item->value;
+                    program->used[pos++] = TRUE;
+                }
+                break;
+        }
+    }
+
+    program->counter = pos;
+}
+
+/**
+ * Optimize the parsed program in ctx and lay it out anew. Programs
+ * with unresolved labels are left alone for finalize_labels() to
+ * report, programs overwriting themselves only get a warning.
+ * Returns FALSE if out of memory.
+ */
+int asm_optimize(vnsasm_context *ctx)
+{
+    vnsasm_program *program = &ctx->program;
+    symtab *st = &program->symbols;
+    optimizer opt;
+    unsigned int i, passes;
+    int changed, result = TRUE;
+
+    for (i = 0; i < st->label_count; i++) {
+        if (-1 == st->labels[i]->addr) {
+            return TRUE;
+        }
+    }
+
+    memset(&opt, 0, sizeof(opt));
+    opt.ctx = ctx;
+    opt.items = program->items;
+    opt.count = program->item_count;
+    opt.state = calloc(opt.count + 1, sizeof(*opt.state));
+    opt.segment = calloc(opt.count + 1, sizeof(*opt.segment));
+    opt.label_item = calloc(st->label_count + 1, sizeof(*opt.label_item));
+
+    if (NULL == opt.state || NULL == opt.segment || NULL == opt.label_item) {
+        asm_error(ctx, "Out of memory\n");
+        changed = result = FALSE;
+    } else if (!(changed = analyze(&opt))) {
+        asm_warning(ctx, "program overwrites itself, not optimized\n");
+    }
+
+    for (passes = 0; changed && passes < OPT_MAX_PASSES; passes++) {
+        changed = optimize_flow(&opt);
+        changed = optimize_loads(&opt) || changed;
+        changed = optimize_stores(&opt) || changed;
+    }
+
+    if (opt.rewrites > 0) {
+        layout(&opt);
+    }
+
+    free(opt.state);
+    free(opt.segment);
+    free(opt.label_item);
+
+    if (result) {
+        fprintf(ctx->out, " -> Optimizer saved %u bytes and %u cycles "
+                "(%u rewrites)\n", opt.bytes, opt.cycles, opt.rewrites);
+    }
+
+    return result;
+}
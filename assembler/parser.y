@@ -17,17 +17,26 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
  */
 
-%{
+%code requires {
 #include "vnsasm.h"
+}
+
+%code {
 #include "instructionset.h"
 
-int yylex (void);
-void yyerror(char*);
-%}
+int yylex(YYSTYPE *lval, YYLTYPE *lloc, yyscan_t scanner);
+void yyerror(YYLTYPE *lloc, yyscan_t scanner, vnsasm_context *ctx,
+             const char *error);
+}
+
+%define api.pure full
+%locations
+%param {yyscan_t scanner}
+%parse-param {vnsasm_context *ctx}
 
 %union {
     uint8_t ival;
-    char *sval;
+    const char *sval;
 }
 
 %token <ival> TOK_INT;
@@ -37,6 +46,8 @@ void yyerror(char*);
 
 %token TOK_BYTE;
 %token TOK_OFFSET;
+%token TOK_ENTRY;
+%token TOK_BANK;
 %token TOK_NEWL;
 %token TOK_UNKNOWN;
 
@@ -50,38 +61,85 @@ asnasmfile
 line
     : TOK_NEWL
     | line instruction TOK_NEWL
-    | line TOK_ID ':' { prc_label_decl($2); } instruction TOK_NEWL
-    | TOK_ID ':'      { prc_label_decl($1); } instruction TOK_NEWL
+    | line TOK_ID ':' {
+                          if (!prc_label_decl(ctx, $2)) YYABORT;
+                      } instruction TOK_NEWL
+    | TOK_ID ':'      {
+                          if (!prc_label_decl(ctx, $1)) YYABORT;
+                      } instruction TOK_NEWL
     | instruction TOK_NEWL
     ;
 
 instruction
     : asm_command
-    | TOK_ID ':'        { prc_label_decl($1);                     }
-    | TOK_INS TOK_ARG   { prc_ins($1, $2, AT_NONE, 0, NULL);      }
-    | TOK_INS TOK_INT   { prc_ins($1, AT_INT, AT_NONE, $2, NULL); }
-    | TOK_INS TOK_ID    { prc_ins($1, AT_LABEL, AT_NONE, 0, $2);  }
+    | TOK_ID ':'        { if (!prc_label_decl(ctx, $1)) YYABORT; }
+    | TOK_INS TOK_ARG   {
+                          if (!prc_ins(ctx, $1, $2, AT_NONE, 0, NULL,
+                                       @1.first_line)) {
+                              YYABORT;
+                          }
+                        }
+    | TOK_INS TOK_INT   {
+                          if (!prc_ins(ctx, $1, AT_INT, AT_NONE, $2, NULL,
+                                       @1.first_line)) {
+                              YYABORT;
+                          }
+                        }
+    | TOK_INS TOK_ID    {
+                          if (!prc_ins(ctx, $1, AT_LABEL, AT_NONE, 0, $2,
+                                       @1.first_line)) {
+                              YYABORT;
+                          }
+                        }
     | TOK_INS TOK_ARG ',' TOK_INT {
-                          prc_ins($1, $2, AT_INT, $4, NULL);      }
+                          if (!prc_ins(ctx, $1, $2, AT_INT, $4, NULL,
+                                       @1.first_line)) {
+                              YYABORT;
+                          }
+                        }
     | TOK_INS TOK_ARG ',' TOK_ARG {
-                          prc_ins($1, $2, $4, 0, NULL);           }
+                          if (!prc_ins(ctx, $1, $2, $4, 0, NULL,
+                                       @1.first_line)) {
+                              YYABORT;
+                          }
+                        }
     | TOK_INS TOK_ARG ',' TOK_ID  {
-                          prc_ins($1, $2, AT_LABEL, 0, $4);       }
-    | TOK_INS           { prc_ins($1, AT_NONE, AT_NONE, 0, NULL); }
+                          if (!prc_ins(ctx, $1, $2, AT_LABEL, 0, $4,
+                                       @1.first_line)) {
+                              YYABORT;
+                          }
+                        }
+    | TOK_INS           {
+                          if (!prc_ins(ctx, $1, AT_NONE, AT_NONE, 0, NULL,
+                                       @1.first_line)) {
+                              YYABORT;
+                          }
+                        }
     ;
 
 asm_command
     : offset
     | byte
+    | entry
+    | bank
     ;
 
 offset
-    : TOK_OFFSET TOK_INT    { prc_offset($2); }
+    : TOK_OFFSET TOK_INT    { if (!prc_offset(ctx, $2)) YYABORT; }
+    ;
+
+entry
+    : TOK_ENTRY TOK_INT     { if (!prc_entry(ctx, NULL, $2)) YYABORT; }
+    | TOK_ENTRY TOK_ID      { if (!prc_entry(ctx, $2, 0)) YYABORT; }
+    ;
+
+bank
+    : TOK_BANK TOK_INT      { if (!prc_bank(ctx, $2)) YYABORT; }
     ;
 
 byte
-    : TOK_BYTE TOK_INT      { prc_byte($2); }
-    | byte ',' TOK_INT      { prc_byte($3); }
+    : TOK_BYTE TOK_INT      { if (!prc_byte(ctx, $2)) YYABORT; }
+    | byte ',' TOK_INT      { if (!prc_byte(ctx, $3)) YYABORT; }
     ;
 
 %%
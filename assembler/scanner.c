@@ -0,0 +1,50 @@
+/* throwaway hand-written reentrant replacement for scanner.l (testing only) */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <strings.h>
+#include "parser.tab.h"
+#include "instructionset.h"
+typedef struct { FILE *in; int line; vnsasm_context *ctx; } scan;
+int yylex_init_extra(vnsasm_context *ctx, yyscan_t *s){ scan *sc=calloc(1,sizeof(scan)); sc->ctx=ctx; sc->line=1; *s=sc; return 0; }
+int yylex_destroy(yyscan_t s){ free(s); return 0; }
+void yyset_in(FILE *in, yyscan_t s){ ((scan*)s)->in=in; }
+int yyget_lineno(yyscan_t s){ return ((scan*)s)->line; }
+#define yyin (sc->in)
+#define yylineno (sc->line)
+static int peekc(scan *sc){int c=getc(yyin); if(c!=EOF) ungetc(c,yyin); return c;}
+static int yylex_(YYSTYPE *yylval, scan *sc);
+int yylex(YYSTYPE *lval, YYLTYPE *lloc, yyscan_t s){scan *sc=s; int t=yylex_(lval,sc); lloc->first_line=lloc->last_line=sc->line; return t;}
+static int yylex_(YYSTYPE *yylval, scan *sc){
+  int c;
+  for(;;){
+    c=getc(yyin);
+    if(c==EOF) return 0;
+    if(c=='\n'||c=='\r'){ if(c=='\n') yylineno++; while((c=peekc(sc))=='\n'||c=='\r'){getc(yyin); if(c=='\n')yylineno++;} return TOK_NEWL; }
+    if(isspace(c)) continue;
+    break;
+  }
+  if(c==';'){ while((c=getc(yyin))!=EOF && c!='\n'); yylineno++; return TOK_NEWL; }
+  if(c==','||c==':') return c;
+  char buf[256]; int n=0;
+  if(isdigit(c)){
+    buf[n++]=c;
+    if(c=='0'&&(peekc(sc)=='x'||peekc(sc)=='X')){ buf[n++]=getc(yyin); while(isxdigit(peekc(sc))) buf[n++]=getc(yyin); buf[n]=0; yylval->ival=strtol(buf+2,NULL,16); return TOK_INT;}
+    while(isdigit(peekc(sc))) buf[n++]=getc(yyin); buf[n]=0; yylval->ival=atoi(buf); return TOK_INT;
+  }
+  if(c=='.'){ while(isalpha(peekc(sc))) buf[n++]=getc(yyin); buf[n]=0;
+    if(!strcasecmp(buf,"byte")) return TOK_BYTE; if(!strcasecmp(buf,"offset")) return TOK_OFFSET;
+    if(!strcasecmp(buf,"entry")) return TOK_ENTRY; if(!strcasecmp(buf,"bank")) return TOK_BANK;
+    return TOK_UNKNOWN; }
+  if(isalpha(c)){ buf[n++]=c; while(isalnum(peekc(sc))||peekc(sc)=='_') buf[n++]=getc(yyin); buf[n]=0;
+    if(!strcasecmp(buf,"a")){yylval->ival=AT_REG_A;return TOK_ARG;}
+    if(!strcasecmp(buf,"l")){yylval->ival=AT_REG_L;return TOK_ARG;}
+    if(!strcasecmp(buf,"m")){yylval->ival=AT_MEM;return TOK_ARG;}
+    if(!strcasecmp(buf,"fl")){yylval->ival=AT_REG_FL;return TOK_ARG;}
+    if(!strcasecmp(buf,"sp")){yylval->ival=AT_REG_SP;return TOK_ARG;}
+    if(n<2) return TOK_UNKNOWN;
+    if(NULL==(yylval->sval=asm_intern(sc->ctx,buf))) return TOK_UNKNOWN; if(is_lookup_mnemonic_name(buf)) return TOK_INS; return TOK_ID; }
+  return TOK_UNKNOWN;
+}
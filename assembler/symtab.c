@@ -0,0 +1,259 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "globals.h"
+#include "symtab.h"
+
+#define SYM_SLOTS_INITIAL 256
+
+/**
+ * FNV-1a, good enough for identifiers and cheap to compute.
+ */
+static uint32_t sym_hash(const char *str)
+{
+    uint32_t hash = 2166136261u;
+
+    while (*str) {
+        hash ^= (uint8_t)*str++;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+/**
+ * Grow an array of count elements of the given size so that at least
+ * one more element fits. Returns FALSE if out of memory.
+ */
+static int sym_reserve(void **array, unsigned int count, unsigned int *size,
+                      size_t elem)
+{
+    unsigned int new_size;
+    void *new_array;
+
+    if (count < *size) {
+        return TRUE;
+    }
+
+    new_size = *size ? *size * 2 : 64;
+    if (NULL == (new_array = realloc(*array, new_size * elem))) {
+        return FALSE;
+    }
+
+    *array = new_array;
+    *size = new_size;
+    return TRUE;
+}
+
+/**
+ * Double the slot array and reinsert all names. Returns FALSE if out of
+ * memory, leaving the table untouched.
+ */
+static int sym_rehash(symtab *st)
+{
+    unsigned int count = st->slot_count * 2;
+    unsigned int i, slot;
+    int *slots;
+
+    if (NULL == (slots = malloc(count * sizeof(*slots)))) {
+        return FALSE;
+    }
+
+    for (i = 0; i < count; i++) {
+        slots[i] = SYM_NONE;
+    }
+
+    for (i = 0; i < st->name_count; i++) {
+        slot = st->names[i].hash & (count - 1);
+        while (SYM_NONE != slots[slot]) {
+            slot = (slot + 1) & (count - 1);
+        }
+        slots[slot] = i;
+    }
+
+    free(st->slots);
+    st->slots = slots;
+    st->slot_count = count;
+
+    return TRUE;
+}
+
+/**
+ * Find the slot holding str or the empty slot where it belongs.
+ */
+static unsigned int sym_probe(symtab *st, const char *str, uint32_t hash)
+{
+    unsigned int mask = st->slot_count - 1;
+    unsigned int slot = hash & mask;
+    sym_name *name;
+
+    while (SYM_NONE != st->slots[slot]) {
+        name = &st->names[st->slots[slot]];
+        if (name->hash == hash &&
+                (name->str == str || 0 == strcmp(name->str, str))) {
+            break;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    return slot;
+}
+
+/**
+ * Look up str and add it if add is set. Returns the index into names,
+ * or SYM_NONE if it is unknown or out of memory.
+ */
+static int sym_lookup(symtab *st, const char *str, int add)
+{
+    uint32_t hash = sym_hash(str);
+    unsigned int slot;
+    char *copy;
+
+    if (NULL == st->slots) {
+        /* the initial slot array is allocated on demand */
+        st->slot_count = SYM_SLOTS_INITIAL / 2;
+        if (!sym_rehash(st)) {
+            return SYM_NONE;
+        }
+    }
+
+    slot = sym_probe(st, str, hash);
+    if (SYM_NONE != st->slots[slot] || !add) {
+        return st->slots[slot];
+    }
+
+    /* keep the load factor below 1/2 */
+    if ((st->name_count + 1) * 2 > st->slot_count) {
+        if (!sym_rehash(st)) {
+            return SYM_NONE;
+        }
+        slot = sym_probe(st, str, hash);
+    }
+
+    if (!sym_reserve((void**)&st->names, st->name_count, &st->name_size,
+                    sizeof(*st->names)) ||
+            NULL == (copy = arena_strdup(&st->mem, str))) {
+        return SYM_NONE;
+    }
+
+    st->names[st->name_count].str = copy;
+    st->names[st->name_count].hash = hash;
+    st->names[st->name_count].label = SYM_NONE;
+    st->slots[slot] = st->name_count;
+
+    return st->name_count++;
+}
+
+void sym_init(symtab *st)
+{
+    memset(st, 0, sizeof(*st));
+    arena_init(&st->mem, 0);
+    pool_init(&st->fixups, &st->mem, sizeof(sym_fixup));
+}
+
+void sym_destroy(symtab *st)
+{
+    arena_destroy(&st->mem);
+    free(st->slots);
+    free(st->names);
+    free(st->labels);
+
+    sym_init(st);
+}
+
+const char *sym_intern(symtab *st, const char *str)
+{
+    int index = sym_lookup(st, str, TRUE);
+
+    return SYM_NONE == index ? NULL : st->names[index].str;
+}
+
+vnsasm_label *sym_find(symtab *st, const char *name)
+{
+    int index = sym_lookup(st, name, FALSE);
+
+    if (SYM_NONE == index || SYM_NONE == st->names[index].label) {
+        return NULL;
+    }
+
+    return st->labels[st->names[index].label];
+}
+
+vnsasm_label *sym_label(symtab *st, const char *name)
+{
+    int index = sym_lookup(st, name, TRUE);
+    vnsasm_label *label;
+
+    if (SYM_NONE == index) {
+        return NULL;
+    }
+
+    if (SYM_NONE != st->names[index].label) {
+        return st->labels[st->names[index].label];
+    }
+
+    if (!sym_reserve((void**)&st->labels, st->label_count, &st->label_size,
+                    sizeof(*st->labels)) ||
+            NULL == (label = arena_alloc(&st->mem, sizeof(*label)))) {
+        return NULL;
+    }
+
+    label->name = st->names[index].str;
+    label->addr = -1;
+    label->index = st->label_count;
+    label->fixups = NULL;
+    st->labels[st->label_count] = label;
+    st->names[index].label = st->label_count++;
+
+    return label;
+}
+
+int sym_add_fixup(symtab *st, vnsasm_label *label, uint16_t pos)
+{
+    sym_fixup *fixup = pool_alloc(&st->fixups);
+
+    if (NULL == fixup) {
+        return FALSE;
+    }
+
+    fixup->pos = pos;
+    fixup->next = label->fixups;
+    label->fixups = fixup;
+
+    return TRUE;
+}
+
+void sym_backpatch(symtab *st, vnsasm_label *label, uint8_t *data)
+{
+    sym_fixup *fixup = label->fixups;
+    sym_fixup *next;
+
+    while (NULL != fixup) {
+        data[fixup->pos] = label->addr;
+        next = fixup->next;
+        pool_free(&st->fixups, fixup);
+        fixup = next;
+    }
+
+    label->fixups = NULL;
+}
@@ -0,0 +1,111 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+#ifndef SYMTAB_H
+#define SYMTAB_H 1
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "arena.h"
+
+/**
+ * Assembler symbol table.
+ *
+ * Every identifier the scanner sees is interned once into the arena of
+ * the table, so equal names share one pointer for the lifetime of the
+ * table. Names live in an open-addressing (linear probing) hash table.
+ * Labels are allocated from the arena as well and listed in order of
+ * first appearance, the backpatch records of pending labels come from a
+ * pool and are chained per label. Lookups, declarations and references
+ * are O(1) amortized, sym_destroy() releases the lot in one go.
+ */
+
+#define SYM_NONE -1
+
+typedef struct _sym_fixup {
+    struct _sym_fixup *next;    // next record of the same label
+    uint16_t pos;               // position of the byte in the data
+} sym_fixup;
+
+typedef struct _vnsasm_label {
+    const char *name;           // interned
+    int addr;                   // -1 while pending
+    unsigned int index;         // position in labels
+    sym_fixup *fixups;          // pending backpatch records
+} vnsasm_label;
+
+typedef struct _sym_name {
+    const char *str;
+    uint32_t hash;
+    int label;                  // index into labels or SYM_NONE
+} sym_name;
+
+typedef struct _symtab {
+    int *slots;                 // indexes into names, SYM_NONE if empty
+    unsigned int slot_count;    // power of two
+    sym_name *names;
+    unsigned int name_count;
+    unsigned int name_size;
+    vnsasm_label **labels;      // in order of first appearance
+    unsigned int label_count;
+    unsigned int label_size;
+    arena mem;                  // names and labels
+    pool fixups;                // recycled by backpatching
+} symtab;
+
+/**
+ * Initialize an empty table. The table must not be moved afterwards,
+ * its pool refers to its arena.
+ */
+void sym_init(symtab *st);
+void sym_destroy(symtab *st);
+
+/**
+ * Return the interned copy of str, adding it on first use. The result
+ * stays valid until sym_destroy(). Returns NULL if out of memory.
+ */
+const char *sym_intern(symtab *st, const char *str);
+
+/**
+ * Find the label called name or return NULL. The returned pointer stays
+ * valid until sym_destroy().
+ */
+vnsasm_label *sym_find(symtab *st, const char *name);
+
+/**
+ * Find the label called name or add it as pending. Returns NULL if out
+ * of memory. The pointer stays valid until sym_destroy().
+ */
+vnsasm_label *sym_label(symtab *st, const char *name);
+
+/**
+ * Record that the byte at pos refers to the pending label. Returns
+ * FALSE if out of memory.
+ */
+int sym_add_fixup(symtab *st, vnsasm_label *label, uint16_t pos);
+
+/**
+ * Write the address of label into every byte recorded for it in data
+ * and release the records for reuse.
+ */
+void sym_backpatch(symtab *st, vnsasm_label *label, uint8_t *data);
+
+#endif /* SYMTAB_H */
@@ -20,272 +20,202 @@
 #include <string.h>
 #include <unistd.h>
 #include <stdlib.h>
-#include <stdarg.h>
-#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
 
 #include "utils.h"
 #include "vnsasm.h"
 
 vnsasm_configuration config;
 
-void yyerror(char *error)
-{
-    util_perror("%s near line %i\n", error, yylineno);
-    exit(EXIT_FAILURE);
-}
+/* progress messages, standard error if the image goes to standard output */
+static FILE *info;
 
-void write_program(void)
+/**
+ * Jobs of a parallel batch. Workers take the next file in order,
+ * the main thread prints the buffered output of each file in order
+ * as soon as it is done.
+ */
+typedef struct _vnsasm_batch {
+    vnsasm_context *jobs;
+    unsigned int count;
+    unsigned int next;
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+} vnsasm_batch;
+
+static void *run_jobs(void *arg)
 {
-    uint8_t *start, *end;
-    size_t size = MEMORY_UNIT_SIZE;
-    FILE *outfile = fopen(config.outfile_name, "w+");
-
-    if (NULL == outfile) {
-        perror(config.outfile_name);
-        exit(EXIT_FAILURE);
-    }
-
-    if (config.strip_trailing_zeros && size) {
-        start = (uint8_t*)config.program;
-        for (end = start + size - 1; *end == 0 && end != start; --end) {
-            --size;
+    vnsasm_batch *batch = (vnsasm_batch*)arg;
+    vnsasm_context *ctx;
+
+    for (;;) {
+        pthread_mutex_lock(&batch->lock);
+        if (batch->next == batch->count) {
+            pthread_mutex_unlock(&batch->lock);
+            return NULL;
+        }
+        ctx = &batch->jobs[batch->next++];
+        pthread_mutex_unlock(&batch->lock);
+
+        ctx->out = open_memstream(&ctx->out_buf, &ctx->out_size);
+        ctx->err = open_memstream(&ctx->err_buf, &ctx->err_size);
+        if (NULL == ctx->out || NULL == ctx->err) {
+            /* nowhere to buffer to, report it directly */
+            util_perror("%s: %s\n", ctx->infile_name, strerror(errno));
+            ctx->failed = TRUE;
+        } else {
+            assemble(ctx);
+        }
+        if (NULL != ctx->out) {
+            fclose(ctx->out);
+        }
+        if (NULL != ctx->err) {
+            fclose(ctx->err);
         }
-    }
 
-    if (1 != fwrite((void*)config.program, size, 1, outfile)) {
-        perror(config.outfile_name);
-        exit(EXIT_FAILURE);
+        pthread_mutex_lock(&batch->lock);
+        ctx->done = TRUE;
+        pthread_cond_broadcast(&batch->done);
+        pthread_mutex_unlock(&batch->lock);
     }
-
-    fclose(outfile);
 }
 
-void backpatch_label(vnsasm_label *label)
+/**
+ * Assemble all jobs with up to config.jobs threads. Returns the number
+ * of files that failed.
+ */
+unsigned int assemble_batch(vnsasm_context *jobs, unsigned int count)
 {
-    list_item *pos;
-    assert(-1 != label->addr);
+    vnsasm_batch batch;
+    pthread_t *threads;
+    unsigned int i, threads_count = config.jobs, failed = 0;
 
-    pos = label->positions.head;
-    while (NULL != pos) {
-        *((uint8_t*)pos->payload) = label->addr;
-        pos = pos->next;
+    if (threads_count > count) {
+        threads_count = count;
     }
 
-    list_destroy(&label->positions);
-}
-
-vnsasm_label *find_label(const char *name)
-{
-    vnsasm_label *label;
-    list_item *item = config.program->labels.head;
-
-    while (NULL != item) {
-        label = (vnsasm_label*)item->payload;
-        if (0 == strcmp(label->name, name)) {
-            return label;
+    if (threads_count <= 1 ||
+            NULL == (threads = malloc(sizeof(*threads) * threads_count))) {
+        for (i = 0; i < count; i++) {
+            jobs[i].out = info;
+            jobs[i].err = stderr;
+            failed += !assemble(&jobs[i]);
         }
-        item = item->next;
+        return failed;
     }
 
-    return NULL;
-}
-
-void free_label(void *label)
-{
-    free(((vnsasm_label*)label)->name);
-    free(label);
-}
-
-vnsasm_label* declare_label(const char *name, unsigned int addr)
-{
-    vnsasm_label *label;
-
-    if (NULL != (label = find_label(name))) {
-        /* label exists */
-        if ((-1 != addr) && (-1 == label->addr)) {
-            /* we've found the declaration for a pending label */
-            label->addr = addr;
-            backpatch_label(label);
-        } else {
-            util_perror("Duplicated label declaration "
-                        "near line %i: %s\n",
-                        yylineno, name);
-            exit(EXIT_FAILURE);
-        }
-    } else {
-        label = malloc(sizeof(*label));
-
-        label->name = strdup(name);
-        label->addr = addr;
+    batch.jobs = jobs;
+    batch.count = count;
+    batch.next = 0;
+    pthread_mutex_init(&batch.lock, NULL);
+    pthread_cond_init(&batch.done, NULL);
 
-        if (-1 == addr) {
-            /* pending label */
-            list_init(&label->positions);
+    for (i = 0; i < threads_count; i++) {
+        if (0 != pthread_create(&threads[i], NULL, run_jobs, &batch)) {
+            break;
         }
-
-        list_insert(&config.program->labels, NULL, label, free_label);
     }
-
-    return label;
-}
-
-void resolve_label(const char *name)
-{
-    vnsasm_label *label;
-    uint8_t *byte = &config.program->data[config.program->counter];
-
-    if (NULL == (label = find_label(name))) {
-        /* declare pending label */
-        label = declare_label(name, -1);
+    threads_count = i;
+    if (0 == threads_count) {
+        /* no thread at all, do the work ourselves */
+        run_jobs(&batch);
     }
 
-    if (-1 == label->addr) {
-        /* label is pending, store position of current byte */
-        list_insert(&label->positions, NULL, (void*)byte, NULL);
-    } else {
-        *byte = label->addr;
-    }
-}
+    for (i = 0; i < count; i++) {
+        pthread_mutex_lock(&batch.lock);
+        while (!jobs[i].done) {
+            pthread_cond_wait(&batch.done, &batch.lock);
+        }
+        pthread_mutex_unlock(&batch.lock);
 
-void finalize_labels(void)
-{
-    vnsasm_label *label;
-    list_item *item;
- 
-    for (item = config.program->labels.head; NULL != item; item = item->next) {
-        label = (vnsasm_label*)item->payload;
-        if (-1 == label->addr) {
-            list_destroy(&label->positions);
-            util_perror("Could not resolve label: %s\n", label->name);
-            exit(EXIT_FAILURE);
+        if (NULL != jobs[i].out_buf) {
+            fwrite(jobs[i].out_buf, jobs[i].out_size, 1, info);
+            fflush(info);
+            free(jobs[i].out_buf);
         }
-        if (config.print_resolved_labels) {
-            printf(" -> Label '%s' resolved to address 0x%.2x (%i)\n",
-                   label->name, label->addr, label->addr);
+        if (NULL != jobs[i].err_buf) {
+            fwrite(jobs[i].err_buf, jobs[i].err_size, 1, stderr);
+            free(jobs[i].err_buf);
         }
+        failed += jobs[i].failed;
     }
-}
-
-void push_byte(uint8_t byte)
-{
-    config.program->data[config.program->counter] = byte;
-    config.program->counter++;
-}
-
-void skip_byte(void)
-{
-    config.program->counter++;
-}
-
-void prc_label_decl(const char *name)
-{
-    declare_label(name, config.program->counter);
-}
 
-void prc_ins(const char *mnemonic,
-             argtype at1, argtype at2,
-             uint8_t i, char *s)
-{
-    vns_instruction *ins;
-    
-    ins = is_find_mnemonic(mnemonic, at1, at2);
-
-    if (NULL == ins) {
-        util_perror("near line %i: ", yylineno);
-        if (is_lookup_mnemonic_name(mnemonic)) {
-            if(at1 == AT_NONE) {
-                util_perror("missing argument for '%s'\n", mnemonic);
-            } else {
-                util_perror("invalid arguments for '%s' (found %x, %x)\n",
-                        mnemonic, at1, at2);
-            }
-        } else {
-            util_perror("Unknown instruction '%s'\n", mnemonic);
-        }
-        exit(EXIT_FAILURE);
+    for (i = 0; i < threads_count; i++) {
+        pthread_join(threads[i], NULL);
     }
 
-    push_byte(ins->opcode);
+    pthread_cond_destroy(&batch.done);
+    pthread_mutex_destroy(&batch.lock);
+    free(threads);
 
-    if (NULL != s && ((ins->at1 & AT_LABEL) || (ins->at2 & AT_LABEL))) {
-        resolve_label(s);
-        skip_byte();
-    } else
-    if ((ins->at1 & AT_INT) || (ins->at2 & AT_INT)) {
-        push_byte(i);
-    }
+    return failed;
 }
 
-void prc_byte(uint8_t value)
-{
-    push_byte(value);
-}
-
-void prc_offset(uint8_t offset)
+/**
+ * Derive the output file of a batch job from its input file by
+ * replacing the extension.
+ */
+char *output_name(const char *infile, const char *extension)
 {
-    config.program->counter = offset;
-}
+    const char *dot = strrchr(infile, '.');
+    size_t len;
+    char *name;
 
-int assemble(void)
-{
-    if (NULL == (yyin = fopen(config.infile_name, "r"))) {
-        perror(config.infile_name);
-        return EXIT_FAILURE;
+    if (NULL == dot || NULL != strchr(dot, '/')) {
+        dot = infile + strlen(infile);
     }
 
-    printf("Assembling %s into %s...\n", 
-            util_basename(config.infile_name),
-            util_basename(config.outfile_name));
-
-    list_init(&(config.program->labels));
-
-    if (0 != yyparse()) {
-        return EXIT_FAILURE;
+    len = dot - infile;
+    if (NULL != (name = malloc(len + strlen(extension) + 1))) {
+        memcpy(name, infile, len);
+        strcpy(name + len, extension);
     }
 
-    finalize_labels();
-
-    write_program();
-
-    list_destroy(&(config.program->labels));
-    fclose(yyin);
-
-    printf("Finished.\n");
-
-    return EXIT_SUCCESS;
+    return name;
 }
 
 void print_usage(char *pname)
 {
-    printf("\nUsage: %s [-hzr] [-o <outfile>] <asmfile>\n\n", pname);
+    printf(BANNER_LINE1, "Assembler");
+    printf(BANNER_LINE2, VERSION);
+    printf("\nUsage: %s [-hzrO] [-o <outfile>] [-g <dbgfile>] [-f raw|vns] "
+           "[-j <n>]\n       <asmfile> [<asmfile>...]\n\n", pname);
     printf("  -h             Show this help text.\n");
     printf("  -o <outfile>   Write assembled program image to <outfile>.\n");
-    printf("  -z             Do NOT pack resulting program image.\n");
+    printf("  -g <dbgfile>   Write debug information to <dbgfile>.\n");
+    printf("  -f raw|vns     Write raw memory dump (default) or container.\n");
+    printf("  -z             Do NOT pack resulting raw program image.\n");
     printf("  -r             Print resolved label addresses.\n");
+    printf("  -O             Optimize the program with a peephole pass.\n");
+    printf("  -j <n>         Assemble up to <n> files in parallel "
+           "(0: one per CPU).\n");
+    printf("\n");
+    printf("A file name of - stands for standard input or output. With\n"
+           "several input files, each image is written next to its source\n"
+           "with the extension .bin (raw) or .vns (container).\n");
     printf("\n");
 }
 
 int main(int argc, char **argv)
 {
-    unsigned int opt;
+    unsigned int opt, i, count, failed;
     char *process_name = util_basename(argv[0]);
-    vnsasm_program program;
-
-    printf(BANNER_LINE1, "Assembler");
-    printf(BANNER_LINE2, VERSION);
-
-    /* initialize program */
-    memset((void*)&program, 0, sizeof(program));
+    vnsasm_context *jobs;
+    long cpus;
 
     /* initialize default configuration */
-    config.outfile_name = "program.bin";
-    config.infile_name = NULL;
+    config.outfile_name = NULL;
+    config.debugfile_name = NULL;
     config.strip_trailing_zeros = TRUE;
+    config.image_format = IMG_RAW;
     config.print_resolved_labels = FALSE;
-    config.program = &program;
+    config.optimize = FALSE;
+    config.debug_labels = FALSE;
+    config.jobs = 1;
 
     /* parse cmdline arguments */
-    while ((opt = getopt(argc, argv, "ho:vzr")) != -1) {
+    while ((opt = getopt(argc, argv, "ho:g:f:vzrOj:")) != -1) {
         switch (opt) {
             case 'h':
                 print_usage(process_name);
@@ -293,12 +223,35 @@ int main(int argc, char **argv)
             case 'o':
                 config.outfile_name = strdup(optarg);
                 break;
+            case 'g':
+                config.debugfile_name = strdup(optarg);
+                break;
+            case 'f':
+                if (0 == strcasecmp(optarg, "raw")) {
+                    config.image_format = IMG_RAW;
+                } else if (0 == strcasecmp(optarg, "vns")) {
+                    config.image_format = IMG_CONTAINER;
+                } else {
+                    util_perror("Unknown image format: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
             case 'z':
                 config.strip_trailing_zeros = FALSE;
                 break;
             case 'r':
                 config.print_resolved_labels = TRUE;
                 break;
+            case 'O':
+                config.optimize = TRUE;
+                break;
+            case 'j':
+                config.jobs = strtoul(optarg, NULL, 0);
+                if (0 == config.jobs) {
+                    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+                    config.jobs = cpus > 0 ? cpus : 1;
+                }
+                break;
             default:
                 print_usage(process_name);
                 return EXIT_SUCCESS;
@@ -310,7 +263,60 @@ int main(int argc, char **argv)
         return EXIT_SUCCESS;
     }
 
-    config.infile_name = strdup(argv[optind]);
+    info = stdout;
+    if (NULL != config.outfile_name && 0 == strcmp(config.outfile_name, "-")) {
+        info = stderr;
+    }
+
+    fprintf(info, BANNER_LINE1, "Assembler");
+    fprintf(info, BANNER_LINE2, VERSION);
+
+    count = argc - optind;
+    if (count > 1 && (NULL != config.outfile_name ||
+                      NULL != config.debugfile_name)) {
+        util_perror("-o and -g need a single input file\n");
+        return EXIT_FAILURE;
+    }
+
+    for (i = 0; i < count && count > 1; i++) {
+        if (0 == strcmp(argv[optind + i], "-")) {
+            util_perror("Standard input can only be assembled alone\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (NULL == (jobs = calloc(count, sizeof(*jobs)))) {
+        perror(process_name);
+        return EXIT_FAILURE;
+    }
+
+    for (i = 0; i < count; i++) {
+        jobs[i].config = &config;
+        jobs[i].infile_name = argv[optind + i];
+        jobs[i].debugfile_name = config.debugfile_name;
+        if (NULL != config.outfile_name) {
+            jobs[i].outfile_name = config.outfile_name;
+        } else if (1 == count) {
+            jobs[i].outfile_name = "program.bin";
+        } else {
+            jobs[i].outfile_name = output_name(argv[optind + i],
+                IMG_CONTAINER == config.image_format ? ".vns" : ".bin");
+            if (NULL == jobs[i].outfile_name) {
+                perror(process_name);
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    failed = assemble_batch(jobs, count);
+
+    if (count > 1) {
+        fprintf(info, "Assembled %u of %u files.\n", count - failed, count);
+        for (i = 0; i < count && NULL == config.outfile_name; i++) {
+            free(jobs[i].outfile_name);
+        }
+    }
+    free(jobs);
 
-    return assemble();
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
 }
@@ -24,43 +24,120 @@
 #include <stdint.h>
 
 #include "globals.h"
-#include "list.h"
+#include "debuginfo.h"
+#include "image.h"
+#include "symtab.h"
 
 #include "instructionset.h"
 
 #define MEMORY_UNIT_SIZE 256
 
+/* the memory unit followed by the bank windows of banks 1 and up */
+#define PROGRAM_DATA_SIZE \
+    (MEMORY_UNIT_SIZE + (IMG_MAX_BANKS - 1) * IMG_BANK_SIZE)
+
+/* kinds of items in the instruction stream */
+#define ASM_ITEM_NONE       0   // removed by the optimizer
+#define ASM_ITEM_INS        1
+#define ASM_ITEM_BYTE       2
+#define ASM_ITEM_OFFSET     3
+#define ASM_ITEM_LABEL      4
+
+/**
+ * One entry of the instruction stream, the program in source order as
+ * the optimizer sees it. Operands referring to a label keep its name,
+ * the address is only filled in by the final layout.
+ */
+typedef struct _vnsasm_item {
+    uint8_t kind;
+    uint8_t value;                      // operand, byte or offset
+    const vns_instruction *ins;
+    const char *label;                  // label operand or declaration
+    int line;
+} vnsasm_item;
+
 typedef struct _vnsasm_program {
-    uint8_t data[MEMORY_UNIT_SIZE];
+    uint8_t data[PROGRAM_DATA_SIZE];
+    uint8_t used[PROGRAM_DATA_SIZE];    // bytes emitted by the source
     uint8_t counter;
-    list labels;
+    uint8_t bank;                       // selected by .bank
+    uint8_t bank_count;                 // highest bank emitted to + 1
+    symtab symbols;
+    debuginfo debug;
+    const char *entry_label;
+    int entry;
+    vnsasm_item *items;                 // only recorded for the optimizer
+    unsigned int item_count;
+    unsigned int item_size;
 } vnsasm_program;
 
+/**
+ * Options shared by all files of one invocation.
+ */
 typedef struct _vnsasm_configuration {
     char *outfile_name;
-    char *infile_name;
+    char *debugfile_name;
     uint8_t strip_trailing_zeros;
+    uint8_t image_format;
     uint8_t print_resolved_labels;
-    vnsasm_program *program;
+    uint8_t optimize;
+    uint8_t debug_labels;               // even without a debug file
+    unsigned int jobs;
 } vnsasm_configuration;
 
-typedef struct _vnsasm_label {
-    char *name;
-    int addr;
-    list positions;
-} vnsasm_label;
+/**
+ * Everything needed to assemble one file. Contexts share nothing but
+ * the read-only configuration, so several may run concurrently.
+ */
+typedef struct _vnsasm_context {
+    const vnsasm_configuration *config;
+    char *infile_name;
+    char *outfile_name;
+    char *debugfile_name;
+    vnsasm_program program;
+    void *scanner;
+    FILE *out;                          // progress and label listing
+    FILE *err;                          // error messages
+    char *out_buf;                      // buffered output of a batch job
+    size_t out_size;
+    char *err_buf;
+    size_t err_size;
+    int done;
+    int failed;
+} vnsasm_context;
+
+#ifndef YY_TYPEDEF_YY_SCANNER_T
+#define YY_TYPEDEF_YY_SCANNER_T
+typedef void *yyscan_t;
+#endif
+
+/* reentrant scanner, generated from scanner.l */
+int yylex_init_extra(vnsasm_context *ctx, yyscan_t *scanner);
+int yylex_destroy(yyscan_t scanner);
+void yyset_in(FILE *in, yyscan_t scanner);
+int yyget_lineno(yyscan_t scanner);
 
-int yyparse(void);
-void yyerror(char *error);
+/* assembler core, see assembler.c */
+int assemble(vnsasm_context *ctx);
+void asm_init(vnsasm_context *ctx);
+int asm_parse(vnsasm_context *ctx, FILE *infile);
+int asm_encode(vnsasm_context *ctx, uint8_t **data, size_t *size);
+void asm_release(vnsasm_context *ctx);
+void asm_error(vnsasm_context *ctx, const char *fmt, ...);
+void asm_error_at(vnsasm_context *ctx, int line, const char *fmt, ...);
+void asm_warning(vnsasm_context *ctx, const char *fmt, ...);
+const char *asm_intern(vnsasm_context *ctx, const char *str);
 
-void prc_label_decl(const char *name);
-void prc_ins(const char *mnemonic,
-             argtype at1, argtype at2,
-             uint8_t i, char *s);
-void prc_byte(uint8_t value);
-void prc_offset(uint8_t offset);
+int prc_label_decl(vnsasm_context *ctx, const char *name);
+int prc_ins(vnsasm_context *ctx, const char *mnemonic,
+            argtype at1, argtype at2,
+            uint8_t i, const char *s, int line);
+int prc_byte(vnsasm_context *ctx, uint8_t value);
+int prc_offset(vnsasm_context *ctx, uint8_t offset);
+int prc_entry(vnsasm_context *ctx, const char *label, uint8_t addr);
+int prc_bank(vnsasm_context *ctx, uint8_t bank);
 
-extern FILE *yyin;
-extern int yylineno;
+/* peephole optimizer, see optimizer.c */
+int asm_optimize(vnsasm_context *ctx);
 
 #endif /* VNSASM_H */
@@ -0,0 +1,18 @@
+; recursive call chain of depth 100, repeated 20 times
+;
+; 0x7F  number of rounds left
+
+        mvi a, 20
+        sta 0x7F
+again:  mvi a, 100
+        call rec
+        lda 0x7F
+        dcr a
+        sta 0x7F
+        jnz again
+        hlt
+
+rec:    dcr a
+        jz done
+        call rec
+done:   ret
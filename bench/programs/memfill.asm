@@ -0,0 +1,18 @@
+; fill the memory from 0x80 to 0xFF with 0xAA, 16 times
+;
+; 0x7F  number of rounds left
+
+        mvi a, 16
+        sta 0x7F
+round:  mvi l, 0x80
+fill:   mvi a, 0xAA
+        mov m, a
+        inr l
+        mov a, l
+        ora a           ; wrapped around to 0x00?
+        jnz fill
+        lda 0x7F
+        dcr a
+        sta 0x7F
+        jnz round
+        hlt
@@ -0,0 +1,34 @@
+; bubble sort of the 64 bytes at 0xC0..0xFF in ascending order
+;
+; 0xB0  number of passes left
+; 0xB2  temporary copy of the current element
+
+        mvi a, 63
+        sta 0xB0
+pass:   mvi l, 0xC0
+inner:  mov a, m        ; a = x[i]
+        sta 0xB2
+        inr l
+        cmp m           ; compare with x[i+1]
+        jc noswap
+        jz noswap
+        mov a, m        ; swap x[i] and x[i+1]
+        dcr l
+        mov m, a
+        inr l
+        lda 0xB2
+        mov m, a
+noswap: mov a, l
+        cpi 0xFF        ; last element reached?
+        jnz inner
+        lda 0xB0
+        dcr a
+        sta 0xB0
+        jnz pass
+        hlt
+
+.offset 0xC0            ; worst case: descending values
+.byte 64, 63, 62, 61, 60, 59, 58, 57, 56, 55, 54, 53, 52, 51, 50, 49
+.byte 48, 47, 46, 45, 44, 43, 42, 41, 40, 39, 38, 37, 36, 35, 34, 33
+.byte 32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17
+.byte 16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1
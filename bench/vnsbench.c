@@ -0,0 +1,606 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+
+#include "globals.h"
+#include "utils.h"
+#include "instructionset.h"
+#include "disasm.h"
+#include "vnsem.h"
+#include "vnsasm.h"
+
+#define BENCH_OP_STEPS      100000
+#define BENCH_MAX_REPS      100
+#define BENCH_CODE_START    0x02
+#define BENCH_CODE_END      0xe0    // RET for call benchmarks lives here
+#define BENCH_DATA          0xf0
+
+typedef struct _bench_configuration {
+    const vnsem_engine *engine;
+    char *programs_dir;
+    char *outfile_name;
+    char *filter;
+    int warmup;
+    int reps;
+    double min_time;
+} bench_configuration;
+
+typedef struct _bench_stats {
+    double mean;
+    double stddev;
+    double min;
+    double max;
+    double work;
+} bench_stats;
+
+/**
+ * A benchmark executes chunks of work until the minimum time of a
+ * repetition has passed. Each chunk returns the number of work units
+ * (instructions, assemblies) it has done.
+ */
+typedef unsigned long bench_func(void *arg);
+
+static bench_configuration bcfg;
+
+static FILE *json;
+static int json_first = TRUE;
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* ------------------------------------------------------------------------
+ *                               measuring
+ * ------------------------------------------------------------------------ */
+
+/**
+ * Run *func* for the configured number of warmup runs and repetitions
+ * and compute the statistics of the nanoseconds per work unit.
+ */
+static void measure(bench_func *func, void *arg, bench_stats *stats)
+{
+    double samples[BENCH_MAX_REPS], start, elapsed, sum = 0, var = 0;
+    unsigned long work, total_work = 0;
+    int rep, i;
+
+    for (rep = -bcfg.warmup; rep < bcfg.reps; ++rep) {
+        work = 0;
+        start = now();
+        do {
+            work += func(arg);
+            elapsed = now() - start;
+        } while (elapsed < bcfg.min_time);
+
+        if (rep >= 0) {
+            samples[rep] = elapsed * 1e9 / work;
+            total_work += work;
+        }
+    }
+
+    stats->min = stats->max = samples[0];
+    for (i = 0; i < bcfg.reps; ++i) {
+        sum += samples[i];
+        if (samples[i] < stats->min) stats->min = samples[i];
+        if (samples[i] > stats->max) stats->max = samples[i];
+    }
+
+    stats->mean = sum / bcfg.reps;
+
+    for (i = 0; i < bcfg.reps; ++i) {
+        var += (samples[i] - stats->mean) * (samples[i] - stats->mean);
+    }
+
+    stats->stddev = (bcfg.reps > 1) ? sqrt(var / (bcfg.reps - 1)) : 0;
+    stats->work = (double)total_work / bcfg.reps;
+}
+
+static void report(const char *group, const char *name, const char *unit,
+                   bench_stats *stats, unsigned long lines)
+{
+    const char *abbr = (0 == strcmp(unit, "instruction")) ? "ins" :
+                       (0 == strcmp(unit, "image")) ? "img" : "asm";
+
+    printf("  %-26s %12.1f ns/%s  +- %5.1f%%  %12.0f %s/s\n",
+            name, stats->mean, abbr,
+            (stats->mean > 0) ? 100 * stats->stddev / stats->mean : 0,
+            1e9 / stats->mean, abbr);
+
+    if (NULL == json) {
+        return;
+    }
+
+    fprintf(json, "%s\n    { \"group\": \"%s\", \"name\": \"%s\", "
+                  "\"unit\": \"%s\",\n", (json_first) ? "" : ",",
+            group, name, unit);
+    fprintf(json, "      \"warmup\": %i, \"reps\": %i, "
+                  "\"work_per_rep\": %.0f,\n",
+            bcfg.warmup, bcfg.reps, stats->work);
+    fprintf(json, "      \"ns_per_unit\": { \"mean\": %.3f, "
+                  "\"stddev\": %.3f, \"variance\": %.3f, "
+                  "\"min\": %.3f, \"max\": %.3f },\n",
+            stats->mean, stats->stddev, stats->stddev * stats->stddev,
+            stats->min, stats->max);
+    fprintf(json, "      \"units_per_sec\": %.1f", 1e9 / stats->mean);
+
+    if (lines) {
+        fprintf(json, ", \"lines\": %lu, \"lines_per_sec\": %.1f",
+                lines, lines * 1e9 / stats->mean);
+    }
+
+    fprintf(json, " }");
+    json_first = FALSE;
+}
+
+static int selected(const char *name)
+{
+    return NULL == bcfg.filter || NULL != strstr(name, bcfg.filter);
+}
+
+/* ------------------------------------------------------------------------
+ *                          emulator benchmarks
+ * ------------------------------------------------------------------------ */
+
+static int bench_input(uint8_t port, uint8_t *value, void *ctx)
+{
+    *value = 0xff;
+    return TRUE;
+}
+
+static void bench_output(uint8_t port, uint8_t value, void *ctx)
+{
+}
+
+static const vnsem_io bench_io = { bench_input, bench_output, NULL };
+
+/* execute a fixed number of steps of an endless opcode loop */
+static unsigned long run_steps(void *arg)
+{
+    vnsem_machine *m = (vnsem_machine*)arg;
+    int (*step)(vnsem_machine*) = bcfg.engine->step;
+    uint32_t start = m->step_count;
+    unsigned long i;
+
+    /* engines may execute several instructions per step */
+    for (i = 0; i < BENCH_OP_STEPS; ++i) {
+        step(m);
+    }
+
+    return m->step_count - start;
+}
+
+/* execute a program from its initial state until it halts */
+static unsigned long run_program(void *arg)
+{
+    const vnsem_machine *pristine = (const vnsem_machine*)arg;
+    int (*step)(vnsem_machine*) = bcfg.engine->step;
+    vnsem_machine m = *pristine;
+
+    while (!m.halted && 0 == step(&m));
+
+    return m.step_count;
+}
+
+static const char *arg_name(argtype at)
+{
+    if (at & AT_REG_A)  return "A";
+    if (at & AT_REG_L)  return "L";
+    if (at & AT_REG_FL) return "FL";
+    if (at & AT_REG_SP) return "SP";
+    if (at & AT_MEM)    return "M";
+    if ((at & AT_ADDR) == AT_ADDR) return "adr";
+    if (at & AT_INT)    return "n";
+    return "";
+}
+
+/**
+ * Build the loop body measuring *op*. Stack and call instructions are
+ * paired with their counterpart to keep the stack balanced, jumps go
+ * to the next instruction. Returns the length of the body.
+ */
+static int op_body(uint8_t op, uint8_t addr, uint8_t *body)
+{
+    switch (op) {
+        case 0xf5: case 0xe5: case 0xed:        /* PUSH x; POP x */
+            body[0] = op;
+            body[1] = (op == 0xed) ? 0xfd : op - 4;
+            return 2;
+        case 0xf1: case 0xe1: case 0xfd:        /* PUSH x; POP x */
+            body[0] = (op == 0xfd) ? 0xed : op + 4;
+            body[1] = op;
+            return 2;
+        case 0xcd: case 0xcc: case 0xc4:        /* CALL sub (sub: RET) */
+        case 0xdc: case 0xd4:
+            body[0] = op;
+            body[1] = BENCH_CODE_END;
+            return 2;
+        case 0xc9:                              /* CALL sub (sub: RET) */
+            body[0] = 0xcd;
+            body[1] = BENCH_CODE_END;
+            return 2;
+        case 0xc3: case 0xca: case 0xc2:        /* jump to next */
+        case 0xda: case 0xd2:
+            body[0] = op;
+            body[1] = addr + 2;
+            return 2;
+    }
+
+    body[0] = op;
+    body[1] = body[2] = BENCH_DATA;
+
+    return is_instruction_length(is_find_opcode(op));
+}
+
+static void bench_opcodes(void)
+{
+    const vns_instruction *ins;
+    vnsem_machine m;
+    bench_stats stats;
+    uint8_t body[3];
+    char name[32];
+    int op, addr, len;
+
+    printf("\nOpcode microbenchmarks (engine '%s'):\n", bcfg.engine->name);
+
+    for (op = 0; op < 256; ++op) {
+        if (NULL == (ins = is_find_opcode(op)) || op == 0x76 /* HLT */) {
+            continue;
+        }
+
+        snprintf(name, sizeof(name), "op/%s%s%s%s%s", ins->mnemonic,
+                (ins->at1) ? " " : "", arg_name(ins->at1),
+                (ins->at2) ? "," : "", arg_name(ins->at2));
+
+        if (!selected(name)) {
+            continue;
+        }
+
+        /* MVI L,n; loop: <body>...; JMP loop; ...; sub: RET */
+        reset_machine(&m);
+        m.io = &bench_io;
+        m.mem[0] = 0x2e;
+        m.mem[1] = BENCH_DATA;
+
+        for (addr = BENCH_CODE_START; ; addr += len) {
+            len = op_body(op, addr, body);
+            if (addr + len > BENCH_CODE_END - 2) {
+                break;
+            }
+            memcpy(&m.mem[addr], body, len);
+        }
+
+        m.mem[addr] = 0xc3;
+        m.mem[addr + 1] = BENCH_CODE_START;
+        m.mem[BENCH_CODE_END] = 0xc9;
+
+        measure(run_steps, &m, &stats);
+        report("opcode", name, "instruction", &stats, 0);
+    }
+}
+
+static void bench_programs(void)
+{
+    static const char *programs[] = { "multiply", "sort", "memfill", "calls" };
+    vnsem_machine m;
+    bench_stats stats;
+    char name[32], path[1024];
+    int i;
+
+    printf("\nProgram benchmarks (engine '%s'):\n", bcfg.engine->name);
+
+    for (i = 0; i < sizeof(programs) / sizeof(char*); ++i) {
+        snprintf(name, sizeof(name), "program/%s", programs[i]);
+        snprintf(path, sizeof(path), "%s/%s.bin",
+                 bcfg.programs_dir, programs[i]);
+
+        if (!selected(name)) {
+            continue;
+        }
+
+        reset_machine(&m);
+        if (!read_program(path, 0, &m)) {
+            continue;
+        }
+        m.io = &bench_io;
+
+        measure(run_program, &m, &stats);
+        report("program", name, "instruction", &stats, 0);
+    }
+}
+
+/* ------------------------------------------------------------------------
+ *                         disassembler benchmarks
+ * ------------------------------------------------------------------------ */
+
+/* discover and format a whole image, like vnsdis without the output */
+static unsigned long run_disassembler(void *arg)
+{
+    const uint8_t *mem = (const uint8_t*)arg;
+    uint8_t cell[DIS_MEMORY_SIZE];
+    char text[64];
+    int addr;
+
+    dis_discover(mem, 0, cell);
+    for (addr = 0; addr < DIS_MEMORY_SIZE; ++addr) {
+        if (cell[addr] & DIS_CELL_CODE) {
+            dis_format(mem, addr, NULL, text, sizeof(text));
+        }
+    }
+
+    return 1;
+}
+
+static void bench_disassembler(void)
+{
+    static const char *programs[] = { "multiply", "sort", "memfill", "calls" };
+    vnsem_machine m;
+    bench_stats stats;
+    char name[32], path[1024];
+    int i;
+
+    printf("\nDisassembler benchmarks:\n");
+
+    for (i = 0; i < sizeof(programs) / sizeof(char*); ++i) {
+        snprintf(name, sizeof(name), "disasm/%s", programs[i]);
+        snprintf(path, sizeof(path), "%s/%s.bin",
+                 bcfg.programs_dir, programs[i]);
+
+        if (!selected(name)) {
+            continue;
+        }
+
+        reset_machine(&m);
+        if (!read_program(path, 0, &m)) {
+            continue;
+        }
+
+        measure(run_disassembler, m.mem, &stats);
+        report("disassembler", name, "image", &stats, 0);
+    }
+}
+
+/* ------------------------------------------------------------------------
+ *                          assembler benchmarks
+ * ------------------------------------------------------------------------ */
+
+/**
+ * Generate an assembler source with *blocks* labeled blocks. Each block
+ * references the label of the next one, so all references are forward
+ * references that need to be backpatched. Returns the number of lines.
+ */
+static unsigned long generate_source(FILE *out, int blocks)
+{
+    unsigned long lines = 0;
+    int i;
+
+    for (i = 0; i < blocks; ++i) {
+        if (0 == i % 40) {
+            fprintf(out, ".offset 0\n");
+            lines++;
+        }
+        fprintf(out, "block_%i:  mvi a, %i\n", i, i & 0xff);
+        fprintf(out, "           add l    ; accumulate\n");
+        fprintf(out, "           jnz block_%i\n", i + 1);
+        lines += 3;
+    }
+
+    fprintf(out, "block_%i:  hlt\n", blocks);
+
+    return lines + 1;
+}
+
+/* a generated assembler source held in memory */
+typedef struct _bench_source {
+    char *text;
+    size_t size;
+} bench_source;
+
+/**
+ * Parse and encode the source in memory, as vnsem --asm does. Process
+ * creation and file output of the vnsasm binary are not measured.
+ */
+static unsigned long run_assembler(void *arg)
+{
+    bench_source *src = (bench_source*)arg;
+    vnsasm_configuration asm_config;
+    vnsasm_context ctx;
+    uint8_t *data = NULL;
+    size_t size;
+    FILE *in;
+    int ok;
+
+    memset(&asm_config, 0, sizeof(asm_config));
+    asm_config.image_format = IMG_RAW;
+    asm_config.strip_trailing_zeros = TRUE;
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.config = &asm_config;
+    ctx.infile_name = "generated.asm";
+    ctx.out = stdout;
+    ctx.err = stderr;
+
+    if (NULL == (in = fmemopen(src->text, src->size, "r"))) {
+        perror("fmemopen");
+        exit(EXIT_FAILURE);
+    }
+
+    ok = asm_parse(&ctx, in) && asm_encode(&ctx, &data, &size);
+    asm_release(&ctx);
+    fclose(in);
+    free(data);
+
+    if (!ok) {
+        util_perror("Assembling the generated source failed.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    return 1;
+}
+
+static void bench_assembler(void)
+{
+    static const int sizes[] = { 100, 1000, 10000 };
+    bench_source src;
+    unsigned long lines;
+    bench_stats stats;
+    char name[32];
+    FILE *out;
+    int i;
+
+    printf("\nAssembler benchmarks (in-process, no file output):\n");
+
+    for (i = 0; i < sizeof(sizes) / sizeof(int); ++i) {
+        snprintf(name, sizeof(name), "asm/labels_%i", sizes[i]);
+
+        if (!selected(name)) {
+            continue;
+        }
+
+        if (NULL == (out = open_memstream(&src.text, &src.size))) {
+            perror("open_memstream");
+            return;
+        }
+
+        lines = generate_source(out, sizes[i]);
+        fclose(out);
+
+        measure(run_assembler, &src, &stats);
+        report("assembler", name, "assembly", &stats, lines);
+
+        free(src.text);
+    }
+}
+
+/* ------------------------------------------------------------------------ */
+
+static void print_usage(char *pname)
+{
+    printf("\nUsage: %s [-h] [-e <engine>] [-r <reps>] [-w <warmup>] "
+           "[-t <ms>]\n"
+           "       [-p <dir>] [-f <filter>] [-o <jsonfile>]\n\n",
+           pname);
+    printf("  -h             Show this help text.\n");
+    printf("  -e <engine>    Benchmark execution engine <engine>.\n");
+    printf("  -r <reps>      Number of measured repetitions (default 5).\n");
+    printf("  -w <warmup>    Number of warmup repetitions (default 1).\n");
+    printf("  -t <ms>        Minimum time per repetition (default 20).\n");
+    printf("  -p <dir>       Directory of the assembled benchmark programs.\n");
+    printf("  -f <filter>    Only run benchmarks containing <filter>.\n");
+    printf("  -o <jsonfile>  Write results as JSON to <jsonfile>.\n");
+    printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+    int opt;
+    char *p, *process_name = util_basename(argv[0]);
+
+    printf(BANNER_LINE1, "Benchmarks");
+    printf(BANNER_LINE2, VERSION);
+
+    bcfg.engine = find_engine("ref");
+    bcfg.programs_dir = "programs";
+    bcfg.outfile_name = NULL;
+    bcfg.filter = NULL;
+    bcfg.warmup = 1;
+    bcfg.reps = 5;
+    bcfg.min_time = 0.02;
+
+    while (-1 != (opt = getopt(argc, argv, "he:r:w:t:p:f:o:"))) {
+        switch (opt) {
+            case 'h':
+                print_usage(process_name);
+                return EXIT_SUCCESS;
+            case 'e':
+                if (NULL == (bcfg.engine = find_engine(optarg))) {
+                    util_perror("Unknown engine: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'r':
+                bcfg.reps = strtol(optarg, &p, 10);
+                if (*p || bcfg.reps < 1 || bcfg.reps > BENCH_MAX_REPS) {
+                    util_perror("Invalid number of repetitions.\n");
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'w':
+                bcfg.warmup = strtol(optarg, &p, 10);
+                if (*p || bcfg.warmup < 0) {
+                    util_perror("Invalid number of warmup runs.\n");
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 't':
+                bcfg.min_time = strtol(optarg, &p, 10) / 1000.0;
+                if (*p || bcfg.min_time <= 0) {
+                    util_perror("Invalid repetition time.\n");
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'p':
+                bcfg.programs_dir = optarg;
+                break;
+            case 'f':
+                bcfg.filter = optarg;
+                break;
+            case 'o':
+                bcfg.outfile_name = optarg;
+                break;
+            default:
+                print_usage(process_name);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (NULL != bcfg.outfile_name) {
+        if (NULL == (json = fopen(bcfg.outfile_name, "w"))) {
+            perror(bcfg.outfile_name);
+            return EXIT_FAILURE;
+        }
+        fprintf(json, "{\n  \"version\": \"%s\",\n  \"engine\": \"%s\",\n"
+                      "  \"compiler\": \"%s\",\n  \"timestamp\": %ld,\n"
+                      "  \"benchmarks\": [",
+                VERSION, bcfg.engine->name, __VERSION__, (long)time(NULL));
+    }
+
+    bench_opcodes();
+    bench_programs();
+    bench_disassembler();
+    bench_assembler();
+
+    if (NULL != json) {
+        fprintf(json, "\n  ]\n}\n");
+        fclose(json);
+        printf("\nResults written to '%s'.\n", bcfg.outfile_name);
+    }
+
+    printf("\n");
+
+    return EXIT_SUCCESS;
+}
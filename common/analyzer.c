@@ -0,0 +1,474 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "globals.h"
+#include "instructionset.h"
+#include "analyzer.h"
+
+/**
+ * Number of state changes an instruction may see before its stack
+ * depth bounds are widened to infinity. This guarantees termination
+ * for loops that push or pop without bound.
+ */
+#define AN_WIDEN_LIMIT 4
+
+/**
+ * Abstract machine state at the start of an instruction. The stack
+ * pointer is tracked as a base (the value set by LXI or the reset value)
+ * plus an interval of bytes pushed since then. A second interval counts
+ * the bytes pushed since entering the current subroutine, which tells
+ * us whether RET pops a return address or some pushed data.
+ */
+typedef struct _an_state {
+    uint8_t visited;
+    uint8_t changes;
+    uint8_t base_known;
+    uint8_t base;
+    uint8_t l_known;
+    uint8_t l;
+    int16_t dmin, dmax;     // depth relative to the stack base
+    int16_t fmin, fmax;     // depth relative to the subroutine entry
+} an_state;
+
+typedef struct _an_context {
+    const uint8_t *mem;
+    an_result *res;
+    an_state states[AN_MEMORY_SIZE];
+    uint16_t marks[AN_MEMORY_SIZE];
+    uint8_t unknown_read[AN_MEMORY_SIZE];
+    uint8_t unknown_write[AN_MEMORY_SIZE];
+    uint8_t queued[AN_MEMORY_SIZE];
+    uint8_t worklist[AN_MEMORY_SIZE];
+    int worklist_len;
+} an_context;
+
+static const char *an_issue_names[] = {
+    NULL,
+    "illegal instruction",
+    "stack underflow",
+    "unbounded stack growth",
+    "stack overlaps code or data",
+    "overlapping instructions",
+    "self-modifying code",
+    "data-dependent jump",
+    "execution wraps around memory end",
+    "stack pointer not static",
+    "unreachable bytes"
+};
+
+const char *an_issue_name(uint8_t type)
+{
+    if (type == 0 || type >= sizeof(an_issue_names) / sizeof(char*)) {
+        return "unknown issue";
+    }
+
+    return an_issue_names[type];
+}
+
+/**
+ * Returns TRUE if an issue of the given type will most probably break
+ * the program at run time. Other issues are reported as warnings since
+ * they may have been introduced on purpose.
+ */
+int an_issue_is_error(uint8_t type)
+{
+    switch (type) {
+        case AN_ISSUE_SELF_MODIFY:
+        case AN_ISSUE_SP_UNKNOWN:
+        case AN_ISSUE_UNREACHABLE:
+        case AN_ISSUE_OVERLAP:
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+static int16_t sat_add(int16_t value, int16_t delta)
+{
+    if (value >= AN_DEPTH_INF || value <= -AN_DEPTH_INF) {
+        return value;
+    }
+
+    return value + delta;
+}
+
+static void mark(an_context *ctx, uint8_t addr, uint8_t type)
+{
+    ctx->marks[addr] |= (1 << type);
+}
+
+static void enqueue(an_context *ctx, uint8_t addr)
+{
+    if (!ctx->queued[addr]) {
+        ctx->queued[addr] = TRUE;
+        ctx->worklist[ctx->worklist_len++] = addr;
+    }
+}
+
+/**
+ * Merge *in* into the state of the instruction at *addr* and schedule
+ * the instruction for (re-)evaluation if its state has changed.
+ */
+static void join(an_context *ctx, uint8_t addr, const an_state *in)
+{
+    an_state *st = &ctx->states[addr];
+    an_state old;
+
+    if (!st->visited) {
+        *st = *in;
+        st->visited = TRUE;
+        st->changes = 0;
+        enqueue(ctx, addr);
+        return;
+    }
+
+    old = *st;
+
+    if (st->base_known && (!in->base_known || st->base != in->base)) {
+        st->base_known = FALSE;
+        mark(ctx, addr, AN_ISSUE_SP_UNKNOWN);
+    }
+
+    if (st->l_known && (!in->l_known || st->l != in->l)) {
+        st->l_known = FALSE;
+    }
+
+    if (in->dmin < st->dmin) st->dmin = in->dmin;
+    if (in->dmax > st->dmax) st->dmax = in->dmax;
+    if (in->fmin < st->fmin) st->fmin = in->fmin;
+    if (in->fmax > st->fmax) st->fmax = in->fmax;
+
+    if (0 == memcmp(&old, st, sizeof(old))) {
+        return;
+    }
+
+    if (++st->changes > AN_WIDEN_LIMIT) {
+        if (st->dmin < old.dmin) st->dmin = -AN_DEPTH_INF;
+        if (st->dmax > old.dmax) st->dmax = AN_DEPTH_INF;
+        if (st->fmin < old.fmin) st->fmin = -AN_DEPTH_INF;
+        if (st->fmax > old.fmax) st->fmax = AN_DEPTH_INF;
+    }
+
+    enqueue(ctx, addr);
+}
+
+static void branch(an_context *ctx, uint8_t target, const an_state *in)
+{
+    ctx->res->cell[target] |= AN_CELL_TARGET;
+    join(ctx, target, in);
+}
+
+static void push(an_context *ctx, an_state *st)
+{
+    int16_t d;
+
+    st->dmin = sat_add(st->dmin, 1);
+    st->dmax = sat_add(st->dmax, 1);
+    st->fmin = sat_add(st->fmin, 1);
+    st->fmax = sat_add(st->fmax, 1);
+
+    if (!st->base_known || st->dmax >= AN_DEPTH_INF) {
+        return;
+    }
+
+    for (d = (st->dmin > 1) ? st->dmin : 1;
+         d <= st->dmax && d <= AN_MEMORY_SIZE; ++d)
+    {
+        ctx->res->cell[(uint8_t)(st->base - d)] |= AN_CELL_STACK;
+    }
+}
+
+static void pop(an_context *ctx, an_state *st, uint8_t addr)
+{
+    if (st->dmin < 1) {
+        mark(ctx, addr, AN_ISSUE_UNDERFLOW);
+    }
+
+    st->dmin = sat_add(st->dmin, -1);
+    st->dmax = sat_add(st->dmax, -1);
+    st->fmin = sat_add(st->fmin, -1);
+    st->fmax = sat_add(st->fmax, -1);
+}
+
+static void read_m(an_context *ctx, const an_state *st, uint8_t addr)
+{
+    if (st->l_known) {
+        ctx->res->cell[st->l] |= AN_CELL_READ;
+    } else {
+        ctx->unknown_read[addr] = TRUE;
+    }
+}
+
+/**
+ * Evaluate the instruction at *addr* for its current abstract state and
+ * propagate the resulting state(s) to all possible successors.
+ */
+static void transfer(an_context *ctx, uint8_t addr)
+{
+    const uint8_t *mem = ctx->mem;
+    an_result *res = ctx->res;
+    const vns_instruction *ins;
+    an_state st = ctx->states[addr], callee;
+    uint8_t i, length, arg, next;
+
+    res->cell[addr] |= AN_CELL_INS;
+
+    if (NULL == (ins = is_find_opcode(mem[addr]))) {
+        mark(ctx, addr, AN_ISSUE_ILLEGAL);
+        return;
+    }
+
+    length = is_instruction_length(ins);
+    for (i = 1; i < length; ++i) {
+        res->cell[(uint8_t)(addr + i)] |= AN_CELL_OPERAND;
+    }
+
+    if (addr + length > AN_MEMORY_SIZE) {
+        mark(ctx, addr, AN_ISSUE_WRAP);
+    }
+
+    arg = mem[(uint8_t)(addr + 1)];
+    next = addr + length;
+
+    switch (ins->opcode) {
+        /* ----- STACK ----- */
+        case 0xf5: /* PUSH A  */
+        case 0xe5: /* PUSH L  */
+        case 0xed: /* PUSH FL */
+            push(ctx, &st);
+            break;
+        case 0xe1: /* POP L   */
+            st.l_known = FALSE;
+            /* fall through */
+        case 0xf1: /* POP A   */
+        case 0xfd: /* POP FL  */
+            pop(ctx, &st, addr);
+            break;
+        case 0x31: /* LXI SP,n */
+            st.base_known = TRUE;
+            st.base = arg;
+            st.dmin = st.dmax = 0;
+            st.fmin = st.fmax = 0;
+            break;
+        /* ----- L REGISTER ----- */
+        case 0x2e: /* MVI L,n */
+            st.l_known = TRUE;
+            st.l = arg;
+            break;
+        case 0x2c: /* INR L */ st.l++;                      break;
+        case 0x2d: /* DCR L */ st.l--;                      break;
+        case 0x6f: /* MOV L,A */ st.l_known = FALSE;        break;
+        case 0x6e: /* MOV L,M */
+            read_m(ctx, &st, addr);
+            st.l_known = FALSE;
+            break;
+        /* ----- MEMORY ----- */
+        case 0x3a: /* LDA adr */ res->cell[arg] |= AN_CELL_READ;  break;
+        case 0x32: /* STA adr */ res->cell[arg] |= AN_CELL_WRITE; break;
+        case 0x77: /* MOV M,A */
+            if (st.l_known) {
+                res->cell[st.l] |= AN_CELL_WRITE;
+            } else {
+                ctx->unknown_write[addr] = TRUE;
+            }
+            break;
+        case 0x7e: /* MOV A,M */
+        case 0x86: /* ADD M */
+        case 0x96: /* SUB M */
+        case 0xbe: /* CMP M */
+        case 0xa6: /* ANA M */
+        case 0xb6: /* ORA M */
+        case 0xae: /* XRA M */
+            read_m(ctx, &st, addr);
+            break;
+        /* ----- BRANCH ----- */
+        case 0xc3: /* JMP adr */
+            branch(ctx, arg, &st);
+            return;
+        case 0xca: /* JZ  adr */
+        case 0xc2: /* JNZ adr */
+        case 0xda: /* JC  adr */
+        case 0xd2: /* JNC adr */
+            branch(ctx, arg, &st);
+            break;
+        case 0xcd: /* CALL adr*/
+        case 0xcc: /* CZ  adr */
+        case 0xc4: /* CNZ adr */
+        case 0xdc: /* CC  adr */
+        case 0xd4: /* CNC adr */
+            /* the callee sees the return address as its frame base */
+            callee = st;
+            push(ctx, &callee);
+            callee.fmin = callee.fmax = 0;
+            res->cell[arg] |= AN_CELL_CALL;
+            branch(ctx, arg, &callee);
+            /* assume the callee returns with a balanced stack */
+            break;
+        case 0xc9: /* RET */
+            if (st.dmin < 1) {
+                mark(ctx, addr, AN_ISSUE_UNDERFLOW);
+            } else if (st.fmin != 0 || st.fmax != 0) {
+                mark(ctx, addr, AN_ISSUE_DATA_JUMP);
+            }
+            return;
+        case 0x76: /* HLT */
+            return;
+    }
+
+    join(ctx, next, &st);
+}
+
+static void add_issue(an_result *res, uint8_t type, uint8_t addr, uint16_t len)
+{
+    an_issue *issue;
+
+    if (res->issue_count >= AN_MAX_ISSUES) {
+        return;
+    }
+
+    issue = &res->issues[res->issue_count++];
+    issue->type = type;
+    issue->addr = addr;
+    issue->len = len;
+}
+
+static int is_branch(uint8_t opcode)
+{
+    switch (opcode) {
+        case 0xc3: case 0xca: case 0xc2: case 0xda: case 0xd2:
+        case 0xcd: case 0xcc: case 0xc4: case 0xdc: case 0xd4:
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+/**
+ * Derive the cell based issues once the fixpoint has been reached and
+ * translate the per-address marks into the issue list of the result.
+ */
+static void collect_issues(an_context *ctx)
+{
+    an_result *res = ctx->res;
+    const an_state *st;
+    uint8_t cell, type;
+    int addr, start;
+
+    for (addr = 0; addr < AN_MEMORY_SIZE; ++addr) {
+        cell = res->cell[addr];
+        st = &ctx->states[addr];
+
+        if (cell & AN_CELL_INS) {
+            res->ins_count++;
+        }
+
+        if (cell & AN_CELL_CODE) {
+            res->code_bytes++;
+        }
+
+        if ((cell & AN_CELL_INS) && (cell & AN_CELL_OPERAND)) {
+            mark(ctx, addr, AN_ISSUE_OVERLAP);
+        }
+
+        if ((cell & AN_CELL_STACK) &&
+                (cell & (AN_CELL_CODE | AN_CELL_READ))) {
+            mark(ctx, addr, AN_ISSUE_STACK_OVERLAP);
+        }
+
+        if ((cell & AN_CELL_WRITE) && (cell & AN_CELL_CODE)) {
+            mark(ctx, addr, AN_ISSUE_SELF_MODIFY);
+            /* a modified branch operand makes the jump data-dependent */
+            if ((cell & AN_CELL_OPERAND) &&
+                    (res->cell[(uint8_t)(addr - 1)] & AN_CELL_INS) &&
+                    is_branch(ctx->mem[(uint8_t)(addr - 1)])) {
+                mark(ctx, addr - 1, AN_ISSUE_DATA_JUMP);
+            }
+        }
+
+        if (st->visited) {
+            if (st->dmax >= AN_DEPTH_INF || st->dmin <= -AN_DEPTH_INF) {
+                mark(ctx, addr, AN_ISSUE_UNBOUNDED);
+            }
+            if (st->dmin < res->depth_min) res->depth_min = st->dmin;
+            if (st->dmax > res->depth_max) res->depth_max = st->dmax;
+        }
+
+        res->unknown_reads += ctx->unknown_read[addr];
+        res->unknown_writes += ctx->unknown_write[addr];
+    }
+
+    for (addr = 0; addr < AN_MEMORY_SIZE; ++addr) {
+        for (type = AN_ISSUE_ILLEGAL; type < AN_ISSUE_UNREACHABLE; ++type) {
+            if (ctx->marks[addr] & (1 << type)) {
+                add_issue(res, type, addr, 1);
+            }
+        }
+    }
+
+    /* report unused non-zero bytes as ranges */
+    for (addr = 0; addr < AN_MEMORY_SIZE; ++addr) {
+        if (0 == ctx->mem[addr] || res->cell[addr]) {
+            continue;
+        }
+        start = addr;
+        while (addr + 1 < AN_MEMORY_SIZE &&
+                0 != ctx->mem[addr + 1] && !res->cell[addr + 1]) {
+            ++addr;
+        }
+        add_issue(res, AN_ISSUE_UNREACHABLE, start, addr - start + 1);
+    }
+}
+
+/**
+ * Statically analyze the memory image *mem* starting at *entry*. The
+ * analysis builds the control flow graph of all reachable instructions
+ * and bounds the stack depth by abstract interpretation. The result is
+ * stored in *res*. Returns the number of issues found.
+ */
+int an_analyze(const uint8_t *mem, uint8_t entry, an_result *res)
+{
+    an_context ctx;
+    an_state init;
+    uint8_t addr;
+
+    memset(&ctx, 0, sizeof(ctx));
+    memset(res, 0, sizeof(*res));
+    ctx.mem = mem;
+    ctx.res = res;
+    res->entry = entry;
+
+    /* the machine starts with SP = 0 after a reset */
+    memset(&init, 0, sizeof(init));
+    init.base_known = TRUE;
+    join(&ctx, entry, &init);
+
+    while (ctx.worklist_len) {
+        addr = ctx.worklist[--ctx.worklist_len];
+        ctx.queued[addr] = FALSE;
+        transfer(&ctx, addr);
+    }
+
+    collect_issues(&ctx);
+
+    return res->issue_count;
+}
@@ -0,0 +1,80 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef ANALYZER_H
+#define ANALYZER_H 1
+
+#include <stdint.h>
+
+#define AN_MEMORY_SIZE   256
+
+/* classification of memory cells */
+#define AN_CELL_INS      0x01    // first byte of a reachable instruction
+#define AN_CELL_OPERAND  0x02    // operand byte of a reachable instruction
+#define AN_CELL_TARGET   0x04    // target of a jump or call
+#define AN_CELL_CALL     0x08    // entry of a subroutine
+#define AN_CELL_READ     0x10    // read as data
+#define AN_CELL_WRITE    0x20    // written as data
+#define AN_CELL_STACK    0x40    // may be used by the stack
+
+#define AN_CELL_CODE     (AN_CELL_INS | AN_CELL_OPERAND)
+
+/* issue types */
+#define AN_ISSUE_ILLEGAL        0x01    // reachable illegal opcode
+#define AN_ISSUE_UNDERFLOW      0x02    // POP/RET on a possibly empty stack
+#define AN_ISSUE_UNBOUNDED      0x03    // stack depth grows without bound
+#define AN_ISSUE_STACK_OVERLAP  0x04    // stack may overwrite code or data
+#define AN_ISSUE_OVERLAP        0x05    // instructions overlap each other
+#define AN_ISSUE_SELF_MODIFY    0x06    // program writes to its own code
+#define AN_ISSUE_DATA_JUMP      0x07    // jump target depends on data
+#define AN_ISSUE_WRAP           0x08    // execution wraps around 0xFF
+#define AN_ISSUE_SP_UNKNOWN     0x09    // stack base is not static
+#define AN_ISSUE_UNREACHABLE    0x0a    // bytes neither executed nor used
+
+#define AN_MAX_ISSUES    64
+
+/* depth value used for unbounded stack growth */
+#define AN_DEPTH_INF     0x7fff
+
+typedef struct _an_issue {
+    uint8_t type;
+    uint8_t addr;
+    uint16_t len;
+} an_issue;
+
+typedef struct _an_result {
+    uint8_t entry;
+    uint8_t cell[AN_MEMORY_SIZE];
+    uint16_t ins_count;
+    uint16_t code_bytes;
+    /* stack depth bounds in bytes over all reachable instructions */
+    int16_t depth_min;
+    int16_t depth_max;
+    /* memory accesses through an unknown L register */
+    uint16_t unknown_reads;
+    uint16_t unknown_writes;
+    uint16_t issue_count;
+    an_issue issues[AN_MAX_ISSUES];
+} an_result;
+
+int an_analyze(const uint8_t *mem, uint8_t entry, an_result *res);
+int an_issue_is_error(uint8_t type);
+const char *an_issue_name(uint8_t type);
+
+#endif /* ANALYZER_H */
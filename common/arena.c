@@ -0,0 +1,144 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+#define ARENA_ALIGN (_Alignof(max_align_t))
+
+/**
+ * Return size bytes aligned to align (a power of two) from the current
+ * chunk, moving on to the next or a new chunk when it is full.
+ */
+static void *arena_take(arena *a, size_t size, size_t align)
+{
+    arena_chunk *chunk = a->current;
+    size_t offset, chunk_size;
+
+    if (NULL != chunk) {
+        offset = (chunk->used + align - 1) & ~(align - 1);
+        if (offset <= chunk->size && size <= chunk->size - offset) {
+            chunk->used = offset + size;
+            return (char*)chunk->data + offset;
+        }
+
+        /* chunks kept by arena_reset() are reused in order */
+        if (NULL != chunk->next && size <= chunk->next->size) {
+            chunk = chunk->next;
+            chunk->used = size;
+            a->current = chunk;
+            return chunk->data;
+        }
+    }
+
+    chunk_size = size > a->chunk_size ? size : a->chunk_size;
+    if (NULL == (chunk = malloc(sizeof(*chunk) + chunk_size))) {
+        return NULL;
+    }
+    chunk->used = size;
+    chunk->size = chunk_size;
+
+    if (NULL == a->current) {
+        chunk->next = a->first;
+        a->first = chunk;
+    } else {
+        chunk->next = a->current->next;
+        a->current->next = chunk;
+    }
+    a->current = chunk;
+
+    return chunk->data;
+}
+
+void arena_init(arena *a, size_t chunk_size)
+{
+    a->first = NULL;
+    a->current = NULL;
+    a->chunk_size = chunk_size ? chunk_size : ARENA_CHUNK_SIZE;
+}
+
+void arena_destroy(arena *a)
+{
+    arena_chunk *chunk;
+
+    while (NULL != (chunk = a->first)) {
+        a->first = chunk->next;
+        free(chunk);
+    }
+
+    a->current = NULL;
+}
+
+void arena_reset(arena *a)
+{
+    /* later chunks are rewound lazily when arena_take() gets to them */
+    a->current = a->first;
+    if (NULL != a->current) {
+        a->current->used = 0;
+    }
+}
+
+void *arena_alloc(arena *a, size_t size)
+{
+    return arena_take(a, size, ARENA_ALIGN);
+}
+
+char *arena_strdup(arena *a, const char *str)
+{
+    size_t len = strlen(str) + 1;
+    char *copy = arena_take(a, len, 1);
+
+    if (NULL != copy) {
+        memcpy(copy, str, len);
+    }
+
+    return copy;
+}
+
+void pool_init(pool *p, arena *a, size_t size)
+{
+    /* released objects hold the link of the free list */
+    if (size < sizeof(void*)) {
+        size = sizeof(void*);
+    }
+
+    p->arena = a;
+    p->size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    p->free = NULL;
+}
+
+void *pool_alloc(pool *p)
+{
+    void *obj = p->free;
+
+    if (NULL != obj) {
+        p->free = *(void**)obj;
+        return obj;
+    }
+
+    return arena_alloc(p->arena, p->size);
+}
+
+void pool_free(pool *p, void *obj)
+{
+    *(void**)obj = p->free;
+    p->free = obj;
+}
@@ -0,0 +1,101 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H 1
+
+#include <stddef.h>
+
+/**
+ * Region allocator for data that lives exactly as long as one job, like
+ * the symbols of an assembly run. Allocation bumps a pointer through a
+ * chain of chunks, nothing is ever freed on its own. arena_reset() drops
+ * everything in O(1) and keeps the chunks for the next job, so a
+ * long-running process stops calling malloc() once it has warmed up.
+ *
+ * A pool hands out objects of one size from an arena and recycles the
+ * ones given back through a free list, for data that comes and goes
+ * while the arena is in use. Pools are only valid until their arena is
+ * reset or destroyed.
+ */
+
+#define ARENA_CHUNK_SIZE 4096
+
+typedef struct _arena_chunk {
+    struct _arena_chunk *next;
+    size_t used;
+    size_t size;
+    max_align_t data[];
+} arena_chunk;
+
+typedef struct _arena {
+    arena_chunk *first;
+    arena_chunk *current;
+    size_t chunk_size;
+} arena;
+
+typedef struct _pool {
+    arena *arena;
+    size_t size;
+    void *free;                 // chain of released objects
+} pool;
+
+/**
+ * Initialize an empty arena. chunk_size is the payload size of each
+ * chunk, 0 selects ARENA_CHUNK_SIZE. No memory is allocated yet.
+ */
+void arena_init(arena *a, size_t chunk_size);
+
+/**
+ * Free all chunks of the arena and leave it empty.
+ */
+void arena_destroy(arena *a);
+
+/**
+ * Release every allocation at once. The chunks are kept and reused.
+ */
+void arena_reset(arena *a);
+
+/**
+ * Return size bytes of suitably aligned memory or NULL if out of
+ * memory. The memory stays valid until the arena is reset or destroyed.
+ */
+void *arena_alloc(arena *a, size_t size);
+
+/**
+ * Copy str into the arena. Returns NULL if out of memory.
+ */
+char *arena_strdup(arena *a, const char *str);
+
+/**
+ * Initialize a pool of objects of the given size, carved from a.
+ */
+void pool_init(pool *p, arena *a, size_t size);
+
+/**
+ * Return an object, preferably a released one, or NULL if out of memory.
+ */
+void *pool_alloc(pool *p);
+
+/**
+ * Give obj back to the pool for reuse.
+ */
+void pool_free(pool *p, void *obj);
+
+#endif /* ARENA_H */
@@ -0,0 +1,213 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "globals.h"
+#include "utils.h"
+#include "debuginfo.h"
+
+#define DBG_MAGIC "# vns debug info v1"
+
+void dbg_init(debuginfo *dbg, const char *source)
+{
+    memset(dbg, 0, sizeof(*dbg));
+
+    if (NULL != source) {
+        strncpy(dbg->source, source, DBG_MAX_PATH - 1);
+    }
+}
+
+/**
+ * Write debug information to *path*. The file format is plain text with
+ * one record per line, so it can be inspected and diffed easily:
+ *
+ *   # vns debug info v1
+ *   source <asmfile>
+ *   line <addr> <line>
+ *   label <addr> <name>
+ *
+ * Returns TRUE on success or FALSE on error.
+ */
+int dbg_write(const char *path, const debuginfo *dbg)
+{
+    int addr, i;
+    FILE *out;
+
+    if (NULL == (out = fopen(path, "w"))) {
+        perror(path);
+        return FALSE;
+    }
+
+    fprintf(out, "%s\n", DBG_MAGIC);
+    fprintf(out, "source %s\n", dbg->source);
+
+    for (addr = 0; addr < DBG_MEMORY_SIZE; ++addr) {
+        if (dbg->line[addr]) {
+            fprintf(out, "line 0x%.2X %u\n", addr, dbg->line[addr]);
+        }
+    }
+
+    for (i = 0; i < dbg->label_count; ++i) {
+        fprintf(out, "label 0x%.2X %s\n", dbg->labels[i].addr,
+                dbg->names + dbg->labels[i].name);
+    }
+
+    if (0 != fclose(out)) {
+        perror(path);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ * Read debug information from *path* into *dbg*. Unknown records are
+ * ignored. Returns TRUE on success or FALSE on error.
+ */
+int dbg_read(const char *path, debuginfo *dbg)
+{
+    char buf[DBG_MAX_PATH], name[DBG_MAX_PATH];
+    unsigned int addr, line;
+    size_t len;
+    FILE *in;
+
+    if (NULL == (in = fopen(path, "r"))) {
+        perror(path);
+        return FALSE;
+    }
+
+    dbg_init(dbg, NULL);
+
+    if (NULL == fgets(buf, sizeof(buf), in) ||
+            0 != strncmp(buf, DBG_MAGIC, strlen(DBG_MAGIC))) {
+        util_perror("%s: not a debug info file\n", path);
+        fclose(in);
+        return FALSE;
+    }
+
+    while (NULL != fgets(buf, sizeof(buf), in)) {
+        if (0 == strncmp(buf, "source ", 7)) {
+            snprintf(dbg->source, DBG_MAX_PATH, "%s", buf + 7);
+            len = strlen(dbg->source);
+            if (len && dbg->source[len - 1] == '\n') {
+                dbg->source[len - 1] = '\0';
+            }
+        } else
+        if (2 == sscanf(buf, "line %x %u", &addr, &line) &&
+                addr < DBG_MEMORY_SIZE) {
+            dbg->line[addr] = line;
+        } else
+        if (2 == sscanf(buf, "label %x %255s", &addr, name) &&
+                addr < DBG_MEMORY_SIZE) {
+            dbg_add_label(dbg, name, addr);
+        }
+    }
+
+    fclose(in);
+
+    return TRUE;
+}
+
+/**
+ * Add the label *name* at *addr*. The first label added for an address
+ * is the one shown for it. Returns FALSE if the tables are full.
+ */
+int dbg_add_label(debuginfo *dbg, const char *name, uint8_t addr)
+{
+    size_t len = strlen(name) + 1;
+    uint16_t current = 0;
+    int i;
+
+    if (dbg->label_count == DBG_MAX_LABELS ||
+            len > DBG_NAMES_SIZE - dbg->names_used) {
+        return FALSE;
+    }
+
+    memcpy(dbg->names + dbg->names_used, name, len);
+    dbg->labels[dbg->label_count].addr = addr;
+    dbg->labels[dbg->label_count].name = dbg->names_used;
+    dbg->names_used += len;
+    dbg->label_count++;
+
+    if (0 == dbg->label_at[addr]) {
+        dbg->label_at[addr] = dbg->label_count;
+    }
+
+    /* labels are few, rebuilding the whole table is cheap */
+    for (i = 0; i < DBG_MEMORY_SIZE; ++i) {
+        if (dbg->label_at[i]) {
+            current = dbg->label_at[i];
+        }
+        dbg->nearest[i] = current;
+    }
+
+    return TRUE;
+}
+
+/**
+ * Return the name of the label at *addr* or NULL.
+ */
+const char *dbg_label_at(const debuginfo *dbg, uint8_t addr)
+{
+    if (0 == dbg->label_at[addr]) {
+        return NULL;
+    }
+
+    return dbg->names + dbg->labels[dbg->label_at[addr] - 1].name;
+}
+
+/**
+ * Return the name of the closest label at or before *addr* and store
+ * the distance to it in *offset*. Returns NULL if there is none.
+ */
+const char *dbg_symbolize(const debuginfo *dbg, uint8_t addr,
+                          uint8_t *offset)
+{
+    const dbg_label *label;
+
+    if (0 == dbg->nearest[addr]) {
+        return NULL;
+    }
+
+    label = &dbg->labels[dbg->nearest[addr] - 1];
+    *offset = addr - label->addr;
+
+    return dbg->names + label->name;
+}
+
+/**
+ * Look up the address of the label *name*. Returns FALSE if there is no
+ * such label.
+ */
+int dbg_find_label(const debuginfo *dbg, const char *name, uint8_t *addr)
+{
+    int i;
+
+    for (i = 0; i < dbg->label_count; ++i) {
+        if (0 == strcmp(dbg->names + dbg->labels[i].name, name)) {
+            *addr = dbg->labels[i].addr;
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
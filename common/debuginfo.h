@@ -0,0 +1,68 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DEBUGINFO_H
+#define DEBUGINFO_H 1
+
+#include <stdint.h>
+
+#define DBG_MEMORY_SIZE  256
+#define DBG_MAX_PATH     256
+#define DBG_MAX_LABELS   512
+#define DBG_NAMES_SIZE   8192
+
+/* enough for "<source>:<line> <label>+<offset>" */
+#define DBG_LOCATION_SIZE (2 * DBG_MAX_PATH + 16)
+
+typedef struct _dbg_label {
+    uint8_t addr;
+    uint16_t name;              // offset into debuginfo.names
+} dbg_label;
+
+/**
+ * Debug information written by the assembler. It maps each address
+ * holding the first byte of an instruction to its source line.
+ * A line of 0 means that no line is known for that address.
+ *
+ * It also holds the labels of the program. *label_at* and *nearest*
+ * are kept up to date by dbg_add_label(), so symbolizing an address
+ * is a table lookup. The structure contains no pointers and may be
+ * copied freely.
+ */
+typedef struct _debuginfo {
+    char source[DBG_MAX_PATH];
+    uint16_t line[DBG_MEMORY_SIZE];
+    uint16_t label_at[DBG_MEMORY_SIZE]; // 1 + first label at address, or 0
+    uint16_t nearest[DBG_MEMORY_SIZE];  // 1 + label at or before, or 0
+    dbg_label labels[DBG_MAX_LABELS];
+    uint16_t label_count;
+    uint16_t names_used;
+    char names[DBG_NAMES_SIZE];
+} debuginfo;
+
+void dbg_init(debuginfo *dbg, const char *source);
+int dbg_write(const char *path, const debuginfo *dbg);
+int dbg_read(const char *path, debuginfo *dbg);
+int dbg_add_label(debuginfo *dbg, const char *name, uint8_t addr);
+const char *dbg_label_at(const debuginfo *dbg, uint8_t addr);
+const char *dbg_symbolize(const debuginfo *dbg, uint8_t addr,
+                          uint8_t *offset);
+int dbg_find_label(const debuginfo *dbg, const char *name, uint8_t *addr);
+
+#endif /* DEBUGINFO_H */
@@ -0,0 +1,162 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+
+#include "instructionset.h"
+#include "disasm.h"
+
+#define OP_LDA  0x3a
+#define OP_STA  0x32
+
+/**
+ * Separate code from data by following the control flow from *entry*.
+ * Jump and call targets are followed, calls are assumed to return.
+ * Illegal opcodes and instructions wrapping around the end of memory
+ * end a path. Fills *cell* with DIS_CELL_* flags and returns the number
+ * of instructions found.
+ */
+int dis_discover(const uint8_t *mem, uint8_t entry, uint8_t *cell)
+{
+    const vns_instruction *ins;
+    uint8_t todo[DIS_MEMORY_SIZE], addr, arg;
+    int top = 0, count = 0, target, i;
+
+    memset(cell, 0, DIS_MEMORY_SIZE);
+    todo[top++] = entry;
+
+    while (top > 0) {
+        addr = todo[--top];
+
+        while (!(cell[addr] & DIS_CELL_CODE)) {
+            ins = is_find_opcode(mem[addr]);
+            if (NULL == ins || addr + ins->length > DIS_MEMORY_SIZE) {
+                break;
+            }
+
+            cell[addr] |= DIS_CELL_CODE;
+            for (i = 1; i < ins->length; ++i) {
+                cell[addr + i] |= DIS_CELL_OPERAND;
+            }
+            count++;
+
+            arg = mem[(uint8_t)(addr + 1)];
+            target = 0;
+
+            switch (ins->flow) {
+                case IS_FLOW_JUMP:
+                case IS_FLOW_COND_JUMP:
+                    target = DIS_CELL_JUMP;
+                    break;
+                case IS_FLOW_CALL:
+                case IS_FLOW_COND_CALL:
+                    target = DIS_CELL_CALL;
+                    break;
+                default:
+                    if (OP_LDA == ins->opcode || OP_STA == ins->opcode) {
+                        cell[arg] |= DIS_CELL_DATA;
+                    }
+                    break;
+            }
+
+            /**
+             * Each instruction is decoded once and pushes at most one
+             * target. Branches take two bytes, so the stack holds at most
+             * 129 entries.
+             */
+            if (target) {
+                cell[arg] |= target;
+                if (!(cell[arg] & DIS_CELL_CODE)) {
+                    todo[top++] = arg;
+                }
+            }
+
+            if (IS_FLOW_JUMP == ins->flow || IS_FLOW_RET == ins->flow ||
+                    IS_FLOW_HALT == ins->flow) {
+                break;
+            }
+
+            addr += ins->length;
+        }
+    }
+
+    return count;
+}
+
+static int format_arg(char *buf, size_t size, argtype at, uint8_t arg,
+                      const char *const *labels)
+{
+    switch (at) {
+        case AT_REG_A:  return snprintf(buf, size, "a");
+        case AT_REG_L:  return snprintf(buf, size, "l");
+        case AT_REG_FL: return snprintf(buf, size, "fl");
+        case AT_REG_SP: return snprintf(buf, size, "sp");
+        case AT_MEM:    return snprintf(buf, size, "m");
+        case AT_ADDR:
+            if (NULL != labels && NULL != labels[arg]) {
+                return snprintf(buf, size, "%s", labels[arg]);
+            }
+            /* fall through */
+        default:
+            return snprintf(buf, size, "0x%.2X", arg);
+    }
+}
+
+/**
+ * Write the instruction at *addr* in assembler syntax to *buf*. Branch
+ * targets and LDA/STA addresses are replaced by the names in *labels*
+ * (may be NULL) if set, port numbers never are. Returns the length of
+ * the instruction or 0 for illegal opcodes.
+ */
+int dis_format(const uint8_t *mem, uint8_t addr,
+               const char *const *labels, char *buf, size_t size)
+{
+    const vns_instruction *ins = is_find_opcode(mem[addr]);
+    uint8_t arg = mem[(uint8_t)(addr + 1)];
+    int n, i;
+
+    if (NULL == ins) {
+        snprintf(buf, size, ".byte 0x%.2X", mem[addr]);
+        return 0;
+    }
+
+    if (IS_FLOW_NONE == ins->flow &&
+            OP_LDA != ins->opcode && OP_STA != ins->opcode) {
+        labels = NULL;
+    }
+
+    for (n = 0, i = 0; ins->mnemonic[i] && n < (int)size - 1; ++i) {
+        buf[n++] = ins->mnemonic[i] | 0x20;
+    }
+    buf[n] = '\0';
+
+    if (AT_NONE != ins->at1 && n < (int)size) {
+        n += snprintf(buf + n, size - n, " ");
+        n += format_arg(buf + n, size - n, ins->at1, arg, labels);
+    }
+
+    if (AT_NONE != ins->at2 && n < (int)size) {
+        n += snprintf(buf + n, size - n, ", ");
+        format_arg(buf + n, size - n, ins->at2, arg, labels);
+    }
+
+    return ins->length;
+}
@@ -0,0 +1,40 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+#ifndef DISASM_H
+#define DISASM_H 1
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define DIS_MEMORY_SIZE  256
+
+/* classification of memory cells */
+#define DIS_CELL_CODE     0x01    // first byte of a reachable instruction
+#define DIS_CELL_OPERAND  0x02    // operand byte of a reachable instruction
+#define DIS_CELL_JUMP     0x04    // target of a jump
+#define DIS_CELL_CALL     0x08    // target of a call
+#define DIS_CELL_DATA     0x10    // address of LDA or STA
+
+int dis_discover(const uint8_t *mem, uint8_t entry, uint8_t *cell);
+int dis_format(const uint8_t *mem, uint8_t addr,
+               const char *const *labels, char *buf, size_t size);
+
+#endif /* DISASM_H */
@@ -0,0 +1,533 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "globals.h"
+#include "utils.h"
+#include "image.h"
+
+static uint16_t get16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void put16(uint8_t *p, uint16_t value)
+{
+    p[0] = value & 0xff;
+    p[1] = value >> 8;
+}
+
+static void put32(uint8_t *p, uint32_t value)
+{
+    put16(p, value & 0xffff);
+    put16(p + 2, value >> 16);
+}
+
+/**
+ * Update the CRC-32 *crc* with *size* bytes of *data*. Start with 0, the
+ * result of one call can be passed to the next to checksum several
+ * blocks.
+ */
+uint32_t img_crc32(uint32_t crc, const uint8_t *data, size_t size)
+{
+    int bit;
+
+    crc = ~crc;
+
+    while (size--) {
+        crc ^= *data++;
+        for (bit = 0; bit < 8; ++bit) {
+            crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+        }
+    }
+
+    return ~crc;
+}
+
+/**
+ * Check the container header and walk all segments and symbols once so
+ * later accesses need no bounds checks. Returns TRUE if *img* is valid.
+ */
+static int validate(vns_image *img)
+{
+    const uint8_t *p, *end = img->base + img->size;
+    uint16_t i, length;
+
+    if (img->size < IMG_HEADER_SIZE) {
+        return FALSE;
+    }
+
+    img->version = img->base[4];
+    img->entry = img->base[5];
+    img->segment_count = get16(img->base + 6);
+    img->symbol_count = get16(img->base + 8);
+
+    if (IMG_VERSION != img->version ||
+            get32(img->base + 12) != img_crc32(0, img->base + IMG_HEADER_SIZE,
+                                              img->size - IMG_HEADER_SIZE)) {
+        return FALSE;
+    }
+
+    p = img->segments = img->base + IMG_HEADER_SIZE;
+    for (i = 0; i < img->segment_count; ++i) {
+        if (end - p < 4) {
+            return FALSE;
+        }
+        length = get16(p + 2);
+        if (p[0] + length > IMG_MEMORY_SIZE || end - p - 4 < length ||
+                p[1] >= IMG_MAX_BANKS || (p[1] && p[0] < IMG_BANK_BASE)) {
+            return FALSE;
+        }
+        p += 4 + length;
+    }
+
+    img->symbols = p;
+    for (i = 0; i < img->symbol_count; ++i) {
+        if (end - p < 2 || end - p - 2 < p[1]) {
+            return FALSE;
+        }
+        p += 2 + p[1];
+    }
+
+    return p == end;
+}
+
+/**
+ * Determine the format of the image data in *img* and validate
+ * containers. *name* is only used for error messages.
+ */
+static int detect(vns_image *img, const char *name)
+{
+    if (img->size < 4 || 0 != memcmp(img->base, IMG_MAGIC, 4)) {
+        img->format = IMG_RAW;
+        return TRUE;
+    }
+
+    img->format = IMG_CONTAINER;
+    if (!validate(img)) {
+        util_perror("%s: corrupt or unsupported program image\n", name);
+        img_close(img);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ * Read a stream that cannot be mapped (pipe, terminal, socket) up to
+ * its end into an allocated buffer.
+ */
+static int read_stream(int fd, vns_image *img)
+{
+    uint8_t *base = NULL, *larger;
+    size_t size = 0, capacity = 0;
+    ssize_t count;
+
+    for (;;) {
+        if (size == capacity) {
+            capacity = capacity ? capacity * 2 : 4096;
+            if (capacity > IMG_MAX_STREAM) {
+                errno = EFBIG;
+            }
+            if (capacity > IMG_MAX_STREAM ||
+                    NULL == (larger = realloc(base, capacity))) {
+                free(base);
+                return FALSE;
+            }
+            base = larger;
+        }
+        count = read(fd, base + size, capacity - size);
+        if (0 == count) {
+            break;
+        }
+        if (-1 == count) {
+            free(base);
+            return FALSE;
+        }
+        size += count;
+    }
+
+    img->base = base;
+    img->size = size;
+    img->storage = IMG_ALLOCATED;
+
+    return TRUE;
+}
+
+/**
+ * Open the image file *path* and determine its format. Regular files
+ * are mapped, other files such as pipes are read completely, "-" is
+ * standard input. Files starting with the container magic must be
+ * valid containers, everything else is taken as raw memory dump.
+ * Returns TRUE on success.
+ */
+int img_open(const char *path, vns_image *img)
+{
+    struct stat st;
+    void *base;
+    int fd, ok = TRUE;
+
+    memset(img, 0, sizeof(*img));
+
+    if (0 == strcmp(path, "-")) {
+        fd = STDIN_FILENO;
+    } else if (-1 == (fd = open(path, O_RDONLY))) {
+        perror(path);
+        return FALSE;
+    }
+
+    if (-1 == fstat(fd, &st)) {
+        ok = FALSE;
+    } else if (!S_ISREG(st.st_mode)) {
+        ok = read_stream(fd, img);
+    } else if (st.st_size > 0) {
+        base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (MAP_FAILED == base) {
+            ok = FALSE;
+        } else {
+            img->base = base;
+            img->size = st.st_size;
+            img->storage = IMG_MAPPED;
+        }
+    }
+
+    if (!ok) {
+        perror(path);
+    }
+    if (STDIN_FILENO != fd) {
+        close(fd);
+    }
+
+    return ok && detect(img, path);
+}
+
+/**
+ * Open *size* bytes of image data at *data*, e.g. produced by
+ * img_encode(). The data is not copied and must outlive the image.
+ */
+int img_open_memory(const uint8_t *data, size_t size, const char *name,
+                    vns_image *img)
+{
+    memset(img, 0, sizeof(*img));
+
+    img->base = data;
+    img->size = size;
+    img->storage = IMG_BORROWED;
+
+    return detect(img, name);
+}
+
+void img_close(vns_image *img)
+{
+    if (NULL != img->base) {
+        if (IMG_MAPPED == img->storage) {
+            munmap((void*)img->base, img->size);
+        } else if (IMG_ALLOCATED == img->storage) {
+            free((void*)img->base);
+        }
+    }
+    memset(img, 0, sizeof(*img));
+}
+
+/**
+ * Copy the image into the memory unit *mem*. Raw images are placed at
+ * *offset*, container segments at their own addresses. Segments of
+ * banks other than 0 are left to img_load_bank(). Returns the number of
+ * bytes loaded.
+ */
+int img_load(const vns_image *img, uint8_t *mem, uint8_t offset)
+{
+    const uint8_t *p = img->segments;
+    int i, length, loaded = 0;
+
+    if (IMG_RAW == img->format) {
+        loaded = IMG_MEMORY_SIZE - offset;
+        if (img->size < loaded) {
+            loaded = img->size;
+        }
+        memcpy(mem + offset, img->base, loaded);
+        return loaded;
+    }
+
+    for (i = 0; i < img->segment_count; ++i) {
+        length = get16(p + 2);
+        if (0 == p[1]) {
+            memcpy(mem + p[0], p + 4, length);
+            loaded += length;
+        }
+        p += 4 + length;
+    }
+
+    return loaded;
+}
+
+/**
+ * Copy the segments of *bank* (1 or higher) into *window*, which holds
+ * the IMG_BANK_SIZE bytes of the bank from IMG_BANK_BASE on. Returns
+ * the number of bytes loaded.
+ */
+int img_load_bank(const vns_image *img, uint8_t *window, uint8_t bank)
+{
+    const uint8_t *p = img->segments;
+    int i, length, loaded = 0;
+
+    if (IMG_CONTAINER != img->format) {
+        return 0;
+    }
+
+    for (i = 0; i < img->segment_count; ++i) {
+        length = get16(p + 2);
+        if (bank == p[1]) {
+            memcpy(window + p[0] - IMG_BANK_BASE, p + 4, length);
+            loaded += length;
+        }
+        p += 4 + length;
+    }
+
+    return loaded;
+}
+
+/**
+ * Return the number of banks the image needs, 1 for images without
+ * bank switching.
+ */
+int img_bank_count(const vns_image *img)
+{
+    const uint8_t *p = img->segments;
+    int i, count = 1;
+
+    if (IMG_CONTAINER != img->format) {
+        return count;
+    }
+
+    for (i = 0; i < img->segment_count; ++i) {
+        if (p[1] >= count) {
+            count = p[1] + 1;
+        }
+        p += 4 + get16(p + 2);
+    }
+
+    return count;
+}
+
+/**
+ * Set the cells of *used* that img_load() writes with the same *offset*
+ * to TRUE and all others to FALSE.
+ */
+void img_used(const vns_image *img, uint8_t *used, uint8_t offset)
+{
+    const uint8_t *p = img->segments;
+    int i, length;
+
+    memset(used, FALSE, IMG_MEMORY_SIZE);
+
+    if (IMG_RAW == img->format) {
+        length = IMG_MEMORY_SIZE - offset;
+        if (img->size < length) {
+            length = img->size;
+        }
+        memset(used + offset, TRUE, length);
+        return;
+    }
+
+    for (i = 0; i < img->segment_count; ++i) {
+        length = get16(p + 2);
+        if (0 == p[1]) {
+            memset(used + p[0], TRUE, length);
+        }
+        p += 4 + length;
+    }
+}
+
+/**
+ * Iterate the label table. *cursor* must be NULL for the first call.
+ * Returns FALSE once all symbols have been read, otherwise the address
+ * and the zero terminated name (up to IMG_MAX_NAME characters) are
+ * stored in *addr* and *name*.
+ */
+int img_next_symbol(const vns_image *img, const uint8_t **cursor,
+                    uint8_t *addr, char *name)
+{
+    const uint8_t *p = (NULL == *cursor) ? img->symbols : *cursor;
+
+    if (IMG_CONTAINER != img->format || p >= img->base + img->size) {
+        return FALSE;
+    }
+
+    *addr = p[0];
+    memcpy(name, p + 2, p[1]);
+    name[p[1]] = '\0';
+    *cursor = p + 2 + p[1];
+
+    return TRUE;
+}
+
+static int name_length(const char *name)
+{
+    size_t len = strlen(name);
+    return (len > IMG_MAX_NAME) ? IMG_MAX_NAME : len;
+}
+
+/**
+ * Append a load segment for each run of used bytes of the *size* bytes
+ * at *mem*, the first of which is at address *base* of *bank*. Returns
+ * the end of the segments written to *p*.
+ */
+static uint8_t *encode_segments(uint8_t *p, const uint8_t *mem,
+                                const uint8_t *used, int size, uint8_t base,
+                                uint8_t bank, uint16_t *segments)
+{
+    int addr, start;
+
+    for (addr = 0; addr < size; ) {
+        if (!used[addr]) {
+            addr++;
+            continue;
+        }
+        for (start = addr; addr < size && used[addr]; ++addr);
+        p[0] = base + start;
+        p[1] = bank;
+        put16(p + 2, addr - start);
+        memcpy(p + 4, mem + start, addr - start);
+        p += 4 + addr - start;
+        (*segments)++;
+    }
+
+    return p;
+}
+
+/**
+ * Encode a container image of all bytes of *mem* marked in *used*. Each
+ * run of used bytes becomes a load segment. On success the allocated
+ * image is stored in *data* and *size* and TRUE is returned.
+ */
+int img_encode(const uint8_t *mem, const uint8_t *used, uint8_t entry,
+               const img_symbol *symbols, int count,
+               uint8_t **data, size_t *size)
+{
+    return img_encode_banked(mem, used, 1, entry, symbols, count, data, size);
+}
+
+/**
+ * Like img_encode(), for a program spread over *bank_count* banks.
+ * *mem* and *used* hold the memory unit with bank 0 in its window,
+ * followed by the IMG_BANK_SIZE bytes of the window of each further
+ * bank.
+ */
+int img_encode_banked(const uint8_t *mem, const uint8_t *used,
+                      int bank_count, uint8_t entry,
+                      const img_symbol *symbols, int count,
+                      uint8_t **data, size_t *size)
+{
+    uint8_t *buf, *p;
+    size_t names_size = 0;
+    uint16_t segments = 0;
+    int bank, i, len;
+
+    for (i = 0; i < count; ++i) {
+        names_size += 2 + name_length(symbols[i].name);
+    }
+
+    buf = malloc(IMG_HEADER_SIZE + 3 * IMG_MEMORY_SIZE +
+                 3 * IMG_BANK_SIZE * (bank_count - 1) + names_size);
+    if (NULL == buf) {
+        return FALSE;
+    }
+
+    p = encode_segments(buf + IMG_HEADER_SIZE, mem, used, IMG_MEMORY_SIZE,
+                        0, 0, &segments);
+    for (bank = 1; bank < bank_count; ++bank) {
+        i = IMG_MEMORY_SIZE + (bank - 1) * IMG_BANK_SIZE;
+        p = encode_segments(p, mem + i, used + i, IMG_BANK_SIZE,
+                            IMG_BANK_BASE, bank, &segments);
+    }
+
+    for (i = 0; i < count; ++i) {
+        len = name_length(symbols[i].name);
+        p[0] = symbols[i].addr;
+        p[1] = len;
+        memcpy(p + 2, symbols[i].name, len);
+        p += 2 + len;
+    }
+
+    memcpy(buf, IMG_MAGIC, 4);
+    buf[4] = IMG_VERSION;
+    buf[5] = entry;
+    put16(buf + 6, segments);
+    put16(buf + 8, count);
+    put16(buf + 10, 0);
+
+    /* the checksum covers segments and symbols */
+    put32(buf + 12, img_crc32(0, buf + IMG_HEADER_SIZE,
+                              p - buf - IMG_HEADER_SIZE));
+
+    *data = buf;
+    *size = p - buf;
+
+    return TRUE;
+}
+
+/**
+ * Write a container image (see img_encode()) to *path*, "-" is standard
+ * output. Returns TRUE on success.
+ */
+int img_write(const char *path, const uint8_t *mem, const uint8_t *used,
+              uint8_t entry, const img_symbol *symbols, int count)
+{
+    uint8_t *data;
+    size_t size;
+    FILE *out;
+    int ok;
+
+    if (!img_encode(mem, used, entry, symbols, count, &data, &size)) {
+        perror(path);
+        return FALSE;
+    }
+
+    if (NULL == (out = util_fopen(path, "w"))) {
+        perror(path);
+        free(data);
+        return FALSE;
+    }
+
+    ok = (1 == fwrite(data, size, 1, out));
+    ok = (0 == util_fclose(out)) && ok;
+
+    if (!ok) {
+        perror(path);
+    }
+
+    free(data);
+
+    return ok;
+}
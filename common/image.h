@@ -0,0 +1,112 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+#ifndef IMAGE_H
+#define IMAGE_H 1
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Program images come in two formats. Raw images are plain memory dumps
+ * as used by the real machine. Container images start with a header and
+ * carry sparse load segments, the entry address and the label table:
+ *
+ *   0   "VNSI"                 magic
+ *   4   u8  version            IMG_VERSION
+ *   5   u8  entry              initial program counter
+ *   6   u16 segment count
+ *   8   u16 symbol count
+ *   10  u16 reserved
+ *   12  u32 checksum           CRC-32 of everything after the header
+ *   16  segments               u8 addr, u8 bank, u16 length, data
+ *   ..  symbols                u8 addr, u8 name length, name
+ *
+ * All numbers are little endian.
+ *
+ * Machines with bank switching map one of several banks into the upper
+ * half of the memory unit, the bank window. Segments of bank 0 may be
+ * anywhere, segments of other banks must lie inside the window. Images
+ * without banks are the same as before banks were introduced.
+ */
+#define IMG_MAGIC           "VNSI"
+#define IMG_VERSION         1
+#define IMG_HEADER_SIZE     16
+#define IMG_MEMORY_SIZE     256
+#define IMG_MAX_NAME        255
+
+#define IMG_BANK_BASE       0x80
+#define IMG_BANK_SIZE       (IMG_MEMORY_SIZE - IMG_BANK_BASE)
+#define IMG_MAX_BANKS       16
+
+#define IMG_MAX_STREAM      (1 << 20)
+
+#define IMG_RAW             0
+#define IMG_CONTAINER       1
+
+#define IMG_MAPPED          0
+#define IMG_ALLOCATED       1
+#define IMG_BORROWED        2
+
+typedef struct _img_symbol {
+    const char *name;
+    uint8_t addr;
+} img_symbol;
+
+/**
+ * An opened image. All pointers refer into the mapped file (or the
+ * buffer a stream was read into), nothing is copied until img_load()
+ * puts the segments into a memory unit.
+ */
+typedef struct _vns_image {
+    const uint8_t *base;
+    size_t size;
+    uint8_t storage;            // IMG_MAPPED, IMG_ALLOCATED or IMG_BORROWED
+    uint8_t format;
+    uint8_t version;
+    uint8_t entry;
+    uint16_t segment_count;
+    uint16_t symbol_count;
+    const uint8_t *segments;
+    const uint8_t *symbols;
+} vns_image;
+
+int img_open(const char *path, vns_image *img);
+int img_open_memory(const uint8_t *data, size_t size, const char *name,
+                    vns_image *img);
+void img_close(vns_image *img);
+int img_load(const vns_image *img, uint8_t *mem, uint8_t offset);
+int img_load_bank(const vns_image *img, uint8_t *window, uint8_t bank);
+int img_bank_count(const vns_image *img);
+void img_used(const vns_image *img, uint8_t *used, uint8_t offset);
+int img_next_symbol(const vns_image *img, const uint8_t **cursor,
+                    uint8_t *addr, char *name);
+int img_encode(const uint8_t *mem, const uint8_t *used, uint8_t entry,
+               const img_symbol *symbols, int count,
+               uint8_t **data, size_t *size);
+int img_encode_banked(const uint8_t *mem, const uint8_t *used,
+                      int bank_count, uint8_t entry,
+                      const img_symbol *symbols, int count,
+                      uint8_t **data, size_t *size);
+int img_write(const char *path, const uint8_t *mem, const uint8_t *used,
+              uint8_t entry, const img_symbol *symbols, int count);
+uint32_t img_crc32(uint32_t crc, const uint8_t *data, size_t size);
+
+#endif /* IMAGE_H */
@@ -34,15 +34,73 @@ typedef uint8_t argtype;
 #define AT_MEM      0x40
 #define AT_LABEL    0x83    // set AT_INT, AT_ADDR too 
 
+/* flags, same bits as in the flag register */
+#define IS_F_C      0x01
+#define IS_F_Z      0x40
+#define IS_F_S      0x80
+#define IS_F_ALL    (IS_F_C | IS_F_Z | IS_F_S)
+
+/* control flow classes */
+#define IS_FLOW_NONE        0x00    // continues with the next instruction
+#define IS_FLOW_JUMP        0x01
+#define IS_FLOW_COND_JUMP   0x02
+#define IS_FLOW_CALL        0x03
+#define IS_FLOW_COND_CALL   0x04
+#define IS_FLOW_RET         0x05
+#define IS_FLOW_HALT        0x06
+
+/* longest mnemonic and most variants of one mnemonic */
+#define IS_MNEMONIC_MAX     4
+#define IS_VARIANTS_MAX     5
+
 typedef struct _vns_instruction {
-    const char *mnemonic;
+    const char *mnemonic;       // NULL for illegal opcodes
     argtype at1;
     argtype at2;
     uint8_t opcode;
+    uint8_t length;             // in bytes, including operands
+    uint8_t cycles;
+    uint8_t flags_read;
+    uint8_t flags_written;
+    uint8_t flow;
 } vns_instruction;
 
+/* a mnemonic with the opcodes of all its variants */
+typedef struct _vns_mnemonic {
+    const char *name;
+    uint8_t count;
+    uint8_t opcodes[IS_VARIANTS_MAX];
+} vns_mnemonic;
+
+/**
+ * Hash of a mnemonic, used for the perfect hash isgen searches. Letters
+ * are folded to upper case, other characters only have to hash to
+ * something.
+ */
+static inline unsigned int is_hash(const char *str, unsigned int seed,
+                                   unsigned int size)
+{
+    unsigned int h = seed;
+
+    while (*str) {
+        h = (h ^ (uint8_t)(*str++ & ~0x20)) * 16777619u;
+    }
+
+    return (h ^ (h >> 15)) % size;
+}
+
+/* tables generated by isgen from instructionset.def */
+extern const vns_instruction is_opcode_table[256];
+extern const vns_mnemonic is_mnemonic_table[];
+extern const int8_t is_mnemonic_hash[];
+extern const unsigned int is_hash_size;
+extern const unsigned int is_hash_seed;
+
 int is_lookup_mnemonic_name(const char *str);
-vns_instruction *is_find_mnemonic(const char *mnemonic, argtype at1, argtype at2);
-vns_instruction *is_find_opcode(uint8_t opcode);
+const vns_instruction *is_find_mnemonic(const char *mnemonic,
+                                        argtype at1, argtype at2);
+const vns_instruction *is_find_opcode(uint8_t opcode);
+uint8_t is_instruction_length(const vns_instruction *ins);
+unsigned long is_lookup_count(void);
 
 #endif /* INSTRUCTIONSET_H */
@@ -0,0 +1,246 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+/**
+ * Generates the decode tables from instructionset.def: a dense table
+ * indexed by opcode and a perfect hash over the mnemonics. Run at
+ * build time, writes C source to stdout.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "instructionset.h"
+
+typedef struct _def {
+    const char *mnemonic;
+    argtype at1;
+    argtype at2;
+    unsigned int opcode;
+    unsigned int cycles;
+    unsigned int reads;
+    unsigned int writes;
+    unsigned int flow;
+} def;
+
+static const def defs[] = {
+#define INS(m, a1, a2, op, cy, rd, wr, fl) \
+    { m, a1, a2, op, cy, rd, wr, IS_FLOW_##fl },
+#include "instructionset.def"
+#undef INS
+};
+
+#define DEF_COUNT (sizeof(defs) / sizeof(def))
+#define SEED_TRIES 1000000
+
+static const char *names[DEF_COUNT];
+static unsigned int name_count;
+static int slot[256];
+
+static int namecmp(const void *a, const void *b)
+{
+    return strcmp(*(const char**)a, *(const char**)b);
+}
+
+static const char *argtype_name(argtype at)
+{
+    switch (at) {
+        case AT_NONE:   return "AT_NONE";
+        case AT_INT:    return "AT_INT";
+        case AT_ADDR:   return "AT_ADDR";
+        case AT_REG_A:  return "AT_REG_A";
+        case AT_REG_L:  return "AT_REG_L";
+        case AT_REG_FL: return "AT_REG_FL";
+        case AT_REG_SP: return "AT_REG_SP";
+        case AT_MEM:    return "AT_MEM";
+    }
+
+    return "AT_NONE";
+}
+
+static const char *flow_name(unsigned int flow)
+{
+    static const char *flows[] = {
+        "IS_FLOW_NONE", "IS_FLOW_JUMP", "IS_FLOW_COND_JUMP", "IS_FLOW_CALL",
+        "IS_FLOW_COND_CALL", "IS_FLOW_RET", "IS_FLOW_HALT"
+    };
+
+    return flows[flow];
+}
+
+static unsigned int length(const def *d)
+{
+    return 1 + ((d->at1 & AT_INT) ? 1 : 0) + ((d->at2 & AT_INT) ? 1 : 0);
+}
+
+/* collect the distinct mnemonics in sorted order */
+static int collect_names(void)
+{
+    const def *by_opcode[256] = { NULL };
+    unsigned int i, j;
+
+    for (i = 0; i < DEF_COUNT; ++i) {
+        if (NULL != by_opcode[defs[i].opcode]) {
+            fprintf(stderr, "isgen: opcode 0x%.2x defined twice\n",
+                    defs[i].opcode);
+            return 0;
+        }
+        by_opcode[defs[i].opcode] = &defs[i];
+
+        if (strlen(defs[i].mnemonic) > IS_MNEMONIC_MAX) {
+            fprintf(stderr, "isgen: mnemonic %s too long\n", defs[i].mnemonic);
+            return 0;
+        }
+
+        for (j = 0; j < name_count; ++j) {
+            if (0 == strcmp(names[j], defs[i].mnemonic)) {
+                break;
+            }
+        }
+        if (j == name_count) {
+            names[name_count++] = defs[i].mnemonic;
+        }
+    }
+
+    qsort(names, name_count, sizeof(names[0]), namecmp);
+    return 1;
+}
+
+/* find a seed that maps all mnemonics to distinct slots */
+static int find_seed(unsigned int size, unsigned int *seed)
+{
+    unsigned int s, i, h;
+
+    for (s = 0; s < SEED_TRIES; ++s) {
+        for (i = 0; i < size; ++i) {
+            slot[i] = -1;
+        }
+        for (i = 0; i < name_count; ++i) {
+            h = is_hash(names[i], s, size);
+            if (slot[h] >= 0) {
+                break;
+            }
+            slot[h] = i;
+        }
+        if (i == name_count) {
+            *seed = s;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static void print_opcode_table(void)
+{
+    const def *d;
+    unsigned int op, i;
+
+    printf("const vns_instruction is_opcode_table[256] = {\n");
+
+    for (op = 0; op < 256; ++op) {
+        for (d = NULL, i = 0; i < DEF_COUNT; ++i) {
+            if (defs[i].opcode == op) {
+                d = &defs[i];
+            }
+        }
+
+        if (NULL == d) {
+            printf("    { NULL, AT_NONE, AT_NONE, 0x%.2x, 1, 0, 0, 0, "
+                   "IS_FLOW_NONE },\n", op);
+            continue;
+        }
+
+        printf("    { \"%s\", %s, %s, 0x%.2x, %u, %u, 0x%.2x, 0x%.2x, %s },\n",
+               d->mnemonic, argtype_name(d->at1), argtype_name(d->at2),
+               op, length(d), d->cycles, d->reads, d->writes,
+               flow_name(d->flow));
+    }
+
+    printf("};\n\n");
+}
+
+static int print_mnemonic_table(void)
+{
+    unsigned int i, j, n;
+
+    printf("const vns_mnemonic is_mnemonic_table[%u] = {\n", name_count);
+
+    for (i = 0; i < name_count; ++i) {
+        printf("    { \"%s\", ", names[i]);
+        for (n = 0, j = 0; j < DEF_COUNT; ++j) {
+            n += (0 == strcmp(names[i], defs[j].mnemonic));
+        }
+        if (n > IS_VARIANTS_MAX) {
+            fprintf(stderr, "isgen: too many variants of %s\n", names[i]);
+            return 0;
+        }
+        printf("%u, {", n);
+        for (n = 0, j = 0; j < DEF_COUNT; ++j) {
+            if (0 == strcmp(names[i], defs[j].mnemonic)) {
+                printf("%s0x%.2x", (n++) ? ", " : " ", defs[j].opcode);
+            }
+        }
+        printf(" } },\n");
+    }
+
+    printf("};\n\n");
+    return 1;
+}
+
+int main(void)
+{
+    unsigned int size, seed, i;
+
+    if (!collect_names()) {
+        return EXIT_FAILURE;
+    }
+
+    /* the smallest power of two that still allows a perfect hash */
+    for (size = 1; size < name_count; size <<= 1);
+    while (!find_seed(size, &seed)) {
+        size <<= 1;
+        if (size > 256) {
+            fprintf(stderr, "isgen: no perfect hash found\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    printf("/* Generated by isgen from instructionset.def, do not edit. */\n\n");
+    printf("#include <stddef.h>\n\n");
+    printf("#include \"instructionset.h\"\n\n");
+
+    print_opcode_table();
+    if (!print_mnemonic_table()) {
+        return EXIT_FAILURE;
+    }
+
+    printf("const int8_t is_mnemonic_hash[%u] = {", size);
+    for (i = 0; i < size; ++i) {
+        printf("%s%3i,", (i % 16) ? " " : "\n    ", slot[i]);
+    }
+    printf("\n};\n\n");
+
+    printf("const unsigned int is_hash_size = %u;\n", size);
+    printf("const unsigned int is_hash_seed = %u;\n", seed);
+
+    return EXIT_SUCCESS;
+}
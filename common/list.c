@@ -23,10 +23,11 @@
 #include "globals.h"
 #include "list.h"
 
-void list_init(list *l)
+void list_init(list *l, pool *nodes)
 {
     l->length = 0;
     l->head = NULL;
+    l->nodes = nodes;
 }
 
 void list_destroy(list *l)
@@ -36,9 +37,19 @@ void list_destroy(list *l)
     }
 }
 
-void list_insert(list *l, list_item *at, void *payload, free_function *f)
+int list_insert(list *l, list_item *at, void *payload, free_function *f)
 {
-    list_item *new_item = malloc(sizeof(*new_item));
+    list_item *new_item;
+
+    if (NULL != l->nodes) {
+        new_item = pool_alloc(l->nodes);
+    } else {
+        new_item = malloc(sizeof(*new_item));
+    }
+
+    if (NULL == new_item) {
+        return FALSE;
+    }
 
     new_item->payload = payload;
     new_item->free_func = f;
@@ -55,7 +66,12 @@ void list_insert(list *l, list_item *at, void *payload, free_function *f)
         at->next = new_item;
     }
 
+    if (NULL != new_item->next) {
+        new_item->next->prev = new_item;
+    }
+
     l->length++;
+    return TRUE;
 }
 
 void list_remove(list *l, list_item *item)
@@ -64,6 +80,9 @@ void list_remove(list *l, list_item *item)
         l->head = item->next;
     } else {
         item->prev->next = item->next;
+    }
+
+    if (NULL != item->next) {
         item->next->prev = item->prev;
     }
 
@@ -71,6 +90,10 @@ void list_remove(list *l, list_item *item)
         item->free_func(item->payload);
     }
 
-    free(item);
+    if (NULL != l->nodes) {
+        pool_free(l->nodes, item);
+    } else {
+        free(item);
+    }
     l->length--;
 }
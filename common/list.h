@@ -20,6 +20,8 @@
 #ifndef LIST_H
 #define LIST_H 1
 
+#include "arena.h"
+
 typedef void free_function(void *);
 
 typedef struct _list_item {
@@ -32,11 +34,22 @@ typedef struct _list_item {
 typedef struct _list {
     list_item *head;
     unsigned int length;
+    pool *nodes;                // NULL: nodes come from malloc()
 } list;
 
-void list_init(list *l);
+/**
+ * Initialize an empty list. Its nodes are taken from nodes, which must
+ * have been set up for objects of sizeof(list_item), or from the heap
+ * if nodes is NULL. Lists sharing a pool recycle each other's nodes.
+ */
+void list_init(list *l, pool *nodes);
 void list_destroy(list *l);
-void list_insert(list *l, list_item *at, void *payload, free_function *f);
+
+/**
+ * Insert payload after at, or at the beginning if at is NULL. Returns
+ * FALSE if out of memory.
+ */
+int list_insert(list *l, list_item *at, void *payload, free_function *f);
 void list_remove(list *l, list_item *item);
 
 #endif /* LIST_H */
@@ -66,3 +66,32 @@ void util_perror(const char *fmt, ...)
     vfprintf(stderr, fmt, args);
     va_end(args);
 }
+
+/**
+ * Like fopen(3), but "-" stands for standard input or output depending
+ * on *mode*.
+ */
+FILE *util_fopen(const char *path, const char *mode)
+{
+    if (0 == strcmp(path, "-")) {
+        return ('r' == mode[0]) ? stdin : stdout;
+    }
+
+    return fopen(path, mode);
+}
+
+/**
+ * Close a file opened with util_fopen(). Standard streams stay open,
+ * standard output is only flushed.
+ */
+int util_fclose(FILE *file)
+{
+    if (stdin == file) {
+        return 0;
+    }
+    if (stdout == file) {
+        return fflush(file);
+    }
+
+    return fclose(file);
+}
@@ -20,10 +20,13 @@
 #ifndef UTILS_H
 #define UTILS_H 1
 
+#include <stdio.h>
 #include <stdint.h>
 
 char *util_basename(char *path);
 int util_strtouint8(const char *str, uint8_t *result);
 void util_perror(const char *fmt, ...);
+FILE *util_fopen(const char *path, const char *mode);
+int util_fclose(FILE *file);
 
 #endif /* UTILS_H */
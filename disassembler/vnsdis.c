@@ -0,0 +1,349 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "globals.h"
+#include "utils.h"
+#include "image.h"
+#include "instructionset.h"
+#include "disasm.h"
+
+#define BYTES_PER_LINE  8
+#define LABEL_SIZE      (IMG_MAX_NAME + 1)
+
+typedef struct _vnsdis_configuration {
+    char *outfile_name;
+    uint8_t print_cycles;
+    uint8_t verbose;
+} vnsdis_configuration;
+
+/**
+ * A program being disassembled. *start* marks the cells a line of the
+ * listing starts at, only those can carry a label.
+ */
+typedef struct _vnsdis_program {
+    uint8_t mem[DIS_MEMORY_SIZE];
+    uint8_t used[DIS_MEMORY_SIZE];
+    uint8_t cell[DIS_MEMORY_SIZE];
+    uint8_t start[DIS_MEMORY_SIZE];
+    char names[DIS_MEMORY_SIZE][LABEL_SIZE];
+    const char *labels[DIS_MEMORY_SIZE];
+    uint8_t entry;
+    uint8_t format;
+    unsigned int instructions;
+    unsigned int data_bytes;
+} vnsdis_program;
+
+static vnsdis_configuration config;
+static vnsdis_program program;
+
+/**
+ * Load *path* and find its code. Raw images carry no information on
+ * which bytes belong to the program, so zeros that are neither code nor
+ * referenced are left to the assembler, which fills gaps with zeros.
+ */
+static int load(const char *path, vnsdis_program *p)
+{
+    const uint8_t *cursor = NULL;
+    char name[LABEL_SIZE];
+    vns_image img;
+    uint8_t addr;
+    int i;
+
+    memset(p->mem, 0, sizeof(p->mem));
+    memset(p->labels, 0, sizeof(p->labels));
+
+    if (!img_open(path, &img)) {
+        return FALSE;
+    }
+
+    img_load(&img, p->mem, 0);
+    img_used(&img, p->used, 0);
+    p->format = img.format;
+    p->entry = (IMG_CONTAINER == img.format) ? img.entry : 0;
+
+    p->instructions = dis_discover(p->mem, p->entry, p->cell);
+
+    /* names from the label table win over generated ones */
+    while (img_next_symbol(&img, &cursor, &addr, name)) {
+        if (NULL == p->labels[addr]) {
+            strcpy(p->names[addr], name);
+            p->labels[addr] = p->names[addr];
+        }
+    }
+
+    img_close(&img);
+
+    if (IMG_RAW == p->format) {
+        for (i = 0; i < DIS_MEMORY_SIZE; ++i) {
+            p->used[i] = p->used[i] && (p->mem[i] || p->cell[i] ||
+                                        NULL != p->labels[i]);
+        }
+    }
+
+    return TRUE;
+}
+
+/**
+ * Decide where lines start and name all line starts that are referenced.
+ * Instructions always start a line. Operand bytes of instructions that
+ * overlap a later one hide it, so its address is used numerically.
+ */
+static void assign_labels(vnsdis_program *p)
+{
+    const char *prefix;
+    int addr = 0;
+
+    memset(p->start, FALSE, sizeof(p->start));
+
+    while (addr < DIS_MEMORY_SIZE) {
+        if (!p->used[addr]) {
+            addr++;
+            continue;
+        }
+
+        p->start[addr] = TRUE;
+
+        if (p->cell[addr] & DIS_CELL_CODE) {
+            addr += is_find_opcode(p->mem[addr])->length;
+        } else {
+            addr++;
+        }
+    }
+
+    for (addr = 0; addr < DIS_MEMORY_SIZE; ++addr) {
+        if (!p->start[addr]) {
+            p->labels[addr] = NULL;
+            continue;
+        }
+
+        if (NULL != p->labels[addr]) {
+            continue;
+        }
+
+        if (IMG_CONTAINER == p->format && addr == p->entry) {
+            strcpy(p->names[addr], "start");
+            p->labels[addr] = p->names[addr];
+            continue;
+        }
+
+        if (p->cell[addr] & DIS_CELL_CALL) {
+            prefix = "sub";
+        } else if (p->cell[addr] & DIS_CELL_JUMP) {
+            prefix = "l";
+        } else if (p->cell[addr] & DIS_CELL_DATA) {
+            prefix = "d";
+        } else {
+            continue;
+        }
+
+        snprintf(p->names[addr], LABEL_SIZE, "%s_%.2X", prefix, addr);
+        p->labels[addr] = p->names[addr];
+    }
+}
+
+static void print_label(FILE *out, const vnsdis_program *p, int addr)
+{
+    if (NULL != p->labels[addr]) {
+        fprintf(out, "%s:\n", p->labels[addr]);
+    }
+}
+
+/* print data bytes up to the next label, instruction or gap */
+static int print_data(FILE *out, vnsdis_program *p, int addr)
+{
+    int n = 0;
+
+    fprintf(out, "        .byte ");
+
+    do {
+        fprintf(out, (n) ? ", 0x%.2X" : "0x%.2X", p->mem[addr]);
+        p->data_bytes++;
+        addr++;
+        n++;
+    } while (n < BYTES_PER_LINE && addr < DIS_MEMORY_SIZE &&
+             p->used[addr] && !(p->cell[addr] & DIS_CELL_CODE) &&
+             NULL == p->labels[addr]);
+
+    fprintf(out, "\n");
+    return n;
+}
+
+static int print_instruction(FILE *out, const vnsdis_program *p, int addr)
+{
+    char text[64];
+    int length;
+
+    length = dis_format(p->mem, addr, p->labels, text, sizeof(text));
+
+    if (config.print_cycles) {
+        fprintf(out, "        %-24s; %u\n", text,
+                is_find_opcode(p->mem[addr])->cycles);
+    } else {
+        fprintf(out, "        %s\n", text);
+    }
+
+    return length;
+}
+
+/**
+ * Write *p* as assembler source that assembles to the same memory
+ * contents (and for containers, the same segments and entry).
+ */
+static void print_program(FILE *out, const char *path, vnsdis_program *p)
+{
+    int addr = 0, counter = 0;
+
+    p->data_bytes = 0;
+
+    fprintf(out, "; %s\n", path);
+    fprintf(out, "; %u instruction(s), entry 0x%.2X\n\n",
+            p->instructions, p->entry);
+
+    if (IMG_CONTAINER == p->format) {
+        fprintf(out, ".entry %s\n\n", p->labels[p->entry]);
+    }
+
+    while (addr < DIS_MEMORY_SIZE) {
+        if (!p->used[addr]) {
+            addr++;
+            continue;
+        }
+
+        if (addr != counter) {
+            fprintf(out, "\n.offset 0x%.2X\n", addr);
+        }
+
+        print_label(out, p, addr);
+
+        if (p->cell[addr] & DIS_CELL_CODE) {
+            addr += print_instruction(out, p, addr);
+        } else {
+            addr += print_data(out, p, addr);
+        }
+
+        counter = addr;
+    }
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void print_usage(char *pname)
+{
+    printf("\nUsage: %s [-hcv] [-o <outfile>] <image> [<image> ...]\n\n",
+           pname);
+    printf("  -h             Show this help text.\n");
+    printf("  -o <outfile>   Write the listing to <outfile> (default: stdout).\n");
+    printf("  -c             Annotate instructions with their cycles.\n");
+    printf("  -v             Print a summary to stderr.\n");
+    printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int opt;
+    unsigned long images = 0, instructions = 0, data_bytes = 0;
+    char *process_name = util_basename(argv[0]);
+    FILE *out = stdout;
+    int i, result = EXIT_SUCCESS;
+    double start;
+
+    /* the listing goes to stdout, so the banner does not */
+    fprintf(stderr, BANNER_LINE1, "Disassembler");
+    fprintf(stderr, BANNER_LINE2, VERSION);
+
+    config.outfile_name = NULL;
+    config.print_cycles = FALSE;
+    config.verbose = FALSE;
+
+    while ((opt = getopt(argc, argv, "ho:cv")) != -1) {
+        switch (opt) {
+            case 'h':
+                print_usage(process_name);
+                return EXIT_SUCCESS;
+            case 'o':
+                config.outfile_name = strdup(optarg);
+                break;
+            case 'c':
+                config.print_cycles = TRUE;
+                break;
+            case 'v':
+                config.verbose = TRUE;
+                break;
+            default:
+                print_usage(process_name);
+                return EXIT_SUCCESS;
+        }
+    }
+
+    if (optind >= argc) {
+        print_usage(process_name);
+        return EXIT_SUCCESS;
+    }
+
+    if (NULL != config.outfile_name &&
+            NULL == (out = fopen(config.outfile_name, "w"))) {
+        perror(config.outfile_name);
+        return EXIT_FAILURE;
+    }
+
+    start = now();
+
+    for (i = optind; i < argc; ++i) {
+        if (!load(argv[i], &program)) {
+            result = EXIT_FAILURE;
+            continue;
+        }
+
+        assign_labels(&program);
+
+        if (i > optind) {
+            fprintf(out, "\n");
+        }
+        print_program(out, argv[i], &program);
+
+        images++;
+        instructions += program.instructions;
+        data_bytes += program.data_bytes;
+    }
+
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    if (config.verbose) {
+        fprintf(stderr, "Disassembled %lu image(s), %lu instruction(s), "
+                "%lu data byte(s) in %.3f ms.\n", images, instructions,
+                data_bytes, (now() - start) * 1000);
+    }
+
+    return result;
+}
@@ -0,0 +1,581 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "globals.h"
+#include "instructionset.h"
+#include "vnsem.h"
+#include "accel.h"
+
+/* locations a value may depend on, the memory cells come first */
+#define LOC_A       256
+#define LOC_L       257
+#define LOCS        258
+#define CONSTANT    (-1)
+
+/* operations of instructions setting the flags */
+#define OP_ADD      0
+#define OP_SUB      1
+#define OP_AND      2
+#define OP_OR       3
+#define OP_XOR      4
+
+/**
+ * A byte during one iteration: *offset* plus the value location *loc*
+ * had at the start of the iteration, or just *offset* for constants.
+ */
+typedef struct _acc_value {
+    int16_t loc;
+    uint8_t offset;
+} acc_value;
+
+typedef struct _acc_flag_op {
+    uint8_t op;
+    acc_value a;
+    acc_value b;
+} acc_flag_op;
+
+typedef struct _acc_branch {
+    uint8_t flag;               // F_ZERO or F_CARRY
+    uint8_t if_set;             // jumps if the flag is set
+    uint8_t taken;              // in the analyzed iteration
+    int flag_op;                // last flag op before, -1: previous iteration
+} acc_branch;
+
+/**
+ * One iteration of a loop, starting and ending at *head*. Locations
+ * not written in the body keep their *start* value, the others are
+ * *final* at the end of each iteration.
+ */
+typedef struct _acc_loop {
+    uint8_t head;
+    unsigned int length;        // instructions
+    unsigned int cycles;
+    uint8_t start[LOCS];        // values at the start of iteration 0
+    uint8_t flags;
+    uint8_t written[LOCS];
+    uint8_t code[256];          // bytes of the instructions of the body
+    acc_value final[LOCS];
+    acc_flag_op ops[ACC_MAX_BODY];
+    unsigned int op_count;
+    acc_branch branches[ACC_MAX_BRANCHES];
+    unsigned int branch_count;
+} acc_loop;
+
+static acc_counters counters;
+
+/* back edges seen per loop head and needed before the next analysis */
+static uint16_t hits[256];
+static uint16_t needed[256];
+
+static inline acc_value constant(uint8_t value)
+{
+    acc_value v = { CONSTANT, value };
+    return v;
+}
+
+/* ------------------------------------------------------------------------
+ * Evaluation for a given iteration
+ * ------------------------------------------------------------------------ */
+
+/**
+ * Value of location *x* at the start of iteration *k*. analyze() made
+ * sure every chain of copies ends in a constant or an induction
+ * variable, so the recursion is shallow.
+ */
+static uint8_t start_value(const acc_loop *l, int x, unsigned int k)
+{
+    const acc_value *f = &l->final[x];
+
+    if (0 == k || !l->written[x]) {
+        return l->start[x];
+    }
+    if (CONSTANT == f->loc) {
+        return f->offset;
+    }
+    if (x == f->loc) {
+        return l->start[x] + k * f->offset;
+    }
+
+    return start_value(l, f->loc, k - 1) + f->offset;
+}
+
+static uint8_t eval(const acc_loop *l, acc_value v, unsigned int k)
+{
+    if (CONSTANT == v.loc) {
+        return v.offset;
+    }
+
+    return start_value(l, v.loc, k) + v.offset;
+}
+
+/* the flags *op* leaves in iteration *k*, as accu_op() sets them */
+static uint8_t op_flags(const acc_loop *l, const acc_flag_op *op,
+                        unsigned int k)
+{
+    int a = eval(l, op->a, k), b = eval(l, op->b, k), result = 0;
+    uint8_t flags = l->flags & ~(F_ZERO | F_SIGN | F_CARRY);
+
+    switch (op->op) {
+        case OP_ADD: result = a + b; break;
+        case OP_SUB: result = a - b; break;
+        case OP_AND: result = a & b; break;
+        case OP_OR:  result = a | b; break;
+        case OP_XOR: result = a ^ b; break;
+    }
+
+    if (0 == (result & 0xff)) flags |= F_ZERO;
+    if (result & 0x80)        flags |= F_SIGN;
+    if (result & 0x100)       flags |= F_CARRY;
+
+    return flags;
+}
+
+static int branch_taken(const acc_loop *l, const acc_branch *b,
+                        unsigned int k)
+{
+    uint8_t flags = l->flags;
+
+    if (b->flag_op >= 0) {
+        flags = op_flags(l, &l->ops[b->flag_op], k);
+    } else if (k > 0 && l->op_count) {
+        flags = op_flags(l, &l->ops[l->op_count - 1], k - 1);
+    }
+
+    return !(flags & b->flag) == !b->if_set;
+}
+
+/* ------------------------------------------------------------------------
+ * Analysis
+ * ------------------------------------------------------------------------ */
+
+static int supported(uint8_t ins)
+{
+    switch (ins) {
+        case 0x7d: case 0x7e: case 0x77: case 0x3e: case 0x3a: case 0x32:
+        case 0x6f: case 0x6e: case 0x2e:
+        case 0x3c: case 0x2c: case 0x3d: case 0x2d:
+        case 0x87: case 0x85: case 0x86: case 0xc6:
+        case 0x97: case 0x95: case 0x96: case 0xd6:
+        case 0xbf: case 0xbd: case 0xbe: case 0xfe:
+        case 0xa7: case 0xa5: case 0xa6: case 0xe6:
+        case 0xb7: case 0xb5: case 0xb6: case 0xf6:
+        case 0xaf: case 0xad: case 0xae: case 0xee:
+        case 0xc3: case 0xca: case 0xc2: case 0xda: case 0xd2:
+        case 0x00:
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+/**
+ * Run one iteration from the head on a copy of *m*, recording the path
+ * and every location written. Returns ACC_FAILS or why the loop cannot
+ * be summarized.
+ */
+static int trace(acc_loop *l, const vnsem_machine *m, uint8_t *path)
+{
+    vnsem_machine c = *m;
+    uint8_t seen[256], ins, pc, i;
+
+    memset(seen, 0, sizeof(seen));
+    c.io = NULL;
+    c.stats = NULL;
+    c.history = NULL;
+    l->length = 0;
+    l->cycles = 0;
+
+    do {
+        pc = c.pc;
+        ins = c.mem[pc];
+
+        if (ACC_MAX_BODY == l->length || seen[pc]) {
+            return ACC_FAIL_SHAPE;
+        }
+        if (!supported(ins)) {
+            return ACC_FAIL_OPCODE;
+        }
+        if (m->break_enabled && pc == m->break_point) {
+            return ACC_FAIL_BREAK;
+        }
+
+        seen[pc] = TRUE;
+        path[l->length++] = pc;
+        l->cycles += is_opcode_table[ins].cycles;
+        for (i = 0; i < is_opcode_table[ins].length; ++i) {
+            l->code[(uint8_t)(pc + i)] = TRUE;
+        }
+
+        switch (ins) {
+            case 0x77: l->written[c.reg_l] = TRUE;                   break;
+            case 0x32: l->written[c.mem[(uint8_t)(pc + 1)]] = TRUE;  break;
+            case 0x6f: case 0x6e: case 0x2e: case 0x2c: case 0x2d:
+                l->written[LOC_L] = TRUE;
+                break;
+            case 0xbf: case 0xbd: case 0xbe: case 0xfe: case 0x00:
+            case 0xc3: case 0xca: case 0xc2: case 0xda: case 0xd2:
+                break;
+            default:
+                l->written[LOC_A] = TRUE;
+        }
+
+        step_machine(&c);
+    } while (c.pc != l->head);
+
+    return ACC_FAILS;
+}
+
+static int add(acc_value *r, acc_value a, acc_value b)
+{
+    if (CONSTANT != a.loc && CONSTANT != b.loc) {
+        return FALSE;
+    }
+
+    r->loc = (CONSTANT != a.loc) ? a.loc : b.loc;
+    r->offset = a.offset + b.offset;
+    return TRUE;
+}
+
+static int sub(acc_value *r, acc_value a, acc_value b)
+{
+    if (CONSTANT != b.loc && a.loc != b.loc) {
+        return FALSE;
+    }
+
+    r->loc = (a.loc == b.loc) ? CONSTANT : a.loc;
+    r->offset = a.offset - b.offset;
+    return TRUE;
+}
+
+/* bitwise operations only stay affine for constants or x op x */
+static int logic(acc_value *r, uint8_t op, acc_value a, acc_value b)
+{
+    if (CONSTANT == a.loc && CONSTANT == b.loc) {
+        r->loc = CONSTANT;
+        r->offset = (OP_AND == op) ? a.offset & b.offset :
+                    (OP_OR == op)  ? a.offset | b.offset :
+                                     a.offset ^ b.offset;
+        return TRUE;
+    }
+    if (a.loc != b.loc || a.offset != b.offset) {
+        return FALSE;
+    }
+
+    *r = (OP_XOR == op) ? constant(0) : a;
+    return TRUE;
+}
+
+/* the address in *v*, which must not depend on the iteration */
+static int address(acc_value v, int *addr)
+{
+    *addr = v.offset;
+    return CONSTANT == v.loc;
+}
+
+/**
+ * Execute the recorded path once more on values relative to the start
+ * of the iteration. Returns ACC_FAILS or why the loop cannot be
+ * summarized.
+ */
+static int symbolic(acc_loop *l, const vnsem_machine *m, const uint8_t *path)
+{
+    acc_value env[LOCS], operand, *a = &env[LOC_A];
+    acc_flag_op *op;
+    acc_branch *b;
+    uint8_t pc, ins, arg, next;
+    unsigned int i;
+    int addr = 0, ok = TRUE;
+
+    for (i = 0; i < LOCS; ++i) {
+        env[i].loc = l->written[i] ? i : CONSTANT;
+        env[i].offset = l->written[i] ? 0 : l->start[i];
+    }
+
+    for (i = 0; i < l->length && ok; ++i) {
+        pc = path[i];
+        ins = m->mem[pc];
+        arg = m->mem[(uint8_t)(pc + 1)];
+        next = (i + 1 < l->length) ? path[i + 1] : l->head;
+
+        /* operand of the ALU instructions, by their register bits */
+        if (ins >= 0x80 && ins < 0xc0) {
+            switch (ins & 0x07) {
+                case 0x07: operand = *a;            break;
+                case 0x05: operand = env[LOC_L];    break;
+                default:
+                    if (!address(env[LOC_L], &addr)) {
+                        return ACC_FAIL_ADDRESS;
+                    }
+                    operand = env[addr];
+            }
+        } else {
+            operand = constant(arg);
+        }
+
+        op = &l->ops[l->op_count];
+        op->a = *a;
+        op->b = operand;
+
+        switch (ins) {
+            case 0x7d: *a = env[LOC_L];                             break;
+            case 0x7e: ok = address(env[LOC_L], &addr);
+                       *a = env[addr];                              break;
+            case 0x77: ok = address(env[LOC_L], &addr) && !l->code[addr];
+                       env[addr] = *a;                              break;
+            case 0x3e: *a = constant(arg);                          break;
+            case 0x3a: *a = env[arg];                               break;
+            case 0x32: ok = !l->code[arg];
+                       env[arg] = *a;                               break;
+            case 0x6f: env[LOC_L] = *a;                             break;
+            case 0x6e: ok = address(env[LOC_L], &addr);
+                       env[LOC_L] = env[addr];                      break;
+            case 0x2e: env[LOC_L] = constant(arg);                  break;
+            case 0x2c: add(&env[LOC_L], env[LOC_L], constant(1));   break;
+            case 0x2d: sub(&env[LOC_L], env[LOC_L], constant(1));   break;
+            case 0x3c: op->op = OP_ADD; op->b = constant(1);        break;
+            case 0x3d: op->op = OP_SUB; op->b = constant(1);        break;
+            case 0x87: case 0x85: case 0x86: case 0xc6:
+                op->op = OP_ADD;
+                break;
+            case 0x97: case 0x95: case 0x96: case 0xd6:
+            case 0xbf: case 0xbd: case 0xbe: case 0xfe:
+                op->op = OP_SUB;
+                break;
+            case 0xa7: case 0xa5: case 0xa6: case 0xe6:
+                op->op = OP_AND;
+                break;
+            case 0xb7: case 0xb5: case 0xb6: case 0xf6:
+                op->op = OP_OR;
+                break;
+            case 0xaf: case 0xad: case 0xae: case 0xee:
+                op->op = OP_XOR;
+                break;
+            case 0xca: case 0xc2: case 0xda: case 0xd2:
+                /* a jump to the next instruction goes nowhere */
+                if (arg == (uint8_t)(pc + 2)) {
+                    break;
+                }
+                if (ACC_MAX_BRANCHES == l->branch_count) {
+                    return ACC_FAIL_SHAPE;
+                }
+                b = &l->branches[l->branch_count++];
+                b->flag = (0xca == ins || 0xc2 == ins) ? F_ZERO : F_CARRY;
+                b->if_set = (0xca == ins || 0xda == ins);
+                b->taken = (next == arg);
+                b->flag_op = (int)l->op_count - 1;
+                break;
+        }
+
+        if (!ok) {
+            return ACC_FAIL_ADDRESS;
+        }
+
+        /* instructions setting the flags, all but INR L and DCR L */
+        if ((ins >= 0x80 && ins <= 0xbf) || 0xc6 == ins || 0xd6 == ins ||
+                0xe6 == ins || 0xf6 == ins || 0xee == ins || 0xfe == ins ||
+                0x3c == ins || 0x3d == ins) {
+            switch (op->op) {
+                case OP_ADD: ok = add(a, op->a, op->b);         break;
+                case OP_SUB:
+                    /* CMP only sets the flags, SUB A is always 0 */
+                    if ((ins < 0xb8 || ins > 0xbf) && 0xfe != ins) {
+                        ok = sub(a, op->a, op->b);
+                    }
+                    break;
+                default:     ok = logic(a, op->op, op->a, op->b);
+            }
+            if (!ok) {
+                return ACC_FAIL_AFFINE;
+            }
+            l->op_count++;
+        }
+    }
+
+    memcpy(l->final, env, sizeof(env));
+    return ACC_FAILS;
+}
+
+/* every written location must be evaluable for any iteration */
+static int affine(const acc_loop *l)
+{
+    int x, y, depth;
+
+    for (x = 0; x < LOCS; ++x) {
+        for (y = x, depth = 0; l->written[y]; ++depth) {
+            if (CONSTANT == l->final[y].loc || y == l->final[y].loc) {
+                break;
+            }
+            if (depth == 4) {
+                return FALSE;
+            }
+            y = l->final[y].loc;
+        }
+    }
+
+    return TRUE;
+}
+
+static int analyze(acc_loop *l, const vnsem_machine *m)
+{
+    uint8_t path[ACC_MAX_BODY];
+    int x, result;
+
+    memset(l, 0, sizeof(*l));
+    l->head = m->pc;
+    l->flags = m->flags;
+    for (x = 0; x < 256; ++x) {
+        l->start[x] = m->mem[x];
+    }
+    l->start[LOC_A] = m->accu;
+    l->start[LOC_L] = m->reg_l;
+
+    if (ACC_FAILS != (result = trace(l, m, path)) ||
+            ACC_FAILS != (result = symbolic(l, m, path))) {
+        return result;
+    }
+
+    return affine(l) ? ACC_FAILS : ACC_FAIL_AFFINE;
+}
+
+/* ------------------------------------------------------------------------ */
+
+/**
+ * Summarize the loop whose head *m* is at. If its body takes the same
+ * path for at least two iterations, up to *max_iterations* of them are
+ * applied to *m* at once, exactly as executing them would. Returns the
+ * number of iterations skipped, 0 if the loop was not summarized.
+ */
+int acc_summarize(vnsem_machine *m, unsigned int max_iterations)
+{
+    static acc_loop l;
+    uint8_t values[LOCS];
+    unsigned int i, k, end;
+    int result;
+
+    if (ACC_FAILS != (result = analyze(&l, m))) {
+        counters.fails[result]++;
+        return 0;
+    }
+
+    /* first iteration leaving the path, byte values repeat after 256 */
+    end = (max_iterations < ACC_PERIOD) ? max_iterations : ACC_PERIOD;
+    for (k = 1; k < end; ++k) {
+        for (i = 0; i < l.branch_count; ++i) {
+            if (branch_taken(&l, &l.branches[i], k) != l.branches[i].taken) {
+                end = k;
+                break;
+            }
+        }
+    }
+
+    if (end < 2) {
+        counters.fails[ACC_FAIL_EXIT]++;
+        return 0;
+    }
+
+    for (i = 0; i < LOCS; ++i) {
+        values[i] = start_value(&l, i, end);
+    }
+    memcpy(m->mem, values, 256);
+    m->accu = values[LOC_A];
+    m->reg_l = values[LOC_L];
+    if (l.op_count) {
+        m->flags = op_flags(&l, &l.ops[l.op_count - 1], end - 1);
+    }
+    m->step_count += end * l.length;
+
+    counters.loops++;
+    counters.iterations += end;
+    counters.steps += (uint64_t)end * l.length;
+    counters.cycles += (uint64_t)end * l.cycles;
+
+    return end;
+}
+
+/**
+ * Step function of the "loop" engine. Executes a single instruction
+ * like step_machine(), or whole iterations of a loop at its head.
+ */
+int acc_step(vnsem_machine *m)
+{
+    uint8_t pc = m->pc, ins = m->mem[pc], target, flow;
+
+    /* summaries do not record history */
+    if (hits[pc] >= ACC_THRESHOLD + needed[pc] && NULL == m->history) {
+        hits[pc] = 0;
+        if (acc_summarize(m, ACC_PERIOD)) {
+            needed[pc] = 0;
+            return 0;
+        }
+        /* the loop may look different later, but try less often */
+        needed[pc] = (needed[pc] < 1024) ? 2 * needed[pc] + 1 : needed[pc];
+    }
+
+    /*
+     * Backward jumps mark loop heads. Counting them before they are
+     * taken keeps step_machine() a tail call, a conditional one not
+     * taken only brings the next analysis forward.
+     */
+    flow = is_opcode_table[ins].flow;
+    if (IS_FLOW_JUMP == flow || IS_FLOW_COND_JUMP == flow) {
+        target = m->mem[(uint8_t)(pc + 1)];
+        if (target <= pc && hits[target] < UINT16_MAX) {
+            hits[target]++;
+        }
+    }
+
+    return step_machine(m);
+}
+
+void acc_read_counters(acc_counters *out)
+{
+    *out = counters;
+}
+
+/* forget all counters and loop heads */
+void acc_reset(void)
+{
+    memset(&counters, 0, sizeof(counters));
+    memset(hits, 0, sizeof(hits));
+    memset(needed, 0, sizeof(needed));
+}
+
+void acc_print_counters(void)
+{
+    static const char *names[ACC_FAILS] = {
+        "shape", "opcode", "break point", "address", "not affine", "exit"
+    };
+    int i;
+
+    printf("Loop engine: %llu loop(s) summarized, %llu iterations, "
+           "%llu steps and %llu cycles skipped.\n",
+           (unsigned long long)counters.loops,
+           (unsigned long long)counters.iterations,
+           (unsigned long long)counters.steps,
+           (unsigned long long)counters.cycles);
+    printf("Not summarized:");
+    for (i = 0; i < ACC_FAILS; ++i) {
+        printf("%s %s %llu", i ? "," : "", names[i],
+               (unsigned long long)counters.fails[i]);
+    }
+    printf(".\n");
+}
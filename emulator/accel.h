@@ -0,0 +1,66 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef ACCEL_H
+#define ACCEL_H 1
+
+#include <stdint.h>
+
+#include "vnsem.h"
+
+/**
+ * Loop acceleration for the "loop" engine. A loop head is the target
+ * of a backward jump. Once it was reached often enough, one
+ * iteration is run on a copy and then again symbolically, with every
+ * value an offset to a constant or to the value of a register or memory
+ * cell at the start of the iteration. If all addresses are constant and
+ * every value written is affine in the iteration number, the branches
+ * of the body tell how many iterations take the same path, and their
+ * effect is applied at once.
+ */
+#define ACC_THRESHOLD       4       // back edges before a loop is analyzed
+#define ACC_MAX_BODY        64      // instructions of one iteration
+#define ACC_MAX_BRANCHES    16
+#define ACC_PERIOD          256     // affine byte values repeat after this
+
+/* why a loop head was not summarized */
+#define ACC_FAIL_SHAPE      0       // no simple cycle back to the head
+#define ACC_FAIL_OPCODE     1       // I/O, stack or other unsupported code
+#define ACC_FAIL_BREAK      2       // break point inside the body
+#define ACC_FAIL_ADDRESS    3       // address not constant, writes code
+#define ACC_FAIL_AFFINE     4       // value not affine in the iteration
+#define ACC_FAIL_EXIT       5       // leaves the path in the next iteration
+
+#define ACC_FAILS           6
+
+typedef struct _acc_counters {
+    uint64_t loops;                 // summaries applied
+    uint64_t iterations;            // iterations skipped by them
+    uint64_t steps;
+    uint64_t cycles;
+    uint64_t fails[ACC_FAILS];
+} acc_counters;
+
+int acc_step(vnsem_machine *m);
+int acc_summarize(vnsem_machine *m, unsigned int max_iterations);
+void acc_read_counters(acc_counters *out);
+void acc_reset(void);
+void acc_print_counters(void);
+
+#endif /* ACCEL_H */
@@ -21,6 +21,8 @@
 #include <stdlib.h>
 #include <ctype.h>
 #include <string.h>
+#include <limits.h>
+#include <time.h>
 #include <readline/readline.h>
 #include <readline/history.h>
 
@@ -28,19 +30,28 @@
 #include "vnsem.h"
 #include "utils.h"
 #include "console.h"
+#include "history.h"
 
 #define CONSOLE_COMMAND_MAX_ARGS (5)
 
+void console_analyze(int argc, char **argv, vnsem_machine *machine);
+void console_bisect(int argc, char **argv, vnsem_machine *machine);
 void console_break(int argc, char **argv, vnsem_machine *machine);
 void console_help(int argc, char **argv, vnsem_machine *machine);
+void console_history(int argc, char **argv, vnsem_machine *machine);
 void console_load(int argc, char **argv, vnsem_machine *machine);
 void console_machine(int argc, char **argv, vnsem_machine *machine);
 void console_memdump(int argc, char **argv, vnsem_machine *machine);
 void console_memset(int argc, char **argv, vnsem_machine *machine);
+void console_pause(int argc, char **argv, vnsem_machine *machine);
 void console_pcset(int argc, char **argv, vnsem_machine *machine);
 void console_quit(int argc, char **argv, vnsem_machine *machine);
 void console_reset(int argc, char **argv, vnsem_machine *machine);
+void console_restore(int argc, char **argv, vnsem_machine *machine);
 void console_run(int argc, char **argv, vnsem_machine *machine);
+void console_save(int argc, char **argv, vnsem_machine *machine);
+void console_seek(int argc, char **argv, vnsem_machine *machine);
+void console_stats(int argc, char **argv, vnsem_machine *machine);
 void console_step(int argc, char **argv, vnsem_machine *machine);
 
 /**
@@ -48,28 +59,44 @@ void console_step(int argc, char **argv, vnsem_machine *machine);
  * command name.
  */
 static const console_command console_commands[] = {
+    { "analyze", console_analyze, "Analyze memory statically",
+                 0, 1,            "[<entry>]", CMD_LIVE },
+    { "bisect",  console_bisect,  "Find first step a predicate holds",
+                 1, 4,            "<lhs> <op> <value>" },
     { "break",   console_break,   "Set break point",
-                 0, 1,            "[<addr>|clear]" },
+                 0, 1,            "[<addr>|<label>|clear]" },
     { "help",    console_help,    "Show help (for command)",
-                 0, 1,            "<command>" },
+                 0, 1,            "<command>", CMD_LIVE },
+    { "history", console_history, "Show execution history",
+                 0, 0,            NULL },
     { "load",    console_load,    "Load program from file",
                  1, 2,            "<programfile> [<offset>]" },
     { "machine", console_machine, "Print machine state",
-                 0, 0,            NULL },
+                 0, 0,            NULL, CMD_LIVE },
     { "memdump", console_memdump, "Dump memory content",
-                 0, 1,            "[<addr>]" },
+                 0, 1,            "[<addr>]", CMD_LIVE },
     { "memset",  console_memset,  "Set content of a memory cell",
                  2, 2,            "<addr> <value>" },
+    { "pause",   console_pause,   "Stop machine at the next instruction",
+                 0, 0,            NULL },
     { "pcset",   console_pcset,   "Set program counter",
                  1, 1,            "<addr>" },
     { "quit",    console_quit,    "Quit emulator",
-                 0, 0,            NULL },
+                 0, 0,            NULL, CMD_LIVE },
     { "reset",   console_reset,   "Reset (parts of the) machine",
                  1, 1,            "pc|mem|all" },
+    { "restore", console_restore, "Continue with a saved machine state",
+                 1, 1,            "<statefile>" },
     { "run",     console_run,     "Start machine",
                  0, 0,            NULL },
-    { "step",    console_step,    "Execute next instruction and stop",
-                 0, 0,            NULL }
+    { "save",    console_save,    "Save machine state and pending input",
+                 1, 1,            "<statefile>" },
+    { "seek",    console_seek,    "Go to the machine state after a step",
+                 1, 1,            "<step>" },
+    { "stats",   console_stats,   "Show runtime statistics",
+                 0, 1,            "[reset]" },
+    { "step",    console_step,    "Execute next instruction (or line) and stop",
+                 0, 1,            "[line]" }
 };
 
 int commandcmp(const void *key, const void *other)
@@ -126,14 +153,90 @@ char **completion(const char *text, int start, int end)
     return matches;
 }
 
+/**
+ * Parse an address given as number or, if debug information is
+ * loaded, as label name. Returns FALSE if it is neither.
+ */
+static int parse_address(const char *str, uint8_t *addr)
+{
+    const debuginfo *dbg = vnsem_debuginfo();
+
+    return util_strtouint8(str, addr) ||
+           (NULL != dbg && dbg_find_label(dbg, str, addr));
+}
+
+void console_analyze(int argc, char **argv, vnsem_machine *machine)
+{
+    uint8_t entry = machine->pc;
+    an_result res;
+
+    if (2 == argc) {
+        if (!parse_address(argv[1], &entry)) {
+            util_perror("Invalid address: %s\n", argv[1]);
+            return;
+        }
+    }
+
+    an_analyze(machine->mem, entry, &res);
+    printf("\n");
+    print_analysis("memory", &res);
+    printf("\n");
+}
+
+static double elapsed_ms(struct timespec *start)
+{
+    struct timespec end;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) * 1e3 +
+           (end.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+void console_bisect(int argc, char **argv, vnsem_machine *machine)
+{
+    char predicate[128] = "";
+    struct timespec start;
+    hist_predicate p;
+    int i;
+
+    if (NULL == machine->history) {
+        printf("No execution history recorded.\n");
+        return;
+    }
+
+    /* the predicate may be split up into several arguments */
+    for (i = 1; i < argc; ++i) {
+        strncat(predicate, argv[i], sizeof(predicate) - strlen(predicate) - 1);
+    }
+
+    if (!hist_parse_predicate(predicate, &p)) {
+        util_perror("Invalid predicate: %s\n", predicate);
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (hist_bisect(machine->history, machine, &p)) {
+        printf("Predicate holds first after step %u (%.3f ms).\n",
+                machine->step_count, elapsed_ms(&start));
+    } else {
+        printf("Predicate never holds in the recorded history (%.3f ms).\n",
+                elapsed_ms(&start));
+    }
+}
+
 void console_break(int argc, char **argv, vnsem_machine *machine)
 {
+    char location[DBG_LOCATION_SIZE];
     uint8_t addr = 0;
 
     if (argc == 1) {
         if (machine->break_enabled) {
-            printf("Current break point at address 0x%.2X.\n",
-                    machine->break_point);
+            format_location(machine->break_point, location,
+                            sizeof(location));
+            printf("Current break point at address 0x%.2X%s%s%s.\n",
+                    machine->break_point, location[0] ? " (" : "",
+                    location, location[0] ? ")" : "");
         } else {
             printf("No breakpoint set.\n");
         }
@@ -147,14 +250,18 @@ void console_break(int argc, char **argv, vnsem_machine *machine)
         return;
     }
 
-    if (!util_strtouint8(argv[1], &addr)) {
+    if (!parse_address(argv[1], &addr)) {
         util_perror("Invalid address: %s\n", argv[1]);
         return;
     }
 
     machine->break_point = addr;
     machine->break_enabled = TRUE;
-    printf("Break point set at address 0x%.2X\n", addr);
+    if (format_location(addr, location, sizeof(location))) {
+        printf("Break point set at address 0x%.2X (%s)\n", addr, location);
+    } else {
+        printf("Break point set at address 0x%.2X\n", addr);
+    }
 }
 
 void console_help(int argc, char **argv, vnsem_machine *machine)
@@ -184,6 +291,16 @@ void console_help(int argc, char **argv, vnsem_machine *machine)
             (NULL == cmd->usage) ? "None" : cmd->usage);
 }
 
+void console_history(int argc, char **argv, vnsem_machine *machine)
+{
+    if (NULL == machine->history) {
+        printf("No execution history recorded.\n");
+        return;
+    }
+
+    hist_print(machine->history);
+}
+
 void console_load(int argc, char **argv, vnsem_machine *machine)
 {
     uint8_t off = 0;
@@ -196,16 +313,20 @@ void console_load(int argc, char **argv, vnsem_machine *machine)
     }
 
     load_program(argv[1], off, machine);
-    machine->pc = off;
 }
 
 void console_machine(int argc, char **argv, vnsem_machine *machine)
 {
     printf("\n  ** Machine information **\n\n");
     printf("           Memory: (-> memdump)\n");
+#if VNS_BANKS > 1
+    printf("      Memory bank: %i of %i (port 0x%.2X)\n", machine->bank,
+           VNS_BANKS, VNS_BANK_PORT);
+#endif
     printf("  Program counter: 0x%.2X\n", machine->pc);
     printf("    Stack pointer: 0x%.2X\n", machine->sp);
     printf("     Step counter: %i (since reset)\n", machine->step_count);
+    printf("            State: %s\n", machine->halted ? "halted" : "running");
     printf("      Accumulator: 0x%.2X (%i)\n",
             machine->accu, machine->accu);
     printf("                L: 0x%.2X (%i)\n",
@@ -221,16 +342,19 @@ void console_machine(int argc, char **argv, vnsem_machine *machine)
 
 void console_memdump(int argc, char **argv, vnsem_machine *machine)
 {
+    char location[DBG_LOCATION_SIZE];
     uint8_t addr = 0;
 
     if (2 == argc) {
-        if (!util_strtouint8(argv[1], &addr)) {
+        if (!parse_address(argv[1], &addr)) {
             util_perror("Invalid address: %s\n", argv[1]);
             return;
         }
 
-        printf(" 0x%.2X   0x%.2X (%i)\n",
-                addr, machine->mem[addr], machine->mem[addr]);
+        format_location(addr, location, sizeof(location));
+        printf(" 0x%.2X   0x%.2X (%i)%s%s\n",
+                addr, machine->mem[addr], machine->mem[addr],
+                location[0] ? "  ; " : "", location);
         return;
     }
 
@@ -241,7 +365,7 @@ void console_memset(int argc, char **argv, vnsem_machine *machine)
 {
     uint8_t a = 0, v = 0;
 
-    if (!util_strtouint8(argv[1], &a)) {
+    if (!parse_address(argv[1], &a)) {
         util_perror("Invalid address: %s\n", argv[1]);
         return;
     }
@@ -255,11 +379,19 @@ void console_memset(int argc, char **argv, vnsem_machine *machine)
     printf(" 0x%.2X   0x%.2X (%i)\n", a, v, v);
 }
 
+void console_pause(int argc, char **argv, vnsem_machine *machine)
+{
+    if (!machine->halted) {
+        machine->halted = TRUE;
+        printf("Machine paused before step %u.\n", machine->step_count + 1);
+    }
+}
+
 void console_pcset(int argc, char **argv, vnsem_machine *machine)
 {
     uint8_t a = 0;
 
-    if (!util_strtouint8(argv[1], &a)) {
+    if (!parse_address(argv[1], &a)) {
         util_perror("Invalid address: %s\n", argv[1]);
         return;
     }
@@ -274,8 +406,16 @@ void console_quit(int argc, char **argv, vnsem_machine *machine)
 
 void console_reset(int argc, char **argv, vnsem_machine *machine)
 {
+    const vnsem_io *io;
+    vnsem_stats *stats;
+    struct _vnsem_history *history;
+
     if (!strncasecmp("mem", argv[1], 3)) {
         memset((void*)&machine->mem, 0, sizeof(machine->mem));
+#if VNS_BANKS > 1
+        memset((void*)&machine->banks, 0, sizeof(machine->banks));
+        machine->bank = 0;
+#endif
         printf("Memory unit has been reset.\n");
     } else
     if (!strncasecmp("pc", argv[1], 2)) {
@@ -284,7 +424,14 @@ void console_reset(int argc, char **argv, vnsem_machine *machine)
         printf("Program counter has been reset to 0x%.2X.\n", machine->pc);
     } else
     if (!strncasecmp("all", argv[1], 3)) {
+        /* hist_resume() pins the reset state like any other change */
+        io = machine->io;
+        stats = machine->stats;
+        history = machine->history;
         reset_machine(machine);
+        machine->io = io;
+        machine->stats = stats;
+        machine->history = history;
         machine->halted = TRUE;
         printf("Machine has been reset.\n");
     } else {
@@ -292,15 +439,95 @@ void console_reset(int argc, char **argv, vnsem_machine *machine)
     }
 }
 
+void console_restore(int argc, char **argv, vnsem_machine *machine)
+{
+    restore_state(argv[1], machine);
+}
+
 void console_run(int argc, char **argv, vnsem_machine *machine)
 {
     machine->halted = FALSE;
 }
 
+void console_save(int argc, char **argv, vnsem_machine *machine)
+{
+    save_state(argv[1], machine);
+}
+
+void console_seek(int argc, char **argv, vnsem_machine *machine)
+{
+    struct timespec start;
+    unsigned long step;
+    char *p;
+
+    if (NULL == machine->history) {
+        printf("No execution history recorded.\n");
+        return;
+    }
+
+    step = strtoul(argv[1], &p, 0);
+    if (*p || step > UINT_MAX) {
+        util_perror("Invalid step: %s\n", argv[1]);
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (hist_seek(machine->history, machine, step)) {
+        printf("Machine state after step %u restored (%.3f ms).\n",
+                machine->step_count, elapsed_ms(&start));
+    }
+}
+
+void console_stats(int argc, char **argv, vnsem_machine *machine)
+{
+    int phase;
+
+    if (NULL == machine->stats) {
+        st_enter(collect_stats(machine), ST_PHASE_CONSOLE);
+        printf("Collecting runtime statistics from now on.\n");
+        return;
+    }
+
+    if (2 == argc) {
+        if (strncasecmp("reset", argv[1], 5)) {
+            util_perror("Invalid argument.\n");
+            return;
+        }
+        phase = machine->stats->phase;
+        st_init(machine->stats);
+        st_enter(machine->stats, phase);
+        printf("Statistics have been reset.\n");
+        return;
+    }
+
+    st_print(machine->stats);
+}
+
 void console_step(int argc, char **argv, vnsem_machine *machine)
 {
+    const debuginfo *dbg = vnsem_debuginfo();
+
+    if (1 == argc) {
+        machine->halted = FALSE;
+        machine->step_mode = STEP_INSTRUCTION;
+        return;
+    }
+
+    if (strcasecmp(argv[1], "line")) {
+        util_perror("Invalid step mode: %s\n", argv[1]);
+        return;
+    }
+
+    if (NULL == dbg) {
+        printf("No debug information loaded (-g or --asm).\n");
+        return;
+    }
+
+    /* run until an instruction of another source line is reached */
     machine->halted = FALSE;
-    machine->step_mode = TRUE;
+    machine->step_mode = STEP_LINE;
+    machine->step_line = dbg->line[machine->pc];
 }
 
 int call_command(char *name, int argc, char **argv, vnsem_machine *machine)
@@ -374,3 +601,61 @@ void vnsem_console(vnsem_machine *machine)
 
     rl_attempted_completion_function = NULL;
 }
+
+/**
+ * Console for a machine running on another thread. Commands flagged
+ * CMD_LIVE run right away on a copy of the latest snapshot, all others
+ * are handed to the emulation thread. While the program waits for
+ * input, a number entered here is taken as the input value.
+ */
+void vnsem_console_live(vnsem_live *live, vnsem_machine *machine)
+{
+    const console_command *cmd;
+    vnsem_snapshot_data data;
+    char prompt[32], name[16], *input;
+    short int value;
+    int port;
+
+    rl_attempted_completion_function = completion;
+
+    while (1) {
+        port = live_input_pending(live);
+        if (port >= 0) {
+            snprintf(prompt, sizeof(prompt), "[%.2X] Program input => ", port);
+        } else {
+            snprintf(prompt, sizeof(prompt), "VNSEM Console => ");
+        }
+
+        set_block_sigint(FALSE);
+        input = readline(prompt);
+        set_block_sigint(TRUE);
+
+        if (NULL == input) {
+            exit(EXIT_SUCCESS);
+        }
+
+        if (1 == sscanf(input, "%hi", &value)) {
+            if (live_input_pending(live) < 0 || abs(value) >= 256) {
+                util_perror("Bad input. Expected byte in hex/dec notation.\n");
+            } else {
+                live_give_input(live, value);
+            }
+            free(input);
+            continue;
+        }
+
+        if (1 == sscanf(input, " %15s", name)) {
+            cmd = find_command(name);
+            if (NULL == cmd || (cmd->flags & CMD_LIVE)) {
+                snap_read(live->snap, &data);
+                snap_to_machine(&data, machine);
+                call_command_for_input(input, machine);
+            } else {
+                live_submit(live, input);
+            }
+            add_history(input);
+        }
+
+        free(input);
+    }
+}
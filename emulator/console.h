@@ -21,6 +21,10 @@
 #define CONSOLE_H 1
 
 #include "vnsem.h"
+#include "live.h"
+
+/* command only reads the machine, so it can run on a snapshot */
+#define CMD_LIVE    0x01
 
 typedef struct _console_command {
     char *name;
@@ -29,9 +33,12 @@ typedef struct _console_command {
     int minargs;
     int maxargs;
     char *usage;
+    int flags;
 } console_command;
 
 void vnsem_console(vnsem_machine *machine);
+void vnsem_console_live(vnsem_live *live, vnsem_machine *machine);
+int call_command_for_input(const char *input, vnsem_machine *machine);
 const console_command *find_command(const char *name);
 
 #endif /* CONSOLE_H */
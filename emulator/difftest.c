@@ -0,0 +1,508 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "globals.h"
+#include "utils.h"
+#include "difftest.h"
+
+typedef struct _dt_input_ctx {
+    const dt_inputs *inputs;
+    int pos;
+} dt_input_ctx;
+
+static int dt_input(uint8_t port, uint8_t *value, void *ctx)
+{
+    dt_input_ctx *in = (dt_input_ctx*)ctx;
+
+    if (in->pos >= in->inputs->count) {
+        return FALSE;
+    }
+
+    *value = in->inputs->values[in->pos++];
+    return TRUE;
+}
+
+static void dt_output(uint8_t port, uint8_t value, void *ctx)
+{
+}
+
+/* splitmix64 finalizer */
+static inline uint64_t dt_mix(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+static inline uint64_t dt_cell(uint8_t addr, uint8_t value)
+{
+    return dt_mix(((uint64_t)addr << 8 | value) + 0x9e3779b97f4a7c15ULL);
+}
+
+static uint64_t dt_memhash(const vnsem_machine *m)
+{
+    uint64_t hash = 0;
+    int i;
+
+    for (i = 0; i < sizeof(m->mem); ++i) {
+        hash ^= dt_cell(i, m->mem[i]);
+    }
+
+    return hash;
+}
+
+static inline uint64_t dt_combine(const vnsem_machine *m, uint64_t memhash)
+{
+    uint64_t regs = (uint64_t)m->pc |
+                    (uint64_t)m->sp << 8 |
+                    (uint64_t)m->accu << 16 |
+                    (uint64_t)m->reg_l << 24 |
+                    (uint64_t)m->flags << 32 |
+                    (uint64_t)m->halted << 40 |
+                    (uint64_t)m->int_active << 41;
+
+#if VNS_BANKS > 1
+    regs |= (uint64_t)m->bank << 48;
+#endif
+
+    return memhash ^ dt_mix(regs ^ dt_mix(m->step_count));
+}
+
+/**
+ * Compute the fingerprint of the complete machine state from scratch.
+ */
+uint64_t dt_fingerprint(const vnsem_machine *m)
+{
+    return dt_combine(m, dt_memhash(m));
+}
+
+void dt_track_init(dt_tracker *t, const vnsem_machine *m)
+{
+    t->memhash = dt_memhash(m);
+}
+
+/**
+ * Determine the memory cell the next instruction may write to. Returns
+ * FALSE if the instruction does not write to memory.
+ */
+static inline int dt_write_addr(const vnsem_machine *m, uint8_t *addr)
+{
+    switch (m->mem[m->pc]) {
+        case 0x32: /* STA adr */
+            *addr = m->mem[(uint8_t)(m->pc + 1)];
+            return TRUE;
+        case 0x77: /* MOV M,A */
+            *addr = m->reg_l;
+            return TRUE;
+        case 0xf5: case 0xe5: case 0xed:            /* PUSH */
+        case 0xcd: case 0xcc: case 0xc4:            /* CALL, CZ, CNZ */
+        case 0xdc: case 0xd4:                       /* CC, CNC */
+            *addr = m->sp - 1;
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+/**
+ * Execute a single step with *engine* and update the fingerprint. Only
+ * the cell the instruction is supposed to write is rehashed, writes to
+ * any other cell are caught by the periodic full recomputation. A step
+ * covering several instructions always recomputes it. Returns the
+ * result of the engine's step function.
+ */
+int dt_track_step(dt_tracker *t, vnsem_machine *m,
+                  const vnsem_engine *engine, uint64_t *fp)
+{
+    uint32_t count = m->step_count;
+    uint8_t addr = 0, old = 0;
+    int writes, result;
+
+    if ((writes = dt_write_addr(m, &addr))) {
+        old = m->mem[addr];
+    }
+
+    result = engine->step(m);
+
+    if (writes && old != m->mem[addr]) {
+        t->memhash ^= dt_cell(addr, old) ^ dt_cell(addr, m->mem[addr]);
+    }
+
+    if (0 == m->step_count % DT_RESYNC || m->step_count - count > 1) {
+        t->memhash = dt_memhash(m);
+    }
+
+    *fp = dt_combine(m, t->memhash);
+
+    return result;
+}
+
+static void dt_diff_field(const char *name, int a, int b)
+{
+    if (a != b) {
+        printf("  %-12s 0x%.2X  !=  0x%.2X\n", name, a, b);
+    }
+}
+
+/**
+ * Print all fields in which the machine states *a* and *b* differ.
+ */
+void dt_print_diff(const vnsem_machine *a, const vnsem_machine *b)
+{
+    char name[16];
+    int i;
+
+    if (a->step_count != b->step_count) {
+        printf("  %-12s %u  !=  %u\n", "step_count",
+                a->step_count, b->step_count);
+    }
+
+    dt_diff_field("pc", a->pc, b->pc);
+    dt_diff_field("sp", a->sp, b->sp);
+    dt_diff_field("accu", a->accu, b->accu);
+    dt_diff_field("reg_l", a->reg_l, b->reg_l);
+    dt_diff_field("flags", a->flags, b->flags);
+    dt_diff_field("halted", a->halted, b->halted);
+    dt_diff_field("int_active", a->int_active, b->int_active);
+
+    for (i = 0; i < sizeof(a->mem); ++i) {
+        snprintf(name, sizeof(name), "mem[0x%.2X]", i);
+        dt_diff_field(name, a->mem[i], b->mem[i]);
+    }
+}
+
+/**
+ * Parse a comma separated list of input values.
+ * Returns TRUE on success or FALSE on error.
+ */
+int dt_parse_inputs(const char *str, dt_inputs *inputs)
+{
+    char *copy = strdup(str), *tok;
+    int result = TRUE;
+
+    inputs->count = 0;
+
+    for (tok = strtok(copy, ","); NULL != tok; tok = strtok(NULL, ",")) {
+        if (inputs->count >= DT_MAX_INPUTS ||
+                !util_strtouint8(tok, &inputs->values[inputs->count])) {
+            result = FALSE;
+            break;
+        }
+        inputs->count++;
+    }
+
+    free(copy);
+    return result;
+}
+
+static int dt_equal(const vnsem_machine *a, const vnsem_machine *b)
+{
+    return a->step_count == b->step_count &&
+           a->pc == b->pc && a->sp == b->sp &&
+           a->accu == b->accu && a->reg_l == b->reg_l &&
+           a->flags == b->flags && a->halted == b->halted &&
+           a->int_active == b->int_active &&
+           0 == memcmp(a->mem, b->mem, sizeof(a->mem))
+#if VNS_BANKS > 1
+           && a->bank == b->bank &&
+           0 == memcmp(a->banks, b->banks, sizeof(a->banks))
+#endif
+           ;
+}
+
+/* one of the machines compared by dt_lockstep() */
+typedef struct _dt_side {
+    const vnsem_engine *engine;
+    vnsem_machine m;
+    dt_tracker t;
+    uint64_t fp;
+    int result;
+} dt_side;
+
+static inline int dt_running(const dt_side *s)
+{
+    return 0 == s->result && !s->m.halted;
+}
+
+/**
+ * Step both sides until they executed the same number of instructions
+ * again. An engine executing several at once runs ahead, the other one
+ * catches up until it gets there or stops.
+ */
+static void dt_step_both(dt_side *a, dt_side *b)
+{
+    dt_side *behind;
+
+    a->result = dt_track_step(&a->t, &a->m, a->engine, &a->fp);
+    b->result = dt_track_step(&b->t, &b->m, b->engine, &b->fp);
+
+    while (a->m.step_count != b->m.step_count) {
+        behind = (a->m.step_count < b->m.step_count) ? a : b;
+        if (!dt_running(behind)) {
+            break;
+        }
+        behind->result = dt_track_step(&behind->t, &behind->m,
+                                       behind->engine, &behind->fp);
+    }
+}
+
+/**
+ * Run engines *a* and *b* in lockstep, both starting from machine state
+ * *m*, and compare their fingerprints after every step. Since memory
+ * writes the fingerprint does not expect only show up at the next full
+ * recomputation, both machines are saved at every recomputation. A
+ * mismatch replays the steps since then with full state comparison to
+ * find the exact step. On divergence the step, the program counter and
+ * a field-level diff are printed, and the step is stored in *diverged_at*
+ * unless it is NULL. Returns TRUE if both engines behaved identically.
+ */
+int dt_lockstep(const vnsem_machine *m, const vnsem_engine *a,
+                const vnsem_engine *b, const dt_inputs *inputs,
+                unsigned long max_steps, unsigned long *diverged_at)
+{
+    dt_side sa = { a, *m }, sb = { b, *m }, saved_a, saved_b;
+    dt_input_ctx ctx_a = { inputs, 0 }, ctx_b = { inputs, 0 };
+    dt_input_ctx saved_ctx_a, saved_ctx_b;
+    vnsem_io io_a = { dt_input, dt_output, &ctx_a };
+    vnsem_io io_b = { dt_input, dt_output, &ctx_b };
+    unsigned long steps = 0;
+    uint32_t end;
+    int diverged = FALSE;
+    uint8_t pc = m->pc;
+
+    sa.m.io = &io_a;
+    sb.m.io = &io_b;
+    dt_track_init(&sa.t, &sa.m);
+    dt_track_init(&sb.t, &sb.m);
+    saved_a = sa; saved_b = sb;
+    saved_ctx_a = ctx_a; saved_ctx_b = ctx_b;
+
+    while (steps < max_steps) {
+        dt_step_both(&sa, &sb);
+        steps = sa.m.step_count - m->step_count;
+
+        if (sa.fp != sb.fp || sa.result != sb.result) {
+            diverged = TRUE;
+            break;
+        }
+
+        if (!dt_running(&sa)) {
+            break;
+        }
+
+        if (sa.m.step_count - saved_a.m.step_count >= DT_RESYNC) {
+            saved_a = sa; saved_b = sb;
+            saved_ctx_a = ctx_a; saved_ctx_b = ctx_b;
+        }
+    }
+
+    if (!diverged && dt_fingerprint(&sa.m) == dt_fingerprint(&sb.m)) {
+        printf("Engines '%s' and '%s' agree on %lu steps.\n",
+                a->name, b->name, steps);
+        if (NULL != diverged_at) {
+            *diverged_at = 0;
+        }
+        return TRUE;
+    }
+
+    /* locate the exact step by replaying from the last saved state */
+    end = (sa.m.step_count > sb.m.step_count) ? sa.m.step_count
+                                                : sb.m.step_count;
+    sa = saved_a; sb = saved_b;
+    ctx_a = saved_ctx_a; ctx_b = saved_ctx_b;
+
+    do {
+        pc = sa.m.pc;
+        dt_step_both(&sa, &sb);
+    } while (sa.result == sb.result && dt_equal(&sa.m, &sb.m) &&
+             dt_running(&sa) && sa.m.step_count < end);
+
+    steps = sa.m.step_count - m->step_count;
+    printf("Engines '%s' and '%s' diverge at step %lu (PC 0x%.2X):\n",
+            a->name, b->name, steps, pc);
+    if (NULL != diverged_at) {
+        *diverged_at = steps;
+    }
+    if (sa.result != sb.result) {
+        printf("  %-12s %i  !=  %i\n", "result", sa.result, sb.result);
+    }
+    dt_print_diff(&sa.m, &sb.m);
+
+    return FALSE;
+}
+
+/**
+ * Run *engine* from state *m* and store the fingerprint of every step
+ * in the golden stream file *path*. The fingerprints are computed from
+ * scratch, so the stream holds the exact state even of engines writing
+ * memory the tracker does not expect. Returns TRUE on success.
+ */
+int dt_record(const vnsem_machine *m, const vnsem_engine *engine,
+              const dt_inputs *inputs, unsigned long max_steps,
+              const char *path)
+{
+    vnsem_machine mm = *m;
+    dt_input_ctx ctx = { inputs, 0 };
+    vnsem_io io = { dt_input, dt_output, &ctx };
+    dt_golden_header header;
+    uint64_t buf[1024];
+    unsigned long step;
+    int n = 0, result = 0;
+    FILE *out;
+
+    if (engine->flags & ENGINE_SKIPS) {
+        util_perror("Engine '%s' skips steps, record with another one\n",
+                    engine->name);
+        return FALSE;
+    }
+
+    if (NULL == (out = fopen(path, "w"))) {
+        perror(path);
+        return FALSE;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, DT_MAGIC, sizeof(header.magic));
+    header.version = DT_VERSION;
+    header.resync = DT_RESYNC;
+    fwrite(&header, sizeof(header), 1, out);
+
+    mm.io = &io;
+
+    for (step = 0; step < max_steps && 0 == result && !mm.halted; ++step) {
+        result = engine->step(&mm);
+        buf[n++] = dt_fingerprint(&mm);
+        if (n == sizeof(buf) / sizeof(uint64_t)) {
+            fwrite(buf, sizeof(uint64_t), n, out);
+            n = 0;
+        }
+    }
+
+    fwrite(buf, sizeof(uint64_t), n, out);
+
+    header.steps = step;
+    fseek(out, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, out);
+
+    if (0 != fclose(out)) {
+        perror(path);
+        return FALSE;
+    }
+
+    printf("Recorded %lu step fingerprints with engine '%s' to '%s'.\n",
+            step, engine->name, path);
+
+    return TRUE;
+}
+
+/**
+ * Replay the golden stream *path* with *engine* starting from state *m*.
+ * The stream is mapped into memory and compared step by step, engines
+ * executing several instructions at once are compared after each of
+ * their steps. There is nothing to replay against, so the fingerprint
+ * is computed from scratch each time and a stray write shows up at the
+ * step that did it. The first diverging step is stored in *diverged_at*
+ * unless it is NULL. Returns TRUE if the engine reproduces the stream
+ * exactly.
+ */
+int dt_verify(const vnsem_machine *m, const vnsem_engine *engine,
+              const dt_inputs *inputs, const char *path,
+              unsigned long *diverged_at)
+{
+    vnsem_machine mm = *m;
+    dt_input_ctx ctx = { inputs, 0 };
+    vnsem_io io = { dt_input, dt_output, &ctx };
+    const dt_golden_header *header;
+    const uint64_t *golden;
+    struct stat st;
+    uint64_t step;
+    void *map;
+    int fd, ok = TRUE;
+    uint8_t pc;
+
+    if (-1 == (fd = open(path, O_RDONLY)) || -1 == fstat(fd, &st)) {
+        perror(path);
+        return FALSE;
+    }
+
+    if (st.st_size < sizeof(dt_golden_header) ||
+            MAP_FAILED == (map = mmap(NULL, st.st_size, PROT_READ,
+                                      MAP_PRIVATE, fd, 0))) {
+        util_perror("%s: invalid golden stream\n", path);
+        close(fd);
+        return FALSE;
+    }
+
+    close(fd);
+    header = (const dt_golden_header*)map;
+    golden = (const uint64_t*)(header + 1);
+
+    if (0 != memcmp(header->magic, DT_MAGIC, sizeof(header->magic)) ||
+            header->version != DT_VERSION ||
+            header->resync != DT_RESYNC ||
+            st.st_size < sizeof(*header) + header->steps * sizeof(uint64_t)) {
+        util_perror("%s: invalid golden stream\n", path);
+        munmap(map, st.st_size);
+        return FALSE;
+    }
+
+    mm.io = &io;
+    if (NULL != diverged_at) {
+        *diverged_at = 0;
+    }
+
+    for (step = 0; step < header->steps; ) {
+        pc = mm.pc;
+        engine->step(&mm);
+        step = mm.step_count - m->step_count;
+        if (step > header->steps) {
+            break;      // summarized past the end of the stream
+        }
+        if (dt_fingerprint(&mm) != golden[step - 1]) {
+            printf("Engine '%s' diverges from '%s' at step %llu "
+                   "(PC 0x%.2X).\n", engine->name, path,
+                   (unsigned long long)step, pc);
+            if (NULL != diverged_at) {
+                *diverged_at = step;
+            }
+            ok = FALSE;
+            break;
+        }
+    }
+
+    if (ok) {
+        printf("Engine '%s' matches all %llu steps of '%s'.\n",
+                engine->name, (unsigned long long)header->steps, path);
+    }
+
+    munmap(map, st.st_size);
+
+    return ok;
+}
@@ -0,0 +1,73 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DIFFTEST_H
+#define DIFFTEST_H 1
+
+#include <stdint.h>
+
+#include "vnsem.h"
+
+#define DT_MAGIC        "VNSG"
+#define DT_VERSION      1
+/* steps between two full recomputations of the memory fingerprint */
+#define DT_RESYNC       256
+#define DT_MAX_INPUTS   64
+
+/**
+ * Incrementally maintained fingerprint of a machine's memory. Each cell
+ * contributes a hash of (address, value), all contributions are XORed.
+ * A memory write therefore only needs two XOR operations to update it.
+ */
+typedef struct _dt_tracker {
+    uint64_t memhash;
+} dt_tracker;
+
+/* deterministic values fed to the IN instruction */
+typedef struct _dt_inputs {
+    uint8_t values[DT_MAX_INPUTS];
+    int count;
+} dt_inputs;
+
+typedef struct _dt_golden_header {
+    char magic[4];
+    uint32_t version;
+    uint32_t resync;
+    uint32_t reserved;
+    uint64_t steps;
+} dt_golden_header;
+
+uint64_t dt_fingerprint(const vnsem_machine *m);
+void dt_track_init(dt_tracker *t, const vnsem_machine *m);
+int dt_track_step(dt_tracker *t, vnsem_machine *m,
+                  const vnsem_engine *engine, uint64_t *fp);
+void dt_print_diff(const vnsem_machine *a, const vnsem_machine *b);
+int dt_parse_inputs(const char *str, dt_inputs *inputs);
+
+int dt_lockstep(const vnsem_machine *m, const vnsem_engine *a,
+                const vnsem_engine *b, const dt_inputs *inputs,
+                unsigned long max_steps, unsigned long *diverged_at);
+int dt_record(const vnsem_machine *m, const vnsem_engine *engine,
+              const dt_inputs *inputs, unsigned long max_steps,
+              const char *path);
+int dt_verify(const vnsem_machine *m, const vnsem_engine *engine,
+              const dt_inputs *inputs, const char *path,
+              unsigned long *diverged_at);
+
+#endif /* DIFFTEST_H */
@@ -0,0 +1,391 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "globals.h"
+#include "analyzer.h"
+#include "fuzzer.h"
+
+#define EDGE_BYTE(from, to) (((from) << 5) | ((to) >> 3))
+#define EDGE_BIT(to)        (1 << ((to) & 7))
+
+#define EDGE_SET(cov, from, to) \
+    ((cov)->edges[EDGE_BYTE(from, to)] |= EDGE_BIT(to))
+#define EDGE_ISSET(cov, from, to) \
+    ((cov)->edges[EDGE_BYTE(from, to)] & EDGE_BIT(to))
+
+typedef struct _fuzz_io_ctx {
+    const fuzz_input *input;
+    uint8_t pos;
+} fuzz_io_ctx;
+
+static int fuzz_io_input(uint8_t port, uint8_t *value, void *ctx)
+{
+    fuzz_io_ctx *io = (fuzz_io_ctx*)ctx;
+
+    if (io->pos >= io->input->len) {
+        return FALSE;
+    }
+
+    *value = io->input->values[io->pos++];
+    return TRUE;
+}
+
+static void fuzz_io_output(uint8_t port, uint8_t value, void *ctx)
+{
+    /* program output is not interesting for coverage */
+}
+
+/* xorshift32, good enough to pick mutations */
+static uint32_t fuzz_rand(fuzz_state *fs)
+{
+    fs->rng ^= fs->rng << 13;
+    fs->rng ^= fs->rng >> 17;
+    fs->rng ^= fs->rng << 5;
+    return fs->rng;
+}
+
+static int is_cond_branch(uint8_t opcode)
+{
+    switch (opcode) {
+        case 0xca: case 0xc2: case 0xda: case 0xd2: /* Jcc */
+        case 0xcc: case 0xc4: case 0xdc: case 0xd4: /* Ccc */
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+/**
+ * Run *m* until it halts, fails, runs out of input or exceeds the step
+ * limit and record the coverage in *cov*. If *stop_at_input* is set, the
+ * run stops right before the first IN instruction is executed.
+ */
+static void fuzz_run(fuzz_state *fs, vnsem_machine *m,
+                     fuzz_coverage *cov, int stop_at_input)
+{
+    unsigned int steps = 0;
+    uint8_t pc, prev = m->pc;
+
+    while (!m->halted && steps < FUZZ_MAX_STEPS) {
+        pc = m->pc;
+        cov->pc[pc] = 1;
+        if (steps) {
+            EDGE_SET(cov, prev, pc);
+        }
+
+        if (stop_at_input && m->mem[pc] == 0xdb) {
+            break;
+        }
+
+        prev = pc;
+        steps++;
+
+        if (0 != step_machine(m)) {
+            break;
+        }
+    }
+
+    fs->steps += steps;
+}
+
+/**
+ * Add the coverage of a single run to the total coverage. Returns TRUE
+ * if the run has reached any instruction or edge not seen before.
+ */
+static int fuzz_merge(fuzz_state *fs, const fuzz_coverage *cov)
+{
+    const uint8_t *mem = fs->snapshot.mem;
+    int i, found = FALSE;
+    uint8_t target, next;
+
+    for (i = 0; i < sizeof(cov->pc); ++i) {
+        if (!cov->pc[i]) {
+            continue;
+        }
+
+        fs->pc_hits[i]++;
+        if (!fs->total.pc[i]) {
+            fs->total.pc[i] = 1;
+            found = TRUE;
+        }
+
+        if (is_cond_branch(mem[i])) {
+            target = mem[(uint8_t)(i + 1)];
+            next = i + 2;
+            if (EDGE_ISSET(cov, i, target)) fs->branch_hits[i][0]++;
+            if (EDGE_ISSET(cov, i, next))   fs->branch_hits[i][1]++;
+        }
+    }
+
+    for (i = 0; i < sizeof(cov->edges); ++i) {
+        if (cov->edges[i] & ~fs->total.edges[i]) {
+            fs->total.edges[i] |= cov->edges[i];
+            found = TRUE;
+        }
+    }
+
+    return found;
+}
+
+static void fuzz_mutate(fuzz_state *fs, fuzz_input *in)
+{
+    static const uint8_t interesting[] = {
+        0x00, 0x01, 0x02, 0x10, 0x7f, 0x80, 0xfe, 0xff
+    };
+    const fuzz_input *other;
+    int n = 1 + fuzz_rand(fs) % 4;
+    uint8_t pos, len;
+
+    while (n--) {
+        pos = (in->len) ? fuzz_rand(fs) % in->len : 0;
+
+        switch ((in->len) ? fuzz_rand(fs) % 7 : 4) {
+            case 0: /* flip a bit */
+                in->values[pos] ^= 1 << (fuzz_rand(fs) % 8);
+                break;
+            case 1: /* random byte */
+                in->values[pos] = fuzz_rand(fs);
+                break;
+            case 2: /* interesting value */
+                in->values[pos] = interesting[fuzz_rand(fs) %
+                                              sizeof(interesting)];
+                break;
+            case 3: /* small delta */
+                in->values[pos] += (int)(fuzz_rand(fs) % 33) - 16;
+                break;
+            case 4: /* insert a value */
+                if (in->len < FUZZ_MAX_INPUTS) {
+                    memmove(&in->values[pos + 1], &in->values[pos],
+                            in->len - pos);
+                    in->values[pos] = interesting[fuzz_rand(fs) %
+                                                  sizeof(interesting)];
+                    in->len++;
+                }
+                break;
+            case 5: /* delete a value */
+                memmove(&in->values[pos], &in->values[pos + 1],
+                        in->len - pos - 1);
+                in->len--;
+                break;
+            case 6: /* splice with another corpus entry */
+                other = &fs->corpus[fuzz_rand(fs) % fs->corpus_len];
+                len = other->len - ((other->len > pos) ? pos : other->len);
+                memcpy(&in->values[pos], &other->values[other->len - len],
+                       len);
+                in->len = pos + len;
+                break;
+        }
+    }
+}
+
+/**
+ * Execute a single run for *input* starting from the snapshot. Returns
+ * TRUE if the run has reached new coverage.
+ */
+static int fuzz_one(fuzz_state *fs, const fuzz_coverage *prefix,
+                    const fuzz_input *input)
+{
+    static fuzz_coverage cov;
+    vnsem_machine m = fs->snapshot;
+    fuzz_io_ctx ctx = { input, 0 };
+    vnsem_io io = { fuzz_io_input, fuzz_io_output, &ctx };
+
+    m.io = &io;
+    memcpy(&cov, prefix, sizeof(cov));
+
+    fuzz_run(fs, &m, &cov, FALSE);
+    fs->runs++;
+
+    return fuzz_merge(fs, &cov);
+}
+
+static void fuzz_keep(fuzz_state *fs, const fuzz_input *input)
+{
+    if (fs->corpus_len < FUZZ_MAX_CORPUS) {
+        fs->corpus[fs->corpus_len++] = *input;
+    }
+}
+
+/**
+ * Fuzz the program loaded into *m* for *runs* runs. The program is
+ * executed once up to its first IN instruction. All further runs start
+ * from a snapshot taken at that point and feed mutated input sequences
+ * to the program. Inputs reaching new coverage are kept in the corpus.
+ * The loaded image and its entry point are kept for the report.
+ */
+void fuzz_program(vnsem_machine *m, unsigned long runs, fuzz_state *fs)
+{
+    static fuzz_coverage prefix;
+    static const uint8_t seeds[] = { 0x00, 0x01, 0xff };
+    struct timespec start, end;
+    fuzz_input input;
+    int i;
+
+    memset(fs, 0, sizeof(*fs));
+    memset(&prefix, 0, sizeof(prefix));
+    fs->rng = 0x2545f491;
+    memcpy(fs->image, m->mem, sizeof(fs->image));
+    fs->entry = m->pc;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    /* run up to the first IN instruction */
+    fs->snapshot = *m;
+    fs->snapshot.io = NULL;
+    fuzz_run(fs, &fs->snapshot, &prefix, TRUE);
+    fs->has_snapshot = !fs->snapshot.halted &&
+                       fs->snapshot.mem[fs->snapshot.pc] == 0xdb;
+
+    if (!fs->has_snapshot) {
+        /* the program does not read any input */
+        fs->runs = 1;
+        fuzz_merge(fs, &prefix);
+    } else {
+        for (i = 0; i < sizeof(seeds) && fs->runs < runs; ++i) {
+            input.len = 1;
+            input.values[0] = seeds[i];
+            if (fuzz_one(fs, &prefix, &input)) {
+                fuzz_keep(fs, &input);
+            }
+        }
+
+        while (fs->runs < runs) {
+            input = fs->corpus[fuzz_rand(fs) % fs->corpus_len];
+            fuzz_mutate(fs, &input);
+            if (fuzz_one(fs, &prefix, &input)) {
+                fuzz_keep(fs, &input);
+            }
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    fs->elapsed = (end.tv_sec - start.tv_sec) +
+                  (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+void fuzz_print_report(fuzz_state *fs)
+{
+    const uint8_t *mem = fs->snapshot.mem;
+    unsigned int i, j, pcs = 0, edges = 0;
+    an_result res;
+
+    an_analyze(fs->image, fs->entry, &res);
+
+    for (i = 0; i < sizeof(fs->total.pc); ++i) {
+        pcs += fs->total.pc[i];
+    }
+
+    for (i = 0; i < sizeof(fs->total.edges); ++i) {
+        edges += __builtin_popcount(fs->total.edges[i]);
+    }
+
+    printf("\nFuzzing finished after %lu run(s) and %llu steps "
+           "(%.0f runs/s, %.2f M steps/s).\n",
+            fs->runs, fs->steps,
+            fs->runs / fs->elapsed, fs->steps / fs->elapsed / 1e6);
+    printf("Covered %u of %u instructions statically reachable from "
+           "0x%.2X and %u edges.\n", pcs, res.ins_count, fs->entry, edges);
+
+    if (!fs->has_snapshot) {
+        printf("The program does not read any input.\n\n");
+        return;
+    }
+
+    for (i = 0; i < sizeof(fs->total.pc); ++i) {
+        if (fs->total.pc[i] && is_cond_branch(mem[i]) &&
+                (!fs->branch_hits[i][0] || !fs->branch_hits[i][1])) {
+            printf("  branch at 0x%.2X never %s\n", i,
+                    (fs->branch_hits[i][0]) ? "falls through" : "taken");
+        }
+    }
+
+    printf("Corpus (%u input sequence(s)):\n", fs->corpus_len);
+    for (i = 0; i < fs->corpus_len; ++i) {
+        printf("  #%-3u", i);
+        for (j = 0; j < fs->corpus[i].len; ++j) {
+            printf(" 0x%.2X", fs->corpus[i].values[j]);
+        }
+        printf("\n");
+    }
+    printf("\n");
+}
+
+/**
+ * Export the accumulated coverage in lcov tracefile format. Line and
+ * branch records are mapped back to the assembler source with the
+ * debug information *dbg*. Hit counts are given in runs.
+ * Returns TRUE on success or FALSE on error.
+ */
+int fuzz_write_lcov(fuzz_state *fs, const vnsem_machine *m,
+                    const debuginfo *dbg, const char *path)
+{
+    unsigned int addr, line, lf = 0, lh = 0, brf = 0, brh = 0;
+    int branch;
+    FILE *out;
+
+    if (NULL == (out = fopen(path, "w"))) {
+        perror(path);
+        return FALSE;
+    }
+
+    fprintf(out, "TN:vnsem_fuzz\n");
+    fprintf(out, "SF:%s\n", dbg->source);
+
+    for (addr = 0; addr < DBG_MEMORY_SIZE; ++addr) {
+        if (0 == (line = dbg->line[addr])) {
+            continue;
+        }
+
+        fprintf(out, "DA:%u,%u\n", line, fs->pc_hits[addr]);
+        lf++;
+        lh += (fs->pc_hits[addr]) ? 1 : 0;
+
+        if (!is_cond_branch(m->mem[addr])) {
+            continue;
+        }
+
+        /* branch 0 is the taken jump/call, branch 1 the fall through */
+        for (branch = 0; branch < 2; ++branch) {
+            brf++;
+            if (!fs->pc_hits[addr]) {
+                fprintf(out, "BRDA:%u,%u,%i,-\n", line, addr, branch);
+                continue;
+            }
+            fprintf(out, "BRDA:%u,%u,%i,%u\n", line, addr, branch,
+                    fs->branch_hits[addr][branch]);
+            brh += (fs->branch_hits[addr][branch]) ? 1 : 0;
+        }
+    }
+
+    fprintf(out, "BRF:%u\nBRH:%u\n", brf, brh);
+    fprintf(out, "LF:%u\nLH:%u\n", lf, lh);
+    fprintf(out, "end_of_record\n");
+
+    if (0 != fclose(out)) {
+        perror(path);
+        return FALSE;
+    }
+
+    return TRUE;
+}
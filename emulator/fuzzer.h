@@ -0,0 +1,71 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef FUZZER_H
+#define FUZZER_H 1
+
+#include <stdint.h>
+
+#include "debuginfo.h"
+#include "vnsem.h"
+
+#define FUZZ_MAX_INPUTS  32
+#define FUZZ_MAX_CORPUS  256
+#define FUZZ_MAX_STEPS   100000
+
+typedef struct _fuzz_input {
+    uint8_t len;
+    uint8_t values[FUZZ_MAX_INPUTS];
+} fuzz_input;
+
+/**
+ * Coverage of a single run: a bitmap of executed instruction addresses
+ * and a bitmap of all taken (from, to) edges between instructions.
+ */
+typedef struct _fuzz_coverage {
+    uint8_t pc[256];
+    uint8_t edges[256 * 256 / 8];
+} fuzz_coverage;
+
+typedef struct _fuzz_state {
+    /* memory and entry point of the program as loaded */
+    uint8_t image[256];
+    uint8_t entry;
+    /* machine state right before the first IN instruction */
+    vnsem_machine snapshot;
+    uint8_t has_snapshot;
+    /* accumulated coverage and hit counts over all runs */
+    fuzz_coverage total;
+    uint32_t pc_hits[256];
+    uint32_t branch_hits[256][2];
+    /* inputs that reached new coverage */
+    fuzz_input corpus[FUZZ_MAX_CORPUS];
+    unsigned int corpus_len;
+    unsigned long runs;
+    unsigned long long steps;
+    double elapsed;
+    uint32_t rng;
+} fuzz_state;
+
+void fuzz_program(vnsem_machine *m, unsigned long runs, fuzz_state *fs);
+void fuzz_print_report(fuzz_state *fs);
+int fuzz_write_lcov(fuzz_state *fs, const vnsem_machine *m,
+                    const debuginfo *dbg, const char *path);
+
+#endif /* FUZZER_H */
@@ -0,0 +1,514 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "globals.h"
+#include "utils.h"
+#include "history.h"
+
+#define INS_IN  0xdb
+
+/* ------------------------------------------------------------------------
+ *                               recording
+ * ------------------------------------------------------------------------ */
+
+static const hist_input *find_input(const vnsem_history *h, unsigned int step)
+{
+    int lo = 0, hi = (int)h->input_count - 1, mid;
+
+    while (lo <= hi) {
+        mid = (lo + hi) / 2;
+        if (h->inputs[mid].step == step) {
+            return &h->inputs[mid];
+        }
+        if (h->inputs[mid].step < step) {
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+
+    return NULL;
+}
+
+/* input hook used while re-executing recorded steps */
+static int replay_input(uint8_t port, uint8_t *value, void *ctx)
+{
+    vnsem_history *h = (vnsem_history*)ctx;
+    const hist_input *in = find_input(h, h->replay_step);
+
+    if (NULL == in) {
+        return FALSE;
+    }
+
+    *value = in->value;
+    return TRUE;
+}
+
+static void replay_output(uint8_t port, uint8_t value, void *ctx)
+{
+    if (!((vnsem_history*)ctx)->quiet) {
+        print_program_output(port, value,
+                             ((vnsem_history*)ctx)->replay_step);
+    }
+}
+
+int hist_init(vnsem_history *h, size_t budget)
+{
+    memset(h, 0, sizeof(*h));
+
+    h->capacity = budget / sizeof(hist_checkpoint);
+    if (h->capacity < 2) {
+        h->capacity = 2;
+    }
+
+    if (NULL == (h->checkpoints = malloc(h->capacity * sizeof(hist_checkpoint)))) {
+        perror("history");
+        return FALSE;
+    }
+
+    h->interval = HIST_MIN_INTERVAL;
+    h->replay_io.input = replay_input;
+    h->replay_io.output = replay_output;
+    h->replay_io.ctx = h;
+
+    return TRUE;
+}
+
+void hist_free(vnsem_history *h)
+{
+    free(h->checkpoints);
+    free(h->inputs);
+    memset(h, 0, sizeof(*h));
+}
+
+/**
+ * Drop every other checkpoint except the first and the pinned ones and
+ * double the interval. If all are pinned, the oldest one goes.
+ */
+static void thin_out(vnsem_history *h)
+{
+    unsigned int i, j = 0;
+
+    for (i = 0; i < h->count; ++i) {
+        if (0 == i || 0 == i % 2 || h->checkpoints[i].pinned) {
+            h->checkpoints[j++] = h->checkpoints[i];
+        }
+    }
+
+    if (j == h->count) {
+        memmove(h->checkpoints, h->checkpoints + 1,
+                --j * sizeof(hist_checkpoint));
+    }
+
+    h->count = j;
+    h->interval *= 2;
+}
+
+static void add_checkpoint(vnsem_history *h, const vnsem_machine *m,
+                           uint8_t pinned)
+{
+    hist_checkpoint *cp;
+
+    if (h->count == h->capacity) {
+        thin_out(h);
+    }
+
+    cp = &h->checkpoints[h->count++];
+    cp->machine = *m;
+    cp->pinned = pinned;
+}
+
+/* forget everything recorded after *step* */
+static void truncate_history(vnsem_history *h, unsigned int step)
+{
+    while (h->count &&
+            h->checkpoints[h->count - 1].machine.step_count >= step) {
+        h->count--;
+    }
+
+    while (h->input_count && h->inputs[h->input_count - 1].step > step) {
+        h->input_count--;
+    }
+
+    h->head = step;
+}
+
+/**
+ * Called before each step of the interactive emulator. Steps below the
+ * head of the history are re-executed with the logged input, new steps
+ * are checkpointed every *interval* steps.
+ */
+void hist_before_step(vnsem_history *h, vnsem_machine *m)
+{
+    hist_checkpoint *last;
+
+    if (m->step_count < h->head) {
+        h->replay_step = m->step_count + 1;
+        h->quiet = FALSE;
+        m->io = &h->replay_io;
+        return;
+    }
+
+    m->io = NULL;
+    last = (h->count) ? &h->checkpoints[h->count - 1] : NULL;
+
+    if (NULL == last || m->step_count >= last->machine.step_count + h->interval) {
+        add_checkpoint(h, m, FALSE);
+    }
+}
+
+void hist_after_step(vnsem_history *h, vnsem_machine *m, uint8_t ins, int result)
+{
+    hist_input *in;
+
+    if (INS_IN == ins && 0 == result) {
+        if (m->io == &h->replay_io) {
+            /* restore flags of inputs outside the byte range */
+            if (NULL != (in = (hist_input*)find_input(h, m->step_count))) {
+                m->flags = in->flags;
+            }
+        } else {
+            if (h->input_count == h->input_capacity) {
+                h->input_capacity = (h->input_capacity) ?
+                                    2 * h->input_capacity : 64;
+                h->inputs = realloc(h->inputs,
+                                    h->input_capacity * sizeof(hist_input));
+                if (NULL == h->inputs) {
+                    perror("history");
+                    exit(EXIT_FAILURE);
+                }
+            }
+            in = &h->inputs[h->input_count++];
+            in->step = m->step_count;
+            in->value = m->accu;
+            in->flags = m->flags;
+        }
+    }
+
+    if (m->step_count > h->head) {
+        h->head = m->step_count;
+    }
+}
+
+/* compare everything the program can observe */
+static int same_state(const vnsem_machine *a, const vnsem_machine *b)
+{
+    return a->step_count == b->step_count && a->pc == b->pc &&
+           a->reg_l == b->reg_l && a->sp == b->sp && a->accu == b->accu &&
+           a->flags == b->flags && a->int_active == b->int_active &&
+           0 == memcmp(a->mem, b->mem, sizeof(a->mem))
+#if VNS_BANKS > 1
+           && a->bank == b->bank &&
+           0 == memcmp(a->banks, b->banks, sizeof(a->banks))
+#endif
+           ;
+}
+
+void hist_pause(vnsem_history *h, vnsem_machine *m)
+{
+    h->consistent = *m;
+}
+
+/**
+ * Called when the console returns. If the machine was changed by hand,
+ * the recorded future is no longer valid: it is dropped and the new
+ * state becomes a pinned checkpoint.
+ */
+void hist_resume(vnsem_history *h, vnsem_machine *m)
+{
+    if (same_state(m, &h->consistent)) {
+        return;
+    }
+
+    truncate_history(h, m->step_count);
+    add_checkpoint(h, m, TRUE);
+}
+
+/* ------------------------------------------------------------------------
+ *                              time travel
+ * ------------------------------------------------------------------------ */
+
+/* index of the last checkpoint at or before *step*, -1 if none */
+static int find_checkpoint(const vnsem_history *h, unsigned int step)
+{
+    int lo = 0, hi = (int)h->count - 1, mid, found = -1;
+
+    while (lo <= hi) {
+        mid = (lo + hi) / 2;
+        if (h->checkpoints[mid].machine.step_count <= step) {
+            found = mid;
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+
+    return found;
+}
+
+static void restore(vnsem_history *h, vnsem_machine *m, int index)
+{
+    vnsem_machine live = *m;
+
+    *m = h->checkpoints[index].machine;
+    m->io = live.io;
+    m->stats = live.stats;
+    m->history = live.history;
+    m->break_enabled = live.break_enabled;
+    m->break_point = live.break_point;
+    m->step_mode = FALSE;
+    m->halted = TRUE;
+}
+
+/**
+ * Re-execute recorded steps quietly until *target* is reached or, if
+ * given, predicate *p* holds. Returns 0 or the ERR_* code of the step
+ * that failed.
+ */
+static int replay(vnsem_history *h, vnsem_machine *m, unsigned int target,
+                  const hist_predicate *p)
+{
+    const vnsem_io *io = m->io;
+    uint8_t ins;
+    int result = 0;
+
+    h->quiet = TRUE;
+    m->io = &h->replay_io;
+
+    while (m->step_count < target && !(p && hist_eval(p, m))) {
+        ins = m->mem[m->pc];
+        h->replay_step = m->step_count + 1;
+        if (0 != (result = step_machine(m))) {
+            break;
+        }
+        hist_after_step(h, m, ins, result);
+    }
+
+    m->io = io;
+    m->halted = TRUE;
+
+    return result;
+}
+
+/**
+ * Restore the machine state after *step* steps. Returns TRUE on success.
+ */
+int hist_seek(vnsem_history *h, vnsem_machine *m, unsigned int step)
+{
+    int index, result;
+
+    if (step > h->head) {
+        util_perror("Step %u is beyond the recorded history (%u).\n",
+                    step, h->head);
+        return FALSE;
+    }
+
+    if (-1 == (index = find_checkpoint(h, step))) {
+        util_perror("Step %u is before the recorded history.\n", step);
+        return FALSE;
+    }
+
+    restore(h, m, index);
+    result = replay(h, m, step, NULL);
+    h->consistent = *m;
+
+    if (0 != result) {
+        util_perror("Replay stopped at step %u with error %i.\n",
+                    m->step_count, result);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ * Find the first recorded step after which predicate *p* holds and
+ * leave the machine there. The checkpoints are binary searched, which
+ * assumes that the predicate keeps holding once it became true; only
+ * the steps between the two checkpoints found are replayed. Returns
+ * TRUE if such a step was found, otherwise the machine is unchanged.
+ */
+int hist_bisect(vnsem_history *h, vnsem_machine *m, const hist_predicate *p)
+{
+    unsigned int origin = m->step_count, end;
+    int lo = 0, hi = (int)h->count, mid;
+
+    if (0 == h->count) {
+        return FALSE;
+    }
+
+    if (hist_eval(p, &h->checkpoints[0].machine)) {
+        restore(h, m, 0);
+        h->consistent = *m;
+        return TRUE;
+    }
+
+    /* checkpoint lo does not satisfy p, hi does (or is the head) */
+    while (hi - lo > 1) {
+        mid = (lo + hi) / 2;
+        if (hist_eval(p, &h->checkpoints[mid].machine)) {
+            hi = mid;
+        } else {
+            lo = mid;
+        }
+    }
+
+    end = (hi < (int)h->count) ? h->checkpoints[hi].machine.step_count : h->head;
+
+    restore(h, m, lo);
+    replay(h, m, end, p);
+    h->consistent = *m;
+
+    if (hist_eval(p, m)) {
+        return TRUE;
+    }
+
+    hist_seek(h, m, origin);
+    return FALSE;
+}
+
+/* ------------------------------------------------------------------------
+ *                              predicates
+ * ------------------------------------------------------------------------ */
+
+static int parse_value(const char **s, uint8_t *value)
+{
+    char *end;
+    long v = strtol(*s, &end, 0);
+
+    if (end == *s || v < -128 || v > 255) {
+        return FALSE;
+    }
+
+    *value = v & 0xff;
+    *s = end;
+
+    return TRUE;
+}
+
+/**
+ * Parse a predicate of the form "<lhs> <op> <value>" where lhs is one of
+ * a, l, pc, sp, fl, m (memory at L) or mem[<addr>] and op one of ==, !=,
+ * <, <=, >, >= and & (any bit set). Returns TRUE on success.
+ */
+int hist_parse_predicate(const char *str, hist_predicate *p)
+{
+    static const struct { const char *name; uint8_t lhs; } names[] = {
+        { "mem[", HP_MEM }, { "accu", HP_ACCU }, { "flags", HP_FLAGS },
+        { "pc", HP_PC }, { "sp", HP_SP }, { "fl", HP_FLAGS },
+        { "a", HP_ACCU }, { "l", HP_L }, { "m", HP_MEM_L }
+    };
+    static const struct { const char *name; uint8_t op; } ops[] = {
+        { "==", HP_EQ }, { "!=", HP_NE }, { "<=", HP_LE }, { ">=", HP_GE },
+        { "<", HP_LT }, { ">", HP_GT }, { "&", HP_AND }, { "=", HP_EQ }
+    };
+    const char *s = str;
+    int i, n;
+
+    memset(p, 0, sizeof(*p));
+
+    while (isspace(*s)) s++;
+
+    for (i = 0, n = sizeof(names) / sizeof(names[0]); i < n; ++i) {
+        if (0 == strncasecmp(s, names[i].name, strlen(names[i].name))) {
+            break;
+        }
+    }
+    if (i == n) {
+        return FALSE;
+    }
+
+    p->lhs = names[i].lhs;
+    s += strlen(names[i].name);
+
+    if (HP_MEM == p->lhs) {
+        if (!parse_value(&s, &p->addr) || ']' != *s++) {
+            return FALSE;
+        }
+    }
+
+    while (isspace(*s)) s++;
+
+    for (i = 0, n = sizeof(ops) / sizeof(ops[0]); i < n; ++i) {
+        if (0 == strncmp(s, ops[i].name, strlen(ops[i].name))) {
+            break;
+        }
+    }
+    if (i == n) {
+        return FALSE;
+    }
+
+    p->op = ops[i].op;
+    s += strlen(ops[i].name);
+
+    while (isspace(*s)) s++;
+
+    if (!parse_value(&s, &p->value)) {
+        return FALSE;
+    }
+
+    while (isspace(*s)) s++;
+
+    return '\0' == *s;
+}
+
+int hist_eval(const hist_predicate *p, const vnsem_machine *m)
+{
+    uint8_t v;
+
+    switch (p->lhs) {
+        case HP_ACCU:   v = m->accu;             break;
+        case HP_L:      v = m->reg_l;            break;
+        case HP_PC:     v = m->pc;               break;
+        case HP_SP:     v = m->sp;               break;
+        case HP_FLAGS:  v = m->flags;            break;
+        case HP_MEM:    v = m->mem[p->addr];     break;
+        default:        v = m->mem[m->reg_l];    break;
+    }
+
+    switch (p->op) {
+        case HP_EQ:     return v == p->value;
+        case HP_NE:     return v != p->value;
+        case HP_LT:     return v <  p->value;
+        case HP_LE:     return v <= p->value;
+        case HP_GT:     return v >  p->value;
+        case HP_GE:     return v >= p->value;
+        default:        return 0 != (v & p->value);
+    }
+}
+
+void hist_print(const vnsem_history *h)
+{
+    printf("\n  ** Execution history **\n\n");
+    printf("      Recorded steps: %u..%u\n",
+            (h->count) ? h->checkpoints[0].machine.step_count : 0, h->head);
+    printf("         Checkpoints: %u of %u (every %u steps)\n",
+            h->count, h->capacity, h->interval);
+    printf("       Memory in use: %lu KiB\n", (unsigned long)
+            (h->count * sizeof(hist_checkpoint) +
+             h->input_count * sizeof(hist_input)) / 1024);
+    printf("       Inputs logged: %u\n", h->input_count);
+    printf("\n");
+}
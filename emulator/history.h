@@ -0,0 +1,102 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+#ifndef HISTORY_H
+#define HISTORY_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "vnsem.h"
+
+/**
+ * Execution history of the interactive emulator. Full snapshots of the
+ * machine are taken periodically while the program runs and all user
+ * input is logged, so any recorded step can be restored by replaying
+ * from the nearest checkpoint. When the memory budget is used up, every
+ * other checkpoint is dropped and the interval is doubled.
+ */
+#define HIST_DEFAULT_BUDGET     (4096 * 1024)
+#define HIST_MIN_INTERVAL       64
+
+typedef struct _hist_checkpoint {
+    vnsem_machine machine;
+    uint8_t pinned;             // state was changed from the console
+} hist_checkpoint;
+
+typedef struct _hist_input {
+    unsigned int step;
+    uint8_t value;
+    uint8_t flags;
+} hist_input;
+
+typedef struct _vnsem_history {
+    hist_checkpoint *checkpoints;
+    unsigned int count;
+    unsigned int capacity;
+    unsigned int interval;
+    unsigned int head;          // furthest step recorded
+    hist_input *inputs;
+    unsigned int input_count;
+    unsigned int input_capacity;
+    vnsem_machine consistent;   // state the console left the machine in
+    vnsem_io replay_io;
+    unsigned int replay_step;   // step of the instruction being replayed
+    uint8_t quiet;
+} vnsem_history;
+
+/* left hand sides of predicates */
+#define HP_ACCU     0
+#define HP_L        1
+#define HP_PC       2
+#define HP_SP       3
+#define HP_FLAGS    4
+#define HP_MEM      5           // mem[addr]
+#define HP_MEM_L    6           // mem[L]
+
+/* predicate operators */
+#define HP_EQ       0
+#define HP_NE       1
+#define HP_LT       2
+#define HP_LE       3
+#define HP_GT       4
+#define HP_GE       5
+#define HP_AND      6           // any of the given bits set
+
+typedef struct _hist_predicate {
+    uint8_t lhs;
+    uint8_t addr;
+    uint8_t op;
+    uint8_t value;
+} hist_predicate;
+
+int hist_init(vnsem_history *h, size_t budget);
+void hist_free(vnsem_history *h);
+void hist_before_step(vnsem_history *h, vnsem_machine *m);
+void hist_after_step(vnsem_history *h, vnsem_machine *m, uint8_t ins, int result);
+void hist_pause(vnsem_history *h, vnsem_machine *m);
+void hist_resume(vnsem_history *h, vnsem_machine *m);
+int hist_seek(vnsem_history *h, vnsem_machine *m, unsigned int step);
+int hist_bisect(vnsem_history *h, vnsem_machine *m, const hist_predicate *p);
+int hist_parse_predicate(const char *str, hist_predicate *p);
+int hist_eval(const hist_predicate *p, const vnsem_machine *m);
+void hist_print(const vnsem_history *h);
+
+#endif /* HISTORY_H */
@@ -0,0 +1,172 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "globals.h"
+#include "utils.h"
+#include "console.h"
+#include "live.h"
+
+int live_start(vnsem_live *l, vnsem_snapshot *s,
+               void *(*run)(void*), void *arg)
+{
+    memset(l->queue, 0, sizeof(l->queue));
+    l->snap = s;
+    l->queued = l->done = 0;
+    atomic_init(&l->pending, FALSE);
+    l->input_port = -1;
+    l->input_ready = FALSE;
+    pthread_mutex_init(&l->lock, NULL);
+    pthread_cond_init(&l->cond, NULL);
+
+    if (0 != pthread_create(&l->thread, NULL, run, arg)) {
+        util_perror("Could not start emulation thread.\n");
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ * Queue a command for the emulation thread and wait until it ran.
+ * Does not wait while the machine waits for input, as the command
+ * cannot run before the input was given. Returns FALSE if the queue
+ * is full.
+ */
+int live_submit(vnsem_live *l, const char *command)
+{
+    unsigned int ticket;
+
+    pthread_mutex_lock(&l->lock);
+
+    if (l->queued - l->done >= LIVE_QUEUE) {
+        pthread_mutex_unlock(&l->lock);
+        util_perror("Too many commands waiting.\n");
+        return FALSE;
+    }
+
+    l->queue[l->queued % LIVE_QUEUE] = strdup(command);
+    ticket = ++l->queued;
+    atomic_store(&l->pending, TRUE);
+    pthread_cond_broadcast(&l->cond);
+
+    while ((int)(ticket - l->done) > 0 && l->input_port < 0) {
+        pthread_cond_wait(&l->cond, &l->lock);
+    }
+
+    if ((int)(ticket - l->done) > 0) {
+        printf("Command queued until the program got its input.\n");
+    }
+
+    pthread_mutex_unlock(&l->lock);
+    return TRUE;
+}
+
+/**
+ * Run all queued commands on *m* and publish the result before the
+ * console is told they are done. Must be called by the emulation thread
+ * at a safe point only.
+ */
+void live_run_queued(vnsem_live *l, vnsem_machine *m)
+{
+    unsigned int next, end;
+
+    pthread_mutex_lock(&l->lock);
+    next = l->done;
+    end = l->queued;
+    pthread_mutex_unlock(&l->lock);
+
+    /* commands print to the console, so don't hold the lock meanwhile */
+    for (; next != end; ++next) {
+        call_command_for_input(l->queue[next % LIVE_QUEUE], m);
+        free(l->queue[next % LIVE_QUEUE]);
+    }
+
+    snap_publish(l->snap, m);
+
+    pthread_mutex_lock(&l->lock);
+    l->done = end;
+    atomic_store(&l->pending, l->done != l->queued);
+    pthread_cond_broadcast(&l->cond);
+    pthread_mutex_unlock(&l->lock);
+}
+
+/* block the halted emulation thread until commands are queued */
+void live_wait(vnsem_live *l)
+{
+    pthread_mutex_lock(&l->lock);
+
+    while (l->done == l->queued) {
+        pthread_cond_wait(&l->cond, &l->lock);
+    }
+
+    pthread_mutex_unlock(&l->lock);
+}
+
+int live_input_pending(vnsem_live *l)
+{
+    int port;
+
+    pthread_mutex_lock(&l->lock);
+    port = l->input_port;
+    pthread_mutex_unlock(&l->lock);
+
+    return port;
+}
+
+void live_give_input(vnsem_live *l, uint8_t value)
+{
+    pthread_mutex_lock(&l->lock);
+    l->input_value = value;
+    l->input_ready = TRUE;
+    pthread_cond_broadcast(&l->cond);
+    pthread_mutex_unlock(&l->lock);
+}
+
+/**
+ * Wait until the user entered a value for *port* at the console. Called
+ * by the emulation thread while executing IN.
+ */
+uint8_t live_input(vnsem_live *l, uint8_t port)
+{
+    uint8_t value;
+
+    pthread_mutex_lock(&l->lock);
+
+    l->input_port = port;
+    l->input_ready = FALSE;
+    /* wake up a console waiting for a queued command */
+    pthread_cond_broadcast(&l->cond);
+
+    printf("[%.2X] Program waits for input, enter a value.\n", port);
+
+    while (!l->input_ready) {
+        pthread_cond_wait(&l->cond, &l->lock);
+    }
+
+    value = l->input_value;
+    l->input_port = -1;
+    pthread_mutex_unlock(&l->lock);
+
+    return value;
+}
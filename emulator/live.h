@@ -0,0 +1,62 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+#ifndef LIVE_H
+#define LIVE_H 1
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "snapshot.h"
+
+#define LIVE_QUEUE      16      // console commands waiting for a safe point
+
+/**
+ * Shared state of a machine running on its own thread while the console
+ * stays usable. The emulation thread publishes the machine to *snap*
+ * and is the only one to touch the machine itself. Commands that need
+ * the machine are queued by the console and run by the emulation thread
+ * at the next safe point, i.e. between two instructions or while the
+ * machine is halted. Program input is entered at the console, too.
+ */
+typedef struct _vnsem_live {
+    vnsem_snapshot *snap;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    char *queue[LIVE_QUEUE];
+    unsigned int queued;        // commands ever queued
+    unsigned int done;          // ... and run
+    atomic_int pending;         // queued != done, checked without lock
+    int input_port;             // port waiting for input or -1
+    int input_ready;
+    uint8_t input_value;
+} vnsem_live;
+
+int live_start(vnsem_live *l, vnsem_snapshot *s,
+               void *(*run)(void*), void *arg);
+int live_submit(vnsem_live *l, const char *command);
+void live_run_queued(vnsem_live *l, vnsem_machine *m);
+void live_wait(vnsem_live *l);
+int live_input_pending(vnsem_live *l);   // port or -1
+void live_give_input(vnsem_live *l, uint8_t value);
+uint8_t live_input(vnsem_live *l, uint8_t port);
+
+#endif /* LIVE_H */
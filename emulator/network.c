@@ -0,0 +1,644 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+
+#include "globals.h"
+#include "utils.h"
+#include "vnsem.h"
+#include "network.h"
+
+static const char *state_names[] = {
+    "running", "halted", "end of input", "no input", "illegal",
+    "step limit", "deadlock"
+};
+
+/* ------------------------------------------------------------------------
+ * Links
+ * ------------------------------------------------------------------------ */
+
+static int ring_empty(net_ring *r)
+{
+    return atomic_load(&r->head) == atomic_load(&r->tail) &&
+           !atomic_load(&r->producer_done);
+}
+
+static int ring_full(net_ring *r)
+{
+    return atomic_load(&r->tail) - atomic_load(&r->head) > r->mask &&
+           !atomic_load(&r->consumer_done);
+}
+
+/**
+ * Wake the side of *r* whose flag is *sleeping* if it is parked. The
+ * waker counts the parked thread as active again, so the network is
+ * never taken for deadlocked while a woken thread did not run yet.
+ */
+static void wake(net_system *net, net_ring *r, atomic_int *sleeping)
+{
+    /* order the caller's update before the flag is read, see park() */
+    atomic_thread_fence(memory_order_seq_cst);
+    if (!atomic_load(sleeping)) {
+        return;
+    }
+
+    pthread_mutex_lock(&r->lock);
+    if (atomic_load(sleeping)) {
+        atomic_store(sleeping, FALSE);
+        atomic_fetch_add(&net->active, 1);
+        pthread_cond_broadcast(&r->cond);
+    }
+    pthread_mutex_unlock(&r->lock);
+}
+
+/* stop all parked machines, nobody would ever wake them */
+static void wake_all(net_system *net)
+{
+    unsigned int i;
+
+    atomic_store(&net->deadlock, TRUE);
+    for (i = 0; i < net->link_count; ++i) {
+        wake(net, &net->links[i].ring, &net->links[i].ring.consumer_sleeping);
+        wake(net, &net->links[i].ring, &net->links[i].ring.producer_sleeping);
+    }
+}
+
+/**
+ * Park the calling side of *r* as long as *must_wait* holds. The flag
+ * is set before the condition is checked again, and the other side
+ * updates the ring before it reads the flag, so either this side sees
+ * the update or the other side sees the flag and wakes it.
+ */
+static void park(net_system *net, net_ring *r, atomic_int *sleeping,
+                 int (*must_wait)(net_ring*))
+{
+    pthread_mutex_lock(&r->lock);
+    atomic_store(sleeping, TRUE);
+
+    if (!must_wait(r) || atomic_load(&net->deadlock)) {
+        atomic_store(sleeping, FALSE);
+        pthread_mutex_unlock(&r->lock);
+        return;
+    }
+
+    if (1 == atomic_fetch_sub(&net->active, 1)) {
+        /* every other machine is parked or stopped */
+        atomic_store(sleeping, FALSE);
+        atomic_fetch_add(&net->active, 1);
+        pthread_mutex_unlock(&r->lock);
+        wake_all(net);
+        return;
+    }
+
+    while (atomic_load(sleeping)) {
+        pthread_cond_wait(&r->cond, &r->lock);
+    }
+    pthread_mutex_unlock(&r->lock);
+}
+
+/**
+ * Append *value* to *r*, parking while the ring is full. Returns FALSE
+ * if the consumer stopped or the network is deadlocked.
+ */
+int ring_push(net_system *net, net_ring *r, uint8_t value)
+{
+    unsigned int tail, fill;
+
+    tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+
+    for (;;) {
+        if (atomic_load_explicit(&r->consumer_done, memory_order_relaxed)) {
+            return FALSE;
+        }
+        if (tail - atomic_load_explicit(&r->head, memory_order_acquire)
+                <= r->mask) {
+            break;
+        }
+        if (atomic_load(&net->deadlock)) {
+            return FALSE;
+        }
+        r->full_waits++;
+        park(net, r, &r->producer_sleeping, ring_full);
+    }
+
+    r->buf[tail & r->mask] = value;
+    atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+
+    fill = tail + 1 - atomic_load_explicit(&r->head, memory_order_relaxed);
+    r->fill_sum += fill;
+    if (fill > r->fill_max) {
+        r->fill_max = fill;
+    }
+
+    wake(net, r, &r->consumer_sleeping);
+    return TRUE;
+}
+
+/**
+ * Take the oldest value from *r*, parking while the ring is empty.
+ * Returns FALSE if the producer stopped and everything it wrote was
+ * read, or if the network is deadlocked.
+ */
+int ring_pop(net_system *net, net_ring *r, uint8_t *value)
+{
+    unsigned int head;
+
+    head = atomic_load_explicit(&r->head, memory_order_relaxed);
+
+    for (;;) {
+        if (head != atomic_load_explicit(&r->tail, memory_order_acquire)) {
+            break;
+        }
+        if (atomic_load(&r->producer_done)) {
+            /* it may have written right before it stopped */
+            if (head != atomic_load(&r->tail)) {
+                break;
+            }
+            return FALSE;
+        }
+        if (atomic_load(&net->deadlock)) {
+            return FALSE;
+        }
+        r->empty_waits++;
+        park(net, r, &r->consumer_sleeping, ring_empty);
+    }
+
+    *value = r->buf[head & r->mask];
+    atomic_store_explicit(&r->head, head + 1, memory_order_release);
+
+    wake(net, r, &r->producer_sleeping);
+    return TRUE;
+}
+
+/* ------------------------------------------------------------------------
+ * Machines
+ * ------------------------------------------------------------------------ */
+
+static int net_input(uint8_t port, uint8_t *value, void *ctx)
+{
+    net_machine *nm = (net_machine*)ctx;
+    net_system *net = nm->net;
+    net_link *l = nm->in[port];
+    int i;
+
+    if (NULL != l) {
+        if (ring_pop(net, &l->ring, value)) {
+            return TRUE;
+        }
+        nm->state = atomic_load(&l->ring.producer_done) ? NET_END
+                                                        : NET_DEADLOCK;
+        return FALSE;
+    }
+
+    /* unlinked ports share the values given with -I */
+    i = atomic_fetch_add(&net->next_input, 1);
+    if (NULL == net->inputs || i >= net->inputs->count) {
+        nm->state = NET_NO_INPUT;
+        return FALSE;
+    }
+
+    *value = net->inputs->values[i];
+    return TRUE;
+}
+
+static void net_output(uint8_t port, uint8_t value, void *ctx)
+{
+    net_machine *nm = (net_machine*)ctx;
+    net_system *net = nm->net;
+    net_link *l = nm->out[port];
+
+    if (NULL == l) {
+        if (!net->quiet) {
+            printf("[%.2X] %s output => 0x%X (%i)\n",
+                   port, nm->name, value, value);
+        }
+        return;
+    }
+
+    if (!ring_push(net, &l->ring, value)) {
+        if (atomic_load(&l->ring.consumer_done)) {
+            l->dropped++;
+        } else {
+            /* OUT cannot fail, stop after this instruction */
+            nm->state = NET_DEADLOCK;
+        }
+    }
+}
+
+/**
+ * Tell the machines linked to *nm* that it stopped and leave the
+ * active ones. The last active machine to stop while others are still
+ * parked finds the network deadlocked.
+ */
+static void stop(net_machine *nm)
+{
+    net_system *net = nm->net;
+    unsigned int i, id = nm - net->machines;
+    net_ring *r;
+
+    /* after a deadlock all are woken anyway, their links are not done */
+    for (i = 0; i < net->link_count && NET_DEADLOCK != nm->state; ++i) {
+        r = &net->links[i].ring;
+        if (id == net->links[i].from) {
+            atomic_store(&r->producer_done, TRUE);
+            wake(net, r, &r->consumer_sleeping);
+        }
+        if (id == net->links[i].to) {
+            atomic_store(&r->consumer_done, TRUE);
+            wake(net, r, &r->producer_sleeping);
+        }
+    }
+
+    atomic_fetch_add(&net->stopped, 1);
+    if (1 == atomic_fetch_sub(&net->active, 1) &&
+            atomic_load(&net->stopped) < (int)net->count) {
+        wake_all(net);
+    }
+}
+
+static void *run_machine(void *arg)
+{
+    net_machine *nm = (net_machine*)arg;
+    int result;
+
+    while (NET_RUNNING == nm->state) {
+        if (nm->steps >= nm->net->max_steps) {
+            nm->state = NET_STEP_LIMIT;
+            break;
+        }
+
+        result = step_machine(&nm->m);
+        nm->steps++;
+
+        if (ERR_ILLEGAL_INSTRUCTION == result) {
+            nm->state = NET_ILLEGAL;
+        } else if (ERR_NO_INPUT == result && NET_RUNNING == nm->state) {
+            nm->state = NET_NO_INPUT;
+        } else if (nm->m.halted) {
+            nm->state = NET_HALTED;
+        }
+    }
+
+    stop(nm);
+    return NULL;
+}
+
+/* ------------------------------------------------------------------------ */
+
+void net_init(net_system *net)
+{
+    memset(net, 0, sizeof(*net));
+    net->max_steps = ~0UL;
+}
+
+/**
+ * Return the number of the machine called *name* or -1 if there is none.
+ */
+int net_find(const net_system *net, const char *name)
+{
+    unsigned int i;
+
+    for (i = 0; i < net->count; ++i) {
+        if (0 == strcmp(net->machines[i].name, name)) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * Add a copy of *m* called *name* to the network. Returns its number
+ * or -1 on errors.
+ */
+int net_add_machine(net_system *net, const char *name,
+                    const vnsem_machine *m)
+{
+    net_machine *nm;
+
+    if (net->count == NET_MAX_MACHINES) {
+        util_perror("Too many machines (at most %i).\n", NET_MAX_MACHINES);
+        return -1;
+    }
+    if (strlen(name) >= NET_MAX_NAME) {
+        util_perror("Machine name too long: %s\n", name);
+        return -1;
+    }
+    if (-1 != net_find(net, name)) {
+        util_perror("Machine %s defined twice.\n", name);
+        return -1;
+    }
+
+    nm = &net->machines[net->count];
+    memset(nm, 0, sizeof(*nm));
+    strcpy(nm->name, name);
+    nm->m = *m;
+    nm->io.input = net_input;
+    nm->io.output = net_output;
+    nm->io.ctx = nm;
+    nm->m.io = &nm->io;
+    nm->m.stats = NULL;
+    nm->m.history = NULL;
+    nm->net = net;
+
+    return net->count++;
+}
+
+/**
+ * Connect OUT *from_port* of machine *from* to IN *to_port* of machine
+ * *to* with a ring of at least *capacity* values. Returns FALSE on
+ * errors.
+ */
+int net_add_link(net_system *net, unsigned int from, uint8_t from_port,
+                 unsigned int to, uint8_t to_port, unsigned int capacity)
+{
+    net_link *l;
+    unsigned int size = 1;
+
+    if (net->link_count == NET_MAX_LINKS) {
+        util_perror("Too many links (at most %i).\n", NET_MAX_LINKS);
+        return FALSE;
+    }
+    if (0 == capacity || capacity > NET_MAX_CAPACITY) {
+        util_perror("Invalid link capacity (1-%i).\n", NET_MAX_CAPACITY);
+        return FALSE;
+    }
+    if (NULL != net->machines[from].out[from_port]) {
+        util_perror("Output port %i of %s is linked twice.\n",
+                    from_port, net->machines[from].name);
+        return FALSE;
+    }
+    if (NULL != net->machines[to].in[to_port]) {
+        util_perror("Input port %i of %s is linked twice.\n",
+                    to_port, net->machines[to].name);
+        return FALSE;
+    }
+
+    while (size < capacity) {
+        size <<= 1;
+    }
+
+    l = &net->links[net->link_count];
+    memset(l, 0, sizeof(*l));
+    if (NULL == (l->ring.buf = malloc(size))) {
+        util_perror("Out of memory.\n");
+        return FALSE;
+    }
+    l->ring.mask = size - 1;
+    pthread_mutex_init(&l->ring.lock, NULL);
+    pthread_cond_init(&l->ring.cond, NULL);
+
+    l->from = from;
+    l->from_port = from_port;
+    l->to = to;
+    l->to_port = to_port;
+    net->machines[from].out[from_port] = l;
+    net->machines[to].in[to_port] = l;
+    net->link_count++;
+
+    return TRUE;
+}
+
+/* parse <machine>:<port> of a link line */
+static int parse_end(net_system *net, char *str, int *machine, uint8_t *port)
+{
+    char *colon = strrchr(str, ':'), *end;
+    unsigned long value;
+
+    if (NULL == colon) {
+        return FALSE;
+    }
+    *colon = '\0';
+    value = strtoul(colon + 1, &end, 0);
+    if (*end || colon[1] == '\0' || value > 255) {
+        return FALSE;
+    }
+    *port = value;
+
+    if (-1 == (*machine = net_find(net, str))) {
+        util_perror("Unknown machine: %s\n", str);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ * Read the topology file *path*. Each line either defines a machine
+ * running a program, relative paths starting at the topology file,
+ *
+ *     machine <name> <program>
+ *
+ * or links an output port of one machine to an input port of another
+ *
+ *     link <machine>:<port> -> <machine>:<port> [<capacity>]
+ *
+ * Empty lines and everything after # are ignored. Returns FALSE on
+ * errors.
+ */
+int net_load(net_system *net, const char *path)
+{
+    char line[512], program[1024], *words[6], *p, *end;
+    const char *slash = strrchr(path, '/');
+    int count, lineno = 0, from, to, ok = TRUE;
+    uint8_t from_port, to_port;
+    unsigned long capacity;
+    vnsem_machine m;
+    FILE *file;
+
+    if (NULL == (file = fopen(path, "r"))) {
+        util_perror("Could not open topology file %s.\n", path);
+        return FALSE;
+    }
+
+    while (ok && NULL != fgets(line, sizeof(line), file)) {
+        lineno++;
+        if (NULL != (p = strchr(line, '#'))) {
+            *p = '\0';
+        }
+
+        count = 0;
+        for (p = strtok(line, " \t\r\n"); NULL != p && count < 6;
+                p = strtok(NULL, " \t\r\n")) {
+            words[count++] = p;
+        }
+
+        if (0 == count) {
+            continue;
+        } else if (3 == count && 0 == strcmp(words[0], "machine")) {
+            if ('/' == words[2][0] || NULL == slash) {
+                snprintf(program, sizeof(program), "%s", words[2]);
+            } else {
+                snprintf(program, sizeof(program), "%.*s/%s",
+                         (int)(slash - path), path, words[2]);
+            }
+            reset_machine(&m);
+            ok = read_program(program, 0, &m) &&
+                 -1 != net_add_machine(net, words[1], &m);
+        } else if ((4 == count || 5 == count) &&
+                   0 == strcmp(words[0], "link") &&
+                   0 == strcmp(words[2], "->")) {
+            capacity = NET_DEFAULT_CAPACITY;
+            if (5 == count) {
+                capacity = strtoul(words[4], &end, 0);
+                if (*end) {
+                    capacity = 0;
+                }
+            }
+            ok = parse_end(net, words[1], &from, &from_port) &&
+                 parse_end(net, words[3], &to, &to_port) &&
+                 net_add_link(net, from, from_port, to, to_port, capacity);
+        } else {
+            ok = FALSE;
+        }
+
+        if (!ok) {
+            util_perror("%s:%i: invalid topology line.\n", path, lineno);
+        }
+    }
+
+    fclose(file);
+
+    if (ok && 0 == net->count) {
+        util_perror("%s: no machines defined.\n", path);
+        ok = FALSE;
+    }
+
+    return ok;
+}
+
+/**
+ * Run every machine on a thread of its own until all of them stopped.
+ * Returns TRUE if each machine halted or read all input of its links.
+ */
+int net_run(net_system *net)
+{
+    struct timespec start, end;
+    unsigned int i, started;
+    int ok = TRUE;
+
+    atomic_store(&net->next_input, 0);
+    atomic_store(&net->active, net->count);
+    atomic_store(&net->stopped, 0);
+    atomic_store(&net->deadlock, FALSE);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (started = 0; started < net->count; ++started) {
+        if (0 != pthread_create(&net->machines[started].thread, NULL,
+                                run_machine, &net->machines[started])) {
+            util_perror("Could not start machine %s.\n",
+                        net->machines[started].name);
+            break;
+        }
+    }
+
+    /* a machine that cannot run would block its neighbours forever */
+    for (i = started; i < net->count; ++i) {
+        net->machines[i].state = NET_DEADLOCK;
+        stop(&net->machines[i]);
+    }
+    if (started < net->count) {
+        wake_all(net);
+    }
+
+    for (i = 0; i < started; ++i) {
+        pthread_join(net->machines[i].thread, NULL);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    net->elapsed = (end.tv_sec - start.tv_sec) +
+                   (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    for (i = 0; i < net->count; ++i) {
+        if (NET_HALTED != net->machines[i].state &&
+                NET_END != net->machines[i].state) {
+            ok = FALSE;
+        }
+    }
+
+    return ok;
+}
+
+void net_release(net_system *net)
+{
+    unsigned int i;
+
+    for (i = 0; i < net->link_count; ++i) {
+        pthread_cond_destroy(&net->links[i].ring.cond);
+        pthread_mutex_destroy(&net->links[i].ring.lock);
+        free(net->links[i].ring.buf);
+    }
+    net->link_count = 0;
+}
+
+void net_print_report(const net_system *net)
+{
+    const net_machine *nm;
+    const net_link *l;
+    unsigned long long items, steps = 0;
+    char name[2 * NET_MAX_NAME + 16];
+    unsigned int i;
+
+    printf("\n  ** Dataflow network **\n\n");
+    printf("  %-32s %-12s %-4s  %10s\n", "Machine", "State", "PC", "Steps");
+
+    for (i = 0; i < net->count; ++i) {
+        nm = &net->machines[i];
+        printf("  %-32s %-12s 0x%.2X  %10llu\n", nm->name,
+               state_names[nm->state], nm->m.pc,
+               (unsigned long long)nm->steps);
+        steps += nm->steps;
+    }
+
+    if (net->link_count) {
+        printf("\n  %-28s %8s  %10s %5s  %8s %4s  %10s  %11s\n", "Link",
+               "Items", "Items/s", "Size", "Avg fill", "Max", "Full waits",
+               "Empty waits");
+    }
+
+    for (i = 0; i < net->link_count; ++i) {
+        l = &net->links[i];
+        items = atomic_load(&l->ring.tail);
+        snprintf(name, sizeof(name), "%s:%i -> %s:%i",
+                 net->machines[l->from].name, l->from_port,
+                 net->machines[l->to].name, l->to_port);
+        printf("  %-28s %8llu  %10.0f %5u  %8.2f %4u  %10llu  %11llu\n",
+               name, items, net->elapsed > 0 ? items / net->elapsed : 0,
+               l->ring.mask + 1, items ? (double)l->ring.fill_sum / items : 0,
+               l->ring.fill_max, (unsigned long long)l->ring.full_waits,
+               (unsigned long long)l->ring.empty_waits);
+        if (l->dropped) {
+            printf("  %-28s %8llu values dropped after %s stopped\n", "",
+                   (unsigned long long)l->dropped,
+                   net->machines[l->to].name);
+        }
+    }
+
+    printf("\n%u machine(s), %u link(s), %.3f s", net->count,
+           net->link_count, net->elapsed);
+    if (net->elapsed > 0) {
+        printf(", %.1f M steps/s", steps / net->elapsed / 1e6);
+    }
+    printf(".\n");
+}
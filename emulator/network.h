@@ -0,0 +1,124 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef NETWORK_H
+#define NETWORK_H 1
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "vnsem.h"
+#include "difftest.h"
+
+#define NET_MAX_MACHINES    16
+#define NET_MAX_LINKS       64
+#define NET_MAX_NAME        32
+#define NET_MAX_CAPACITY    65536
+#define NET_DEFAULT_CAPACITY 64
+
+/* why a machine stopped */
+#define NET_RUNNING     0
+#define NET_HALTED      1
+#define NET_END         2       // its producers are done and drained
+#define NET_NO_INPUT    3       // unlinked port, -I values used up
+#define NET_ILLEGAL     4
+#define NET_STEP_LIMIT  5
+#define NET_DEADLOCK    6
+
+/**
+ * Single producer, single consumer ring buffer of one link. *head* is
+ * only written by the consumer and *tail* only by the producer, so
+ * neither side takes a lock while the ring is neither empty nor full.
+ * A side that has to wait parks on *cond*; the other side only takes
+ * *lock* to wake it if the sleeping flag is set.
+ */
+typedef struct _net_ring {
+    _Alignas(64) atomic_uint head;      // next slot to read
+    uint64_t empty_waits;               // consumer parked, ring empty
+    _Alignas(64) atomic_uint tail;      // next slot to write
+    uint64_t full_waits;                // producer parked, ring full
+    uint64_t fill_sum;                  // occupancy after each push
+    unsigned int fill_max;
+    _Alignas(64) uint8_t *buf;
+    unsigned int mask;                  // capacity - 1, a power of two
+    atomic_int producer_done;
+    atomic_int consumer_done;
+    atomic_int producer_sleeping;
+    atomic_int consumer_sleeping;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} net_ring;
+
+typedef struct _net_link {
+    unsigned int from;                  // machine writing with OUT
+    uint8_t from_port;
+    unsigned int to;                    // machine reading with IN
+    uint8_t to_port;
+    uint64_t dropped;                   // written after the reader stopped
+    net_ring ring;
+} net_link;
+
+typedef struct _net_machine {
+    char name[NET_MAX_NAME];
+    vnsem_machine m;
+    vnsem_io io;
+    struct _net_system *net;
+    net_link *in[256];                  // link read from by IN port
+    net_link *out[256];                 // link written to by OUT port
+    uint8_t state;                      // NET_RUNNING or why it stopped
+    uint64_t steps;
+    pthread_t thread;
+} net_machine;
+
+/**
+ * Machines connected port to port, each running on a host thread of
+ * its own. *active* counts the machines neither parked nor stopped,
+ * the last one to park finds the network deadlocked.
+ */
+typedef struct _net_system {
+    net_machine machines[NET_MAX_MACHINES];
+    unsigned int count;
+    net_link links[NET_MAX_LINKS];
+    unsigned int link_count;
+    unsigned long max_steps;            // per machine
+    const dt_inputs *inputs;            // read by unlinked ports, may be NULL
+    atomic_int next_input;
+    atomic_int active;
+    atomic_int stopped;
+    atomic_int deadlock;
+    uint8_t quiet;                      // do not print unlinked output
+    double elapsed;                     // seconds of the last net_run()
+} net_system;
+
+void net_init(net_system *net);
+int net_add_machine(net_system *net, const char *name,
+                    const vnsem_machine *m);
+int net_add_link(net_system *net, unsigned int from, uint8_t from_port,
+                 unsigned int to, uint8_t to_port, unsigned int capacity);
+int net_load(net_system *net, const char *path);
+int net_find(const net_system *net, const char *name);
+int net_run(net_system *net);
+void net_release(net_system *net);
+void net_print_report(const net_system *net);
+
+int ring_push(net_system *net, net_ring *r, uint8_t value);
+int ring_pop(net_system *net, net_ring *r, uint8_t *value);
+
+#endif /* NETWORK_H */
@@ -0,0 +1,200 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "globals.h"
+#include "utils.h"
+#include "image.h"
+#include "vnsem.h"
+#include "savestate.h"
+
+#if VNS_BANKS > 1
+#define SS_BANKS VNS_BANKS
+#else
+#define SS_BANKS 0
+#endif
+
+#define SS_CHECKED  (offsetof(ss_header, checksum) + sizeof(uint32_t))
+
+/**
+ * Write machine *m* and the values in *inputs* (may be NULL) to the
+ * state file *path*. The file is written next to *path* and renamed,
+ * so an existing state is only replaced by a complete one.
+ */
+int ss_save(const char *path, const vnsem_machine *m,
+            const dt_inputs *inputs)
+{
+    size_t size = sizeof(ss_header) + SS_BANKS * IMG_BANK_SIZE;
+    ss_header *h;
+    uint8_t *data;
+    char *tmp;
+    FILE *f;
+    int ok;
+
+    if (NULL != inputs) {
+        size += inputs->count;
+    }
+
+    tmp = malloc(strlen(path) + 5);
+    if (NULL == tmp || NULL == (data = calloc(1, size))) {
+        free(tmp);
+        util_perror("Out of memory.\n");
+        return FALSE;
+    }
+    sprintf(tmp, "%s.tmp", path);
+
+    h = (ss_header*)data;
+    memcpy(h->magic, SS_MAGIC, sizeof(h->magic));
+    h->version = SS_VERSION;
+    h->size = size;
+    h->step_count = m->step_count;
+    h->step_line = m->step_line;
+    h->step_mode = m->step_mode;
+    h->halted = m->halted;
+    h->int_active = m->int_active;
+    h->break_enabled = m->break_enabled;
+    h->break_point = m->break_point;
+    h->pc = m->pc;
+    h->reg_l = m->reg_l;
+    h->sp = m->sp;
+    h->accu = m->accu;
+    h->flags = m->flags;
+    h->bank_count = SS_BANKS;
+    memcpy(h->mem, m->mem, sizeof(h->mem));
+#if VNS_BANKS > 1
+    h->bank = m->bank;
+    memcpy(h + 1, m->banks, sizeof(m->banks));
+#endif
+    if (NULL != inputs) {
+        h->input_count = inputs->count;
+        memcpy(data + sizeof(*h) + SS_BANKS * IMG_BANK_SIZE,
+               inputs->values, inputs->count);
+    }
+    h->checksum = img_crc32(0, data + SS_CHECKED, size - SS_CHECKED);
+
+    ok = NULL != (f = fopen(tmp, "wb"));
+    if (ok) {
+        ok = 1 == fwrite(data, size, 1, f);
+        ok = (0 == fclose(f)) && ok;
+    }
+    ok = ok && 0 == rename(tmp, path);
+
+    if (!ok) {
+        perror(path);
+        unlink(tmp);
+    }
+
+    free(data);
+    free(tmp);
+
+    return ok;
+}
+
+/**
+ * Read the state file *path* into machine *m*, keeping its I/O hooks,
+ * statistics and history, and replace *inputs* (may be NULL) by the
+ * input values saved with it. Returns FALSE without touching either if
+ * the file is invalid.
+ */
+int ss_restore(const char *path, vnsem_machine *m, dt_inputs *inputs)
+{
+    const ss_header *h;
+    const uint8_t *values;
+    struct stat st;
+    void *map;
+    int fd, ok;
+
+    if (-1 == (fd = open(path, O_RDONLY)) || -1 == fstat(fd, &st)) {
+        perror(path);
+        if (-1 != fd) {
+            close(fd);
+        }
+        return FALSE;
+    }
+
+    if (st.st_size < sizeof(ss_header) ||
+            MAP_FAILED == (map = mmap(NULL, st.st_size, PROT_READ,
+                                      MAP_PRIVATE, fd, 0))) {
+        util_perror("%s: invalid machine state\n", path);
+        close(fd);
+        return FALSE;
+    }
+
+    close(fd);
+    h = (const ss_header*)map;
+    values = (const uint8_t*)map + sizeof(*h) + h->bank_count * IMG_BANK_SIZE;
+
+    ok = 0 == memcmp(h->magic, SS_MAGIC, sizeof(h->magic)) &&
+         h->version == SS_VERSION &&
+         h->size == st.st_size &&
+         h->size == sizeof(*h) + h->bank_count * IMG_BANK_SIZE +
+                    h->input_count &&
+         h->input_count <= DT_MAX_INPUTS &&
+         h->checksum == img_crc32(0, (const uint8_t*)map + SS_CHECKED,
+                                  h->size - SS_CHECKED);
+
+    if (!ok) {
+        util_perror("%s: invalid machine state\n", path);
+    } else if (h->bank_count > SS_BANKS) {
+        util_perror("%s: machine state needs %i memory banks, the emulator "
+                    "was built with %i\n", path, h->bank_count, VNS_BANKS);
+        ok = FALSE;
+    } else if (h->bank >= VNS_BANKS ||
+               (h->bank && h->bank >= h->bank_count)) {
+        util_perror("%s: invalid machine state\n", path);
+        ok = FALSE;
+    }
+
+    if (ok) {
+        m->step_count = h->step_count;
+        m->step_line = h->step_line;
+        m->step_mode = h->step_mode;
+        m->halted = h->halted;
+        m->int_active = h->int_active;
+        m->break_enabled = h->break_enabled;
+        m->break_point = h->break_point;
+        m->pc = h->pc;
+        m->reg_l = h->reg_l;
+        m->sp = h->sp;
+        m->accu = h->accu;
+        m->flags = h->flags;
+        memcpy(m->mem, h->mem, sizeof(m->mem));
+#if VNS_BANKS > 1
+        m->bank = h->bank;
+        memset(m->banks, 0, sizeof(m->banks));
+        memcpy(m->banks, h + 1, h->bank_count * IMG_BANK_SIZE);
+#endif
+        if (NULL != inputs) {
+            inputs->count = h->input_count;
+            memcpy(inputs->values, values, h->input_count);
+        }
+    }
+
+    munmap(map, st.st_size);
+
+    return ok;
+}
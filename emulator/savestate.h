@@ -0,0 +1,69 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef SAVESTATE_H
+#define SAVESTATE_H 1
+
+#include <stdint.h>
+
+#include "vnsem.h"
+#include "difftest.h"
+
+#define SS_MAGIC    "VNSS"
+#define SS_VERSION  1
+
+/**
+ * Save state file, written in host byte order with every field
+ * naturally aligned so a mapped file can be read in place:
+ *
+ *   ss_header              registers, break point, memory unit
+ *   u8[bank_count][128]    windows of all banks, none without banking
+ *   u8[input_count]        input values not read yet
+ *
+ * The mapped bank is the one in the window of the memory unit, its
+ * entry in the bank list is stale as in vnsem_machine.
+ */
+typedef struct _ss_header {
+    char magic[4];
+    uint32_t version;
+    uint32_t size;              // of the whole file
+    uint32_t checksum;          // CRC-32 of everything after this field
+    uint32_t step_count;
+    uint16_t step_line;
+    uint8_t step_mode;
+    uint8_t halted;
+    uint8_t int_active;
+    uint8_t break_enabled;
+    uint8_t break_point;
+    uint8_t pc;
+    uint8_t reg_l;
+    uint8_t sp;
+    uint8_t accu;
+    uint8_t flags;
+    uint8_t bank;
+    uint8_t bank_count;
+    uint16_t input_count;
+    uint8_t mem[256];
+} ss_header;
+
+int ss_save(const char *path, const vnsem_machine *m,
+            const dt_inputs *inputs);
+int ss_restore(const char *path, vnsem_machine *m, dt_inputs *inputs);
+
+#endif /* SAVESTATE_H */
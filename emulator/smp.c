@@ -0,0 +1,505 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "globals.h"
+#include "utils.h"
+#include "instructionset.h"
+#include "vnsem.h"
+#include "smp.h"
+
+static const char *state_names[] = {
+    "running", "halted", "no input", "illegal", "step limit"
+};
+
+static const char *scheduler_names[] = {
+    "round robin", "cycles", "threads"
+};
+
+/* ------------------------------------------------------------------------
+ * The core. Like process_instruction() in vnsem.c, but every data access
+ * goes to the shared memory and is counted. *shared* is a constant at
+ * each call site, so the serial and the threaded variant are compiled
+ * separately and only the latter pays for sequentially consistent
+ * accesses.
+ * ------------------------------------------------------------------------ */
+
+static inline memory_order order(const int shared)
+{
+    return shared ? memory_order_seq_cst : memory_order_relaxed;
+}
+
+static inline uint8_t fetch(smp_system *s, smp_cpu *c)
+{
+    return atomic_load_explicit(&s->mem[c->pc++], memory_order_relaxed);
+}
+
+static inline uint8_t load(smp_system *s, smp_cpu *c, uint8_t addr,
+                           const int shared)
+{
+    uint8_t writer = atomic_load_explicit(&s->writer[addr],
+                                          memory_order_relaxed);
+
+    c->loads++;
+    if (writer && writer != c->id + 1) {
+        c->conflicts++;
+    }
+
+    return atomic_load_explicit(&s->mem[addr], order(shared));
+}
+
+static inline void store(smp_system *s, smp_cpu *c, uint8_t addr,
+                         uint8_t value, const int shared)
+{
+    uint8_t writer;
+
+    c->stores++;
+    atomic_store_explicit(&s->mem[addr], value, order(shared));
+
+    if (shared) {
+        writer = atomic_exchange_explicit(&s->writer[addr], c->id + 1,
+                                          memory_order_relaxed);
+    } else {
+        writer = atomic_load_explicit(&s->writer[addr], memory_order_relaxed);
+        atomic_store_explicit(&s->writer[addr], c->id + 1,
+                              memory_order_relaxed);
+    }
+    if (writer && writer != c->id + 1) {
+        c->conflicts++;
+    }
+}
+
+static inline void update_flags(smp_cpu *c, int16_t value)
+{
+    c->flags = (c->flags & ~(F_ZERO | F_SIGN | F_CARRY)) |
+               ((value & 0xff) ? 0 : F_ZERO) |
+               ((value & 0x80) ? F_SIGN : 0) |
+               ((value & 0x100) ? F_CARRY : 0);
+}
+
+static inline void accu_op(smp_cpu *c, int16_t value)
+{
+    update_flags(c, value);
+    c->accu = value & 0xff;
+}
+
+static inline void push(smp_system *s, smp_cpu *c, uint8_t value,
+                        const int shared)
+{
+    c->sp--;
+    store(s, c, c->sp, value, shared);
+}
+
+static inline uint8_t pop(smp_system *s, smp_cpu *c, const int shared)
+{
+    return load(s, c, c->sp++, shared);
+}
+
+static inline void call(smp_system *s, smp_cpu *c, uint8_t addr, int cond,
+                        const int shared)
+{
+    if (cond) {
+        push(s, c, c->pc, shared);
+        c->pc = addr;
+    }
+}
+
+static inline void jump(smp_cpu *c, uint8_t addr, int cond)
+{
+    if (cond) {
+        c->pc = addr;
+    }
+}
+
+static int input(smp_system *s, smp_cpu *c, uint8_t port)
+{
+    int next;
+
+    c->inputs++;
+
+    if (SMP_CPU_PORT == port) {
+        accu_op(c, c->id);
+        return TRUE;
+    }
+
+    next = atomic_fetch_add(&s->next_input, 1);
+    if (NULL == s->inputs || next >= s->inputs->count) {
+        c->state = SMP_NO_INPUT;
+        return FALSE;
+    }
+
+    accu_op(c, s->inputs->values[next]);
+    return TRUE;
+}
+
+static void output(smp_system *s, smp_cpu *c, uint8_t port)
+{
+    c->outputs++;
+
+    if (!s->quiet) {
+        printf("[%.2X] CPU %i output => 0x%X (%i)\n", port, c->id,
+               c->accu, c->accu);
+    }
+}
+
+static inline int execute(smp_system *s, smp_cpu *c, const int shared)
+{
+    uint8_t ins = fetch(s, c);
+
+    c->steps++;
+    c->cycles += is_opcode_table[ins].cycles;
+
+    switch (ins) {
+        /* ----- TRANSFER ----- */
+        case 0x7d: /* MOV A,L */ c->accu = c->reg_l;                      break;
+        case 0x7e: /* MOV A,M */ c->accu = load(s, c, c->reg_l, shared);  break;
+        case 0x77: /* MOV M,A */ store(s, c, c->reg_l, c->accu, shared);  break;
+        case 0x3e: /* MVI A,n */ c->accu = fetch(s, c);                   break;
+        case 0x3a: /* LDA adr */
+            c->accu = load(s, c, fetch(s, c), shared);
+            break;
+        case 0x32: /* STA adr */
+            store(s, c, fetch(s, c), c->accu, shared);
+            break;
+        case 0x6f: /* MOV L,A */ c->reg_l = c->accu;                      break;
+        case 0x6e: /* MOV L,M */ c->reg_l = load(s, c, c->reg_l, shared); break;
+        case 0x2e: /* MVI L,n */ c->reg_l = fetch(s, c);                  break;
+        case 0x31: /* LXI SP,n*/ c->sp = fetch(s, c);                     break;
+        case 0xf5: /* PUSH A  */ push(s, c, c->accu, shared);             break;
+        case 0xe5: /* PUSH L  */ push(s, c, c->reg_l, shared);            break;
+        case 0xed: /* PUSH FL */ push(s, c, c->flags, shared);            break;
+        case 0xf1: /* POP A   */ c->accu = pop(s, c, shared);             break;
+        case 0xe1: /* POP L   */ c->reg_l = pop(s, c, shared);            break;
+        case 0xfd: /* POP FL  */ c->flags = pop(s, c, shared);            break;
+        case 0xdb: /* IN adr  */
+            if (!input(s, c, fetch(s, c))) {
+                return ERR_NO_INPUT;
+            }
+            break;
+        case 0xd3: /* OUT adr */ output(s, c, fetch(s, c));               break;
+        /* ------ ARITHMETIC  ------ */
+        case 0x3c: /* INR A */ accu_op(c, c->accu + 1);                   break;
+        case 0x2c: /* INR L */ c->reg_l++;                                break;
+        case 0x3d: /* DCR A */ accu_op(c, c->accu - 1);                   break;
+        case 0x2d: /* DCR L */ c->reg_l--;                                break;
+        case 0x87: /* ADD A */ accu_op(c, c->accu * 2);                   break;
+        case 0x85: /* ADD L */ accu_op(c, c->accu + c->reg_l);            break;
+        case 0x86: /* ADD M */
+            accu_op(c, c->accu + load(s, c, c->reg_l, shared));
+            break;
+        case 0xc6: /* ADI n */ accu_op(c, c->accu + fetch(s, c));         break;
+        case 0x97: /* SUB A */ accu_op(c, 0);                             break;
+        case 0x95: /* SUB L */ accu_op(c, c->accu - c->reg_l);            break;
+        case 0x96: /* SUB M */
+            accu_op(c, c->accu - load(s, c, c->reg_l, shared));
+            break;
+        case 0xd6: /* SUI n */ accu_op(c, c->accu - fetch(s, c));         break;
+        case 0xbf: /* CMP A */ update_flags(c, 0);                        break;
+        case 0xbd: /* CMP L */ update_flags(c, c->accu - c->reg_l);       break;
+        case 0xbe: /* CMP M */
+            update_flags(c, c->accu - load(s, c, c->reg_l, shared));
+            break;
+        case 0xfe: /* CPI n */ update_flags(c, c->accu - fetch(s, c));    break;
+        /* ----- LOGIC ----- */
+        case 0xa7: /* ANA A */ accu_op(c, c->accu);                       break;
+        case 0xa5: /* ANA L */ accu_op(c, c->accu & c->reg_l);            break;
+        case 0xa6: /* ANA M */
+            accu_op(c, c->accu & load(s, c, c->reg_l, shared));
+            break;
+        case 0xe6: /* ANI n */ accu_op(c, c->accu & fetch(s, c));         break;
+        case 0xb7: /* ORA A */ accu_op(c, c->accu);                       break;
+        case 0xb5: /* ORA L */ accu_op(c, c->accu | c->reg_l);            break;
+        case 0xb6: /* ORA M */
+            accu_op(c, c->accu | load(s, c, c->reg_l, shared));
+            break;
+        case 0xf6: /* ORI n */ accu_op(c, c->accu | fetch(s, c));         break;
+        case 0xaf: /* XRA A */ accu_op(c, 0);                             break;
+        case 0xad: /* XRA L */ accu_op(c, c->accu ^ c->reg_l);            break;
+        case 0xae: /* XRA M */
+            accu_op(c, c->accu ^ load(s, c, c->reg_l, shared));
+            break;
+        case 0xee: /* XRI n */ accu_op(c, c->accu ^ fetch(s, c));         break;
+        /* ----- BRANCH ----- */
+        case 0xc3: /* JMP adr */ c->pc = fetch(s, c);                     break;
+        case 0xcd: /* CALL adr*/ call(s, c, fetch(s, c), TRUE, shared);   break;
+        case 0xca: /* JZ  adr */
+            jump(c, fetch(s, c), c->flags & F_ZERO);
+            break;
+        case 0xc2: /* JNZ adr */
+            jump(c, fetch(s, c), !(c->flags & F_ZERO));
+            break;
+        case 0xda: /* JC  adr */
+            jump(c, fetch(s, c), c->flags & F_CARRY);
+            break;
+        case 0xd2: /* JNC adr */
+            jump(c, fetch(s, c), !(c->flags & F_CARRY));
+            break;
+        case 0xcc: /* CZ  adr */
+            call(s, c, fetch(s, c), c->flags & F_ZERO, shared);
+            break;
+        case 0xc4: /* CNZ adr */
+            call(s, c, fetch(s, c), !(c->flags & F_ZERO), shared);
+            break;
+        case 0xdc: /* CC  adr */
+            call(s, c, fetch(s, c), c->flags & F_CARRY, shared);
+            break;
+        case 0xd4: /* CNC adr */
+            call(s, c, fetch(s, c), !(c->flags & F_CARRY), shared);
+            break;
+        case 0xc9: /* RET     */ c->pc = pop(s, c, shared);               break;
+        /* ----- SPECIAL ----- */
+        case 0x76: /* HLT */ c->state = SMP_HALTED;                       break;
+        case 0x00: /* NOP */                                              break;
+        case 0xfb: /* EI  */ c->int_active = TRUE;                        break;
+        case 0xf3: /* DI  */ c->int_active = FALSE;                       break;
+        default:
+            c->state = SMP_ILLEGAL;
+            return ERR_ILLEGAL_INSTRUCTION;
+    }
+    return 0;
+}
+
+/**
+ * Execute a single instruction of CPU *c* as the deterministic
+ * schedulers do. Returns 0 or one of the ERR_* codes.
+ */
+int smp_step(smp_system *s, smp_cpu *c)
+{
+    return execute(s, c, FALSE);
+}
+
+/* ------------------------------------------------------------------------
+ * Schedulers
+ * ------------------------------------------------------------------------ */
+
+/* check the step limit, TRUE if *c* may execute another instruction */
+static int runnable(smp_system *s, smp_cpu *c)
+{
+    if (SMP_RUNNING == c->state && c->steps >= s->max_steps) {
+        c->state = SMP_STEP_LIMIT;
+    }
+
+    return SMP_RUNNING == c->state;
+}
+
+static void run_round_robin(smp_system *s)
+{
+    unsigned int i, active;
+
+    do {
+        active = 0;
+        for (i = 0; i < s->count; ++i) {
+            if (runnable(s, &s->cpus[i])) {
+                smp_step(s, &s->cpus[i]);
+                active++;
+            }
+        }
+    } while (active);
+}
+
+/* the CPU that has used the fewest cycles goes next, the lowest on ties */
+static void run_cycles(smp_system *s)
+{
+    smp_cpu *next;
+    unsigned int i;
+
+    for (;;) {
+        next = NULL;
+        for (i = 0; i < s->count; ++i) {
+            if (runnable(s, &s->cpus[i]) &&
+                    (NULL == next || s->cpus[i].cycles < next->cycles)) {
+                next = &s->cpus[i];
+            }
+        }
+        if (NULL == next) {
+            return;
+        }
+        smp_step(s, next);
+    }
+}
+
+typedef struct _smp_thread {
+    smp_system *s;
+    smp_cpu *c;
+} smp_thread;
+
+static void *run_thread(void *arg)
+{
+    smp_thread *t = (smp_thread*)arg;
+
+    while (runnable(t->s, t->c)) {
+        execute(t->s, t->c, TRUE);
+    }
+
+    return NULL;
+}
+
+static void run_threads(smp_system *s)
+{
+    pthread_t threads[SMP_MAX_CPUS];
+    smp_thread args[SMP_MAX_CPUS];
+    uint8_t started[SMP_MAX_CPUS];
+    unsigned int i;
+
+    for (i = 0; i < s->count; ++i) {
+        args[i].s = s;
+        args[i].c = &s->cpus[i];
+        started[i] = (0 == pthread_create(&threads[i], NULL, run_thread,
+                                          &args[i]));
+    }
+
+    /* CPUs without a thread of their own run on this one */
+    for (i = 0; i < s->count; ++i) {
+        if (!started[i]) {
+            run_thread(&args[i]);
+        }
+    }
+
+    for (i = 0; i < s->count; ++i) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+}
+
+/* ------------------------------------------------------------------------ */
+
+/**
+ * Set up *count* CPUs sharing the memory of *m*, all of them starting
+ * with the registers of *m*.
+ */
+void smp_init(smp_system *s, const vnsem_machine *m, unsigned int count,
+              int scheduler)
+{
+    unsigned int i;
+
+    memset(s, 0, sizeof(*s));
+
+    for (i = 0; i < 256; ++i) {
+        atomic_init(&s->mem[i], m->mem[i]);
+        atomic_init(&s->writer[i], 0);
+    }
+    atomic_init(&s->next_input, 0);
+
+    s->count = count;
+    s->scheduler = scheduler;
+    s->max_steps = ~0UL;
+
+    for (i = 0; i < count; ++i) {
+        s->cpus[i].id = i;
+        s->cpus[i].pc = m->pc;
+        s->cpus[i].reg_l = m->reg_l;
+        s->cpus[i].sp = m->sp;
+        s->cpus[i].accu = m->accu;
+        s->cpus[i].flags = m->flags;
+        s->cpus[i].int_active = m->int_active;
+    }
+}
+
+/**
+ * Run all CPUs until each of them halted or stopped otherwise. Returns
+ * TRUE if all of them executed HLT.
+ */
+int smp_run(smp_system *s)
+{
+    struct timespec start, end;
+    unsigned int i;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    switch (s->scheduler) {
+        case SMP_ROUND_ROBIN: run_round_robin(s); break;
+        case SMP_CYCLES:      run_cycles(s);      break;
+        case SMP_THREADS:     run_threads(s);     break;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    s->elapsed = (end.tv_sec - start.tv_sec) +
+                 (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    for (i = 0; i < s->count; ++i) {
+        if (SMP_HALTED != s->cpus[i].state) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/**
+ * Return the scheduler called *name* or -1 if there is none.
+ */
+int smp_parse_scheduler(const char *name)
+{
+    if (0 == strcasecmp(name, "rr")) {
+        return SMP_ROUND_ROBIN;
+    } else if (0 == strcasecmp(name, "cycles")) {
+        return SMP_CYCLES;
+    } else if (0 == strcasecmp(name, "threads")) {
+        return SMP_THREADS;
+    }
+
+    return -1;
+}
+
+void smp_print_report(const smp_system *s)
+{
+    const smp_cpu *c;
+    smp_cpu total;
+    unsigned int i;
+
+    memset(&total, 0, sizeof(total));
+
+    printf("\n  ** Multiprocessor run **\n\n");
+    printf("  CPU  State        PC       Steps      Cycles       Loads"
+           "      Stores   Conflicts\n");
+
+    for (i = 0; i < s->count; ++i) {
+        c = &s->cpus[i];
+        printf("  %3i  %-10s 0x%.2X  %10llu  %10llu  %10llu  %10llu  %10llu\n",
+               c->id, state_names[c->state], c->pc,
+               (unsigned long long)c->steps, (unsigned long long)c->cycles,
+               (unsigned long long)c->loads, (unsigned long long)c->stores,
+               (unsigned long long)c->conflicts);
+        total.steps += c->steps;
+        total.cycles += c->cycles;
+        total.loads += c->loads;
+        total.stores += c->stores;
+        total.conflicts += c->conflicts;
+    }
+
+    printf("  all                   %10llu  %10llu  %10llu  %10llu  %10llu\n\n",
+           (unsigned long long)total.steps, (unsigned long long)total.cycles,
+           (unsigned long long)total.loads, (unsigned long long)total.stores,
+           (unsigned long long)total.conflicts);
+
+    printf("%u CPU(s), %s scheduler, %.3f s", s->count,
+           scheduler_names[s->scheduler], s->elapsed);
+    if (s->elapsed > 0) {
+        printf(", %.1f M steps/s", total.steps / s->elapsed / 1e6);
+    }
+    printf(".\n");
+}
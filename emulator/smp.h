@@ -0,0 +1,94 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+#ifndef SMP_H
+#define SMP_H 1
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "difftest.h"
+
+#define SMP_MAX_CPUS    16
+#define SMP_CPU_PORT    0xFF    // IN reads the number of the CPU
+
+/* schedulers */
+#define SMP_ROUND_ROBIN 0       // one instruction per CPU in turn
+#define SMP_CYCLES      1       // the CPU with the fewest cycles runs next
+#define SMP_THREADS     2       // free running, one host thread per CPU
+
+/* why a CPU stopped */
+#define SMP_RUNNING     0
+#define SMP_HALTED      1
+#define SMP_NO_INPUT    2
+#define SMP_ILLEGAL     3
+#define SMP_STEP_LIMIT  4
+
+/**
+ * Register file and counters of one CPU. Each CPU is written by a
+ * single thread only, the alignment keeps CPUs of the free running
+ * scheduler off each other's cache lines.
+ */
+typedef struct _smp_cpu {
+    _Alignas(64) uint8_t id;
+    uint8_t pc;
+    uint8_t reg_l;
+    uint8_t sp;
+    uint8_t accu;
+    uint8_t flags;
+    uint8_t int_active;
+    uint8_t state;              // SMP_RUNNING or why it stopped
+    uint64_t steps;
+    uint64_t cycles;
+    uint64_t loads;             // data accesses, fetches not counted
+    uint64_t stores;
+    uint64_t conflicts;         // accesses to cells another CPU wrote last
+    uint64_t inputs;
+    uint64_t outputs;
+} smp_cpu;
+
+/**
+ * Several CPUs sharing one memory unit. Memory cells are accessed with
+ * atomic byte operations, sequentially consistent when the CPUs run on
+ * host threads, so programs may synchronize with Peterson's or
+ * Dekker's algorithm. *writer* tracks the CPU that stored to each cell
+ * last (CPU number + 1, 0 for the loaded program) to count conflicts.
+ */
+typedef struct _smp_system {
+    _Atomic uint8_t mem[256];
+    _Atomic uint8_t writer[256];
+    smp_cpu cpus[SMP_MAX_CPUS];
+    unsigned int count;
+    int scheduler;
+    unsigned long max_steps;    // per CPU
+    const dt_inputs *inputs;    // shared by all CPUs, may be NULL
+    atomic_int next_input;
+    uint8_t quiet;              // do not print program output
+    double elapsed;             // seconds of the last smp_run()
+} smp_system;
+
+void smp_init(smp_system *s, const vnsem_machine *m, unsigned int count,
+              int scheduler);
+int smp_step(smp_system *s, smp_cpu *c);
+int smp_run(smp_system *s);
+void smp_print_report(const smp_system *s);
+int smp_parse_scheduler(const char *name);
+
+#endif /* SMP_H */
@@ -0,0 +1,100 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+#include <string.h>
+
+#include "snapshot.h"
+
+void snap_init(vnsem_snapshot *s)
+{
+    memset(&s->data, 0, sizeof(s->data));
+    atomic_init(&s->seq, 0);
+}
+
+static void write_begin(vnsem_snapshot *s)
+{
+    atomic_store_explicit(&s->seq,
+            atomic_load_explicit(&s->seq, memory_order_relaxed) + 1,
+            memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+static void write_end(vnsem_snapshot *s)
+{
+    atomic_store_explicit(&s->seq,
+            atomic_load_explicit(&s->seq, memory_order_relaxed) + 1,
+            memory_order_release);
+}
+
+void snap_publish(vnsem_snapshot *s, const vnsem_machine *m)
+{
+    write_begin(s);
+    s->data.step_count = m->step_count;
+    memcpy(s->data.mem, m->mem, sizeof(s->data.mem));
+    s->data.pc = m->pc;
+    s->data.reg_l = m->reg_l;
+    s->data.sp = m->sp;
+    s->data.accu = m->accu;
+    s->data.flags = m->flags;
+    s->data.halted = m->halted;
+    write_end(s);
+}
+
+void snap_output(vnsem_snapshot *s, uint8_t port, uint8_t value,
+                 unsigned int step)
+{
+    snap_out_entry *out;
+
+    write_begin(s);
+    out = &s->data.out[s->data.out_count % SNAP_OUT_LOG];
+    out->step = step;
+    out->port = port;
+    out->value = value;
+    s->data.out_count++;
+    write_end(s);
+}
+
+void snap_read(vnsem_snapshot *s, vnsem_snapshot_data *out)
+{
+    unsigned int seq;
+
+    do {
+        /* an odd sequence number means a write is in progress */
+        while ((seq = atomic_load_explicit(&s->seq, memory_order_acquire)) & 1);
+        memcpy(out, &s->data, sizeof(*out));
+        atomic_thread_fence(memory_order_acquire);
+    } while (seq != atomic_load_explicit(&s->seq, memory_order_relaxed));
+}
+
+/**
+ * Copy the published state into *m*, e.g. to run read-only commands on
+ * it. Hooks, statistics and history of *m* are left alone.
+ */
+void snap_to_machine(const vnsem_snapshot_data *d, vnsem_machine *m)
+{
+    m->step_count = d->step_count;
+    memcpy(m->mem, d->mem, sizeof(m->mem));
+    m->pc = d->pc;
+    m->reg_l = d->reg_l;
+    m->sp = d->sp;
+    m->accu = d->accu;
+    m->flags = d->flags;
+    m->halted = d->halted;
+}
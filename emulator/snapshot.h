@@ -0,0 +1,71 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H 1
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "vnsem.h"
+
+#define SNAP_OUT_LOG    16
+
+typedef struct _snap_output {
+    unsigned int step;
+    uint8_t port;
+    uint8_t value;
+} snap_out_entry;
+
+/**
+ * Everything other threads may see of a running machine. The output log
+ * is a ring buffer indexed by *out_count*.
+ */
+typedef struct _vnsem_snapshot_data {
+    unsigned int step_count;
+    uint8_t mem[256];
+    uint8_t pc;
+    uint8_t reg_l;
+    uint8_t sp;
+    uint8_t accu;
+    uint8_t flags;
+    uint8_t halted;
+    unsigned int out_count;
+    snap_out_entry out[SNAP_OUT_LOG];
+} vnsem_snapshot_data;
+
+/**
+ * A snapshot published with a sequence lock. The emulation thread is
+ * the only writer and never waits; readers retry until they got a copy
+ * the writer did not touch in between.
+ */
+typedef struct _vnsem_snapshot {
+    atomic_uint seq;
+    vnsem_snapshot_data data;
+} vnsem_snapshot;
+
+void snap_init(vnsem_snapshot *s);
+void snap_publish(vnsem_snapshot *s, const vnsem_machine *m);
+void snap_output(vnsem_snapshot *s, uint8_t port, uint8_t value,
+                 unsigned int step);
+void snap_read(vnsem_snapshot *s, vnsem_snapshot_data *out);
+void snap_to_machine(const vnsem_snapshot_data *d, vnsem_machine *m);
+
+#endif /* SNAPSHOT_H */
@@ -0,0 +1,143 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "instructionset.h"
+#include "stats.h"
+
+static const char *st_phase_names[ST_PHASES] = {
+    "other", "load", "execute", "i/o", "trace", "console", "delay"
+};
+
+uint64_t st_clock(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * Start collecting statistics. The decode lookup counter is global, so
+ * its current value is kept as baseline until the statistics are read.
+ */
+void st_init(vnsem_stats *st)
+{
+    memset(st, 0, sizeof(*st));
+    st->decode_lookups = is_lookup_count();
+    st->start_ns = st->phase_start_ns = st_clock();
+    st->phase = ST_PHASE_OTHER;
+    st->phase_entries[ST_PHASE_OTHER] = 1;
+}
+
+/**
+ * Account the time since the last switch to the current phase and
+ * continue with *phase*. Returns the previous phase, so nested phases
+ * can switch back with st_enter(st, previous).
+ */
+int st_enter(vnsem_stats *st, int phase)
+{
+    uint64_t now = st_clock();
+    int previous = st->phase;
+
+    st->phase_ns[previous] += now - st->phase_start_ns;
+    st->phase_start_ns = now;
+    st->phase = phase;
+    st->phase_entries[phase]++;
+
+    return previous;
+}
+
+/**
+ * Account one timed step of *instructions* instructions, of which
+ * *execute_ns* were spent executing and *trace_ns* tracing.
+ */
+void st_sample(vnsem_stats *st, uint64_t execute_ns, uint64_t trace_ns,
+               unsigned int instructions)
+{
+    st->sampled_instructions += instructions;
+    st->sampled_execute_ns += execute_ns;
+    st->sampled_trace_ns += trace_ns;
+}
+
+/**
+ * Copy the statistics to *out* as if the current phase ended right now
+ * and fill in the counters kept outside of the emulator. The share of
+ * tracing in the execute phase is estimated from the timed steps.
+ */
+void st_read(const vnsem_stats *st, vnsem_stats *out)
+{
+    uint64_t now = st_clock(), trace;
+    uint64_t sampled = st->sampled_execute_ns + st->sampled_trace_ns;
+
+    *out = *st;
+    out->phase_ns[st->phase] += now - st->phase_start_ns;
+    out->phase_start_ns = now;
+
+    if (sampled) {
+        trace = (double)out->phase_ns[ST_PHASE_EXECUTE] *
+                st->sampled_trace_ns / sampled;
+        out->phase_ns[ST_PHASE_EXECUTE] -= trace;
+        out->phase_ns[ST_PHASE_TRACE] += trace;
+    }
+
+    out->decode_lookups = is_lookup_count() - st->decode_lookups;
+}
+
+const char *st_phase_name(int phase)
+{
+    return (phase >= 0 && phase < ST_PHASES) ? st_phase_names[phase] : "?";
+}
+
+void st_print(const vnsem_stats *st)
+{
+    vnsem_stats s;
+    double total;
+    int i;
+
+    st_read(st, &s);
+    total = (s.phase_start_ns - s.start_ns) / 1e9;
+
+    printf("\n  ** Runtime statistics **\n\n");
+    printf("   Retired instructions: %llu\n", (unsigned long long)s.retired);
+    printf("  Host time/instruction: %.1f ns (every %ith step timed)\n",
+            (s.sampled_instructions) ?
+                (double)s.sampled_execute_ns / s.sampled_instructions : 0,
+            ST_SAMPLE_STEPS);
+    printf("             Wall clock: %.6f s\n", total);
+    printf("                    I/O: %llu input(s), %llu waited for user, "
+           "%llu output(s)\n",
+            (unsigned long long)s.inputs, (unsigned long long)s.input_waits,
+            (unsigned long long)s.outputs);
+    printf("         Opcode lookups: %llu\n",
+            (unsigned long long)s.decode_lookups);
+
+    printf("\n    Phase          Time     Share      Entries\n");
+    for (i = 0; i < ST_PHASES; ++i) {
+        printf("    %-8s %10.6f s  %6.2f%%  %11llu\n", st_phase_name(i),
+                s.phase_ns[i] / 1e9,
+                (total > 0) ? 100 * s.phase_ns[i] / 1e9 / total : 0,
+                (unsigned long long)s.phase_entries[i]);
+    }
+    printf("\n");
+}
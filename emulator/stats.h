@@ -0,0 +1,70 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef STATS_H
+#define STATS_H 1
+
+#include <stdint.h>
+
+/* phases the host time of the emulator is accounted to */
+#define ST_PHASE_OTHER      0   // startup and everything not listed below
+#define ST_PHASE_LOAD       1   // reading program images
+#define ST_PHASE_EXECUTE    2   // running instructions, tracing included
+#define ST_PHASE_IO         3   // IN/OUT, including waiting for the user
+#define ST_PHASE_TRACE      4   // printing instructions and machine state
+#define ST_PHASE_CONSOLE    5   // interactive console
+#define ST_PHASE_DELAY      6   // configured step delay
+
+#define ST_PHASES           7
+
+/* one step in this many is timed to split execution from tracing */
+#define ST_SAMPLE_STEPS     64
+
+/**
+ * Runtime statistics of the emulator. Time is sampled from the monotonic
+ * clock whenever the emulator switches phases, which the emulation loop
+ * does not do per step. Only every ST_SAMPLE_STEPS-th step is timed in
+ * its parts, and st_read() splits the execute phase by these samples.
+ */
+typedef struct _vnsem_stats {
+    uint64_t retired;               // instructions retired
+    uint64_t inputs;                // IN instructions executed
+    uint64_t input_waits;           // ... of which waited for the user
+    uint64_t outputs;               // OUT instructions executed
+    uint64_t decode_lookups;        // opcode lookups (trace, analyzer)
+    uint64_t sampled_instructions;
+    uint64_t sampled_execute_ns;
+    uint64_t sampled_trace_ns;
+    uint64_t phase_ns[ST_PHASES];
+    uint64_t phase_entries[ST_PHASES];
+    uint64_t start_ns;
+    uint64_t phase_start_ns;
+    int phase;
+} vnsem_stats;
+
+void st_init(vnsem_stats *st);
+int st_enter(vnsem_stats *st, int phase);
+uint64_t st_clock(void);
+void st_sample(vnsem_stats *st, uint64_t execute_ns, uint64_t trace_ns,
+               unsigned int instructions);
+void st_read(const vnsem_stats *st, vnsem_stats *out);
+void st_print(const vnsem_stats *st);
+const char *st_phase_name(int phase);
+
+#endif /* STATS_H */
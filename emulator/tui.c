@@ -0,0 +1,331 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "globals.h"
+#include "instructionset.h"
+#include "tui.h"
+
+/* screen layout, rows and columns start at 1 */
+#define ROW_GRID        4
+#define COL_GRID        9
+#define COL_PANEL       58
+#define ROW_REGS        4
+#define ROW_DISASM      11
+#define ROW_OUT         22
+#define ROW_PROMPT      (ROW_OUT + TUI_OUT_LINES + 1)
+
+#define SLOT_TITLE      0
+#define SLOT_REGS       1
+#define SLOT_DISASM     6
+#define SLOT_OUT        (SLOT_DISASM + TUI_DISASM)
+
+typedef struct _frame {
+    char buf[32768];
+    size_t len;
+} frame;
+
+static void emit(frame *f, const char *fmt, ...)
+{
+    va_list ap;
+    int n;
+
+    va_start(ap, fmt);
+    n = vsnprintf(f->buf + f->len, sizeof(f->buf) - f->len, fmt, ap);
+    va_end(ap);
+
+    if (n > 0) {
+        f->len += n;
+        if (f->len > sizeof(f->buf) - 1) {
+            f->len = sizeof(f->buf) - 1;
+        }
+    }
+}
+
+static void flush(frame *f)
+{
+    const char *p = f->buf;
+    ssize_t n;
+
+    while (f->len > 0 && (n = write(STDOUT_FILENO, p, f->len)) > 0) {
+        p += n;
+        f->len -= n;
+    }
+
+    f->len = 0;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* row and column of each text slot and its width */
+static void slot_position(int slot, int *row, int *col, int *width)
+{
+    if (SLOT_TITLE == slot) {
+        *row = 1; *col = 1; *width = TUI_SLOT_WIDTH;
+    } else if (slot < SLOT_DISASM) {
+        *row = ROW_REGS + slot - SLOT_REGS; *col = COL_PANEL + 2; *width = 20;
+    } else if (slot < SLOT_OUT) {
+        *row = ROW_DISASM + slot - SLOT_DISASM; *col = COL_PANEL; *width = 22;
+    } else {
+        *row = ROW_OUT + slot - SLOT_OUT; *col = 3; *width = 54;
+    }
+}
+
+static void format_arg(char *buf, size_t size, const vnsem_snapshot_data *d,
+                       uint8_t addr, argtype at)
+{
+    if (at & AT_REG_A)       snprintf(buf, size, "A");
+    else if (at & AT_REG_L)  snprintf(buf, size, "L");
+    else if (at & AT_REG_FL) snprintf(buf, size, "FL");
+    else if (at & AT_REG_SP) snprintf(buf, size, "SP");
+    else if (at & AT_MEM)    snprintf(buf, size, "M");
+    else snprintf(buf, size, "0x%.2X", d->mem[(uint8_t)(addr + 1)]);
+}
+
+/* disassemble the instruction at *addr*, returns its length */
+static int disassemble(char *buf, size_t size, const vnsem_snapshot_data *d,
+                       uint8_t addr)
+{
+    const vns_instruction *ins = is_find_opcode(d->mem[addr]);
+    char a1[8] = "", a2[8] = "";
+
+    if (NULL == ins) {
+        snprintf(buf, size, "%s0x%.2X  .byte 0x%.2X",
+                (addr == d->pc) ? "> " : "  ", addr, d->mem[addr]);
+        return 1;
+    }
+
+    if (ins->at1) format_arg(a1, sizeof(a1), d, addr, ins->at1);
+    if (ins->at2) format_arg(a2, sizeof(a2), d, addr, ins->at2);
+
+    snprintf(buf, size, "%s0x%.2X  %s %s%s%s",
+            (addr == d->pc) ? "> " : "  ", addr, ins->mnemonic,
+            a1, (ins->at2) ? ", " : "", a2);
+
+    return is_instruction_length(ins);
+}
+
+/* compose the text of all slots for snapshot *d* */
+static void compose(vnsem_tui *t, const vnsem_snapshot_data *d,
+                    char text[TUI_SLOTS][TUI_SLOT_WIDTH + 1])
+{
+    const snap_out_entry *out;
+    unsigned int i, first;
+    uint8_t addr = d->pc;
+
+    snprintf(text[SLOT_TITLE], TUI_SLOT_WIDTH + 1,
+            " VNS Emulator   step #%-10u %-8s %10.0f ins/s",
+            d->step_count, (d->halted) ? "HALTED" : "RUNNING", t->speed);
+
+    snprintf(text[SLOT_REGS + 0], TUI_SLOT_WIDTH + 1, "ACCU  0x%.2X (%3i)",
+            d->accu, d->accu);
+    snprintf(text[SLOT_REGS + 1], TUI_SLOT_WIDTH + 1, "L     0x%.2X (%3i)",
+            d->reg_l, d->reg_l);
+    snprintf(text[SLOT_REGS + 2], TUI_SLOT_WIDTH + 1, "PC    0x%.2X", d->pc);
+    snprintf(text[SLOT_REGS + 3], TUI_SLOT_WIDTH + 1, "SP    0x%.2X", d->sp);
+    snprintf(text[SLOT_REGS + 4], TUI_SLOT_WIDTH + 1, "C:%c  Z:%c  S:%c",
+            (d->flags & F_CARRY) ? '*' : '-',
+            (d->flags & F_ZERO)  ? '*' : '-',
+            (d->flags & F_SIGN)  ? '*' : '-');
+
+    for (i = 0; i < TUI_DISASM; ++i) {
+        addr += disassemble(text[SLOT_DISASM + i], TUI_SLOT_WIDTH + 1, d, addr);
+    }
+
+    first = (d->out_count > TUI_OUT_LINES) ? d->out_count - TUI_OUT_LINES : 0;
+    for (i = 0; i < TUI_OUT_LINES; ++i) {
+        if (first + i < d->out_count) {
+            out = &d->out[(first + i) % SNAP_OUT_LOG];
+            snprintf(text[SLOT_OUT + i], TUI_SLOT_WIDTH + 1,
+                    "#%.5u  [%.2X] => 0x%.2X (%i)",
+                    out->step, out->port, out->value, out->value);
+        } else {
+            text[SLOT_OUT + i][0] = '\0';
+        }
+    }
+}
+
+static void draw_static(frame *f)
+{
+    int i;
+
+    emit(f, "\033[H\033[2J");
+    emit(f, "\033[%i;%iH", ROW_GRID - 1, COL_GRID);
+    for (i = 0; i < 16; ++i) {
+        emit(f, "%.2X ", i);
+    }
+    for (i = 0; i < 16; ++i) {
+        emit(f, "\033[%i;2H0x%.2X", ROW_GRID + i, i * 16);
+    }
+    emit(f, "\033[%i;%iHRegisters", ROW_REGS - 1, COL_PANEL);
+    emit(f, "\033[%i;%iHDisassembly", ROW_DISASM - 1, COL_PANEL);
+    emit(f, "\033[%i;1HOutput", ROW_OUT - 1);
+}
+
+static void draw_cell(frame *f, const vnsem_snapshot_data *d, int addr)
+{
+    emit(f, "\033[%i;%iH%s%.2X%s", ROW_GRID + addr / 16, COL_GRID + 3 * (addr % 16),
+            (addr == d->pc) ? "\033[7m" : "", d->mem[addr],
+            (addr == d->pc) ? "\033[m" : "");
+}
+
+static void render(vnsem_tui *t)
+{
+    static frame f;
+    static vnsem_snapshot_data d;
+    char text[TUI_SLOTS][TUI_SLOT_WIDTH + 1];
+    int i, row, col, width;
+    double time = now();
+
+    snap_read(t->snap, &d);
+
+    if (time > t->last_time) {
+        t->speed = (d.step_count >= t->last_step) ?
+                   (d.step_count - t->last_step) / (time - t->last_time) : 0;
+    }
+    t->last_step = d.step_count;
+    t->last_time = time;
+
+    compose(t, &d, text);
+
+    if (!t->valid) {
+        draw_static(&f);
+    }
+
+    for (i = 0; i < 256; ++i) {
+        if (!t->valid || d.mem[i] != t->shown.mem[i] ||
+                ((i == d.pc) != (i == t->shown.pc))) {
+            draw_cell(&f, &d, i);
+        }
+    }
+
+    for (i = 0; i < TUI_SLOTS; ++i) {
+        if (t->valid && 0 == strcmp(text[i], t->text[i])) {
+            continue;
+        }
+        slot_position(i, &row, &col, &width);
+        emit(&f, "\033[%i;%iH%-*.*s", row, col, width, width, text[i]);
+        strcpy(t->text[i], text[i]);
+    }
+
+    /* park the cursor where stray output does the least harm */
+    emit(&f, "\033[%i;1H", ROW_PROMPT);
+    flush(&f);
+
+    t->shown = d;
+    t->valid = TRUE;
+}
+
+static void *render_thread(void *arg)
+{
+    vnsem_tui *t = (vnsem_tui*)arg;
+    struct timespec delay;
+
+    delay.tv_sec = 0;
+    delay.tv_nsec = 1000000000L / t->fps;
+
+    while (atomic_load(&t->running)) {
+        pthread_mutex_lock(&t->lock);
+        if (!t->suspended) {
+            render(t);
+        }
+        pthread_mutex_unlock(&t->lock);
+        nanosleep(&delay, NULL);
+    }
+
+    return NULL;
+}
+
+int tui_start(vnsem_tui *t, vnsem_snapshot *s, unsigned int fps)
+{
+    frame f = { .len = 0 };
+
+    memset(t, 0, sizeof(*t));
+    t->snap = s;
+    t->fps = (fps) ? fps : TUI_DEFAULT_FPS;
+    t->last_time = now();
+    atomic_init(&t->running, TRUE);
+    pthread_mutex_init(&t->lock, NULL);
+
+    /* alternate screen, hidden cursor */
+    emit(&f, "\033[?1049h\033[?25l");
+    flush(&f);
+
+    if (0 != pthread_create(&t->thread, NULL, render_thread, t)) {
+        perror("tui");
+        tui_stop(t);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+void tui_stop(vnsem_tui *t)
+{
+    frame f = { .len = 0 };
+
+    if (atomic_exchange(&t->running, FALSE)) {
+        pthread_join(t->thread, NULL);
+    }
+
+    emit(&f, "\033[?25h\033[?1049l");
+    flush(&f);
+}
+
+/**
+ * Hand the terminal over to the console: wait for the current frame to
+ * finish and clear the prompt area below the display.
+ */
+void tui_suspend(vnsem_tui *t)
+{
+    frame f = { .len = 0 };
+
+    pthread_mutex_lock(&t->lock);
+    render(t);
+    t->suspended = TRUE;
+    emit(&f, "\033[%i;1H\033[J\033[?25h", ROW_PROMPT);
+    flush(&f);
+    fflush(stdout);
+    pthread_mutex_unlock(&t->lock);
+}
+
+void tui_resume(vnsem_tui *t)
+{
+    frame f = { .len = 0 };
+
+    fflush(stdout);
+    pthread_mutex_lock(&t->lock);
+    t->suspended = FALSE;
+    t->valid = FALSE;
+    emit(&f, "\033[?25l");
+    flush(&f);
+    pthread_mutex_unlock(&t->lock);
+}
@@ -0,0 +1,64 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+#ifndef TUI_H
+#define TUI_H 1
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "snapshot.h"
+
+#define TUI_DEFAULT_FPS 30
+#define TUI_PUBLISH_MASK 0xff   // publish every 256 steps at full speed
+#define TUI_DISASM      9       // disassembled lines
+#define TUI_OUT_LINES   8       // lines of the output log
+#define TUI_SLOTS       (6 + TUI_DISASM + TUI_OUT_LINES)
+#define TUI_SLOT_WIDTH  80
+
+/**
+ * Full screen terminal UI. A render thread reads the published snapshot
+ * at a fixed frame rate and redraws only what changed since the last
+ * frame. The emulation thread never waits for it, except when the
+ * terminal is handed over to the console with tui_suspend().
+ */
+typedef struct _vnsem_tui {
+    vnsem_snapshot *snap;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    atomic_int running;
+    int suspended;
+    int valid;                  // screen matches the shown state
+    unsigned int fps;
+    /* what is on screen */
+    vnsem_snapshot_data shown;
+    char text[TUI_SLOTS][TUI_SLOT_WIDTH + 1];
+    /* speed measurement */
+    unsigned int last_step;
+    double last_time;
+    double speed;
+} vnsem_tui;
+
+int tui_start(vnsem_tui *t, vnsem_snapshot *s, unsigned int fps);
+void tui_stop(vnsem_tui *t);
+void tui_suspend(vnsem_tui *t);
+void tui_resume(vnsem_tui *t);
+
+#endif /* TUI_H */
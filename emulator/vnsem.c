@@ -19,20 +19,120 @@
 
 #include <stdio.h>
 #include <unistd.h>
+#include <getopt.h>
 #include <stdlib.h>
 #include <string.h>
 #include <signal.h>
 #include <math.h>
+#include <time.h>
 #include <readline/readline.h>
 
 #include "globals.h"
 #include "utils.h"
 #include "console.h"
 #include "instructionset.h"
+#include "analyzer.h"
+#include "debuginfo.h"
+#include "image.h"
+#include "fuzzer.h"
+#include "difftest.h"
+#include "history.h"
+#include "live.h"
+#include "snapshot.h"
+#include "smp.h"
+#include "network.h"
+#include "savestate.h"
+#include "accel.h"
+#include "tui.h"
+#include "vnsasm.h"
 #include "vnsem.h"
 
 vnsem_configuration config;
 
+static vnsem_stats stats;
+static vnsem_history history;
+
+/* engine of the emulation loop, see -e */
+static const vnsem_engine *engine;
+
+/* full screen display, only used if config.tui_fps is set */
+static vnsem_snapshot snapshot;
+static vnsem_tui tui;
+static int tui_active = FALSE;
+
+/* emulation on its own thread, only used if config.live_mode is set */
+static vnsem_live live;
+static int live_active = FALSE;
+
+/* values read by IN before the user is asked, from -I or a saved state */
+static dt_inputs pending_inputs;
+
+/* debug information from -g or of the program assembled last (--asm) */
+static debuginfo debug;
+static int debug_loaded = FALSE;
+
+/**
+ * Return the debug information of the loaded program or NULL.
+ */
+const debuginfo *vnsem_debuginfo(void)
+{
+    return debug_loaded ? &debug : NULL;
+}
+
+/**
+ * Start collecting runtime statistics for *machine*, which --stats
+ * does from the start and the stats command on first use.
+ */
+vnsem_stats *collect_stats(vnsem_machine *machine)
+{
+    if (NULL == machine->stats) {
+        st_init(&stats);
+        machine->stats = &stats;
+    }
+
+    return machine->stats;
+}
+
+/* switch the phase the host time is accounted to, if anybody asked */
+static inline int enter_phase(vnsem_machine *machine, int phase)
+{
+    if (NULL == machine->stats) {
+        return ST_PHASE_EXECUTE;
+    }
+
+    return st_enter(machine->stats, phase);
+}
+
+/**
+ * Describe *addr* by source line and closest label, e.g.
+ * "multiply.asm:12 mult+2". Writes an empty string and returns FALSE
+ * if nothing is known about the address.
+ */
+int format_location(uint8_t addr, char *buf, size_t size)
+{
+    const char *label = NULL;
+    uint8_t offset = 0;
+    int len = 0;
+
+    buf[0] = '\0';
+    if (!debug_loaded) {
+        return FALSE;
+    }
+
+    if (debug.line[addr]) {
+        len = snprintf(buf, size, "%s:%u", util_basename(debug.source),
+                       debug.line[addr]);
+    }
+
+    if (NULL != (label = dbg_symbolize(&debug, addr, &offset)) &&
+            len >= 0 && (size_t)len < size) {
+        snprintf(buf + len, size - len, offset ? "%s%s+%u" : "%s%s",
+                 len ? " " : "", label, offset);
+    }
+
+    return '\0' != buf[0];
+}
+
 void print_machine_state(vnsem_machine *machine)
 {
     printf("#%.5i  ", machine->step_count);
@@ -80,10 +180,22 @@ void dump_memory(vnsem_machine *machine)
         printf("%.2X ", machine->mem[i]);
     }
     printf("\n\n");
+
+    if (debug_loaded && debug.label_count) {
+        printf(" Labels:");
+        for (i = 0; i < debug.label_count; ++i) {
+            printf("%s 0x%.2X %s", i ? "," : "", debug.labels[i].addr,
+                   debug.names + debug.labels[i].name);
+        }
+        printf("\n\n");
+    }
 }
 
 void print_instruction_arg(vnsem_machine *machine, argtype at)
 {
+    uint8_t arg = machine->mem[(uint8_t)(machine->pc + 1)];
+    const char *label;
+
     if (at & AT_REG_A) {
         printf("A");
     } else
@@ -99,14 +211,19 @@ void print_instruction_arg(vnsem_machine *machine, argtype at)
     if (at & AT_MEM) {
         printf("0x%.2X", machine->mem[machine->reg_l]);
     } else
+    if ((at & AT_LABEL || at & AT_ADDR) && debug_loaded &&
+            NULL != (label = dbg_label_at(&debug, arg))) {
+        printf("%s", label);
+    } else
     if (at & AT_LABEL || at & AT_ADDR || at & AT_INT) {
-        printf("0x%.2X", machine->mem[(uint8_t)(machine->pc + 1)]);
+        printf("0x%.2X", arg);
     }
 }
 
 void print_instruction(vnsem_machine *machine)
 {
-    vns_instruction *ins = is_find_opcode(machine->mem[machine->pc]);
+    const vns_instruction *ins = is_find_opcode(machine->mem[machine->pc]);
+    char location[DBG_LOCATION_SIZE];
 
     printf("                                                                ");
     if (ins) {
@@ -121,30 +238,225 @@ void print_instruction(vnsem_machine *machine)
             }
         }
     }
+    if (format_location(machine->pc, location, sizeof(location))) {
+        printf("  ; %s", location);
+    }
     printf("\r");
 }
 
+void print_analysis(const char *name, an_result *res)
+{
+    int i, errors = 0;
+    an_issue *issue;
+
+    printf("%s: entry 0x%.2X, %i instructions, %i code bytes, ",
+            name, res->entry, res->ins_count, res->code_bytes);
+
+    if (res->depth_max >= AN_DEPTH_INF) {
+        printf("stack depth unbounded\n");
+    } else {
+        printf("stack depth %i..%i\n", res->depth_min, res->depth_max);
+    }
+
+    if (res->unknown_reads || res->unknown_writes) {
+        printf("  %i read(s) and %i write(s) through unknown L register\n",
+                res->unknown_reads, res->unknown_writes);
+    }
+
+    for (i = 0; i < res->issue_count; ++i) {
+        issue = &res->issues[i];
+        if (an_issue_is_error(issue->type)) {
+            errors++;
+        }
+        printf("  %-7s 0x%.2X", an_issue_is_error(issue->type) ?
+                "error" : "warning", issue->addr);
+        if (issue->len > 1) {
+            printf("-0x%.2X", issue->addr + issue->len - 1);
+        }
+        printf("  %s\n", an_issue_name(issue->type));
+    }
+
+    if (errors) {
+        printf("  %i error(s) found.\n", errors);
+    }
+}
+
 void reset_machine(vnsem_machine *machine)
 {
     /* set everything to zero */
     memset(machine, 0, sizeof(*machine));
 }
 
-int load_program(char *filepath, uint8_t offset, vnsem_machine *machine)
+/**
+ * Assemble the source *filepath* ("-" for standard input) in memory and
+ * open the result as container image. The image refers to *data*, which
+ * the caller frees after img_close().
+ */
+static int assemble_image(char *filepath, vns_image *img, uint8_t **data)
 {
-    FILE *in;
-
-    /* load the program */
-    if (NULL == (in = fopen(filepath, "r"))) {
+    vnsasm_configuration asm_config;
+    vnsasm_context ctx;
+    size_t size;
+    FILE *infile;
+    int ok;
+
+    memset(&asm_config, 0, sizeof(asm_config));
+    asm_config.image_format = IMG_CONTAINER;
+    /* an explicit debug info file takes precedence */
+    asm_config.debug_labels = (NULL == config.debugfile_name);
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.config = &asm_config;
+    ctx.infile_name = filepath;
+    ctx.out = stdout;
+    ctx.err = stderr;
+
+    if (NULL == (infile = util_fopen(filepath, "r"))) {
         perror(filepath);
         return FALSE;
     }
 
+    ok = asm_parse(&ctx, infile) && asm_encode(&ctx, data, &size);
+    asm_release(&ctx);
+    util_fclose(infile);
+
+    if (!ok) {
+        return FALSE;
+    }
+
+    if (asm_config.debug_labels) {
+        debug = ctx.program.debug;
+        debug_loaded = TRUE;
+    }
+
+    if (!img_open_memory(*data, size, filepath, img)) {
+        free(*data);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ * Load the program image *filepath* into *machine*'s memory and set the
+ * program counter to its entry. Raw images are placed at *offset* and
+ * entered there, containers bring their own addresses. Regular files
+ * are mapped and copied into the memory unit directly, "-" and other
+ * streams are read completely first. With --asm, *filepath* is a
+ * source file and assembled in memory.
+ */
+static int load_image(char *filepath, uint8_t offset, vnsem_machine *machine,
+                      int verbose)
+{
+    uint8_t *data = NULL;
+    vns_image img;
+    int loaded, bank_count;
+#if VNS_BANKS > 1
+    int bank;
+#endif
+
+    if (config.asm_source) {
+        if (!assemble_image(filepath, &img, &data)) {
+            return FALSE;
+        }
+    } else if (!img_open(filepath, &img)) {
+        return FALSE;
+    }
+
+    bank_count = img_bank_count(&img);
+    if (bank_count > VNS_BANKS) {
+        util_perror("%s: program needs %i memory banks, the emulator was "
+                    "built with %i\n", filepath, bank_count, VNS_BANKS);
+        img_close(&img);
+        free(data);
+        return FALSE;
+    }
+
+    loaded = 0;
+#if VNS_BANKS > 1
+    select_bank(0, machine);
+    for (bank = 1; bank < bank_count; ++bank) {
+        loaded += img_load_bank(&img, machine->banks[bank], bank);
+    }
+#endif
+    loaded += img_load(&img, machine->mem, offset);
+
+    if (IMG_CONTAINER == img.format) {
+        machine->pc = img.entry;
+        if (verbose) {
+            printf("%i bytes in %i segment(s), %i symbol(s), entry 0x%.2X...",
+                    loaded, img.segment_count, img.symbol_count, img.entry);
+        }
+    } else {
+        machine->pc = offset;
+    }
+
+    img_close(&img);
+    free(data);
+
+    return TRUE;
+}
+
+/**
+ * Read the program image *filepath* into *machine*'s memory at *offset*
+ * without printing anything. Returns TRUE on success.
+ */
+int read_program(char *filepath, uint8_t offset, vnsem_machine *machine)
+{
+    return load_image(filepath, offset, machine, FALSE);
+}
+
+int load_program(char *filepath, uint8_t offset, vnsem_machine *machine)
+{
+    int phase = 0, result = FALSE;
+
+    if (NULL != machine->stats) {
+        phase = st_enter(machine->stats, ST_PHASE_LOAD);
+    }
+
     printf("Loading program '%s'...", filepath);
-    fread((void*)&machine->mem[offset], 1, sizeof(machine->mem) - offset, in);
-    fclose(in);
-    printf("done.\n");
+    fflush(stdout);
+
+    if (load_image(filepath, offset, machine, TRUE)) {
+        printf("done.\n");
+        result = TRUE;
+    }
 
+    if (NULL != machine->stats) {
+        st_enter(machine->stats, phase);
+    }
+
+    return result;
+}
+
+/**
+ * Write *machine* and the input not read yet to the state file
+ * *filepath*.
+ */
+int save_state(char *filepath, vnsem_machine *machine)
+{
+    if (!ss_save(filepath, machine, &pending_inputs)) {
+        return FALSE;
+    }
+
+    printf("Machine state saved to '%s' (step %u, %i pending input(s)).\n",
+           filepath, machine->step_count, pending_inputs.count);
+    return TRUE;
+}
+
+/**
+ * Continue with the machine and pending input saved to *filepath*.
+ */
+int restore_state(char *filepath, vnsem_machine *machine)
+{
+    printf("Restoring machine state '%s'...", filepath);
+    fflush(stdout);
+
+    if (!ss_restore(filepath, machine, &pending_inputs)) {
+        return FALSE;
+    }
+
+    printf("done, step %u, PC 0x%.2X.\n", machine->step_count, machine->pc);
     return TRUE;
 }
 
@@ -247,25 +559,152 @@ int sigint_is_pending(void)
 }
 
 void console(vnsem_machine *machine) {
+    int phase = enter_phase(machine, ST_PHASE_CONSOLE);
+
+    if (NULL != machine->history) {
+        hist_pause(machine->history, machine);
+    }
+
+    if (tui_active) {
+        snap_publish(&snapshot, machine);
+        tui_suspend(&tui);
+    }
+
     set_block_sigint(FALSE);
     vnsem_console(machine);
     set_block_sigint(TRUE);
+
+    if (tui_active) {
+        snap_publish(&snapshot, machine);
+        tui_resume(&tui);
+    }
+
+    if (NULL != machine->history) {
+        hist_resume(machine->history, machine);
+    }
+
+    enter_phase(machine, phase);
 }
 
+void print_program_output(uint8_t port, uint8_t value, unsigned int step)
+{
+    if (tui_active) {
+        snap_output(&snapshot, port, value, step);
+        return;
+    }
+
+    printf("[%.2X] Program output => 0x%X (%i)\n", port, value, value);
+}
+
+#if VNS_BANKS > 1
+/**
+ * Map *bank* (modulo VNS_BANKS) into the bank window. The window of the
+ * machine is the current bank, the one mapped before is saved.
+ */
+void select_bank(uint8_t bank, vnsem_machine *m)
+{
+    bank %= VNS_BANKS;
+    if (bank == m->bank) {
+        return;
+    }
+
+    memcpy(m->banks[m->bank], m->mem + IMG_BANK_BASE, IMG_BANK_SIZE);
+    memcpy(m->mem + IMG_BANK_BASE, m->banks[bank], IMG_BANK_SIZE);
+    m->bank = bank;
+}
+#endif
+
 void user_output(uint8_t port, vnsem_machine *machine)
 {
-    printf("[%.2X] Program output => 0x%X (%i)\n",
-            port, machine->accu, machine->accu);
+    int phase = 0;
+
+#if VNS_BANKS > 1
+    if (VNS_BANK_PORT == port) {
+        select_bank(machine->accu, machine);
+        return;
+    }
+#endif
+
+    if (NULL != machine->stats) {
+        machine->stats->outputs++;
+        phase = st_enter(machine->stats, ST_PHASE_IO);
+    }
+
+    if (NULL != machine->io) {
+        machine->io->output(port, machine->accu, machine->io->ctx);
+    } else {
+        print_program_output(port, machine->accu, machine->step_count);
+    }
+
+    if (NULL != machine->stats) {
+        st_enter(machine->stats, phase);
+    }
+}
+
+int read_user_input(uint8_t port, vnsem_machine *machine);
+
+int user_input(uint8_t port, vnsem_machine *machine)
+{
+    int phase = 0, result;
+
+#if VNS_BANKS > 1
+    if (VNS_BANK_PORT == port) {
+        accu_op(machine->bank, machine);
+        return TRUE;
+    }
+#endif
+
+    if (NULL == machine->stats) {
+        return read_user_input(port, machine);
+    }
+
+    machine->stats->inputs++;
+    phase = st_enter(machine->stats, ST_PHASE_IO);
+    result = read_user_input(port, machine);
+    st_enter(machine->stats, phase);
+
+    return result;
 }
 
-void user_input(uint8_t port, vnsem_machine *machine)
+int read_user_input(uint8_t port, vnsem_machine *machine)
 {
     short int result;
     uint16_t value;
+    uint8_t byte;
     char prompt[32], *input;
 
+    if (NULL != machine->io) {
+        if (!machine->io->input(port, &byte, machine->io->ctx)) {
+            return FALSE;
+        }
+        accu_op(byte, machine);
+        return TRUE;
+    }
+
+    if (pending_inputs.count) {
+        accu_op(pending_inputs.values[0], machine);
+        memmove(pending_inputs.values, pending_inputs.values + 1,
+                --pending_inputs.count);
+        return TRUE;
+    }
+
+    if (NULL != machine->stats) {
+        machine->stats->input_waits++;
+    }
+
+    if (live_active) {
+        snap_publish(&snapshot, machine);
+        accu_op(live_input(&live, port), machine);
+        return TRUE;
+    }
+
     snprintf((char*)&prompt, 32, "[%.2X] Program input => ", port);
 
+    if (tui_active) {
+        snap_publish(&snapshot, machine);
+        tui_suspend(&tui);
+    }
+
     while (1) {
         set_block_sigint(FALSE);
         input = readline(prompt);
@@ -283,8 +722,15 @@ void user_input(uint8_t port, vnsem_machine *machine)
     }
 
     value = result;
-    printf("----> %i\n", value);
     accu_op(value, machine);
+
+    if (tui_active) {
+        tui_resume(&tui);
+    } else {
+        printf("----> %i\n", value);
+    }
+
+    return TRUE;
 }
 
 int process_instruction(uint8_t ins, vnsem_machine *m)
@@ -307,7 +753,11 @@ int process_instruction(uint8_t ins, vnsem_machine *m)
         case 0xf1: /* POP A   */ m->accu  = m->mem[m->sp]; m->sp++;    break;
         case 0xe1: /* POP L   */ m->reg_l = m->mem[m->sp]; m->sp++;    break;
         case 0xfd: /* POP FL  */ m->flags = m->mem[m->sp]; m->sp++;    break;
-        case 0xdb: /* IN adr  */ user_input(read_arg(m), m);           break;
+        case 0xdb: /* IN adr  */
+            if (!user_input(read_arg(m), m)) {
+                return ERR_NO_INPUT;
+            }
+            break;
         case 0xd3: /* OUT adr */ user_output(read_arg(m), m);          break;
         /* ------ ARITHMETIC  ------ */
         case 0x3c: /* INR A */ accu_op(m->accu + 1, m);                break;
@@ -362,93 +812,584 @@ int process_instruction(uint8_t ins, vnsem_machine *m)
     return 0;
 }
 
-int emulate(void)
+/**
+ * Fetch and execute the instruction the program counter points at.
+ * Returns 0 on success or one of the ERR_* codes.
+ */
+int step_machine(vnsem_machine *m)
 {
-    uint8_t next_ins;
+    uint8_t ins = m->mem[m->pc];
 
-    vnsem_machine machine;
-    reset_machine(&machine);
+    m->pc++;
+    m->step_count++;
 
-    if (NULL != config.infile_name) {
-        if (!load_program(config.infile_name, 0, &machine)) {
-            machine.halted = TRUE;
+    return process_instruction(ins, m);
+}
+
+/**
+ * All available execution engines. The first one is the reference
+ * implementation all others are checked against.
+ */
+static const vnsem_engine vnsem_engines[] = {
+    { "ref", step_machine, "reference interpreter", 0 },
+    { "loop", acc_step, "summarizes counted loops", ENGINE_SKIPS },
+};
+
+const vnsem_engine *find_engine(const char *name)
+{
+    int i, n = sizeof(vnsem_engines) / sizeof(vnsem_engine);
+
+    for (i = 0; i < n; ++i) {
+        if (0 == strcasecmp(name, vnsem_engines[i].name)) {
+            return &vnsem_engines[i];
         }
     }
 
-    if (config.interactive_mode) {
-        machine.halted = TRUE;
+    return NULL;
+}
+
+/* restore the terminal before anything else is printed on exit */
+void stop_tui(void)
+{
+    if (tui_active) {
+        tui_active = FALSE;
+        tui_stop(&tui);
     }
+}
 
-    print_key();
+/* run the commands the live console queued, at a safe point only */
+static void run_queued(vnsem_machine *machine)
+{
+    int phase = enter_phase(machine, ST_PHASE_CONSOLE);
 
-    /* block SIGINT in order to use sigpending() */
-    set_block_sigint(TRUE);
+    if (NULL != machine->history) {
+        hist_pause(machine->history, machine);
+    }
+
+    live_run_queued(&live, machine);
+
+    if (NULL != machine->history) {
+        hist_resume(machine->history, machine);
+    }
+
+    enter_phase(machine, phase);
+}
+
+/**
+ * The emulation loop. Runs on its own thread in live mode, where the
+ * console is served by the main thread instead of being called here.
+ */
+static void *run_machine(void *arg)
+{
+    vnsem_machine *machine = (vnsem_machine*)arg;
+    int publish = tui_active || live_active;
+    char location[DBG_LOCATION_SIZE];
+    uint64_t start = 0, executed = 0, traced = 0;
+    unsigned long steps = 0;
+    uint32_t step_count;
+    uint8_t next_ins;
+    int result, sampled;
+
+    enter_phase(machine, ST_PHASE_EXECUTE);
 
     while (1) {
         /* check for pending SIGINT */
         if (sigint_is_pending()) {
             printf("Interrupt received. Dropping into console.\n");
-            machine.halted = TRUE;
+            machine->halted = TRUE;
         }
 
-        /* check for step mode */
-        if (machine.step_mode) {
-            machine.step_mode = FALSE;
-            machine.halted = TRUE;
+        /* check for step mode, by instruction or by source line */
+        if (STEP_INSTRUCTION == machine->step_mode ||
+                (STEP_LINE == machine->step_mode &&
+                 debug.line[machine->pc] &&
+                 debug.line[machine->pc] != machine->step_line)) {
+            machine->step_mode = FALSE;
+            machine->halted = TRUE;
         }
 
         /* check if we have reached a breakpoint */
-        if (machine.break_enabled && machine.pc == machine.break_point) {
-            printf("Break point 0x%.2X reached.\n", machine.break_point);
-            machine.halted = TRUE;
+        if (machine->break_enabled && machine->pc == machine->break_point) {
+            if (format_location(machine->pc, location, sizeof(location))) {
+                printf("Break point 0x%.2X (%s) reached.\n",
+                       machine->break_point, location);
+            } else {
+                printf("Break point 0x%.2X reached.\n", machine->break_point);
+            }
+            machine->halted = TRUE;
         }
 
-        while (machine.halted) {
+        /* the live console may have queued commands meanwhile */
+        if (live_active && atomic_load(&live.pending)) {
+            run_queued(machine);
+        }
+
+        if (live_active && machine->halted) {
             printf("Machine halted.\n");
-            console(&machine);
+            snap_publish(&snapshot, machine);
         }
 
-        print_instruction(&machine);
+        while (machine->halted) {
+            if (live_active) {
+                live_wait(&live);
+                run_queued(machine);
+                continue;
+            }
+            if (!tui_active) {
+                printf("Machine halted.\n");
+            }
+            console(machine);
+        }
 
-        next_ins = machine.mem[machine.pc];
-        machine.pc++;
-        machine.step_count++;
+        /* reading the clock every step would cost more than the step */
+        sampled = NULL != machine->stats && 0 == ++steps % ST_SAMPLE_STEPS;
+        if (sampled) {
+            start = st_clock();
+        }
+
+        if (!publish) {
+            print_instruction(machine);
+        }
+
+        next_ins = machine->mem[machine->pc];
+        step_count = machine->step_count;
+
+        if (NULL != machine->history) {
+            hist_before_step(machine->history, machine);
+        }
+
+        if (sampled) {
+            traced = st_clock();
+        }
+        /* single steps must stop after one instruction */
+        result = (machine->step_mode) ? step_machine(machine)
+                                      : engine->step(machine);
+        if (sampled) {
+            executed = st_clock();
+        }
 
-        switch (process_instruction(next_ins, &machine)) {
+        if (NULL != machine->history) {
+            hist_after_step(machine->history, machine, next_ins, result);
+        }
+
+        switch (result) {
             case 0:
-                print_machine_state(&machine);
-                usleep(config.step_time_ms * 1000);
+                if (NULL != machine->stats) {
+                    machine->stats->retired +=
+                        machine->step_count - step_count;
+                }
+                if (publish) {
+                    /* publish every step only if somebody can see it */
+                    if (config.step_time_ms || machine->halted ||
+                            (step_count ^ machine->step_count) &
+                            ~TUI_PUBLISH_MASK) {
+                        snap_publish(&snapshot, machine);
+                    }
+                } else {
+                    print_machine_state(machine);
+                }
+                if (sampled) {
+                    st_sample(machine->stats, executed - traced,
+                              (traced - start) + (st_clock() - executed),
+                              machine->step_count - step_count);
+                }
+                if (config.step_time_ms) {
+                    enter_phase(machine, ST_PHASE_DELAY);
+                    usleep(config.step_time_ms * 1000);
+                    enter_phase(machine, ST_PHASE_EXECUTE);
+                }
                 break;
             case ERR_ILLEGAL_INSTRUCTION:
+                format_location(machine->pc - 1, location, sizeof(location));
                 util_perror("Unknown instruction 0x%.2X "
-                            "at address 0x%.2X.\n",
-                            next_ins, machine.pc - 1);
-                machine.halted = TRUE;
+                            "at address 0x%.2X%s%s%s.\n",
+                            next_ins, machine->pc - 1, location[0] ? " (" : "",
+                            location, location[0] ? ")" : "");
+                machine->halted = TRUE;
                 break;
             default:
+                format_location(machine->pc - 1, location, sizeof(location));
                 util_perror("Could not execute instruction 0x%.2X "
-                            "at address 0x%.2X for unknown reason.\n",
-                            next_ins, machine.pc - 1);
-                machine.halted = TRUE;
+                            "at address 0x%.2X%s%s%s for unknown reason.\n",
+                            next_ins, machine->pc - 1, location[0] ? " (" : "",
+                            location, location[0] ? ")" : "");
+                machine->halted = TRUE;
                 break;
         }
     }
 
+    return NULL;
+}
+
+int emulate(void)
+{
+    vnsem_machine machine, view;
+
+    if (NULL == (engine = find_engine(config.engine_name))) {
+        util_perror("Unknown engine: %s\n", config.engine_name);
+        return EXIT_FAILURE;
+    }
+
+    /* the trace and the history need every single step */
+    if ((engine->flags & ENGINE_SKIPS) &&
+            ((!config.tui_fps && !config.live_mode) ||
+             config.history_budget)) {
+        util_perror("Engine '%s' skips steps, it needs --tui or --live "
+                    "and --history 0.\n", engine->name);
+        return EXIT_FAILURE;
+    }
+
+    reset_machine(&machine);
+    if (config.print_stats) {
+        collect_stats(&machine);
+    }
+
+    if (config.history_budget) {
+        if (!hist_init(&history, config.history_budget)) {
+            return EXIT_FAILURE;
+        }
+        machine.history = &history;
+    }
+
+    pending_inputs.count = 0;
+    if (NULL != config.inputs &&
+            !dt_parse_inputs(config.inputs, &pending_inputs)) {
+        util_perror("Invalid input values: %s\n", config.inputs);
+        return EXIT_FAILURE;
+    }
+
+    if (NULL != config.resume_file) {
+        if (!restore_state(config.resume_file, &machine)) {
+            return EXIT_FAILURE;
+        }
+    } else if (NULL != config.infile_name) {
+        if (!load_program(config.infile_name, 0, &machine)) {
+            machine.halted = TRUE;
+        }
+    }
+
+    if (config.interactive_mode) {
+        machine.halted = TRUE;
+    }
+
+    snap_init(&snapshot);
+    snap_publish(&snapshot, &machine);
+
+    if (config.tui_fps) {
+        if (!tui_start(&tui, &snapshot, config.tui_fps)) {
+            return EXIT_FAILURE;
+        }
+        tui_active = TRUE;
+        atexit(stop_tui);
+    } else if (!config.live_mode) {
+        print_key();
+    }
+
+    /* block SIGINT in order to use sigpending(), inherited by threads */
+    set_block_sigint(TRUE);
+
+    if (!config.live_mode) {
+        run_machine(&machine);
+        return EXIT_SUCCESS;
+    }
+
+    live_active = TRUE;
+    if (!live_start(&live, &snapshot, run_machine, &machine)) {
+        return EXIT_FAILURE;
+    }
+
+    /* the console only gets to see copies of the running machine */
+    reset_machine(&view);
+    view.stats = machine.stats;
+    vnsem_console_live(&live, &view);
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Statically analyze all given program images without running them.
+ * Returns EXIT_FAILURE if any image contains errors.
+ */
+int analyze(int count, char **files)
+{
+    int i, j, result = EXIT_SUCCESS;
+    double elapsed_us = 0;
+    struct timespec start, end;
+    vnsem_machine machine;
+    an_result res;
+
+    for (i = 0; i < count; ++i) {
+        reset_machine(&machine);
+
+        if (!read_program(files[i], 0, &machine)) {
+            result = EXIT_FAILURE;
+            continue;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        an_analyze(machine.mem, machine.pc, &res);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        elapsed_us += (end.tv_sec - start.tv_sec) * 1e6 +
+                      (end.tv_nsec - start.tv_nsec) / 1e3;
+
+        print_analysis(files[i], &res);
+
+        for (j = 0; j < res.issue_count; ++j) {
+            if (an_issue_is_error(res.issues[j].type)) {
+                result = EXIT_FAILURE;
+            }
+        }
+    }
+
+    if (count) {
+        printf("Analyzed %i image(s) in %.1f us (%.2f us per image).\n",
+                count, elapsed_us, elapsed_us / count);
+    }
+
+    return result;
+}
+
+/**
+ * Fuzz the program given on the command line and optionally export the
+ * resulting coverage as lcov tracefile.
+ */
+int fuzz(void)
+{
+    static fuzz_state fs;
+    vnsem_machine machine;
+
+    reset_machine(&machine);
+
+    if (NULL != config.lcovfile_name && NULL == config.debugfile_name &&
+            !config.asm_source) {
+        util_perror("Coverage export requires debug information (-g).\n");
+        return EXIT_FAILURE;
+    }
+
+    if (!load_program(config.infile_name, 0, &machine)) {
+        return EXIT_FAILURE;
+    }
+
+    fuzz_program(&machine, config.fuzz_runs, &fs);
+    fuzz_print_report(&fs);
+
+    if (NULL != config.lcovfile_name) {
+        if (!fuzz_write_lcov(&fs, &machine, &debug, config.lcovfile_name)) {
+            return EXIT_FAILURE;
+        }
+        printf("Coverage written to '%s'.\n", config.lcovfile_name);
+    }
+
     return EXIT_SUCCESS;
 }
 
+/**
+ * Check an engine against another one or against a golden fingerprint
+ * stream, depending on the configuration.
+ */
+int difftest(void)
+{
+    const vnsem_engine *a, *b;
+    char *names, *sep;
+    vnsem_machine machine;
+    dt_inputs inputs;
+    int ok;
+
+    inputs.count = 0;
+    if (NULL != config.inputs && !dt_parse_inputs(config.inputs, &inputs)) {
+        util_perror("Invalid input values: %s\n", config.inputs);
+        return EXIT_FAILURE;
+    }
+
+    reset_machine(&machine);
+    if (!load_program(config.infile_name, 0, &machine)) {
+        return EXIT_FAILURE;
+    }
+
+    if (NULL != config.diff_engines) {
+        names = strdup(config.diff_engines);
+        if (NULL == (sep = index(names, ','))) {
+            util_perror("Expected two engines: <engine>,<engine>\n");
+            free(names);
+            return EXIT_FAILURE;
+        }
+        *sep = '\0';
+        if (NULL == (a = find_engine(names)) ||
+                NULL == (b = find_engine(sep + 1))) {
+            util_perror("Unknown engine in: %s\n", config.diff_engines);
+            free(names);
+            return EXIT_FAILURE;
+        }
+        free(names);
+        acc_reset();
+        ok = dt_lockstep(&machine, a, b, &inputs, config.max_steps, NULL);
+        if (a->step == acc_step || b->step == acc_step) {
+            acc_print_counters();
+        }
+    } else {
+        if (NULL == (a = find_engine(config.engine_name))) {
+            util_perror("Unknown engine: %s\n", config.engine_name);
+            return EXIT_FAILURE;
+        }
+        if (NULL != config.golden_record) {
+            ok = dt_record(&machine, a, &inputs, config.max_steps,
+                           config.golden_record);
+        } else {
+            ok = dt_verify(&machine, a, &inputs, config.golden_verify,
+                           NULL);
+        }
+    }
+
+    return (ok) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * Run the program given on the command line on several CPUs sharing
+ * its memory and report the counters of each CPU.
+ */
+int multiprocessor(void)
+{
+    static smp_system system;
+    vnsem_machine machine;
+    dt_inputs inputs;
+    int ok;
+
+    inputs.count = 0;
+    if (NULL != config.inputs && !dt_parse_inputs(config.inputs, &inputs)) {
+        util_perror("Invalid input values: %s\n", config.inputs);
+        return EXIT_FAILURE;
+    }
+
+    reset_machine(&machine);
+    if (!load_program(config.infile_name, 0, &machine)) {
+        return EXIT_FAILURE;
+    }
+
+    smp_init(&system, &machine, config.cpus, config.scheduler);
+    system.inputs = &inputs;
+    system.max_steps = config.max_steps;
+
+    ok = smp_run(&system);
+    smp_print_report(&system);
+
+    return (ok) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * Run the machines of the topology file given with -N, each on a host
+ * thread of its own, and report the traffic on their links.
+ */
+int network(void)
+{
+    static net_system net;
+    dt_inputs inputs;
+    int ok;
+
+    inputs.count = 0;
+    if (NULL != config.inputs && !dt_parse_inputs(config.inputs, &inputs)) {
+        util_perror("Invalid input values: %s\n", config.inputs);
+        return EXIT_FAILURE;
+    }
+
+    net_init(&net);
+    if (!net_load(&net, config.topology)) {
+        net_release(&net);
+        return EXIT_FAILURE;
+    }
+    net.inputs = &inputs;
+    net.max_steps = config.max_steps;
+
+    ok = net_run(&net);
+    net_print_report(&net);
+    net_release(&net);
+
+    return (ok) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+void print_exit_stats(void)
+{
+    st_print(&stats);
+}
+
 void print_usage(char *pname)
 {
-    printf("\nUsage: %s [-h] | [-i] [-s <ms>] [<program>]\n\n", pname);
+    printf("\nUsage: %s [-h] | [-i] [-s <ms>] [-I <inputs>] [--stats]\n"
+           "             [--history <KiB>] [--tui[=<fps>] | --live] "
+           "[-e <engine>]\n"
+           "             [--asm] [<program> | --resume <state>]\n",
+           pname);
+    printf("       %s -a <program> [<program> ...]\n", pname);
+    printf("       %s -f <runs> [-g <dbgfile> [-c <lcovfile>]] <program>\n",
+            pname);
+    printf("       %s -D <engine>,<engine> | [-e <engine>] -G|-V <file>\n"
+           "             [-I <inputs>] [-n <steps>] <program>\n", pname);
+    printf("       %s -P <cpus> [--sched rr|cycles|threads] [-I <inputs>]\n"
+           "             [-n <steps>] <program>\n", pname);
+    printf("       %s -N <topology> [-I <inputs>] [-n <steps>]\n\n", pname);
     printf("  -h         Show this help text.\n");
+    printf("  -a         Analyze programs statically and exit.\n");
+    printf("  -f <runs>  Fuzz program inputs for <runs> runs and exit.\n");
+    printf("  -g <file>  Read debug information (lines, labels) from "
+           "<file>.\n");
+    printf("  -c <file>  Write fuzzing coverage as lcov tracefile to "
+           "<file>.\n");
+    printf("  -D <a>,<b> Run engines <a> and <b> in lockstep and compare.\n");
+    printf("  -G <file>  Record golden fingerprint stream to <file>.\n");
+    printf("  -V <file>  Verify engine against golden stream <file>.\n");
+    printf("  -e <name>  Use engine <name> (default: ref).\n");
+    printf("  -I <list>  Comma separated values read by IN instructions.\n");
+    printf("  -n <steps> Stop batch runs after <steps> steps.\n");
+    printf("  -P <cpus>  Run <cpus> CPUs sharing one memory unit.\n");
+    printf("  -N <file>  Run the network of machines described in "
+           "<file>.\n");
     printf("  -i         Enter console mode at startup.\n");
     printf("  -s <ms>    Set step time to <ms> milliseconds.\n");
+    printf("  --stats    Print runtime statistics on exit.\n");
+    printf("  --tui[=<fps>]\n"
+           "             Show a full screen display at <fps> frames per "
+           "second.\n");
+    printf("  --live     Keep the console usable while the program runs.\n");
+    printf("  --asm      Programs are assembler sources, assemble them in "
+           "memory.\n");
+    printf("  --history <KiB>\n"
+           "             Memory for execution history (default: %i, 0: off).\n",
+           HIST_DEFAULT_BUDGET / 1024);
+    printf("  --resume <state>\n"
+           "             Continue the machine saved to <state> (console: "
+           "save).\n");
+    printf("  --sched rr|cycles|threads\n"
+           "             Interleave CPUs by instructions (default) or cycles,\n"
+           "             or run each on a thread of its own.\n");
+    printf("\n");
+    printf("A <program> of - is read from standard input, other streams\n"
+           "such as /dev/fd/<n> work as well.\n");
     printf("\n");
 }
 
+#define OPT_STATS   0x100
+#define OPT_HISTORY 0x101
+#define OPT_TUI     0x102
+#define OPT_LIVE    0x103
+#define OPT_ASM     0x104
+#define OPT_SCHED   0x105
+#define OPT_RESUME  0x106
+
+static const struct option long_options[] = {
+    { "stats",   no_argument,       NULL, OPT_STATS },
+    { "history", required_argument, NULL, OPT_HISTORY },
+    { "tui",     optional_argument, NULL, OPT_TUI },
+    { "live",    no_argument,       NULL, OPT_LIVE },
+    { "asm",     no_argument,       NULL, OPT_ASM },
+    { "sched",   required_argument, NULL, OPT_SCHED },
+    { "resume",  required_argument, NULL, OPT_RESUME },
+    { NULL,    0,           NULL, 0 }
+};
+
 int main(int argc, char **argv)
 {
-    unsigned int opt;
+    int opt;
+    unsigned int analyze_only = FALSE, engine_given = FALSE;
     char *p, *process_name = util_basename(argv[0]);
 
     printf(BANNER_LINE1, "Emulator");
@@ -457,8 +1398,27 @@ int main(int argc, char **argv)
     config.interactive_mode = FALSE;
     config.step_time_ms = 0;
     config.infile_name = NULL;
-
-    while (-1 != (opt = getopt(argc, argv, "hvis:d"))) {
+    config.debugfile_name = NULL;
+    config.lcovfile_name = NULL;
+    config.fuzz_runs = 0;
+    config.max_steps = 1000000;
+    config.engine_name = "ref";
+    config.diff_engines = NULL;
+    config.golden_record = NULL;
+    config.golden_verify = NULL;
+    config.inputs = NULL;
+    config.print_stats = FALSE;
+    config.history_budget = HIST_DEFAULT_BUDGET;
+    config.tui_fps = 0;
+    config.live_mode = FALSE;
+    config.asm_source = FALSE;
+    config.cpus = 0;
+    config.scheduler = SMP_ROUND_ROBIN;
+    config.topology = NULL;
+    config.resume_file = NULL;
+
+    while (-1 != (opt = getopt_long(argc, argv, "hvias:df:g:c:D:G:V:e:I:n:P:N:",
+                                    long_options, NULL))) {
         switch (opt) {
             case 'h':
                 print_usage(process_name);
@@ -473,17 +1433,162 @@ int main(int argc, char **argv)
             case 'i':
                 config.interactive_mode = TRUE;
                 break;
+            case 'a':
+                analyze_only = TRUE;
+                break;
+            case 'f':
+                config.fuzz_runs = strtoul(optarg, &p, 10);
+                if (*p || !config.fuzz_runs) {
+                    util_perror("Invalid number of fuzzing runs.\n");
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'g':
+                config.debugfile_name = strdup(optarg);
+                break;
+            case 'c':
+                config.lcovfile_name = strdup(optarg);
+                break;
+            case 'D':
+                config.diff_engines = strdup(optarg);
+                break;
+            case 'G':
+                config.golden_record = strdup(optarg);
+                break;
+            case 'V':
+                config.golden_verify = strdup(optarg);
+                break;
+            case 'e':
+                config.engine_name = strdup(optarg);
+                engine_given = TRUE;
+                break;
+            case 'I':
+                config.inputs = strdup(optarg);
+                break;
+            case 'n':
+                config.max_steps = strtoul(optarg, &p, 10);
+                if (*p || !config.max_steps) {
+                    util_perror("Invalid step limit.\n");
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'P':
+                config.cpus = strtoul(optarg, &p, 10);
+                if (*p || !config.cpus || config.cpus > SMP_MAX_CPUS) {
+                    util_perror("Invalid number of CPUs (1-%i).\n",
+                                SMP_MAX_CPUS);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'N':
+                config.topology = strdup(optarg);
+                break;
+            case OPT_STATS:
+                config.print_stats = TRUE;
+                break;
+            case OPT_TUI:
+                config.tui_fps = TUI_DEFAULT_FPS;
+                if (NULL != optarg) {
+                    config.tui_fps = strtoul(optarg, &p, 10);
+                    if (*p || !config.tui_fps || config.tui_fps > 1000) {
+                        util_perror("Invalid frame rate.\n");
+                        return EXIT_FAILURE;
+                    }
+                }
+                break;
+            case OPT_LIVE:
+                config.live_mode = TRUE;
+                break;
+            case OPT_ASM:
+                config.asm_source = TRUE;
+                break;
+            case OPT_SCHED:
+                if (-1 == (config.scheduler = smp_parse_scheduler(optarg))) {
+                    util_perror("Unknown scheduler: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case OPT_RESUME:
+                config.resume_file = strdup(optarg);
+                break;
+            case OPT_HISTORY:
+                config.history_budget = strtoul(optarg, &p, 10) * 1024;
+                if (*p) {
+                    util_perror("Invalid history budget.\n");
+                    return EXIT_FAILURE;
+                }
+                break;
             default:
                 print_usage(process_name);
                 return EXIT_SUCCESS;
         }
     }
 
+    /* only the emulation loop and golden streams run a single engine */
+    if (engine_given && (analyze_only || config.topology ||
+                         config.fuzz_runs || config.cpus ||
+                         config.diff_engines)) {
+        util_perror("-e cannot be combined with -a, -f, -D, -P or -N.\n");
+        return EXIT_FAILURE;
+    }
+
+    if (NULL != config.debugfile_name) {
+        if (!dbg_read(config.debugfile_name, &debug)) {
+            return EXIT_FAILURE;
+        }
+        debug_loaded = TRUE;
+    }
+
+    if (analyze_only) {
+        return analyze(argc - optind, &argv[optind]);
+    }
+
+    if (NULL != config.topology) {
+        return network();
+    }
+
     if (optind < argc) {
         config.infile_name = strdup(argv[optind]);
-    } else {
+        if (NULL != config.resume_file) {
+            util_perror("A program cannot be loaded with --resume.\n");
+            return EXIT_FAILURE;
+        }
+    } else if (NULL == config.resume_file) {
         config.interactive_mode = TRUE;
     }
 
+    if (config.fuzz_runs) {
+        if (NULL == config.infile_name) {
+            util_perror("No program to fuzz.\n");
+            return EXIT_FAILURE;
+        }
+        return fuzz();
+    }
+
+    if (config.diff_engines || config.golden_record || config.golden_verify) {
+        if (NULL == config.infile_name) {
+            util_perror("No program to run.\n");
+            return EXIT_FAILURE;
+        }
+        return difftest();
+    }
+
+    if (config.cpus) {
+        if (NULL == config.infile_name) {
+            util_perror("No program to run.\n");
+            return EXIT_FAILURE;
+        }
+        return multiprocessor();
+    }
+
+    if (config.tui_fps && config.live_mode) {
+        util_perror("The full screen display cannot be used in live mode.\n");
+        return EXIT_FAILURE;
+    }
+
+    if (config.print_stats) {
+        atexit(print_exit_stats);
+    }
+
     return emulate();
 }
@@ -23,23 +23,83 @@
 #include <stdio.h>
 #include <stdint.h>
 
+#include "analyzer.h"
+#include "stats.h"
+#include "debuginfo.h"
+#include "image.h"
+
+/**
+ * Number of memory banks, fixed at build time (make BANKS=n). With more
+ * than one bank, OUT to VNS_BANK_PORT maps bank A modulo VNS_BANKS into
+ * the upper half of the memory unit and IN from it reads the current
+ * bank. The default of one bank builds the plain 256 byte machine
+ * without any bank handling in the core.
+ */
+#ifndef VNS_BANKS
+#define VNS_BANKS 1
+#endif
+
+#if VNS_BANKS < 1 || VNS_BANKS > IMG_MAX_BANKS
+#error "VNS_BANKS must be between 1 and IMG_MAX_BANKS"
+#endif
+
+#define VNS_BANK_PORT 0xFE
+
 typedef struct _vnsem_configuration {
     uint8_t interactive_mode;
     uint16_t step_time_ms;
     char *infile_name;
+    char *debugfile_name;
+    char *lcovfile_name;
+    unsigned long fuzz_runs;
+    unsigned long max_steps;
+    char *engine_name;
+    char *diff_engines;
+    char *golden_record;
+    char *golden_verify;
+    char *inputs;
+    uint8_t print_stats;
+    unsigned long history_budget;
+    unsigned int tui_fps;
+    uint8_t live_mode;
+    uint8_t asm_source;
+    unsigned int cpus;
+    int scheduler;
+    char *topology;
+    char *resume_file;
 } vnsem_configuration;
 
 typedef uint8_t led;
 
+/**
+ * I/O hooks used by the IN and OUT instructions instead of the user
+ * console. *input* returns FALSE if no input is available, which stops
+ * the machine with ERR_NO_INPUT.
+ */
+typedef struct _vnsem_io {
+    int (*input)(uint8_t port, uint8_t *value, void *ctx);
+    void (*output)(uint8_t port, uint8_t value, void *ctx);
+    void *ctx;
+} vnsem_io;
+
+#define STEP_INSTRUCTION 1
+#define STEP_LINE        2
+
 typedef struct _vnsem_machine {
     unsigned int step_count;
-    uint8_t step_mode;
+    uint8_t step_mode;          // FALSE, STEP_INSTRUCTION or STEP_LINE
+    uint16_t step_line;         // source line a STEP_LINE started on
     uint8_t halted;
     uint8_t int_active;
     uint8_t break_enabled;
     uint8_t break_point;
     /* the memory unit */
     uint8_t mem[256];
+#if VNS_BANKS > 1
+    /* banks not mapped, the current one lives in the window of mem */
+    uint8_t bank;
+    uint8_t banks[VNS_BANKS][IMG_BANK_SIZE];
+#endif
     /* register */
     uint8_t pc;
     uint8_t reg_l;
@@ -47,17 +107,56 @@ typedef struct _vnsem_machine {
     /* alu */ 
     uint8_t accu;
     uint8_t flags;
+    /* i/o hooks, NULL for the user console */
+    const vnsem_io *io;
+    /* runtime statistics, NULL if not collected */
+    vnsem_stats *stats;
+    /* execution history, NULL if not recorded */
+    struct _vnsem_history *history;
 } vnsem_machine;
 
+/* the engine may execute several instructions in one step */
+#define ENGINE_SKIPS    0x01
+
+/**
+ * An execution engine. *step* executes a single instruction exactly
+ * like step_machine() does and returns 0 or one of the ERR_* codes.
+ * Engines flagged ENGINE_SKIPS may execute several instructions at
+ * once, leaving the machine and its step_count as executing them one
+ * by one would.
+ */
+typedef struct _vnsem_engine {
+    const char *name;
+    int (*step)(vnsem_machine *m);
+    const char *description;
+    uint8_t flags;
+} vnsem_engine;
+
 #define F_NONE  0x00
 #define F_CARRY 0x01
 #define F_ZERO  0x40
 #define F_SIGN  0x80
 
 void dump_memory(vnsem_machine *machine);
+void print_program_output(uint8_t port, uint8_t value, unsigned int step);
+void print_analysis(const char *name, an_result *res);
 void reset_machine(vnsem_machine *machine);
+int read_program(char *filepath, uint8_t offset, vnsem_machine *machine);
+const debuginfo *vnsem_debuginfo(void);
+vnsem_stats *collect_stats(vnsem_machine *machine);
+int format_location(uint8_t addr, char *buf, size_t size);
 int load_program(char *filepath, uint8_t offset, vnsem_machine *machine);
+int save_state(char *filepath, vnsem_machine *machine);
+int restore_state(char *filepath, vnsem_machine *machine);
+int process_instruction(uint8_t ins, vnsem_machine *m);
+#if VNS_BANKS > 1
+void select_bank(uint8_t bank, vnsem_machine *m);
+#endif
+int step_machine(vnsem_machine *m);
+const vnsem_engine *find_engine(const char *name);
+void set_block_sigint(uint8_t do_block);
 
 #define ERR_ILLEGAL_INSTRUCTION (1)
+#define ERR_NO_INPUT            (2)
 
 #endif /* VNSEM_H */
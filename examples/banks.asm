@@ -0,0 +1,38 @@
+; add up the first byte of banks 1 to 3, needs a container image
+; (vnsasm -f vns) and an emulator built with make BANKS=4
+mvi l,0x40
+mvi a,0
+mov m,a
+
+; count down from bank 3
+mvi l,0x41
+mvi a,3
+mov m,a
+
+; map bank a and add its first byte
+next: out 0xfe
+mvi l,0x80
+mov a,m
+mvi l,0x40
+add m
+mov m,a
+mvi l,0x41
+mov a,m
+dcr a
+mov m,a
+jnz next
+
+mvi l,0x40
+mov a,m
+out 0
+hlt
+
+.bank 1
+.offset 0x80
+.byte 10
+.bank 2
+.offset 0x80
+.byte 20
+.bank 3
+.offset 0x80
+.byte 12
@@ -0,0 +1,64 @@
+; two CPUs add 1 to the shared counter at 0x80 fifty times each,
+; Peterson's algorithm makes the update mutually exclusive:
+;   flag[id] = 1; turn = other; while (flag[other] && turn == other);
+;   counter++; flag[id] = 0
+; run with vnsem -P 2 --sched threads examples/peterson.asm
+
+; count[id] = 50, the flags are at 0x84, the counts at 0x88
+in  0xff
+adi 0x88
+mov l,a
+mvi a,50
+mov m,a
+
+; flag[id] = 1
+loop: in 0xff
+adi 0x84
+mov l,a
+mvi a,1
+mov m,a
+
+; turn = other
+in  0xff
+xri 1
+sta 0x82
+
+; wait while flag[other] and turn == other
+wait: in 0xff
+xri 1
+adi 0x84
+mov l,a
+mov a,m
+cpi 0
+jz  enter
+lda 0x82
+mov l,a
+in  0xff
+xri 1
+cmp l
+jz  wait
+
+; critical section
+enter: lda 0x80
+inr a
+sta 0x80
+
+; flag[id] = 0
+in  0xff
+adi 0x84
+mov l,a
+mvi a,0
+mov m,a
+
+; count[id]--
+in  0xff
+adi 0x88
+mov l,a
+mov a,m
+dcr a
+mov m,a
+jnz loop
+
+lda 0x80
+out 0
+hlt
@@ -0,0 +1,7 @@
+; second stage of examples/pipeline.net, doubles each value and stops
+; after passing on the closing 0
+loop: in 0
+add a
+out 1
+jnz loop
+hlt
@@ -0,0 +1,10 @@
+; first stage of examples/pipeline.net, reads n from the unlinked port 0
+; and sends n, n-1, ..., 1 and a closing 0 to port 1
+in  0
+cpi 0
+jz  done
+loop: out 1
+dcr a
+jnz loop
+done: out 1
+hlt
@@ -0,0 +1,14 @@
+; last stage of examples/pipeline.net, adds up the values at 0x80 and
+; prints the total to the unlinked port 0 when the closing 0 arrives
+mvi a,0
+sta 0x80
+loop: in 0
+cpi 0
+jz  done
+mvi l,0x80
+add m
+mov m,a
+jmp loop
+done: lda 0x80
+out 0
+hlt
@@ -0,0 +1,725 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "globals.h"
+#include "superopt.h"
+
+/**
+ * Superoptimizer for short straight sequences. Candidates are all
+ * sequences over the usable instructions and a few immediates, tried in
+ * order of their first instruction by a pool of threads. A candidate
+ * is run on random machine states first, SO_PROBE_LANES of them, then
+ * all SO_LANES, and only survivors are checked exhaustively.
+ *
+ * The interpreter runs one instruction on all lanes of a batch before
+ * the next, so each opcode is dispatched once per batch. Writes to
+ * memory are logged to compare and undo them. No instruction in the
+ * searched set reads the flags, so a sequence can only pass them on or
+ * overwrite them; two flag states are enough to tell these apart.
+ */
+
+#define SO_PROBE_LANES  4
+#define SO_SEED         0x2545f491u
+#define SO_CELL_NONE    -1
+#define SO_CELL_AT_L    -2
+
+typedef struct _so_batch {
+    uint8_t a0[SO_LANES];               // initial state of each lane
+    uint8_t l0[SO_LANES];
+    uint8_t f0[SO_LANES];
+    uint8_t a[SO_LANES];
+    uint8_t l[SO_LANES];
+    uint8_t f[SO_LANES];
+    uint8_t mem[SO_LANES][SO_MEMORY_SIZE];
+    uint8_t log_addr[SO_MAX_LENGTH][SO_LANES];
+    uint8_t log_old[SO_MAX_LENGTH][SO_LANES];
+    unsigned int log_count;
+} so_batch;
+
+/* what the reference sequence left in each lane */
+typedef struct _so_expect {
+    uint8_t a[SO_LANES];
+    uint8_t l[SO_LANES];
+    uint8_t f[SO_LANES];
+    uint8_t addr[SO_MAX_LENGTH][SO_LANES];
+    uint8_t value[SO_MAX_LENGTH][SO_LANES];
+    unsigned int writes;
+} so_expect;
+
+/* state shared by the threads of a search */
+typedef struct _so_context {
+    so_search *search;
+    so_ins *alphabet;
+    unsigned int alphabet_size;
+    unsigned int target_cost;
+    unsigned int best;
+    unsigned int next;
+    unsigned int result_size;
+    int failed;
+    pthread_mutex_t lock;
+} so_context;
+
+typedef struct _so_worker {
+    so_context *ctx;
+    so_batch batch;
+    so_expect expect;
+    so_sequence cand;
+    unsigned int best;
+    unsigned long candidates;
+    unsigned long filtered;
+} so_worker;
+
+#define LANES(stmt)     for (n = 0; n < lanes; n++) { stmt; }
+#define FLAGS(f, v)     (((f) & ~IS_F_ALL) |                          \
+                         (((v) & 0xff) ? 0 : IS_F_Z) |                \
+                         (((v) & 0x80) ? IS_F_S : 0) |                \
+                         (((v) & 0x100) ? IS_F_C : 0))
+#define ALU(expr)       LANES(v = (expr); b->f[n] = FLAGS(b->f[n], v); \
+                              b->a[n] = v)
+#define CMP(expr)       LANES(v = b->a[n] - (expr); b->f[n] = FLAGS(b->f[n], v))
+#define STORE(where)    LANES(k = (where); b->log_addr[w][n] = k;      \
+                              b->log_old[w][n] = b->mem[n][k];        \
+                              b->mem[n][k] = b->a[n]);                \
+                        b->log_count++
+
+/**
+ * Run *seq* on the first *lanes* lanes of *b*, with the same effect as
+ * process_instruction() of the emulator.
+ */
+static void run(so_batch *b, const so_sequence *seq, unsigned int lanes)
+{
+    unsigned int i, n, w;
+    uint8_t x, k;
+    int v;
+
+    for (i = 0; i < seq->length; i++) {
+        x = seq->code[i].arg;
+        w = b->log_count;
+        switch (seq->code[i].ins->opcode) {
+            case 0x7d: /* MOV A,L */ LANES(b->a[n] = b->l[n]);              break;
+            case 0x7e: /* MOV A,M */ LANES(b->a[n] = b->mem[n][b->l[n]]);   break;
+            case 0x77: /* MOV M,A */ STORE(b->l[n]);                        break;
+            case 0x3e: /* MVI A,n */ LANES(b->a[n] = x);                    break;
+            case 0x3a: /* LDA adr */ LANES(b->a[n] = b->mem[n][x]);         break;
+            case 0x32: /* STA adr */ STORE(x);                              break;
+            case 0x6f: /* MOV L,A */ LANES(b->l[n] = b->a[n]);              break;
+            case 0x6e: /* MOV L,M */ LANES(b->l[n] = b->mem[n][b->l[n]]);   break;
+            case 0x2e: /* MVI L,n */ LANES(b->l[n] = x);                    break;
+            case 0x3c: /* INR A */   ALU(b->a[n] + 1);                      break;
+            case 0x2c: /* INR L */   LANES(b->l[n]++);                      break;
+            case 0x3d: /* DCR A */   ALU(b->a[n] - 1);                      break;
+            case 0x2d: /* DCR L */   LANES(b->l[n]--);                      break;
+            case 0x87: /* ADD A */   ALU(b->a[n] * 2);                      break;
+            case 0x85: /* ADD L */   ALU(b->a[n] + b->l[n]);                break;
+            case 0x86: /* ADD M */   ALU(b->a[n] + b->mem[n][b->l[n]]);     break;
+            case 0xc6: /* ADI n */   ALU(b->a[n] + x);                      break;
+            case 0x97: /* SUB A */   ALU(0);                                break;
+            case 0x95: /* SUB L */   ALU(b->a[n] - b->l[n]);                break;
+            case 0x96: /* SUB M */   ALU(b->a[n] - b->mem[n][b->l[n]]);     break;
+            case 0xd6: /* SUI n */   ALU(b->a[n] - x);                      break;
+            case 0xbf: /* CMP A */   CMP(b->a[n]);                          break;
+            case 0xbd: /* CMP L */   CMP(b->l[n]);                          break;
+            case 0xbe: /* CMP M */   CMP(b->mem[n][b->l[n]]);               break;
+            case 0xfe: /* CPI n */   CMP(x);                                break;
+            case 0xa7: /* ANA A */   ALU(b->a[n]);                          break;
+            case 0xa5: /* ANA L */   ALU(b->a[n] & b->l[n]);                break;
+            case 0xa6: /* ANA M */   ALU(b->a[n] & b->mem[n][b->l[n]]);     break;
+            case 0xe6: /* ANI n */   ALU(b->a[n] & x);                      break;
+            case 0xb7: /* ORA A */   ALU(b->a[n]);                          break;
+            case 0xb5: /* ORA L */   ALU(b->a[n] | b->l[n]);                break;
+            case 0xb6: /* ORA M */   ALU(b->a[n] | b->mem[n][b->l[n]]);     break;
+            case 0xf6: /* ORI n */   ALU(b->a[n] | x);                      break;
+            case 0xaf: /* XRA A */   ALU(0);                                break;
+            case 0xad: /* XRA L */   ALU(b->a[n] ^ b->l[n]);                break;
+            case 0xae: /* XRA M */   ALU(b->a[n] ^ b->mem[n][b->l[n]]);     break;
+            case 0xee: /* XRI n */   ALU(b->a[n] ^ x);                      break;
+            case 0x00: /* NOP */                                            break;
+        }
+    }
+}
+
+static void reset(so_batch *b, unsigned int lanes)
+{
+    memcpy(b->a, b->a0, lanes);
+    memcpy(b->l, b->l0, lanes);
+    memcpy(b->f, b->f0, lanes);
+}
+
+static void undo(so_batch *b, unsigned int lanes)
+{
+    unsigned int n, w;
+
+    for (w = b->log_count; w-- > 0; ) {
+        LANES(b->mem[n][b->log_addr[w][n]] = b->log_old[w][n]);
+    }
+    b->log_count = 0;
+}
+
+/**
+ * Run the reference sequence and remember its results.
+ */
+static void expect(so_batch *b, so_expect *e, const so_sequence *seq,
+                   unsigned int lanes)
+{
+    unsigned int n, w;
+
+    reset(b, lanes);
+    run(b, seq, lanes);
+
+    memcpy(e->a, b->a, lanes);
+    memcpy(e->l, b->l, lanes);
+    memcpy(e->f, b->f, lanes);
+    e->writes = b->log_count;
+    for (w = 0; w < e->writes; w++) {
+        LANES(e->addr[w][n] = b->log_addr[w][n];
+              e->value[w][n] = b->mem[n][b->log_addr[w][n]]);
+    }
+
+    undo(b, lanes);
+}
+
+/**
+ * Compare the memory of lane *n* after a run with the expectation. A
+ * cell written by only one of both sequences has to hold its original
+ * value in the other.
+ */
+static int memory_matches(so_batch *b, so_expect *e, unsigned int n)
+{
+    unsigned int w, j;
+    uint8_t addr;
+
+    for (w = 0; w < e->writes; w++) {
+        if (b->mem[n][e->addr[w][n]] != e->value[w][n]) {
+            return FALSE;
+        }
+    }
+
+    for (w = 0; w < b->log_count; w++) {
+        addr = b->log_addr[w][n];
+        for (j = 0; j < e->writes && e->addr[j][n] != addr; j++);
+        if (j < e->writes) {
+            continue;
+        }
+        for (j = 0; b->log_addr[j][n] != addr; j++);
+        if (b->mem[n][addr] != b->log_old[j][n]) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static int matches(so_batch *b, so_expect *e, const so_sequence *seq,
+                   unsigned int live, unsigned int lanes)
+{
+    int result = TRUE;
+    unsigned int n;
+
+    reset(b, lanes);
+    run(b, seq, lanes);
+
+    for (n = 0; n < lanes && result; n++) {
+        result = (!(live & SO_LIVE_A) || b->a[n] == e->a[n]) &&
+                 (!(live & SO_LIVE_L) || b->l[n] == e->l[n]) &&
+                 (!(live & SO_LIVE_FLAGS) || b->f[n] == e->f[n]) &&
+                 memory_matches(b, e, n);
+    }
+
+    undo(b, lanes);
+
+    return result;
+}
+
+static uint32_t next_random(uint32_t *seed)
+{
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 17;
+    *seed ^= *seed << 5;
+    return *seed;
+}
+
+/**
+ * Fill all lanes with random, but reproducible, states. Behind the
+ * probe lanes all pairs of edge values of A and L follow, where carry,
+ * sign and zero flags tend to differ.
+ */
+static void randomize(so_batch *b)
+{
+    static const uint8_t edges[] = {0x00, 0x01, 0x7f, 0x80, 0xff};
+    const unsigned int count = sizeof(edges);
+    uint32_t seed = SO_SEED;
+    unsigned int n, i, e;
+
+    for (n = 0; n < SO_LANES; n++) {
+        b->a0[n] = next_random(&seed);
+        b->l0[n] = next_random(&seed);
+        b->f0[n] = next_random(&seed);
+        e = n - SO_PROBE_LANES;
+        if (n >= SO_PROBE_LANES && e < count * count) {
+            b->a0[n] = edges[e % count];
+            b->l0[n] = edges[e / count];
+        }
+        for (i = 0; i < SO_MEMORY_SIZE; i++) {
+            b->mem[n][i] = next_random(&seed);
+        }
+    }
+    b->log_count = 0;
+}
+
+/**
+ * The memory cell whose value is enumerated by so_equivalent(): the
+ * one L points at if any instruction uses M, else the first address
+ * read by LDA. All other cells keep a random value per lane.
+ */
+static int relevant_cell(const so_sequence *x, const so_sequence *y)
+{
+    const so_sequence *seqs[2] = {x, y};
+    const vns_instruction *ins;
+    int cell = SO_CELL_NONE;
+    unsigned int i, s;
+
+    for (s = 0; s < 2; s++) {
+        for (i = 0; i < seqs[s]->length; i++) {
+            ins = seqs[s]->code[i].ins;
+            if (AT_MEM == ins->at1 || AT_MEM == ins->at2) {
+                return SO_CELL_AT_L;
+            }
+            if (0x3a == ins->opcode && SO_CELL_NONE == cell) {
+                cell = seqs[s]->code[i].arg;
+            }
+        }
+    }
+
+    return cell;
+}
+
+/**
+ * Instructions a sequence may consist of: no control flow, no I/O, no
+ * stack and nothing that reads the flags.
+ */
+int so_usable(const vns_instruction *ins)
+{
+    static const char *excluded[] = {
+        "IN", "OUT", "EI", "DI", "PUSH", "POP", "LXI", NULL
+    };
+    int i;
+
+    if (NULL == ins || NULL == ins->mnemonic ||
+            IS_FLOW_NONE != ins->flow || 0 != ins->flags_read) {
+        return FALSE;
+    }
+
+    for (i = 0; NULL != excluded[i]; i++) {
+        if (0 == strcmp(ins->mnemonic, excluded[i])) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+int so_append(so_sequence *seq, const vns_instruction *ins, uint8_t arg)
+{
+    if (seq->length >= SO_MAX_LENGTH) {
+        return FALSE;
+    }
+
+    seq->code[seq->length].ins = ins;
+    seq->code[seq->length].arg = arg;
+    seq->length++;
+    seq->bytes += ins->length;
+    seq->cycles += ins->cycles;
+
+    return TRUE;
+}
+
+unsigned int so_cost(const so_sequence *seq, int by_size)
+{
+    return by_size ? seq->bytes : seq->cycles;
+}
+
+/**
+ * Run *seq* on a single machine state.
+ */
+void so_run(so_state *state, const so_sequence *seq)
+{
+    so_batch *b = malloc(sizeof(*b));
+
+    if (NULL == b) {
+        return;
+    }
+
+    b->a0[0] = state->a;
+    b->l0[0] = state->l;
+    b->f0[0] = state->flags;
+    memcpy(b->mem[0], state->mem, SO_MEMORY_SIZE);
+    b->log_count = 0;
+
+    reset(b, 1);
+    run(b, seq, 1);
+
+    state->a = b->a[0];
+    state->l = b->l[0];
+    state->flags = b->f[0];
+    memcpy(state->mem, b->mem[0], SO_MEMORY_SIZE);
+
+    free(b);
+}
+
+/**
+ * Check that *x* and *y* leave the same live registers, flags and
+ * memory for every value of A and L, both flag states and every value
+ * of the relevant memory cell. Returns FALSE if not or out of memory.
+ */
+int so_equivalent(const so_sequence *x, const so_sequence *y,
+                  unsigned int live)
+{
+    int cell = relevant_cell(x, y), result = TRUE;
+    unsigned long s, st, states = 1UL << 17;
+    uint8_t addr[SO_LANES], saved[SO_LANES];
+    so_batch *b = malloc(sizeof(*b));
+    so_expect *e = malloc(sizeof(*e));
+    unsigned int n, lanes = SO_LANES;
+
+    if (NULL == b || NULL == e) {
+        free(b);
+        free(e);
+        return FALSE;
+    }
+
+    randomize(b);
+    if (SO_CELL_NONE != cell) {
+        states <<= 8;
+    }
+
+    for (s = 0; s < states && result; s += SO_LANES) {
+        for (n = 0; n < SO_LANES; n++) {
+            st = s + n;
+            b->a0[n] = st;
+            b->l0[n] = st >> 8;
+            b->f0[n] = (st >> 16) & 1 ? IS_F_ALL : 0;
+            if (SO_CELL_NONE != cell) {
+                addr[n] = SO_CELL_AT_L == cell ? b->l0[n] : cell;
+                saved[n] = b->mem[n][addr[n]];
+                b->mem[n][addr[n]] = st >> 17;
+            }
+        }
+
+        expect(b, e, x, SO_LANES);
+        result = matches(b, e, y, live, SO_LANES);
+
+        if (SO_CELL_NONE != cell) {
+            LANES(b->mem[n][addr[n]] = saved[n]);
+        }
+    }
+
+    free(b);
+    free(e);
+
+    return result;
+}
+
+static int compare_results(const void *p, const void *q, int by_size)
+{
+    const so_sequence *x = p, *y = q;
+    unsigned int i;
+
+    if (so_cost(x, by_size) != so_cost(y, by_size)) {
+        return so_cost(x, by_size) < so_cost(y, by_size) ? -1 : 1;
+    }
+    if (so_cost(x, !by_size) != so_cost(y, !by_size)) {
+        return so_cost(x, !by_size) < so_cost(y, !by_size) ? -1 : 1;
+    }
+    if (x->length != y->length) {
+        return x->length < y->length ? -1 : 1;
+    }
+    for (i = 0; i < x->length; i++) {
+        if (x->code[i].ins->opcode != y->code[i].ins->opcode) {
+            return x->code[i].ins->opcode < y->code[i].ins->opcode ? -1 : 1;
+        }
+        if (x->code[i].arg != y->code[i].arg) {
+            return x->code[i].arg < y->code[i].arg ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+static int compare_cycles(const void *p, const void *q)
+{
+    return compare_results(p, q, FALSE);
+}
+
+static int compare_bytes(const void *p, const void *q)
+{
+    return compare_results(p, q, TRUE);
+}
+
+static void add_result(so_worker *w)
+{
+    so_context *ctx = w->ctx;
+    so_search *search = ctx->search;
+    unsigned int cost = so_cost(&w->cand, search->by_size);
+    so_sequence *results;
+
+    pthread_mutex_lock(&ctx->lock);
+    if (search->result_count == ctx->result_size) {
+        ctx->result_size = ctx->result_size ? 2 * ctx->result_size : 16;
+        results = realloc(search->results,
+                          sizeof(*results) * ctx->result_size);
+        if (NULL == results) {
+            ctx->failed = TRUE;
+            pthread_mutex_unlock(&ctx->lock);
+            return;
+        }
+        search->results = results;
+    }
+    search->results[search->result_count++] = w->cand;
+    if (cost < ctx->best) {
+        ctx->best = cost;
+    }
+    w->best = ctx->best;
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+static void try_candidate(so_worker *w)
+{
+    so_search *search = w->ctx->search;
+
+    w->candidates++;
+    if (!matches(&w->batch, &w->expect, &w->cand, search->live,
+                 SO_PROBE_LANES) ||
+            !matches(&w->batch, &w->expect, &w->cand, search->live,
+                     SO_LANES)) {
+        return;
+    }
+
+    w->filtered++;
+    if (so_equivalent(&search->target, &w->cand, search->live)) {
+        add_result(w);
+    }
+}
+
+/**
+ * Extend the current candidate to *length* instructions in all ways
+ * that may still be cheaper than the target and no more expensive than
+ * the best result, and try them.
+ */
+static void enumerate(so_worker *w, unsigned int cost, unsigned int length)
+{
+    so_context *ctx = w->ctx;
+    so_sequence *cand = &w->cand;
+    unsigned int i, next;
+    so_ins *ins;
+
+    if (cand->length == length) {
+        try_candidate(w);
+        return;
+    }
+
+    for (i = 0; i < ctx->alphabet_size; i++) {
+        ins = &ctx->alphabet[i];
+        next = cost + (ctx->search->by_size ? ins->ins->length
+                                            : ins->ins->cycles);
+        if (next >= ctx->target_cost || next > w->best) {
+            continue;
+        }
+        so_append(cand, ins->ins, ins->arg);
+        enumerate(w, next, length);
+        cand->length--;
+        cand->bytes -= ins->ins->length;
+        cand->cycles -= ins->ins->cycles;
+    }
+}
+
+/**
+ * Jobs are all first instructions of all lengths, shorter lengths
+ * first, so cheap results are found early and prune the longer ones.
+ */
+static void *run_worker(void *arg)
+{
+    so_worker *w = (so_worker*)arg;
+    so_context *ctx = w->ctx;
+    unsigned int job, cost;
+    so_ins *ins;
+
+    randomize(&w->batch);
+    expect(&w->batch, &w->expect, &ctx->search->target, SO_LANES);
+
+    for (;;) {
+        pthread_mutex_lock(&ctx->lock);
+        job = ctx->next++;
+        w->best = ctx->best;
+        pthread_mutex_unlock(&ctx->lock);
+
+        if (job >= ctx->alphabet_size * ctx->search->max_length) {
+            return NULL;
+        }
+
+        ins = &ctx->alphabet[job % ctx->alphabet_size];
+        memset(&w->cand, 0, sizeof(w->cand));
+        so_append(&w->cand, ins->ins, ins->arg);
+        cost = so_cost(&w->cand, ctx->search->by_size);
+        if (cost < ctx->target_cost && cost <= w->best) {
+            enumerate(w, cost, 1 + job / ctx->alphabet_size);
+        }
+    }
+}
+
+static void add_const(uint8_t *consts, unsigned int *count, uint8_t value)
+{
+    unsigned int i;
+
+    for (i = 0; i < *count && consts[i] != value; i++);
+    if (i == *count && *count < SO_MAX_CONSTS) {
+        consts[(*count)++] = value;
+    }
+}
+
+/**
+ * Collect the instructions of the search, immediates take the values
+ * the target uses plus 0, 1 and 0xFF.
+ */
+static int build_alphabet(so_context *ctx)
+{
+    const so_sequence *target = &ctx->search->target;
+    uint8_t consts[SO_MAX_CONSTS];
+    unsigned int i, j, count = 0;
+    const vns_instruction *ins;
+
+    for (i = 0; i < target->length; i++) {
+        if (2 == target->code[i].ins->length) {
+            add_const(consts, &count, target->code[i].arg);
+        }
+    }
+    add_const(consts, &count, 0x00);
+    add_const(consts, &count, 0x01);
+    add_const(consts, &count, 0xff);
+
+    ctx->alphabet = malloc(sizeof(so_ins) * 256 * SO_MAX_CONSTS);
+    if (NULL == ctx->alphabet) {
+        return FALSE;
+    }
+
+    ctx->alphabet_size = 0;
+    for (i = 1; i < 256; i++) {
+        ins = is_find_opcode(i);
+        if (!so_usable(ins)) {
+            continue;
+        }
+        for (j = 0; j < (2 == ins->length ? count : 1); j++) {
+            ctx->alphabet[ctx->alphabet_size].ins = ins;
+            ctx->alphabet[ctx->alphabet_size].arg = consts[j];
+            ctx->alphabet_size++;
+        }
+    }
+
+    return TRUE;
+}
+
+/**
+ * Search all sequences of up to search->max_length instructions for
+ * replacements of search->target that are cheaper and equivalent.
+ * Returns FALSE if out of memory.
+ */
+int so_search_run(so_search *search)
+{
+    so_context ctx;
+    so_worker *workers;
+    pthread_t *threads;
+    unsigned int i, count = search->threads ? search->threads : 1;
+    unsigned int started;
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.search = search;
+    ctx.target_cost = so_cost(&search->target, search->by_size);
+    ctx.best = ctx.target_cost;
+    search->results = NULL;
+    search->result_count = 0;
+    search->candidates = 0;
+    search->filtered = 0;
+
+    if (search->max_length > SO_MAX_LENGTH) {
+        search->max_length = SO_MAX_LENGTH;
+    }
+
+    workers = malloc(sizeof(*workers) * count);
+    threads = malloc(sizeof(*threads) * count);
+    if (NULL == workers || NULL == threads || !build_alphabet(&ctx)) {
+        free(workers);
+        free(threads);
+        free(ctx.alphabet);
+        return FALSE;
+    }
+    pthread_mutex_init(&ctx.lock, NULL);
+
+    /* the empty sequence, if the target does nothing that is live */
+    memset(&workers[0].cand, 0, sizeof(workers[0].cand));
+    workers[0].ctx = &ctx;
+    if (so_equivalent(&search->target, &workers[0].cand, search->live)) {
+        add_result(&workers[0]);
+    }
+
+    for (i = 0; i < count; i++) {
+        workers[i].ctx = &ctx;
+        workers[i].candidates = 0;
+        workers[i].filtered = 0;
+    }
+
+    for (started = 0; started < count; started++) {
+        if (0 != pthread_create(&threads[started], NULL, run_worker,
+                                &workers[started])) {
+            break;
+        }
+    }
+    if (0 == started) {
+        /* no thread at all, do the work ourselves */
+        run_worker(&workers[0]);
+    }
+
+    for (i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    for (i = 0; i < count; i++) {
+        search->candidates += workers[i].candidates;
+        search->filtered += workers[i].filtered;
+    }
+
+    qsort(search->results, search->result_count, sizeof(so_sequence),
+          search->by_size ? compare_bytes : compare_cycles);
+
+    pthread_mutex_destroy(&ctx.lock);
+    free(ctx.alphabet);
+    free(workers);
+    free(threads);
+
+    return !ctx.failed;
+}
+
+void so_search_release(so_search *search)
+{
+    free(search->results);
+    search->results = NULL;
+    search->result_count = 0;
+}
@@ -0,0 +1,91 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+#ifndef SUPEROPT_H
+#define SUPEROPT_H 1
+
+#include <stdint.h>
+
+#include "instructionset.h"
+
+#define SO_MAX_LENGTH   5       // instructions in a sequence
+#define SO_MAX_CONSTS   8       // immediates tried by the search
+#define SO_LANES        64      // machine states run side by side
+#define SO_MEMORY_SIZE  256
+
+/* parts of the machine state a replacement has to preserve, the
+ * memory is always compared */
+#define SO_LIVE_A       0x01
+#define SO_LIVE_L       0x02
+#define SO_LIVE_FLAGS   0x04
+#define SO_LIVE_ALL     (SO_LIVE_A | SO_LIVE_L | SO_LIVE_FLAGS)
+
+typedef struct _so_ins {
+    const vns_instruction *ins;
+    uint8_t arg;
+} so_ins;
+
+/**
+ * A straight sequence of instructions without control flow, I/O or
+ * stack access.
+ */
+typedef struct _so_sequence {
+    so_ins code[SO_MAX_LENGTH];
+    unsigned int length;
+    unsigned int bytes;
+    unsigned int cycles;
+} so_sequence;
+
+/* one machine state for so_run() */
+typedef struct _so_state {
+    uint8_t a;
+    uint8_t l;
+    uint8_t flags;
+    uint8_t mem[SO_MEMORY_SIZE];
+} so_state;
+
+/**
+ * A search for sequences cheaper than *target* with the same effect on
+ * the live registers, the flags and the memory. Fill in the first
+ * block, so_search_run() fills in the rest.
+ */
+typedef struct _so_search {
+    so_sequence target;
+    unsigned int live;
+    unsigned int max_length;
+    uint8_t by_size;            // cost is bytes, not cycles
+    unsigned int threads;
+
+    so_sequence *results;       // cheapest first
+    unsigned int result_count;
+    unsigned long candidates;   // sequences enumerated
+    unsigned long filtered;     // passed the random states
+} so_search;
+
+int so_usable(const vns_instruction *ins);
+int so_append(so_sequence *seq, const vns_instruction *ins, uint8_t arg);
+unsigned int so_cost(const so_sequence *seq, int by_size);
+void so_run(so_state *state, const so_sequence *seq);
+int so_equivalent(const so_sequence *a, const so_sequence *b,
+                  unsigned int live);
+int so_search_run(so_search *search);
+void so_search_release(so_search *search);
+
+#endif /* SUPEROPT_H */
@@ -0,0 +1,336 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "globals.h"
+#include "utils.h"
+#include "instructionset.h"
+#include "disasm.h"
+#include "superopt.h"
+
+#define LINE_SIZE       128
+#define DEFAULT_LENGTH  4
+#define DEFAULT_SHOWN   10
+
+typedef struct _vnsopt_configuration {
+    char *infile_name;
+    unsigned int shown;
+} vnsopt_configuration;
+
+static vnsopt_configuration config;
+static so_search search;
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static char *trim(char *str)
+{
+    char *end;
+
+    while (isspace((unsigned char)*str)) {
+        str++;
+    }
+    end = str + strlen(str);
+    while (end > str && isspace((unsigned char)end[-1])) {
+        *--end = '\0';
+    }
+
+    return str;
+}
+
+/**
+ * Parse an argument of an instruction, a register or a number.
+ */
+static int parse_arg(char *str, argtype *at, uint8_t *value)
+{
+    static const struct {
+        const char *name;
+        argtype at;
+    } regs[] = {
+        {"A", AT_REG_A}, {"L", AT_REG_L}, {"M", AT_MEM},
+        {"FL", AT_REG_FL}, {"SP", AT_REG_SP}, {NULL, AT_NONE}
+    };
+    char *end;
+    long number;
+    int i;
+
+    str = trim(str);
+    for (i = 0; NULL != regs[i].name; i++) {
+        if (0 == strcasecmp(str, regs[i].name)) {
+            *at = regs[i].at;
+            return TRUE;
+        }
+    }
+
+    number = strtol(str, &end, 0);
+    if (end == str || '\0' != *end || number < 0 || number > 0xff) {
+        return FALSE;
+    }
+
+    *at = AT_INT;
+    *value = number;
+
+    return TRUE;
+}
+
+/**
+ * Parse one line of assembler source and append its instruction to
+ * *seq*. Comments and empty lines are skipped, labels are not
+ * supported.
+ */
+static int parse_instruction(char *line, so_sequence *seq)
+{
+    argtype at[2] = {AT_NONE, AT_NONE};
+    const vns_instruction *ins;
+    char *mnemonic, *args, *arg;
+    uint8_t value = 0;
+    int n = 0;
+
+    if (NULL != (args = strchr(line, ';'))) {
+        *args = '\0';
+    }
+    line = trim(line);
+    if ('\0' == *line) {
+        return TRUE;
+    }
+
+    mnemonic = line;
+    for (args = line; *args && !isspace((unsigned char)*args); args++);
+    if (*args) {
+        *args++ = '\0';
+        for (arg = strtok(args, ","); NULL != arg; arg = strtok(NULL, ",")) {
+            if (n == 2 || !parse_arg(arg, &at[n++], &value)) {
+                util_perror("Bad argument in '%s'\n", mnemonic);
+                return FALSE;
+            }
+        }
+    }
+
+    ins = is_find_mnemonic(mnemonic, at[0], at[1]);
+    if (NULL == ins) {
+        util_perror("Unknown instruction: %s\n", mnemonic);
+        return FALSE;
+    }
+    if (!so_usable(ins)) {
+        util_perror("%s: only instructions without control flow, I/O "
+                    "and stack access can be optimized\n", ins->mnemonic);
+        return FALSE;
+    }
+    if (!so_append(seq, ins, value)) {
+        util_perror("Sequences are limited to %u instructions\n",
+                    SO_MAX_LENGTH);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static int read_sequence(const char *path, so_sequence *seq)
+{
+    char line[LINE_SIZE];
+    FILE *in;
+    int result = TRUE;
+
+    if (NULL == (in = util_fopen(path, "r"))) {
+        perror(path);
+        return FALSE;
+    }
+
+    while (result && NULL != fgets(line, sizeof(line), in)) {
+        result = parse_instruction(line, seq);
+    }
+
+    util_fclose(in);
+
+    return result;
+}
+
+static void print_sequence(const char *indent, const so_sequence *seq)
+{
+    uint8_t mem[2];
+    char buf[LINE_SIZE];
+    unsigned int i;
+
+    if (0 == seq->length) {
+        printf("%s(nothing)\n", indent);
+    }
+
+    for (i = 0; i < seq->length; i++) {
+        mem[0] = seq->code[i].ins->opcode;
+        mem[1] = seq->code[i].arg;
+        dis_format(mem, 0, NULL, buf, sizeof(buf));
+        printf("%s%s\n", indent, buf);
+    }
+}
+
+static void print_cost(const so_sequence *seq)
+{
+    printf("%u instruction(s), %u byte(s), %u cycles\n",
+           seq->length, seq->bytes, seq->cycles);
+}
+
+void print_usage(char *pname)
+{
+    printf("\nUsage: %s [-hs] [-d a|l|f] [-n <len>] [-k <count>] [-j <n>]\n"
+           "       -i <file> | <instruction> [<instruction>...]\n\n", pname);
+    printf("  -h             Show this help text.\n");
+    printf("  -i <file>      Read the sequence from <file>, - is stdin.\n");
+    printf("  -s             Minimize bytes instead of cycles.\n");
+    printf("  -d a|l|f       A, L or the flags are dead after the sequence,\n"
+           "                 may be given several times.\n");
+    printf("  -n <len>       Try replacements of up to <len> instructions "
+           "(default: %u).\n", DEFAULT_LENGTH);
+    printf("  -k <count>     Show the <count> cheapest replacements "
+           "(default: %u).\n", DEFAULT_SHOWN);
+    printf("  -j <n>         Search with <n> threads (default 0: one per "
+           "CPU).\n");
+    printf("\n");
+    printf("Example: %s -d f 'mvi a, 0' 'add l'\n", pname);
+    printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int opt, i, max_length = 0;
+    char *process_name = util_basename(argv[0]);
+    char line[LINE_SIZE];
+    long cpus;
+    double start;
+
+    printf(BANNER_LINE1, "Superoptimizer");
+    printf(BANNER_LINE2, VERSION);
+
+    config.infile_name = NULL;
+    config.shown = DEFAULT_SHOWN;
+    search.live = SO_LIVE_ALL;
+    search.by_size = FALSE;
+    search.threads = 0;
+
+    while ((opt = getopt(argc, argv, "hi:sd:n:k:j:")) != -1) {
+        switch (opt) {
+            case 'h':
+                print_usage(process_name);
+                return EXIT_SUCCESS;
+            case 'i':
+                config.infile_name = strdup(optarg);
+                break;
+            case 's':
+                search.by_size = TRUE;
+                break;
+            case 'd':
+                if (0 == strcasecmp(optarg, "a")) {
+                    search.live &= ~SO_LIVE_A;
+                } else if (0 == strcasecmp(optarg, "l")) {
+                    search.live &= ~SO_LIVE_L;
+                } else if (0 == strcasecmp(optarg, "f")) {
+                    search.live &= ~SO_LIVE_FLAGS;
+                } else {
+                    util_perror("Unknown register: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'n':
+                max_length = strtoul(optarg, NULL, 0);
+                break;
+            case 'k':
+                config.shown = strtoul(optarg, NULL, 0);
+                break;
+            case 'j':
+                search.threads = strtoul(optarg, NULL, 0);
+                break;
+            default:
+                print_usage(process_name);
+                return EXIT_SUCCESS;
+        }
+    }
+
+    if (NULL != config.infile_name) {
+        if (!read_sequence(config.infile_name, &search.target)) {
+            return EXIT_FAILURE;
+        }
+    } else if (optind < argc) {
+        for (i = optind; i < (unsigned int)argc; i++) {
+            snprintf(line, sizeof(line), "%s", argv[i]);
+            if (!parse_instruction(line, &search.target)) {
+                return EXIT_FAILURE;
+            }
+        }
+    } else {
+        print_usage(process_name);
+        return EXIT_SUCCESS;
+    }
+
+    if (0 == search.target.length) {
+        util_perror("No instructions to optimize\n");
+        return EXIT_FAILURE;
+    }
+
+    if (0 == max_length) {
+        max_length = search.target.length < DEFAULT_LENGTH ?
+                     search.target.length : DEFAULT_LENGTH;
+    }
+    search.max_length = max_length;
+
+    if (0 == search.threads) {
+        cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        search.threads = cpus > 0 ? cpus : 1;
+    }
+
+    printf("\nSequence: ");
+    print_cost(&search.target);
+    print_sequence("    ", &search.target);
+
+    start = now();
+    if (!so_search_run(&search)) {
+        util_perror("Out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("\nSearched %lu candidates of up to %u instruction(s), %lu "
+           "passed the random states (%.2f s, %u thread(s)).\n",
+           search.candidates, search.max_length, search.filtered,
+           now() - start, search.threads);
+
+    if (0 == search.result_count) {
+        printf("No cheaper equivalent found.\n");
+    }
+
+    for (i = 0; i < search.result_count && i < config.shown; i++) {
+        printf("\nReplacement %u: ", i + 1);
+        print_cost(&search.results[i]);
+        print_sequence("    ", &search.results[i]);
+    }
+
+    so_search_release(&search);
+
+    return EXIT_SUCCESS;
+}
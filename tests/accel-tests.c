@@ -0,0 +1,249 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "unittest.h"
+#include "globals.h"
+#include "vnsem.h"
+#include "accel.h"
+
+unsigned int tests_run = 0;
+
+static int _input(uint8_t port, uint8_t *value, void *ctx)
+{
+    *value = 3;
+    return TRUE;
+}
+
+static void _output(uint8_t port, uint8_t value, void *ctx)
+{
+}
+
+static const vnsem_io _io = { _input, _output, NULL };
+
+/* instructions the loop engine may summarize, with their operand */
+static const uint8_t _body_ops[] = {
+    0x7d, 0x7e, 0x77, 0x3e, 0x3a, 0x32, 0x6f, 0x6e, 0x2e,
+    0x3c, 0x2c, 0x3d, 0x2d, 0x87, 0x85, 0x86, 0xc6,
+    0x97, 0x95, 0x96, 0xd6, 0xbf, 0xbd, 0xbe, 0xfe,
+    0xa7, 0xa5, 0xa6, 0xe6, 0xb7, 0xb5, 0xb6, 0xf6,
+    0xaf, 0xad, 0xae, 0xee, 0x00
+};
+
+static int _has_operand(uint8_t op)
+{
+    return 0x3e == op || 0x3a == op || 0x32 == op || 0x2e == op ||
+           0xc6 == op || 0xd6 == op || 0xfe == op || 0xe6 == op ||
+           0xf6 == op || 0xee == op;
+}
+
+/* compare everything but the hooks */
+static int _same(const vnsem_machine *a, const vnsem_machine *b)
+{
+    return a->step_count == b->step_count && a->pc == b->pc &&
+           a->accu == b->accu && a->reg_l == b->reg_l &&
+           a->flags == b->flags && a->sp == b->sp &&
+           a->halted == b->halted &&
+           0 == memcmp(a->mem, b->mem, sizeof(a->mem));
+}
+
+/**
+ * Run *m* with the loop engine for up to *steps* steps and the reference
+ * interpreter up to the same step count, and compare the results.
+ */
+static int _compare(const vnsem_machine *m, unsigned int steps)
+{
+    vnsem_machine ref = *m, loop = *m;
+    int r = 0, l = 0;
+
+    while (loop.step_count < steps && !loop.halted && 0 == l) {
+        l = acc_step(&loop);
+    }
+    while (ref.step_count < loop.step_count && !ref.halted && 0 == r) {
+        r = step_machine(&ref);
+    }
+
+    return l == r && _same(&ref, &loop);
+}
+
+/**
+ * Write a random counted loop: a body of summarizable instructions with
+ * addresses in the data area, an occasional forward jump, and a counter
+ * in memory driving the backward jump.
+ */
+static void _random_loop(vnsem_machine *m)
+{
+    static const uint8_t jumps[] = { 0xca, 0xc2, 0xda, 0xd2 };
+    uint8_t pc = 0, head, op;
+    int i, n = 1 + rand() % 12;
+
+    memset(m, 0, sizeof(*m));
+    for (i = 0xc0; i < 0x100; ++i) {
+        m->mem[i] = rand();
+    }
+    m->accu = rand();
+    m->reg_l = 0xc0 + rand() % 0x40;
+    m->flags = rand();
+    m->sp = 0xbf;
+
+    head = pc;
+    for (i = 0; i < n; ++i) {
+        if (0 == rand() % 8) {
+            m->mem[pc++] = jumps[rand() % 4];
+            m->mem[pc] = pc + 2;
+            pc++;
+            m->mem[pc++] = 0x00;
+            continue;
+        }
+        op = _body_ops[rand() % sizeof(_body_ops)];
+        m->mem[pc++] = op;
+        if (_has_operand(op)) {
+            // data area addresses, mostly small immediates
+            m->mem[pc++] = (0x3a == op || 0x32 == op || 0x2e == op)
+                           ? 0xc0 + rand() % 0x40 : rand() % 8;
+        }
+    }
+
+    // lda cnt; adi/sui step; sta cnt; jnz/jnc head; hlt
+    m->mem[pc++] = 0x3a;
+    m->mem[pc++] = 0xff;
+    m->mem[pc++] = (rand() & 1) ? 0xd6 : 0xc6;
+    m->mem[pc++] = 1 + rand() % 3;
+    m->mem[pc++] = 0x32;
+    m->mem[pc++] = 0xff;
+    m->mem[pc++] = jumps[rand() % 4];
+    m->mem[pc++] = head;
+    m->mem[pc++] = 0x76;
+}
+
+/* ------------------------------------------------------------------------
+ *                            test loop engine
+ * ------------------------------------------------------------------------ */
+
+TEST(test_acc_counted)
+{
+    // mvi a,0; sta 0xf0; loop: lda 0xf0; adi 3; sta 0xf0; lda 0xf1;
+    // dcr a; sta 0xf1; jnz loop; hlt
+    static const uint8_t program[] = {
+        0x3e, 0x00, 0x32, 0xf0, 0x3a, 0xf0, 0xc6, 0x03, 0x32, 0xf0,
+        0x3a, 0xf1, 0x3d, 0x32, 0xf1, 0xc2, 0x04, 0x76
+    };
+    vnsem_machine m;
+    acc_counters c;
+
+    acc_reset();
+    memset(&m, 0, sizeof(m));
+    memcpy(m.mem, program, sizeof(program));
+    m.mem[0xf1] = 200;
+
+    ASSERT(_compare(&m, 100000), "Loop engine differs!");
+
+    acc_read_counters(&c);
+    ASSERT(1 == c.loops, "Loop not summarized!");
+    ASSERT(c.iterations == 200 - ACC_THRESHOLD - 1,
+           "Wrong number of iterations summarized!");
+    ASSERT(c.steps == 7 * c.iterations, "Wrong number of steps!");
+
+    // stopping inside the summarized iterations needs the same result
+    ASSERT(_compare(&m, 500), "Loop engine differs at a step limit!");
+
+    return TEST_OK;
+}
+
+TEST(test_acc_random)
+{
+    vnsem_machine m;
+    acc_counters c;
+    int i;
+
+    acc_reset();
+    srand(42);
+
+    for (i = 0; i < 5000; ++i) {
+        _random_loop(&m);
+        if (!_compare(&m, 5000)) {
+            printf("Random loop %i differs!\n", i);
+            return "Loop engine differs from the reference!";
+        }
+    }
+
+    acc_read_counters(&c);
+    // most random bodies are not affine, but enough of them are
+    ASSERT(c.loops > 250, "Too few random loops summarized!");
+
+    return TEST_OK;
+}
+
+TEST(test_acc_fallback)
+{
+    // loop: in 0; dcr a; jnz loop; hlt
+    static const uint8_t io[] = { 0xdb, 0x00, 0x3d, 0xc2, 0x00, 0x76 };
+    // loop: dcr a; jnz loop; hlt
+    static const uint8_t count[] = { 0x3d, 0xc2, 0x00, 0x76 };
+    vnsem_machine m;
+    acc_counters c;
+
+    acc_reset();
+    memset(&m, 0, sizeof(m));
+    memcpy(m.mem, io, sizeof(io));
+    m.io = &_io;
+    ASSERT(_compare(&m, 1000), "Loop engine differs with I/O!");
+    acc_read_counters(&c);
+    ASSERT(0 == c.loops && c.fails[ACC_FAIL_OPCODE] > 0,
+           "Loop with I/O summarized!");
+
+    acc_reset();
+    memset(&m, 0, sizeof(m));
+    memcpy(m.mem, count, sizeof(count));
+    m.accu = 100;
+    m.break_enabled = TRUE;
+    m.break_point = 0x01;
+    ASSERT(_compare(&m, 1000), "Loop engine differs at a break point!");
+    acc_read_counters(&c);
+    ASSERT(0 == c.loops && c.fails[ACC_FAIL_BREAK] > 0,
+           "Loop with a break point summarized!");
+
+    // without the break point it is
+    acc_reset();
+    m.break_enabled = FALSE;
+    ASSERT(_compare(&m, 1000), "Loop engine differs!");
+    acc_read_counters(&c);
+    ASSERT(1 == c.loops, "Loop not summarized!");
+
+    return TEST_OK;
+}
+
+/* ------------------------------------------------------------------------ */
+
+char *run_tests(void)
+{
+    RUN_TEST(test_acc_counted);
+    RUN_TEST(test_acc_random);
+    RUN_TEST(test_acc_fallback);
+
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    return ut_main(argc, argv, run_tests);
+}
@@ -0,0 +1,177 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "unittest.h"
+#include "globals.h"
+#include "analyzer.h"
+
+unsigned int tests_run = 0;
+
+// analyze a program given as byte string
+static int _analyze(const char *program, size_t size, an_result *res)
+{
+    uint8_t mem[AN_MEMORY_SIZE];
+
+    memset(mem, 0, sizeof(mem));
+    memcpy(mem, program, size);
+
+    return an_analyze(mem, 0, res);
+}
+
+#define ANALYZE(prog, res) _analyze(prog, sizeof(prog) - 1, res)
+
+static int _has_issue(an_result *res, uint8_t type, uint8_t addr)
+{
+    int i;
+
+    for (i = 0; i < res->issue_count; ++i) {
+        if (res->issues[i].type == type && res->issues[i].addr == addr) {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+/* ------------------------------------------------------------------------
+ *                            test analyzer
+ * ------------------------------------------------------------------------ */
+
+TEST(test_an_clean_program)
+{
+    an_result res;
+
+    // CALL 0x04; HLT; NOP; PUSH A; POP A; RET
+    ANALYZE("\xcd\x04\x76\x00\xf5\xf1\xc9", &res);
+
+    ASSERT(res.issue_count == 0, "Clean program reported issues!");
+    ASSERT(res.ins_count == 5, "Wrong instruction count!");
+    ASSERT(res.depth_min == 0 && res.depth_max == 2, "Wrong stack depth!");
+    ASSERT(res.cell[0x04] & AN_CELL_CALL, "Call target not marked!");
+    ASSERT(!(res.cell[0x03] & AN_CELL_CODE), "Unreachable byte is code!");
+
+    return TEST_OK;
+}
+
+TEST(test_an_underflow)
+{
+    an_result res;
+
+    // POP A; HLT
+    ANALYZE("\xf1\x76", &res);
+
+    ASSERT(_has_issue(&res, AN_ISSUE_UNDERFLOW, 0x00),
+           "Stack underflow not detected!");
+
+    return TEST_OK;
+}
+
+TEST(test_an_unbounded)
+{
+    an_result res;
+
+    // loop: PUSH A; JMP loop
+    ANALYZE("\xf5\xc3\x00", &res);
+
+    ASSERT(res.depth_max >= AN_DEPTH_INF, "Stack depth not unbounded!");
+    ASSERT(_has_issue(&res, AN_ISSUE_UNBOUNDED, 0x00),
+           "Unbounded stack not detected!");
+
+    return TEST_OK;
+}
+
+TEST(test_an_data_jump)
+{
+    an_result res;
+
+    // CALL 0x03; HLT; PUSH A; RET
+    ANALYZE("\xcd\x03\x76\xf5\xc9", &res);
+
+    ASSERT(_has_issue(&res, AN_ISSUE_DATA_JUMP, 0x04),
+           "Return to pushed data not detected!");
+
+    // MVI A,0x10; STA 0x06; JMP 0x00
+    ANALYZE("\x3e\x10\x32\x06\x00\xc3\x00", &res);
+
+    ASSERT(_has_issue(&res, AN_ISSUE_SELF_MODIFY, 0x06),
+           "Self-modifying code not detected!");
+    ASSERT(_has_issue(&res, AN_ISSUE_DATA_JUMP, 0x05),
+           "Modified jump target not detected!");
+
+    return TEST_OK;
+}
+
+TEST(test_an_unreachable)
+{
+    an_result res;
+
+    // JMP 0x04; MVI A,n; HLT; .byte 0x2a at 0x10
+    ANALYZE("\xc3\x04\x3e\x01\x76\0\0\0\0\0\0\0\0\0\0\0\x2a", &res);
+
+    ASSERT(_has_issue(&res, AN_ISSUE_UNREACHABLE, 0x02),
+           "Skipped code not reported!");
+    ASSERT(res.issues[0].len == 2, "Wrong unreachable range!");
+    ASSERT(_has_issue(&res, AN_ISSUE_UNREACHABLE, 0x10),
+           "Unreferenced data not reported!");
+
+    // MVI L,0x10; MOV A,M; HLT; .byte 0x2a at 0x10
+    ANALYZE("\x2e\x10\x7e\x76\0\0\0\0\0\0\0\0\0\0\0\0\x2a", &res);
+
+    ASSERT(res.issue_count == 0, "Referenced data reported!");
+    ASSERT(res.cell[0x10] & AN_CELL_READ, "Data read not marked!");
+
+    return TEST_OK;
+}
+
+TEST(test_an_illegal_and_overlap)
+{
+    an_result res;
+
+    // JZ 0x03; MVI A,0x08; <illegal 0x08>
+    ANALYZE("\xca\x03\x3e\x08", &res);
+
+    ASSERT(_has_issue(&res, AN_ISSUE_OVERLAP, 0x03),
+           "Overlapping instructions not detected!");
+    ASSERT(_has_issue(&res, AN_ISSUE_ILLEGAL, 0x03),
+           "Illegal instruction not detected!");
+
+    return TEST_OK;
+}
+
+/* ------------------------------------------------------------------------ */
+
+char *run_tests(void)
+{
+    RUN_TEST(test_an_clean_program);
+    RUN_TEST(test_an_underflow);
+    RUN_TEST(test_an_unbounded);
+    RUN_TEST(test_an_data_jump);
+    RUN_TEST(test_an_unreachable);
+    RUN_TEST(test_an_illegal_and_overlap);
+
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    return ut_main(argc, argv, run_tests);
+}
@@ -0,0 +1,204 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "unittest.h"
+#include "globals.h"
+#include "arena.h"
+#include "list.h"
+
+unsigned int tests_run = 0;
+
+/* ------------------------------------------------------------------------
+ *                            test arena and pool
+ * ------------------------------------------------------------------------ */
+
+TEST(test_arena_alloc)
+{
+    char *a, *b, *big;
+    arena_chunk *first;
+    arena ar;
+    int i;
+
+    arena_init(&ar, 64);
+
+    a = arena_alloc(&ar, 3);
+    b = arena_alloc(&ar, 8);
+    ASSERT(NULL != a && NULL != b, "Allocation failed!");
+    ASSERT(0 == (uintptr_t)b % _Alignof(max_align_t), "Allocation not aligned!");
+    ASSERT(b >= a + 3, "Allocations overlap!");
+
+    a = arena_strdup(&ar, "label");
+    ASSERT(NULL != a && 0 == strcmp(a, "label"), "String copy wrong!");
+
+    // requests larger than a chunk get a chunk of their own
+    big = arena_alloc(&ar, 1000);
+    ASSERT(NULL != big, "Large allocation failed!");
+    memset(big, 0xaa, 1000);
+    ASSERT(0 == strcmp(a, "label"), "Large allocation overlaps!");
+
+    for (i = 0; i < 100; i++) {
+        ASSERT(NULL != arena_alloc(&ar, 48), "Allocation failed!");
+    }
+
+    // a reset hands out the same memory again without new chunks
+    first = ar.first;
+    arena_reset(&ar);
+    a = arena_alloc(&ar, 3);
+    ASSERT(a == (char*)first->data, "Reset did not rewind!");
+    for (i = 0; i < 100; i++) {
+        ASSERT(NULL != arena_alloc(&ar, 48), "Allocation failed!");
+    }
+    ASSERT(ar.first == first, "Reset lost chunks!");
+
+    arena_destroy(&ar);
+    ASSERT(NULL == ar.first && NULL == ar.current, "Arena not empty!");
+
+    return TEST_OK;
+}
+
+TEST(test_pool)
+{
+    void *a, *b, *c;
+    arena ar;
+    pool p;
+
+    arena_init(&ar, 0);
+    pool_init(&p, &ar, 1);
+
+    a = pool_alloc(&p);
+    b = pool_alloc(&p);
+    ASSERT(NULL != a && NULL != b && a != b, "Allocation failed!");
+    ASSERT((char*)b - (char*)a >= (ptrdiff_t)sizeof(void*),
+           "Objects too small for the free list!");
+
+    // released objects come back first, most recent first
+    pool_free(&p, a);
+    pool_free(&p, b);
+    ASSERT(pool_alloc(&p) == b, "Released object not reused!");
+    ASSERT(pool_alloc(&p) == a, "Released object not reused!");
+    c = pool_alloc(&p);
+    ASSERT(NULL != c && c != a && c != b, "Fresh object expected!");
+
+    arena_destroy(&ar);
+
+    return TEST_OK;
+}
+
+/* ------------------------------------------------------------------------
+ *                            test list
+ * ------------------------------------------------------------------------ */
+
+static unsigned int freed = 0;
+
+static void count_free(void *payload)
+{
+    freed++;
+}
+
+/**
+ * Check both directions of the list against the expected payloads.
+ */
+static int list_matches(list *l, const int *values, unsigned int count)
+{
+    list_item *item = l->head, *last = NULL;
+    unsigned int i;
+
+    for (i = 0; i < count; i++, item = item->next) {
+        if (NULL == item || *(int*)item->payload != values[i] ||
+                item->prev != last) {
+            return FALSE;
+        }
+        last = item;
+    }
+
+    return NULL == item && count == l->length;
+}
+
+TEST(test_list)
+{
+    int values[] = { 1, 2, 3, 4 };
+    int expect1[] = { 1, 2, 4 };
+    int expect2[] = { 2, 4 };
+    int expect3[] = { 2 };
+    list_item *removed;
+    void *recycled;
+    arena ar;
+    pool nodes;
+    list l;
+
+    arena_init(&ar, 0);
+    pool_init(&nodes, &ar, sizeof(list_item));
+    list_init(&l, &nodes);
+
+    ASSERT(list_insert(&l, NULL, &values[0], count_free), "Insert failed!");
+    ASSERT(list_insert(&l, l.head, &values[3], count_free), "Insert failed!");
+    ASSERT(list_insert(&l, l.head, &values[1], count_free), "Insert failed!");
+    ASSERT(list_insert(&l, l.head->next, &values[2], count_free),
+           "Insert failed!");
+
+    // remove from the middle, the front and the tail
+    removed = l.head->next->next;
+    list_remove(&l, removed);
+    ASSERT(list_matches(&l, expect1, 3), "Remove from middle broke list!");
+    ASSERT(1 == freed, "Payload not released!");
+    list_remove(&l, l.head);
+    ASSERT(list_matches(&l, expect2, 2), "Remove from front broke list!");
+    list_remove(&l, l.head->next);
+    ASSERT(list_matches(&l, expect3, 1), "Remove from tail broke list!");
+
+    // nodes are recycled through the pool
+    recycled = nodes.free;
+    ASSERT(list_insert(&l, NULL, &values[0], NULL), "Insert failed!");
+    ASSERT(l.head == recycled, "Node not recycled!");
+    list_destroy(&l);
+    ASSERT(0 == l.length && NULL == l.head, "List not empty!");
+    ASSERT(4 == freed, "Payloads not released!");
+
+    // heap allocated nodes
+    list_init(&l, NULL);
+    ASSERT(list_insert(&l, NULL, &values[0], NULL), "Insert failed!");
+    ASSERT(list_insert(&l, l.head, &values[1], NULL), "Insert failed!");
+    list_destroy(&l);
+    ASSERT(0 == l.length, "List not empty!");
+
+    arena_destroy(&ar);
+
+    return TEST_OK;
+}
+
+/* ------------------------------------------------------------------------ */
+
+char *run_tests(void)
+{
+    RUN_TEST(test_arena_alloc);
+    RUN_TEST(test_pool);
+    RUN_TEST(test_list);
+
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    return ut_main(argc, argv, run_tests);
+}
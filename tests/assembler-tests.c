@@ -0,0 +1,189 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "unittest.h"
+#include "globals.h"
+#include "image.h"
+#include "vnsasm.h"
+
+unsigned int tests_run = 0;
+
+#define THREADS 4
+
+/* an assembled source, see _assemble() */
+typedef struct _job {
+    const char *name;
+    char *source;
+    uint8_t *image;
+    size_t size;
+    char *errors;
+    int ok;
+} job;
+
+static vnsasm_configuration _config;
+
+/**
+ * Assemble the source of *j* in memory into a container image, like
+ * vnsem --asm does. Error messages are collected in j->errors.
+ */
+static void *_assemble(void *arg)
+{
+    job *j = (job*)arg;
+    vnsasm_context ctx;
+    size_t err_size;
+    FILE *in;
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.config = &_config;
+    ctx.infile_name = (char*)j->name;
+    ctx.out = fopen("/dev/null", "w");
+    ctx.err = open_memstream(&j->errors, &err_size);
+    in = fmemopen(j->source, strlen(j->source), "r");
+
+    j->image = NULL;
+    j->ok = asm_parse(&ctx, in) && asm_encode(&ctx, &j->image, &j->size);
+
+    asm_release(&ctx);
+    fclose(in);
+    fclose(ctx.err);
+    fclose(ctx.out);
+
+    return NULL;
+}
+
+static void _free(job *j)
+{
+    free(j->image);
+    free(j->errors);
+}
+
+/**
+ * Generate a source of *blocks* labeled blocks, each jumping forward to
+ * the next one.
+ */
+static char *_generate(int blocks)
+{
+    char *text;
+    size_t size;
+    FILE *out = open_memstream(&text, &size);
+    int i;
+
+    for (i = 0; i < blocks; ++i) {
+        if (0 == i % 40) {
+            fprintf(out, ".offset 0\n");
+        }
+        fprintf(out, "block_%i:  mvi a, %i\n", i, i & 0xff);
+        fprintf(out, "           add l\n");
+        fprintf(out, "           jnz block_%i\n", i + 1);
+    }
+    fprintf(out, "block_%i:  hlt\n", blocks);
+    fclose(out);
+
+    return text;
+}
+
+/* ------------------------------------------------------------------------
+ *                         test reentrant assembler
+ * ------------------------------------------------------------------------ */
+
+TEST(test_asm_error)
+{
+    job bad = { "bad.asm", "mvi a,1\nmvi a,,\nhlt\n" };
+    job good = { "good.asm", "start: mvi a,1\n jmp end\nend: hlt\n" };
+    uint8_t mem[256] = { 0 };
+    vns_image img;
+
+    _assemble(&bad);
+    ASSERT(!bad.ok, "Syntax error not reported!");
+    ASSERT(NULL != strstr(bad.errors, "Error: bad.asm:2: "),
+           "Error message without file and line!");
+    _free(&bad);
+
+    // the process is still alive, and the next file is not affected
+    _assemble(&good);
+    ASSERT(good.ok, "Valid source after an error failed!");
+    ASSERT('\0' == good.errors[0], "Errors reported for a valid source!");
+    ASSERT(img_open_memory(good.image, good.size, "good.asm", &img),
+           "Invalid image!");
+    img_load(&img, mem, 0);
+    img_close(&img);
+    ASSERT(0x3e == mem[0] && 0x01 == mem[1] && 0xc3 == mem[2] &&
+           0x04 == mem[3] && 0x76 == mem[4], "Wrong bytes!");
+    _free(&good);
+
+    return TEST_OK;
+}
+
+TEST(test_asm_threads)
+{
+    static const int blocks[THREADS] = { 1000, 3000, 2000, 4000 };
+    job serial[THREADS], parallel[THREADS];
+    pthread_t threads[THREADS];
+    int i;
+
+    for (i = 0; i < THREADS; ++i) {
+        serial[i].name = parallel[i].name = "generated.asm";
+        serial[i].source = parallel[i].source = _generate(blocks[i]);
+        _assemble(&serial[i]);
+        ASSERT(serial[i].ok, "Generated source not assembled!");
+    }
+
+    for (i = 0; i < THREADS; ++i) {
+        ASSERT(0 == pthread_create(&threads[i], NULL, _assemble,
+                                   &parallel[i]), "Thread not started!");
+    }
+    for (i = 0; i < THREADS; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+
+    for (i = 0; i < THREADS; ++i) {
+        ASSERT(parallel[i].ok, "Concurrent assembly failed!");
+        ASSERT(parallel[i].size == serial[i].size &&
+               0 == memcmp(parallel[i].image, serial[i].image,
+                           serial[i].size),
+               "Concurrent assembly differs from a serial one!");
+        _free(&serial[i]);
+        _free(&parallel[i]);
+        free(serial[i].source);
+    }
+
+    return TEST_OK;
+}
+
+/* ------------------------------------------------------------------------ */
+
+char *run_tests(void)
+{
+    _config.image_format = IMG_CONTAINER;
+
+    RUN_TEST(test_asm_error);
+    RUN_TEST(test_asm_threads);
+
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    return ut_main(argc, argv, run_tests);
+}
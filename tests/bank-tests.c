@@ -0,0 +1,183 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "unittest.h"
+#include "globals.h"
+#include "vnsem.h"
+#include "savestate.h"
+
+// built with make BANKS=4, see the Makefile
+#if VNS_BANKS != 4
+#error "bank tests need VNS_BANKS=4"
+#endif
+
+unsigned int tests_run = 0;
+
+static char _path[] = "/tmp/bank-tests-XXXXXX";
+
+static int _output_count;
+
+static int _input(uint8_t port, uint8_t *value, void *ctx)
+{
+    *value = 0x2a;
+    return TRUE;
+}
+
+static void _output(uint8_t port, uint8_t value, void *ctx)
+{
+    _output_count++;
+}
+
+static const vnsem_io _io = { _input, _output, NULL };
+
+// OUT adr or IN adr at address 0
+static void _port(vnsem_machine *m, uint8_t opcode, uint8_t port)
+{
+    m->mem[1] = port;
+    m->pc = 1;
+    process_instruction(opcode, m);
+}
+
+/* ------------------------------------------------------------------------
+ *                            test bank switching
+ * ------------------------------------------------------------------------ */
+
+TEST(test_bank_switch)
+{
+    vnsem_machine m;
+
+    memset(&m, 0, sizeof(m));
+    m.io = &_io;
+    m.mem[0x7f] = 0x11;
+    m.mem[0x80] = 0x22;
+    m.banks[2][0] = 0x33;
+
+    // OUT 0xFE maps bank A into the window
+    m.accu = 2;
+    _port(&m, 0xd3, VNS_BANK_PORT);
+    ASSERT(m.bank == 2, "Bank not selected!");
+    ASSERT(m.mem[0x80] == 0x33, "Bank not mapped!");
+    ASSERT(m.mem[0x7f] == 0x11, "Memory below the window changed!");
+    ASSERT(m.banks[0][0] == 0x22, "Previous bank not saved!");
+    ASSERT(_output_count == 0, "Bank port passed to the I/O hooks!");
+
+    // IN 0xFE reads the bank, other ports still reach the hooks
+    m.accu = 0;
+    _port(&m, 0xdb, VNS_BANK_PORT);
+    ASSERT(m.accu == 2, "Current bank not read!");
+    _port(&m, 0xdb, 0x00);
+    ASSERT(m.accu == 0x2a, "Input not read from the hooks!");
+    _port(&m, 0xd3, 0x00);
+    ASSERT(_output_count == 1, "Output not passed to the hooks!");
+
+    // banks wrap around, selecting bank 0 again restores the window
+    m.accu = VNS_BANKS;
+    _port(&m, 0xd3, VNS_BANK_PORT);
+    ASSERT(m.bank == 0 && m.mem[0x80] == 0x22, "Bank 0 not restored!");
+    ASSERT(m.banks[2][0] == 0x33, "Bank 2 not saved!");
+
+    return TEST_OK;
+}
+
+TEST(test_bank_load)
+{
+    uint8_t mem[IMG_MEMORY_SIZE + 3 * IMG_BANK_SIZE];
+    uint8_t used[IMG_MEMORY_SIZE + 3 * IMG_BANK_SIZE], *data;
+    vnsem_machine m;
+    size_t size;
+    FILE *out;
+
+    memset(mem, 0, sizeof(mem));
+    memset(used, 0, sizeof(used));
+    mem[0x80] = 0x01;
+    used[0x80] = TRUE;
+    mem[IMG_MEMORY_SIZE + 2 * IMG_BANK_SIZE] = 0x03;
+    used[IMG_MEMORY_SIZE + 2 * IMG_BANK_SIZE] = TRUE;
+
+    ASSERT(img_encode_banked(mem, used, 4, 0x00, NULL, 0, &data, &size),
+           "Encoding banked container failed!");
+    out = fopen(_path, "w");
+    fwrite(data, size, 1, out);
+    fclose(out);
+    free(data);
+
+    // loading maps bank 0 first, whatever was selected before
+    memset(&m, 0, sizeof(m));
+    m.accu = 1;
+    _port(&m, 0xd3, VNS_BANK_PORT);
+    ASSERT(read_program(_path, 0, &m), "Loading banked program failed!");
+    ASSERT(m.bank == 0 && m.mem[0x80] == 0x01, "Bank 0 not loaded!");
+    ASSERT(m.banks[3][0] == 0x03, "Bank 3 not loaded!");
+
+    m.accu = 3;
+    _port(&m, 0xd3, VNS_BANK_PORT);
+    ASSERT(m.mem[0x80] == 0x03, "Loaded bank not mapped!");
+
+    return TEST_OK;
+}
+
+TEST(test_bank_savestate)
+{
+    vnsem_machine m, r;
+
+    memset(&m, 0, sizeof(m));
+    m.mem[0x80] = 0x22;
+    m.banks[1][5] = 0x11;
+    m.banks[3][0] = 0x33;
+    m.accu = 3;
+    _port(&m, 0xd3, VNS_BANK_PORT);
+
+    // all banks are saved, the mapped one stays mapped
+    ASSERT(ss_save(_path, &m, NULL), "Saving state failed!");
+    memset(&r, 0, sizeof(r));
+    ASSERT(ss_restore(_path, &r, NULL), "Restoring state failed!");
+    ASSERT(0 == memcmp(&m, &r, sizeof(m)), "Machine not restored!");
+
+    r.accu = 1;
+    _port(&r, 0xd3, VNS_BANK_PORT);
+    ASSERT(r.mem[0x85] == 0x11 && r.banks[3][0] == 0x33,
+           "Banks not restored!");
+
+    return TEST_OK;
+}
+
+/* ------------------------------------------------------------------------ */
+
+char *run_tests(void)
+{
+    close(mkstemp(_path));
+
+    RUN_TEST(test_bank_switch);
+    RUN_TEST(test_bank_load);
+    RUN_TEST(test_bank_savestate);
+
+    unlink(_path);
+
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    return ut_main(argc, argv, run_tests);
+}
@@ -0,0 +1,124 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "unittest.h"
+#include "globals.h"
+#include "debuginfo.h"
+
+unsigned int tests_run = 0;
+
+static char _path[] = "/tmp/debuginfo-tests-XXXXXX";
+
+/* ------------------------------------------------------------------------
+ *                            test debug information
+ * ------------------------------------------------------------------------ */
+
+TEST(test_dbg_labels)
+{
+    static debuginfo dbg;
+    uint8_t addr, offset;
+
+    dbg_init(&dbg, "prog.asm");
+    ASSERT(NULL == dbg_symbolize(&dbg, 0x10, &offset), "Phantom label!");
+
+    ASSERT(dbg_add_label(&dbg, "loop", 0x10), "Adding label failed!");
+    ASSERT(dbg_add_label(&dbg, "start", 0x00), "Adding label failed!");
+    ASSERT(dbg_add_label(&dbg, "again", 0x10), "Adding label failed!");
+
+    ASSERT(0 == strcmp(dbg_label_at(&dbg, 0x10), "loop"),
+           "First label at an address must win!");
+    ASSERT(NULL == dbg_label_at(&dbg, 0x11), "Label at wrong address!");
+
+    ASSERT(0 == strcmp(dbg_symbolize(&dbg, 0x0f, &offset), "start") &&
+           offset == 0x0f, "Symbolizing before a label failed!");
+    ASSERT(0 == strcmp(dbg_symbolize(&dbg, 0xff, &offset), "loop") &&
+           offset == 0xef, "Symbolizing after the last label failed!");
+
+    ASSERT(dbg_find_label(&dbg, "again", &addr) && addr == 0x10,
+           "Finding label failed!");
+    ASSERT(!dbg_find_label(&dbg, "nowhere", &addr), "Unknown label found!");
+
+    return TEST_OK;
+}
+
+TEST(test_dbg_roundtrip)
+{
+    static debuginfo dbg, read;
+    uint8_t addr;
+
+    dbg_init(&dbg, "prog.asm");
+    dbg.line[0x00] = 3;
+    dbg.line[0x02] = 4;
+    dbg_add_label(&dbg, "main", 0x00);
+    dbg_add_label(&dbg, "data", 0x40);
+
+    ASSERT(dbg_write(_path, &dbg), "Writing debug info failed!");
+    ASSERT(dbg_read(_path, &read), "Reading debug info failed!");
+
+    ASSERT(0 == strcmp(read.source, "prog.asm"), "Source lost!");
+    ASSERT(read.line[0x00] == 3 && read.line[0x02] == 4, "Lines lost!");
+    ASSERT(read.line[0x01] == 0, "Phantom line!");
+    ASSERT(read.label_count == 2, "Labels lost!");
+    ASSERT(dbg_find_label(&read, "data", &addr) && addr == 0x40,
+           "Label address lost!");
+
+    return TEST_OK;
+}
+
+TEST(test_dbg_full)
+{
+    static debuginfo dbg;
+    char name[16];
+    int i;
+
+    dbg_init(&dbg, NULL);
+    for (i = 0; i < DBG_MAX_LABELS; ++i) {
+        sprintf(name, "l%i", i);
+        ASSERT(dbg_add_label(&dbg, name, i & 0xff), "Adding label failed!");
+    }
+    ASSERT(!dbg_add_label(&dbg, "extra", 0), "Label table overflow!");
+
+    return TEST_OK;
+}
+
+/* ------------------------------------------------------------------------ */
+
+char *run_tests(void)
+{
+    close(mkstemp(_path));
+
+    RUN_TEST(test_dbg_labels);
+    RUN_TEST(test_dbg_roundtrip);
+    RUN_TEST(test_dbg_full);
+
+    unlink(_path);
+
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    return ut_main(argc, argv, run_tests);
+}
@@ -0,0 +1,161 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "unittest.h"
+#include "globals.h"
+#include "vnsem.h"
+#include "difftest.h"
+
+unsigned int tests_run = 0;
+
+static char _path[] = "/tmp/difftest-tests-XXXXXX";
+
+/* mvi a,0; loop: inr a; jnz loop; hlt -- 514 steps */
+static const uint8_t _program[] = { 0x3e, 0x00, 0x3c, 0xc2, 0x02, 0x76 };
+
+/* writes a cell no instruction of the program touches at step 100 */
+static int _stray_step(vnsem_machine *m)
+{
+    int result = step_machine(m);
+
+    if (100 == m->step_count) {
+        m->mem[0xf0] ^= 0x01;
+    }
+
+    return result;
+}
+
+/* like _stray_step, but restores the cell again at step 150 */
+static int _restored_step(vnsem_machine *m)
+{
+    int result = step_machine(m);
+
+    if (100 == m->step_count || 150 == m->step_count) {
+        m->mem[0xf0] ^= 0x01;
+    }
+
+    return result;
+}
+
+/* sets the carry flag a correct INR or JNZ leaves alone at step 50 */
+static int _carry_step(vnsem_machine *m)
+{
+    int result = step_machine(m);
+
+    if (50 == m->step_count) {
+        m->flags ^= F_CARRY;
+    }
+
+    return result;
+}
+
+static const vnsem_engine _ref = { "ref", step_machine, "reference", 0 };
+static const vnsem_engine _stray = { "stray", _stray_step, "stray", 0 };
+static const vnsem_engine _restored = {
+    "restored", _restored_step, "restored", 0
+};
+static const vnsem_engine _carry = { "carry", _carry_step, "carry", 0 };
+
+static void _load(vnsem_machine *m)
+{
+    memset(m, 0, sizeof(*m));
+    memcpy(m->mem, _program, sizeof(_program));
+}
+
+/* ------------------------------------------------------------------------
+ *                          test differential testing
+ * ------------------------------------------------------------------------ */
+
+TEST(test_dt_lockstep)
+{
+    vnsem_machine m;
+    dt_inputs inputs = { { 0 }, 0 };
+    unsigned long at = 1;
+
+    _load(&m);
+
+    ASSERT(dt_lockstep(&m, &_ref, &_ref, &inputs, 10000, &at),
+           "Reference differs from itself!");
+    ASSERT(0 == at, "Divergence reported for identical engines!");
+
+    ASSERT(!dt_lockstep(&m, &_ref, &_stray, &inputs, 10000, &at),
+           "Stray write not detected!");
+    ASSERT(100 == at, "Stray write reported at the wrong step!");
+
+    ASSERT(!dt_lockstep(&m, &_carry, &_ref, &inputs, 10000, &at),
+           "Wrong carry flag not detected!");
+    ASSERT(50 == at, "Wrong carry flag reported at the wrong step!");
+
+    return TEST_OK;
+}
+
+TEST(test_dt_golden)
+{
+    vnsem_machine m;
+    dt_inputs inputs = { { 0 }, 0 };
+    unsigned long at = 1;
+
+    _load(&m);
+
+    ASSERT(dt_record(&m, &_ref, &inputs, 10000, _path),
+           "Recording the golden stream failed!");
+
+    ASSERT(dt_verify(&m, &_ref, &inputs, _path, &at),
+           "Reference differs from its own recording!");
+    ASSERT(0 == at, "Divergence reported for the recording engine!");
+
+    ASSERT(!dt_verify(&m, &_stray, &inputs, _path, &at),
+           "Stray write not detected!");
+    ASSERT(100 == at, "Stray write reported at the wrong step!");
+
+    // undone before any periodic recomputation would have seen it
+    ASSERT(!dt_verify(&m, &_restored, &inputs, _path, &at),
+           "Restored stray write not detected!");
+    ASSERT(100 == at, "Restored stray write reported at the wrong step!");
+
+    ASSERT(!dt_verify(&m, &_carry, &inputs, _path, &at),
+           "Wrong carry flag not detected!");
+    ASSERT(50 == at, "Wrong carry flag reported at the wrong step!");
+
+    return TEST_OK;
+}
+
+/* ------------------------------------------------------------------------ */
+
+char *run_tests(void)
+{
+    close(mkstemp(_path));
+
+    RUN_TEST(test_dt_lockstep);
+    RUN_TEST(test_dt_golden);
+
+    unlink(_path);
+
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    return ut_main(argc, argv, run_tests);
+}
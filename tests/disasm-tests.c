@@ -0,0 +1,137 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "unittest.h"
+#include "globals.h"
+#include "disasm.h"
+
+unsigned int tests_run = 0;
+
+// discover the code of a program given as byte string
+static int _discover(const char *program, size_t size, uint8_t *mem,
+                     uint8_t *cell)
+{
+    memset(mem, 0, DIS_MEMORY_SIZE);
+    memcpy(mem, program, size);
+
+    return dis_discover(mem, 0, cell);
+}
+
+#define DISCOVER(prog, mem, cell) _discover(prog, sizeof(prog) - 1, mem, cell)
+
+/* ------------------------------------------------------------------------
+ *                           test disassembler
+ * ------------------------------------------------------------------------ */
+
+TEST(test_dis_linear)
+{
+    /* MVI A,1; STA 0x80; HLT; data */
+    const char prog[] = "\x3e\x01\x32\x80\x76\x12\x34";
+    uint8_t mem[DIS_MEMORY_SIZE], cell[DIS_MEMORY_SIZE];
+
+    ASSERT(3 == DISCOVER(prog, mem, cell), "Wrong instruction count!");
+    ASSERT(cell[0] == DIS_CELL_CODE && cell[1] == DIS_CELL_OPERAND,
+           "MVI not classified!");
+    ASSERT(cell[4] == DIS_CELL_CODE, "HLT not classified!");
+    ASSERT(cell[5] == 0 && cell[6] == 0, "Data after HLT taken as code!");
+    ASSERT(cell[0x80] == DIS_CELL_DATA, "STA address not marked!");
+
+    return TEST_OK;
+}
+
+TEST(test_dis_branches)
+{
+    /* 0: JZ 6; CALL 8; JMP 0; 6: HLT; 7: data; 8: RET */
+    const char prog[] = "\xca\x07\xcd\x09\xc3\x00\xff\x76\xff\xc9";
+    uint8_t mem[DIS_MEMORY_SIZE], cell[DIS_MEMORY_SIZE];
+
+    ASSERT(5 == DISCOVER(prog, mem, cell), "Wrong instruction count!");
+    ASSERT(cell[0] & DIS_CELL_JUMP, "Jump target not marked!");
+    ASSERT(cell[7] == (DIS_CELL_CODE | DIS_CELL_JUMP), "Branch not followed!");
+    ASSERT(cell[9] == (DIS_CELL_CODE | DIS_CELL_CALL), "Call not followed!");
+    ASSERT(cell[6] == 0 && cell[8] == 0, "Data taken as code!");
+
+    return TEST_OK;
+}
+
+TEST(test_dis_illegal_and_wrap)
+{
+    uint8_t mem[DIS_MEMORY_SIZE], cell[DIS_MEMORY_SIZE];
+
+    /* JMP 0xFF; 0xFF: MVI A wrapping around */
+    memset(mem, 0, sizeof(mem));
+    mem[0] = 0xc3;
+    mem[1] = 0xff;
+    mem[0xff] = 0x3e;
+
+    ASSERT(1 == dis_discover(mem, 0, cell), "Wrapping instruction decoded!");
+    ASSERT(cell[0xff] == DIS_CELL_JUMP, "Wrapping target misclassified!");
+
+    /* illegal opcode ends the path */
+    mem[0] = 0xff;
+    ASSERT(0 == dis_discover(mem, 0, cell), "Illegal opcode decoded!");
+
+    return TEST_OK;
+}
+
+TEST(test_dis_format)
+{
+    const char *labels[DIS_MEMORY_SIZE] = { NULL };
+    uint8_t mem[DIS_MEMORY_SIZE];
+    char text[64];
+
+    memset(mem, 0, sizeof(mem));
+    memcpy(mem, "\x7e\xc3\x10\xdb\x10\x31\x20\xff\x3a\x10", 10);
+    labels[0x10] = "loop";
+
+    ASSERT(1 == dis_format(mem, 0, labels, text, sizeof(text)), "Length!");
+    ASSERT(0 == strcmp(text, "mov a, m"), "MOV A,M misformatted!");
+    ASSERT(2 == dis_format(mem, 1, labels, text, sizeof(text)), "Length!");
+    ASSERT(0 == strcmp(text, "jmp loop"), "Label not used!");
+    dis_format(mem, 3, labels, text, sizeof(text));
+    ASSERT(0 == strcmp(text, "in 0x10"), "Port replaced by label!");
+    dis_format(mem, 5, NULL, text, sizeof(text));
+    ASSERT(0 == strcmp(text, "lxi sp, 0x20"), "LXI misformatted!");
+    ASSERT(0 == dis_format(mem, 7, labels, text, sizeof(text)), "Length!");
+    ASSERT(0 == strcmp(text, ".byte 0xFF"), "Illegal opcode misformatted!");
+    dis_format(mem, 8, labels, text, sizeof(text));
+    ASSERT(0 == strcmp(text, "lda loop"), "Data label not used!");
+
+    return TEST_OK;
+}
+
+/* ------------------------------------------------------------------------ */
+
+char *run_tests(void)
+{
+    RUN_TEST(test_dis_linear);
+    RUN_TEST(test_dis_branches);
+    RUN_TEST(test_dis_illegal_and_wrap);
+    RUN_TEST(test_dis_format);
+
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    return ut_main(argc, argv, run_tests);
+}
@@ -19,10 +19,13 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "unittest.h"
 #include "globals.h"
 #include "vnsem.h"
+#include "snapshot.h"
+#include "live.h"
 
 unsigned int tests_run = 0;
 
@@ -1213,6 +1216,185 @@ TEST(test_ins_nop)
     return TEST_OK;
 }
 
+/* ------------------------------------------------------------------------
+ *                            test statistics
+ * ------------------------------------------------------------------------ */
+
+static int _stats_input(uint8_t port, uint8_t *value, void *ctx)
+{
+    *value = 0x2a;
+    return TRUE;
+}
+
+static void _stats_output(uint8_t port, uint8_t value, void *ctx)
+{
+}
+
+static const vnsem_io _stats_io = { _stats_input, _stats_output, NULL };
+
+TEST(test_stats_io)
+{
+    vnsem_machine m1 = _get_machine(NULL);
+    vnsem_stats st;
+
+    st_init(&st);
+    m1.io = &_stats_io;
+    m1.stats = &st;
+    m1.mem[1] = 0x01;
+    m1.mem[3] = 0x02;
+
+    st_enter(&st, ST_PHASE_EXECUTE);
+    m1.pc = 1;
+    process_instruction(0xdb, &m1);
+    m1.pc = 3;
+    process_instruction(0xd3, &m1);
+
+    ASSERT(m1.accu == 0x2a, "IN with I/O hooks failed!");
+    ASSERT(st.inputs == 1 && st.outputs == 1, "I/O not counted!");
+    ASSERT(st.input_waits == 0, "Hooked input counted as user wait!");
+    ASSERT(st.phase_entries[ST_PHASE_IO] == 2, "I/O phase not entered!");
+    ASSERT(st.phase == ST_PHASE_EXECUTE, "Phase not restored after I/O!");
+
+    return TEST_OK;
+}
+
+TEST(test_stats_phases)
+{
+    vnsem_stats st, snapshot;
+    int previous;
+
+    st_init(&st);
+    previous = st_enter(&st, ST_PHASE_TRACE);
+    ASSERT(previous == ST_PHASE_OTHER, "Wrong initial phase!");
+    previous = st_enter(&st, ST_PHASE_EXECUTE);
+    ASSERT(previous == ST_PHASE_TRACE, "Wrong previous phase!");
+
+    st_read(&st, &snapshot);
+    ASSERT(snapshot.phase_ns[ST_PHASE_EXECUTE] >= st.phase_ns[ST_PHASE_EXECUTE],
+           "Open phase not accounted in snapshot!");
+    ASSERT(snapshot.phase_start_ns - snapshot.start_ns >=
+           snapshot.phase_ns[ST_PHASE_OTHER] +
+           snapshot.phase_ns[ST_PHASE_TRACE] +
+           snapshot.phase_ns[ST_PHASE_EXECUTE], "Phases exceed wall time!");
+
+    return TEST_OK;
+}
+
+TEST(test_snapshot)
+{
+    vnsem_snapshot snap;
+    vnsem_snapshot_data data;
+    vnsem_machine m = _get_machine(NULL);
+    unsigned int i;
+
+    m.pc = 0x42;
+    m.accu = 0x17;
+    m.mem[0x80] = 0xAB;
+    m.step_count = 99;
+
+    snap_init(&snap);
+    snap_publish(&snap, &m);
+    for (i = 0; i < SNAP_OUT_LOG + 3; i++) {
+        snap_output(&snap, 0x01, i, i);
+    }
+    snap_read(&snap, &data);
+
+    ASSERT(0 == (atomic_load(&snap.seq) & 1), "Sequence left odd!");
+    ASSERT(data.pc == 0x42 && data.accu == 0x17, "Registers not published!");
+    ASSERT(data.mem[0x80] == 0xAB, "Memory not published!");
+    ASSERT(data.step_count == 99, "Step count not published!");
+    ASSERT(data.out_count == SNAP_OUT_LOG + 3, "Wrong output count!");
+    ASSERT(data.out[(data.out_count - 1) % SNAP_OUT_LOG].value ==
+           SNAP_OUT_LOG + 2, "Newest output not in ring!");
+
+    m = _get_machine(NULL);
+    m.stats = (vnsem_stats*)&snap;
+    snap_to_machine(&data, &m);
+    ASSERT(m.pc == 0x42 && m.mem[0x80] == 0xAB, "Snapshot not copied!");
+    ASSERT(m.stats == (vnsem_stats*)&snap, "Hooks overwritten!");
+
+    return TEST_OK;
+}
+
+static uint8_t live_value;
+
+static void *live_reader(void *arg)
+{
+    live_value = live_input((vnsem_live*)arg, 0x03);
+    return NULL;
+}
+
+TEST(test_live_input)
+{
+    vnsem_snapshot snap;
+    vnsem_live l;
+
+    snap_init(&snap);
+    ASSERT(live_start(&l, &snap, live_reader, &l), "Thread not started!");
+
+    while (live_input_pending(&l) < 0) {
+        usleep(1000);
+    }
+    ASSERT(0x03 == live_input_pending(&l), "Wrong input port!");
+
+    live_give_input(&l, 0x2A);
+    pthread_join(l.thread, NULL);
+
+    ASSERT(0x2A == live_value, "Input not handed over!");
+    ASSERT(live_input_pending(&l) < 0, "Input still pending!");
+
+    return TEST_OK;
+}
+
+
+/* ------------------------------------------------------------------------
+ *                            benchmarks
+ * ------------------------------------------------------------------------ */
+
+// every iteration runs the same steps from address 0x00 on
+static const struct {
+    const char *name;
+    uint8_t code[3];
+    uint8_t steps;
+} _bench_code[] = {
+    { "nop",              { 0x00 },             1 },
+    { "mov a,m",          { 0x7e },             1 },
+    { "add m",            { 0x86 },             1 },
+    { "cpi 0x10",         { 0xfe, 0x10 },       1 },
+    { "jnz 0x00 (taken)", { 0xc2, 0x00 },       1 },
+    { "push a, pop a",    { 0xf5, 0xf1 },       2 },
+    { "call 0x00, ret",   { 0xcd, 0x00 },       1 },
+};
+
+TEST(bench_process_instruction)
+{
+    vnsem_machine m = _get_machine(NULL);
+    unsigned int i, step;
+
+    for (i = 0; i < sizeof(_bench_code) / sizeof(*_bench_code); i++) {
+        m = _get_machine(NULL);
+        memcpy(m.mem, _bench_code[i].code, sizeof(_bench_code[i].code));
+        m.mem[0x80] = 0xc9;                             // RET
+        m.reg_l = 0x40;
+
+        BENCH(_bench_code[i].name, 1000000) {
+            m.pc = 0;
+            for (step = 0; step < _bench_code[i].steps; step++) {
+                step_machine(&m);
+            }
+            if (0xcd == m.mem[0]) {
+                // return from the call right away
+                m.pc = 0x80;
+                step_machine(&m);
+            }
+            BENCH_KEEP(m.accu);
+        }
+
+        ASSERT(0 == m.sp, "Stack not balanced!");
+    }
+
+    return TEST_OK;
+}
 
 /* ------------------------------------------------------------------------ */
 
@@ -1275,18 +1457,16 @@ char *run_tests(void)
     RUN_TEST(test_ins_ret);
     RUN_TEST(test_ins_hlt);
     RUN_TEST(test_ins_nop);
+    RUN_TEST(test_stats_io);
+    RUN_TEST(test_stats_phases);
+    RUN_TEST(test_snapshot);
+    RUN_TEST(test_live_input);
+    RUN_BENCH(bench_process_instruction);
 
     return NULL;
 }
 
 int main(int argc, char **argv)
 {
-    char *result = run_tests();
-    if (result != NULL) {
-        printf("\033[1;31m%s\033[m\n", result);
-    } else {
-        printf("\033[1;32mALL TESTS PASSED\033[m\n");
-    }
-    printf("Tests run: %d\n", tests_run);
-    return (result) ? -1 : 0;
+    return ut_main(argc, argv, run_tests);
 }
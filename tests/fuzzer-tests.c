@@ -0,0 +1,195 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "unittest.h"
+#include "globals.h"
+#include "vnsem.h"
+#include "debuginfo.h"
+#include "fuzzer.h"
+
+unsigned int tests_run = 0;
+
+static char _path[] = "/tmp/fuzzer-tests-XXXXXX";
+static fuzz_state _fs;
+
+/* 0: in 0; cpi 0x42; jz hit; hlt; hit: mvi a,1; hlt */
+static const uint8_t _branch[] = {
+    0xdb, 0x00, 0xfe, 0x42, 0xca, 0x07, 0x76, 0x3e, 0x01, 0x76
+};
+
+static void _load(vnsem_machine *m, const uint8_t *program, size_t len)
+{
+    memset(m, 0, sizeof(*m));
+    memcpy(m->mem, program, len);
+}
+
+/* ------------------------------------------------------------------------
+ *                               test fuzzer
+ * ------------------------------------------------------------------------ */
+
+TEST(test_fuzz_snapshot)
+{
+    // mvi a,5; sta 0xf0; in 0; hlt
+    static const uint8_t program[] = {
+        0x3e, 0x05, 0x32, 0xf0, 0xdb, 0x00, 0x76
+    };
+    // mvi a,5; sta 0xf0; hlt
+    static const uint8_t no_input[] = { 0x3e, 0x05, 0x32, 0xf0, 0x76 };
+    vnsem_machine m;
+
+    _load(&m, program, sizeof(program));
+    fuzz_program(&m, 10, &_fs);
+
+    ASSERT(_fs.has_snapshot, "No snapshot taken!");
+    ASSERT(0x04 == _fs.snapshot.pc, "Snapshot not at the first IN!");
+    ASSERT(2 == _fs.snapshot.step_count,
+           "Snapshot after the wrong number of steps!");
+    ASSERT(0x05 == _fs.snapshot.mem[0xf0] && 0x05 == _fs.snapshot.accu,
+           "Snapshot misses the state before the first IN!");
+    ASSERT(0 == m.step_count && 0 == m.mem[0xf0],
+           "The fuzzed machine has been modified!");
+    ASSERT(10 == _fs.runs, "Wrong number of runs!");
+
+    _load(&m, no_input, sizeof(no_input));
+    fuzz_program(&m, 10, &_fs);
+
+    ASSERT(!_fs.has_snapshot, "Snapshot of a program without input!");
+    ASSERT(1 == _fs.runs, "A program without input run more than once!");
+    ASSERT(_fs.total.pc[0x04], "Coverage of the single run missing!");
+
+    return TEST_OK;
+}
+
+TEST(test_fuzz_entry)
+{
+    // 0x10: in 0; hlt
+    static const uint8_t program[] = { 0xdb, 0x00, 0x76 };
+    vnsem_machine m;
+
+    memset(&m, 0, sizeof(m));
+    memcpy(&m.mem[0x10], program, sizeof(program));
+    m.pc = 0x10;
+    m.mem[0x00] = 0xff;         // not code
+    fuzz_program(&m, 10, &_fs);
+
+    ASSERT(0x10 == _fs.entry, "Entry point not kept!");
+    ASSERT(0 == memcmp(_fs.image, m.mem, sizeof(m.mem)),
+           "Loaded image not kept!");
+
+    return TEST_OK;
+}
+
+TEST(test_fuzz_corpus)
+{
+    vnsem_machine m;
+    int i, found = FALSE;
+
+    _load(&m, _branch, sizeof(_branch));
+    fuzz_program(&m, 20000, &_fs);
+
+    ASSERT(_fs.total.pc[0x06] && _fs.total.pc[0x07],
+           "Branch not covered both ways!");
+
+    // the seed 0x00 reaches the first edges, only 0x42 the branch target
+    ASSERT(2 == _fs.corpus_len, "Corpus keeps inputs without new edges!");
+    ASSERT(0x00 == _fs.corpus[0].values[0], "Seed input not kept!");
+    for (i = 0; i < _fs.corpus_len; ++i) {
+        found |= (0x42 == _fs.corpus[i].values[0]);
+    }
+    ASSERT(found, "Input covering the branch not kept!");
+
+    return TEST_OK;
+}
+
+TEST(test_fuzz_lcov)
+{
+    static const uint16_t lines[] = { 1, 0, 2, 0, 3, 0, 4, 5, 0, 6 };
+    char buf[8192], expected[64];
+    vnsem_machine m;
+    debuginfo dbg;
+    FILE *in;
+    size_t len;
+    int i;
+
+    _load(&m, _branch, sizeof(_branch));
+    fuzz_program(&m, 20000, &_fs);
+
+    dbg_init(&dbg, "branch.asm");
+    for (i = 0; i < sizeof(lines) / sizeof(lines[0]); ++i) {
+        dbg.line[i] = lines[i];
+    }
+    dbg.line[0x20] = 7;        // never executed
+
+    ASSERT(fuzz_write_lcov(&_fs, &m, &dbg, _path), "lcov export failed!");
+
+    ASSERT(NULL != (in = fopen(_path, "r")), "Tracefile missing!");
+    len = fread(buf, 1, sizeof(buf) - 1, in);
+    buf[len] = '\0';
+    fclose(in);
+
+    ASSERT(0 == strncmp(buf, "TN:vnsem_fuzz\nSF:branch.asm\n", 28),
+           "Wrong tracefile header!");
+
+    // every run executes the IN of the snapshot
+    snprintf(expected, sizeof(expected), "\nDA:1,%lu\n", _fs.runs);
+    ASSERT(NULL != strstr(buf, expected), "Wrong line hit count!");
+
+    snprintf(expected, sizeof(expected), "\nBRDA:3,4,0,%u\n",
+             _fs.branch_hits[0x04][0]);
+    ASSERT(NULL != strstr(buf, expected), "Taken branch record missing!");
+    snprintf(expected, sizeof(expected), "\nBRDA:3,4,1,%u\n",
+             _fs.branch_hits[0x04][1]);
+    ASSERT(NULL != strstr(buf, expected),
+           "Fall through branch record missing!");
+    ASSERT(_fs.branch_hits[0x04][0] + _fs.branch_hits[0x04][1] ==
+           _fs.pc_hits[0x04], "Branch hit counts do not add up!");
+
+    ASSERT(NULL != strstr(buf, "\nDA:7,0\n"), "Unexecuted line missing!");
+    ASSERT(NULL != strstr(buf, "\nBRF:2\nBRH:2\nLF:7\nLH:6\n"
+                               "end_of_record\n"),
+           "Wrong tracefile summary!");
+
+    return TEST_OK;
+}
+
+/* ------------------------------------------------------------------------ */
+
+char *run_tests(void)
+{
+    close(mkstemp(_path));
+
+    RUN_TEST(test_fuzz_snapshot);
+    RUN_TEST(test_fuzz_entry);
+    RUN_TEST(test_fuzz_corpus);
+    RUN_TEST(test_fuzz_lcov);
+
+    unlink(_path);
+
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    return ut_main(argc, argv, run_tests);
+}
@@ -0,0 +1,254 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+
+#include "unittest.h"
+#include "globals.h"
+#include "vnsem.h"
+#include "history.h"
+#include "console.h"
+
+unsigned int tests_run = 0;
+
+// MVI A,0; loop: INR A; STA 0x80; JNZ loop; HLT
+static const uint8_t _program[] = {
+    0x3e, 0x00, 0x3c, 0x32, 0x80, 0xc2, 0x02, 0x76
+};
+
+static void _load(vnsem_machine *m)
+{
+    memset(m, 0, sizeof(*m));
+    memcpy(m->mem, _program, sizeof(_program));
+}
+
+// run the program to its end while recording the history
+static void _record(vnsem_history *h, vnsem_machine *m, size_t budget)
+{
+    uint8_t ins;
+    int result;
+
+    hist_init(h, budget);
+    _load(m);
+    m->history = h;
+
+    while (!m->halted) {
+        ins = m->mem[m->pc];
+        hist_before_step(h, m);
+        result = step_machine(m);
+        hist_after_step(h, m, ins, result);
+    }
+}
+
+// run the program without history until *step*
+static void _run_to(vnsem_machine *m, unsigned int step)
+{
+    _load(m);
+    while (m->step_count < step) {
+        step_machine(m);
+    }
+}
+
+/* ------------------------------------------------------------------------
+ *                            test history
+ * ------------------------------------------------------------------------ */
+
+TEST(test_hist_seek)
+{
+    vnsem_history h;
+    vnsem_machine m, ref;
+    unsigned int steps[] = { 0, 1, 63, 64, 65, 500, 767 }, i;
+
+    _record(&h, &m, HIST_DEFAULT_BUDGET);
+
+    for (i = 0; i < sizeof(steps) / sizeof(steps[0]); ++i) {
+        ASSERT(hist_seek(&h, &m, steps[i]), "Seek failed!");
+        _run_to(&ref, steps[i]);
+        ASSERT(m.step_count == steps[i], "Wrong step after seek!");
+        ASSERT(m.pc == ref.pc && m.accu == ref.accu && m.flags == ref.flags &&
+               0 == memcmp(m.mem, ref.mem, sizeof(m.mem)),
+               "Wrong state after seek!");
+    }
+
+    ASSERT(!hist_seek(&h, &m, h.head + 1), "Seek beyond head succeeded!");
+
+    hist_free(&h);
+
+    return TEST_OK;
+}
+
+TEST(test_hist_thin_out)
+{
+    vnsem_history h;
+    vnsem_machine m, ref;
+
+    // room for four checkpoints only
+    _record(&h, &m, 4 * sizeof(hist_checkpoint));
+
+    ASSERT(h.count <= 4, "Budget exceeded!");
+    ASSERT(h.interval > HIST_MIN_INTERVAL, "Interval not adapted!");
+
+    ASSERT(hist_seek(&h, &m, 700), "Seek failed!");
+    _run_to(&ref, 700);
+    ASSERT(m.accu == ref.accu && m.pc == ref.pc, "Wrong state after seek!");
+
+    hist_free(&h);
+
+    return TEST_OK;
+}
+
+TEST(test_hist_bisect)
+{
+    vnsem_history h;
+    vnsem_machine m, ref;
+    hist_predicate p;
+
+    _record(&h, &m, HIST_DEFAULT_BUDGET);
+
+    ASSERT(hist_parse_predicate("mem[0x80] >= 100", &p), "Parse failed!");
+    ASSERT(hist_bisect(&h, &m, &p), "Predicate not found!");
+
+    _load(&ref);
+    while (ref.mem[0x80] < 100) {
+        step_machine(&ref);
+    }
+
+    ASSERT(m.step_count == ref.step_count, "Wrong step found!");
+    ASSERT(m.mem[0x80] == 100, "Wrong state after bisect!");
+
+    ASSERT(hist_parse_predicate("l==1", &p), "Parse failed!");
+    ASSERT(!hist_bisect(&h, &m, &p), "Impossible predicate found!");
+    ASSERT(m.step_count == ref.step_count, "State changed by failed bisect!");
+
+    hist_free(&h);
+
+    return TEST_OK;
+}
+
+TEST(test_hist_mutation)
+{
+    vnsem_history h;
+    vnsem_machine m;
+
+    _record(&h, &m, HIST_DEFAULT_BUDGET);
+
+    ASSERT(hist_seek(&h, &m, 100), "Seek failed!");
+
+    // an unchanged machine keeps the recorded future
+    hist_pause(&h, &m);
+    hist_resume(&h, &m);
+    ASSERT(h.head > 100, "History truncated without change!");
+
+    // a change from the console drops it
+    hist_pause(&h, &m);
+    m.mem[0x90] = 1;
+    hist_resume(&h, &m);
+    ASSERT(h.head == 100, "History not truncated after change!");
+    ASSERT(h.checkpoints[h.count - 1].pinned, "Change not pinned!");
+    ASSERT(hist_seek(&h, &m, 100) && m.mem[0x90] == 1, "Change lost!");
+
+    hist_free(&h);
+
+    return TEST_OK;
+}
+
+TEST(test_hist_reset_all)
+{
+    vnsem_history h;
+    vnsem_machine m;
+    uint8_t ins;
+    int result;
+
+    _record(&h, &m, HIST_DEFAULT_BUDGET);
+
+    ASSERT(hist_seek(&h, &m, 100), "Seek failed!");
+
+    hist_pause(&h, &m);
+    call_command_for_input("reset all", &m);
+    hist_resume(&h, &m);
+    ASSERT(&h == m.history, "History lost by reset!");
+    ASSERT(0 == h.head, "History not truncated after reset!");
+    ASSERT(h.checkpoints[h.count - 1].pinned, "Reset not pinned!");
+
+    // load the program again and record a new future
+    hist_pause(&h, &m);
+    memcpy(m.mem, _program, sizeof(_program));
+    m.halted = FALSE;
+    hist_resume(&h, &m);
+    while (m.step_count < 50) {
+        ins = m.mem[m.pc];
+        hist_before_step(&h, &m);
+        result = step_machine(&m);
+        hist_after_step(&h, &m, ins, result);
+    }
+
+    call_command_for_input("seek 0", &m);
+    ASSERT(0 == m.step_count && 0x3e == m.mem[0], "Load not restored!");
+    call_command_for_input("seek 20", &m);
+    ASSERT(20 == m.step_count && 0x3c == m.mem[2],
+           "Seek after reset failed!");
+
+    hist_free(&h);
+
+    return TEST_OK;
+}
+
+TEST(test_hist_predicates)
+{
+    hist_predicate p;
+    vnsem_machine m;
+
+    memset(&m, 0, sizeof(m));
+    m.accu = 0x10;
+    m.reg_l = 0x20;
+    m.mem[0x20] = 0x05;
+    m.flags = F_ZERO;
+
+    ASSERT(hist_parse_predicate("a == 16", &p) && hist_eval(&p, &m), "a");
+    ASSERT(hist_parse_predicate("m<6", &p) && hist_eval(&p, &m), "m");
+    ASSERT(hist_parse_predicate("fl & 0x40", &p) && hist_eval(&p, &m), "fl");
+    ASSERT(hist_parse_predicate("MEM[32] != 4", &p) && hist_eval(&p, &m),
+           "mem");
+    ASSERT(!hist_parse_predicate("mem[300] == 1", &p), "Bad address!");
+    ASSERT(!hist_parse_predicate("x == 1", &p), "Bad operand!");
+    ASSERT(!hist_parse_predicate("a == 1 2", &p), "Trailing garbage!");
+
+    return TEST_OK;
+}
+
+/* ------------------------------------------------------------------------ */
+
+char *run_tests(void)
+{
+    RUN_TEST(test_hist_seek);
+    RUN_TEST(test_hist_thin_out);
+    RUN_TEST(test_hist_bisect);
+    RUN_TEST(test_hist_mutation);
+    RUN_TEST(test_hist_reset_all);
+    RUN_TEST(test_hist_predicates);
+
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    return ut_main(argc, argv, run_tests);
+}
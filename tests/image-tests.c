@@ -0,0 +1,269 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "unittest.h"
+#include "globals.h"
+#include "image.h"
+
+unsigned int tests_run = 0;
+
+static char _path[] = "/tmp/image-tests-XXXXXX";
+
+// write a small container with two segments and two symbols
+static int _write_container(void)
+{
+    uint8_t mem[IMG_MEMORY_SIZE], used[IMG_MEMORY_SIZE];
+    img_symbol symbols[] = { { "start", 0x10 }, { "data", 0x40 } };
+
+    memset(mem, 0, sizeof(mem));
+    memset(used, 0, sizeof(used));
+    memcpy(&mem[0x10], "\x3e\x05\x76", 3);
+    memset(&used[0x10], 1, 3);
+    memcpy(&mem[0x40], "\x01\x02", 2);
+    memset(&used[0x40], 1, 2);
+
+    return img_write(_path, mem, used, 0x10, symbols, 2);
+}
+
+static void _write_file(const char *data, size_t size)
+{
+    FILE *out = fopen(_path, "w");
+    fwrite(data, size, 1, out);
+    fclose(out);
+}
+
+/* ------------------------------------------------------------------------
+ *                            test images
+ * ------------------------------------------------------------------------ */
+
+TEST(test_img_roundtrip)
+{
+    uint8_t mem[IMG_MEMORY_SIZE], addr;
+    const uint8_t *cursor = NULL;
+    char name[IMG_MAX_NAME + 1];
+    vns_image img;
+
+    ASSERT(_write_container(), "Writing container failed!");
+    ASSERT(img_open(_path, &img), "Opening container failed!");
+    ASSERT(img.format == IMG_CONTAINER, "Container not detected!");
+    ASSERT(img.entry == 0x10, "Wrong entry!");
+    ASSERT(img.segment_count == 2, "Wrong segment count!");
+    ASSERT(img.symbol_count == 2, "Wrong symbol count!");
+
+    memset(mem, 0xff, sizeof(mem));
+    ASSERT(img_load(&img, mem, 0x80) == 5, "Wrong number of bytes loaded!");
+    ASSERT(0 == memcmp(&mem[0x10], "\x3e\x05\x76", 3), "Segment 1 wrong!");
+    ASSERT(0 == memcmp(&mem[0x40], "\x01\x02", 2), "Segment 2 wrong!");
+    ASSERT(mem[0x00] == 0xff && mem[0x13] == 0xff, "Unused bytes touched!");
+
+    img_used(&img, mem, 0x80);
+    ASSERT(mem[0x10] && mem[0x12] && mem[0x41], "Segment not marked used!");
+    ASSERT(!mem[0x0f] && !mem[0x13] && !mem[0x80], "Unused byte marked!");
+
+    ASSERT(img_next_symbol(&img, &cursor, &addr, name), "Symbol missing!");
+    ASSERT(addr == 0x10 && 0 == strcmp(name, "start"), "Symbol 1 wrong!");
+    ASSERT(img_next_symbol(&img, &cursor, &addr, name), "Symbol missing!");
+    ASSERT(addr == 0x40 && 0 == strcmp(name, "data"), "Symbol 2 wrong!");
+    ASSERT(!img_next_symbol(&img, &cursor, &addr, name), "Extra symbol!");
+
+    img_close(&img);
+
+    return TEST_OK;
+}
+
+TEST(test_img_raw)
+{
+    uint8_t mem[IMG_MEMORY_SIZE];
+    vns_image img;
+
+    _write_file("\x3e\x05\x76", 3);
+    ASSERT(img_open(_path, &img), "Opening raw image failed!");
+    ASSERT(img.format == IMG_RAW, "Raw image not detected!");
+
+    memset(mem, 0, sizeof(mem));
+    ASSERT(img_load(&img, mem, 0xfe) == 2, "Raw image not clipped!");
+    ASSERT(mem[0xfe] == 0x3e && mem[0xff] == 0x05, "Raw image misplaced!");
+
+    img_used(&img, mem, 0x10);
+    ASSERT(mem[0x10] && mem[0x12] && !mem[0x13] && !mem[0x0f],
+           "Raw image marked wrong!");
+
+    img_close(&img);
+
+    return TEST_OK;
+}
+
+TEST(test_img_corrupt)
+{
+    vns_image img;
+    FILE *f;
+
+    ASSERT(_write_container(), "Writing container failed!");
+
+    // flip a data byte, the checksum must catch it
+    f = fopen(_path, "r+");
+    fseek(f, IMG_HEADER_SIZE + 5, SEEK_SET);
+    fputc(0x00, f);
+    fclose(f);
+
+    ASSERT(!img_open(_path, &img), "Corrupt container accepted!");
+
+    // truncated header
+    _write_file("VNSI\x01", 5);
+    ASSERT(!img_open(_path, &img), "Truncated container accepted!");
+
+    return TEST_OK;
+}
+
+TEST(test_img_memory)
+{
+    uint8_t mem[IMG_MEMORY_SIZE], used[IMG_MEMORY_SIZE], *data;
+    img_symbol symbols[] = { { "loop", 0x21 } };
+    size_t size;
+    vns_image img;
+
+    memset(mem, 0, sizeof(mem));
+    memset(used, 0, sizeof(used));
+    memcpy(&mem[0x20], "\x00\xc3\x20", 3);
+    memset(&used[0x20], 1, 3);
+
+    ASSERT(img_encode(mem, used, 0x20, symbols, 1, &data, &size),
+           "Encoding container failed!");
+    ASSERT(img_open_memory(data, size, "memory", &img),
+           "Opening encoded container failed!");
+    ASSERT(img.format == IMG_CONTAINER && img.entry == 0x20,
+           "Encoded container wrong!");
+    ASSERT(img.segment_count == 1 && img.symbol_count == 1,
+           "Encoded container wrong!");
+
+    memset(mem, 0, sizeof(mem));
+    ASSERT(img_load(&img, mem, 0) == 3, "Wrong number of bytes loaded!");
+    ASSERT(mem[0x21] == 0xc3, "Segment wrong!");
+
+    img_close(&img);
+    ASSERT(data[0] == 'V', "Borrowed data touched by img_close()!");
+    free(data);
+
+    return TEST_OK;
+}
+
+TEST(test_img_stream)
+{
+    uint8_t mem[IMG_MEMORY_SIZE];
+    char path[32];
+    vns_image img;
+    int fds[2];
+
+    // a pipe can only be read, not mapped
+    ASSERT(0 == pipe(fds), "Creating pipe failed!");
+    ASSERT(3 == write(fds[1], "\x3e\x05\x76", 3), "Writing pipe failed!");
+    close(fds[1]);
+
+    snprintf(path, sizeof(path), "/dev/fd/%i", fds[0]);
+    ASSERT(img_open(path, &img), "Opening stream failed!");
+    ASSERT(img.format == IMG_RAW && img.size == 3, "Stream read wrong!");
+
+    memset(mem, 0, sizeof(mem));
+    ASSERT(img_load(&img, mem, 0x10) == 3, "Stream image not loaded!");
+    ASSERT(mem[0x10] == 0x3e && mem[0x12] == 0x76, "Stream image wrong!");
+
+    img_close(&img);
+    close(fds[0]);
+
+    return TEST_OK;
+}
+
+TEST(test_img_banks)
+{
+    uint8_t mem[IMG_MEMORY_SIZE + 2 * IMG_BANK_SIZE];
+    uint8_t used[IMG_MEMORY_SIZE + 2 * IMG_BANK_SIZE];
+    uint8_t window[IMG_BANK_SIZE], *data;
+    uint32_t crc;
+    size_t size;
+    vns_image img;
+    int i;
+
+    // bank 0 at 0x10, bank 2 at the start of the window
+    memset(mem, 0, sizeof(mem));
+    memset(used, 0, sizeof(used));
+    mem[0x10] = 0x76;
+    used[0x10] = 1;
+    memcpy(&mem[IMG_MEMORY_SIZE + IMG_BANK_SIZE], "\x0a\x0b", 2);
+    memset(&used[IMG_MEMORY_SIZE + IMG_BANK_SIZE], 1, 2);
+
+    ASSERT(img_encode_banked(mem, used, 3, 0x10, NULL, 0, &data, &size),
+           "Encoding banked container failed!");
+    ASSERT(img_open_memory(data, size, "memory", &img),
+           "Opening banked container failed!");
+    ASSERT(img.segment_count == 2, "Wrong segment count!");
+    ASSERT(img_bank_count(&img) == 3, "Wrong bank count!");
+
+    memset(mem, 0, IMG_MEMORY_SIZE);
+    ASSERT(img_load(&img, mem, 0) == 1, "Banked segment loaded to bank 0!");
+    ASSERT(mem[0x10] == 0x76 && mem[IMG_BANK_BASE] == 0, "Bank 0 wrong!");
+    memset(window, 0, sizeof(window));
+    ASSERT(img_load_bank(&img, window, 1) == 0, "Bank 1 not empty!");
+    ASSERT(img_load_bank(&img, window, 2) == 2, "Bank 2 not loaded!");
+    ASSERT(window[0] == 0x0a && window[1] == 0x0b, "Bank 2 wrong!");
+
+    img_used(&img, mem, 0);
+    ASSERT(mem[0x10] && !mem[IMG_BANK_BASE], "Banks marked used!");
+    img_close(&img);
+
+    // banked segments must lie inside the window
+    data[IMG_HEADER_SIZE + 5] = IMG_BANK_BASE - 1;
+    crc = img_crc32(0, data + IMG_HEADER_SIZE, size - IMG_HEADER_SIZE);
+    for (i = 0; i < 4; ++i) {
+        data[12 + i] = crc >> (8 * i);
+    }
+    ASSERT(!img_open_memory(data, size, "memory", &img),
+           "Banked segment outside the window accepted!");
+    free(data);
+
+    return TEST_OK;
+}
+
+/* ------------------------------------------------------------------------ */
+
+char *run_tests(void)
+{
+    close(mkstemp(_path));
+
+    RUN_TEST(test_img_roundtrip);
+    RUN_TEST(test_img_raw);
+    RUN_TEST(test_img_corrupt);
+    RUN_TEST(test_img_memory);
+    RUN_TEST(test_img_stream);
+    RUN_TEST(test_img_banks);
+
+    unlink(_path);
+
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    return ut_main(argc, argv, run_tests);
+}
@@ -0,0 +1,183 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "unittest.h"
+#include "globals.h"
+#include "instructionset.h"
+
+unsigned int tests_run = 0;
+
+typedef struct _def {
+    const char *mnemonic;
+    argtype at1;
+    argtype at2;
+    uint8_t opcode;
+    uint8_t cycles;
+    uint8_t reads;
+    uint8_t writes;
+    uint8_t flow;
+} def;
+
+/* the definitions the tables were generated from */
+static const def defs[] = {
+#define INS(m, a1, a2, op, cy, rd, wr, fl) \
+    { m, a1, a2, op, cy, rd, wr, IS_FLOW_##fl },
+#include "instructionset.def"
+#undef INS
+};
+
+#define DEF_COUNT (sizeof(defs) / sizeof(def))
+
+/* ------------------------------------------------------------------------
+ *                          test instruction set
+ * ------------------------------------------------------------------------ */
+
+TEST(test_is_opcode_table)
+{
+    const vns_instruction *ins;
+    unsigned int i, legal = 0;
+
+    for (i = 0; i < DEF_COUNT; ++i) {
+        ins = is_find_opcode(defs[i].opcode);
+        ASSERT(NULL != ins, "Defined opcode not found!");
+        ASSERT(0 == strcmp(ins->mnemonic, defs[i].mnemonic), "Wrong mnemonic!");
+        ASSERT(ins->at1 == defs[i].at1 && ins->at2 == defs[i].at2,
+               "Wrong argument types!");
+        ASSERT(ins->cycles == defs[i].cycles, "Wrong cycle count!");
+        ASSERT(ins->flags_read == defs[i].reads &&
+               ins->flags_written == defs[i].writes, "Wrong flags!");
+        ASSERT(ins->flow == defs[i].flow, "Wrong flow class!");
+    }
+
+    for (i = 0; i < 256; ++i) {
+        legal += (NULL != is_find_opcode(i));
+    }
+    ASSERT(legal == DEF_COUNT, "Undefined opcodes decode!");
+    ASSERT(NULL == is_find_opcode(0xff), "Illegal opcode decodes!");
+
+    return TEST_OK;
+}
+
+TEST(test_is_length)
+{
+    ASSERT(1 == is_instruction_length(is_find_opcode(0x76)), "HLT length!");
+    ASSERT(2 == is_instruction_length(is_find_opcode(0x3e)), "MVI length!");
+    ASSERT(2 == is_instruction_length(is_find_opcode(0xc3)), "JMP length!");
+    ASSERT(2 == is_instruction_length(is_find_opcode(0x31)), "LXI length!");
+    ASSERT(1 == is_instruction_length(is_find_opcode(0x77)), "MOV length!");
+
+    return TEST_OK;
+}
+
+TEST(test_is_mnemonic_names)
+{
+    unsigned int i;
+
+    for (i = 0; i < DEF_COUNT; ++i) {
+        ASSERT(is_lookup_mnemonic_name(defs[i].mnemonic), "Mnemonic missing!");
+    }
+
+    ASSERT(is_lookup_mnemonic_name("mov"), "Lookup is case sensitive!");
+    ASSERT(is_lookup_mnemonic_name("CnC"), "Lookup is case sensitive!");
+    ASSERT(!is_lookup_mnemonic_name(""), "Empty name found!");
+    ASSERT(!is_lookup_mnemonic_name("a"), "Register found!");
+    ASSERT(!is_lookup_mnemonic_name("MOVE"), "Unknown name found!");
+    ASSERT(!is_lookup_mnemonic_name("loop_1"), "Label found!");
+    ASSERT(!is_lookup_mnemonic_name("CALLS"), "Prefix match!");
+
+    return TEST_OK;
+}
+
+TEST(test_is_find_mnemonic)
+{
+    const vns_instruction *ins;
+    unsigned int i;
+
+    for (i = 0; i < DEF_COUNT; ++i) {
+        ins = is_find_mnemonic(defs[i].mnemonic, defs[i].at1, defs[i].at2);
+        ASSERT(NULL != ins && ins->opcode == defs[i].opcode,
+               "Instruction not found by mnemonic!");
+    }
+
+    /* labels match address operands */
+    ins = is_find_mnemonic("jmp", AT_LABEL, AT_NONE);
+    ASSERT(NULL != ins && 0xc3 == ins->opcode, "Label operand not matched!");
+
+    ASSERT(NULL == is_find_mnemonic("MOV", AT_MEM, AT_MEM), "MOV M, M!");
+    ASSERT(NULL == is_find_mnemonic("RET", AT_INT, AT_NONE), "RET n!");
+    ASSERT(NULL == is_find_mnemonic("FOO", AT_NONE, AT_NONE), "FOO!");
+
+    return TEST_OK;
+}
+
+#define LOOKUP_THREADS  4
+#define LOOKUPS         1000000
+
+static void *_lookup(void *arg)
+{
+    unsigned int i;
+
+    for (i = 0; i < LOOKUPS; ++i) {
+        is_find_opcode(i);
+    }
+
+    return NULL;
+}
+
+TEST(test_is_lookup_count)
+{
+    pthread_t threads[LOOKUP_THREADS];
+    unsigned long start = is_lookup_count();
+    int i;
+
+    for (i = 0; i < LOOKUP_THREADS; ++i) {
+        ASSERT(0 == pthread_create(&threads[i], NULL, _lookup, NULL),
+               "Thread not started!");
+    }
+    for (i = 0; i < LOOKUP_THREADS; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+
+    ASSERT(is_lookup_count() - start == LOOKUP_THREADS * LOOKUPS,
+           "Concurrent lookups lost!");
+
+    return TEST_OK;
+}
+
+/* ------------------------------------------------------------------------ */
+
+char *run_tests(void)
+{
+    RUN_TEST(test_is_opcode_table);
+    RUN_TEST(test_is_length);
+    RUN_TEST(test_is_mnemonic_names);
+    RUN_TEST(test_is_find_mnemonic);
+    RUN_TEST(test_is_lookup_count);
+
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    return ut_main(argc, argv, run_tests);
+}
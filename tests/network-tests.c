@@ -0,0 +1,300 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "unittest.h"
+#include "globals.h"
+#include "vnsem.h"
+#include "network.h"
+
+unsigned int tests_run = 0;
+
+// examples/pipeline-source.asm: sends n (read from port 0), ..., 1, 0
+static const uint8_t _source[] = {
+    0xdb, 0x00, 0xfe, 0x00, 0xca, 0x0b, 0xd3, 0x01, 0x3d, 0xc2, 0x06, 0xd3,
+    0x01, 0x76
+};
+
+// examples/pipeline-double.asm: doubles each value up to the closing 0
+static const uint8_t _double[] = {
+    0xdb, 0x00, 0x87, 0xd3, 0x01, 0xc2, 0x00, 0x76
+};
+
+// examples/pipeline-sum.asm: adds up the values at 0x80 until a 0
+static const uint8_t _sum[] = {
+    0x3e, 0x00, 0x32, 0x80, 0xdb, 0x00, 0xfe, 0x00, 0xca, 0x10, 0x2e, 0x80,
+    0x86, 0x77, 0xc3, 0x04, 0x3a, 0x80, 0xd3, 0x00, 0x76
+};
+
+// in 0, out 1, hlt
+static const uint8_t _forward[] = { 0xdb, 0x00, 0xd3, 0x01, 0x76 };
+
+// jmp 0
+static const uint8_t _loop[] = { 0xc3, 0x00 };
+
+static void _load(vnsem_machine *m, const uint8_t *code, size_t size)
+{
+    memset(m, 0, sizeof(*m));
+    memcpy(m->mem, code, size);
+}
+
+#define RING_VALUES 200000
+
+typedef struct _consumer {
+    net_system *net;
+    net_ring *ring;
+    int in_order;
+} consumer;
+
+static void *_consume(void *arg)
+{
+    consumer *c = (consumer*)arg;
+    uint8_t value;
+    int i;
+
+    c->in_order = TRUE;
+    for (i = 0; i < RING_VALUES; ++i) {
+        if (!ring_pop(c->net, c->ring, &value) || value != (uint8_t)i) {
+            c->in_order = FALSE;
+        }
+    }
+
+    return NULL;
+}
+
+/* ------------------------------------------------------------------------
+ *                              test network
+ * ------------------------------------------------------------------------ */
+
+TEST(test_net_ring)
+{
+    static net_system net;
+    pthread_t thread;
+    consumer c;
+    net_ring *r;
+    uint8_t value;
+    int i;
+
+    net_init(&net);
+    ASSERT(net_add_link(&net, 0, 1, 1, 0, 3), "Link not added!");
+    ASSERT(!net_add_link(&net, 0, 1, 1, 2, 3), "Output linked twice!");
+    ASSERT(!net_add_link(&net, 1, 1, 1, 0, 3), "Input linked twice!");
+    ASSERT(!net_add_link(&net, 1, 1, 0, 0, 0), "Empty link added!");
+
+    r = &net.links[0].ring;
+    ASSERT(r->mask == 3, "Capacity not rounded to a power of two!");
+
+    /* a tiny ring makes both sides park over and over */
+    atomic_store(&net.active, 2);
+    c.net = &net;
+    c.ring = r;
+    ASSERT(0 == pthread_create(&thread, NULL, _consume, &c),
+           "Could not start consumer!");
+    for (i = 0; i < RING_VALUES; ++i) {
+        ring_push(&net, r, i);
+    }
+    pthread_join(thread, NULL);
+
+    ASSERT(c.in_order, "Values lost or reordered!");
+    ASSERT(atomic_load(&r->tail) == RING_VALUES, "Values not counted!");
+    ASSERT(r->fill_max <= 4, "Ring overfilled!");
+    ASSERT(!atomic_load(&net.deadlock), "Deadlock reported!");
+
+    /* once the producer is done an empty ring ends the input */
+    atomic_store(&r->producer_done, TRUE);
+    ASSERT(!ring_pop(&net, r, &value), "Value read from empty ring!");
+
+    atomic_store(&r->consumer_done, TRUE);
+    ASSERT(!ring_push(&net, r, 1), "Value written to stopped consumer!");
+
+    net_release(&net);
+
+    return TEST_OK;
+}
+
+TEST(test_net_pipeline)
+{
+    static net_system net;
+    static dt_inputs inputs;
+    vnsem_machine m;
+    int runs, source, dbl, sum;
+
+    inputs.values[0] = 100;
+    inputs.count = 1;
+
+    for (runs = 0; runs < 20; ++runs) {
+        net_init(&net);
+        net.quiet = TRUE;
+        net.inputs = &inputs;
+
+        _load(&m, _source, sizeof(_source));
+        source = net_add_machine(&net, "source", &m);
+        _load(&m, _double, sizeof(_double));
+        dbl = net_add_machine(&net, "double", &m);
+        _load(&m, _sum, sizeof(_sum));
+        sum = net_add_machine(&net, "sum", &m);
+        ASSERT(0 == source && 1 == dbl && 2 == sum, "Machines not added!");
+        if (0 == runs) {
+            ASSERT(-1 == net_add_machine(&net, "sum", &m),
+                   "Name used twice!");
+        }
+
+        ASSERT(net_add_link(&net, source, 1, dbl, 0, 1 + runs % 4) &&
+               net_add_link(&net, dbl, 1, sum, 0, 64), "Links not added!");
+
+        ASSERT(net_run(&net), "Pipeline did not halt!");
+        // 2 * (1 + ... + 100) = 10100, modulo 256
+        ASSERT(net.machines[sum].m.mem[0x80] == 116, "Wrong total!");
+        ASSERT(atomic_load(&net.links[0].ring.tail) == 101 &&
+               atomic_load(&net.links[1].ring.tail) == 101,
+               "Values lost on the links!");
+        ASSERT(net.machines[source].state == NET_HALTED &&
+               net.machines[dbl].state == NET_HALTED &&
+               net.machines[sum].state == NET_HALTED, "Machine not halted!");
+
+        net_release(&net);
+    }
+
+    return TEST_OK;
+}
+
+TEST(test_net_stops)
+{
+    static net_system net;
+    vnsem_machine m;
+    int runs;
+
+    /* each machine waits for the other one first */
+    for (runs = 0; runs < 20; ++runs) {
+        net_init(&net);
+        net.quiet = TRUE;
+        _load(&m, _forward, sizeof(_forward));
+        net_add_machine(&net, "a", &m);
+        net_add_machine(&net, "b", &m);
+        net_add_link(&net, 0, 1, 1, 0, 1);
+        net_add_link(&net, 1, 1, 0, 0, 1);
+
+        ASSERT(!net_run(&net), "Deadlock not detected!");
+        ASSERT(net.machines[0].state == NET_DEADLOCK &&
+               net.machines[1].state == NET_DEADLOCK, "Wrong state!");
+        net_release(&net);
+    }
+
+    /* a consumer reading past the end of a halted producer */
+    net_init(&net);
+    net.quiet = TRUE;
+    _load(&m, _forward, sizeof(_forward));
+    net_add_machine(&net, "a", &m);
+    _load(&m, _double, sizeof(_double));
+    net_add_machine(&net, "b", &m);
+    net_add_link(&net, 0, 1, 1, 0, 8);
+
+    ASSERT(!net_run(&net), "Missing input not reported!");
+    ASSERT(net.machines[0].state == NET_NO_INPUT, "Input not missing!");
+    ASSERT(net.machines[1].state == NET_END, "End of input not seen!");
+    net_release(&net);
+
+    /* the step limit applies to each machine */
+    net_init(&net);
+    net.quiet = TRUE;
+    net.max_steps = 10;
+    _load(&m, _loop, sizeof(_loop));
+    net_add_machine(&net, "a", &m);
+    ASSERT(!net_run(&net), "Step limit not reported!");
+    ASSERT(net.machines[0].state == NET_STEP_LIMIT &&
+           net.machines[0].steps == 10, "Step limit not kept!");
+    net_release(&net);
+
+    return TEST_OK;
+}
+
+TEST(test_net_load)
+{
+    static net_system net;
+    char dir[] = "/tmp/network-tests-XXXXXX", path[64], topo[64];
+    FILE *f;
+
+    ASSERT(NULL != mkdtemp(dir), "Could not create directory!");
+    snprintf(path, sizeof(path), "%s/forward.bin", dir);
+    f = fopen(path, "w");
+    fwrite(_forward, sizeof(_forward), 1, f);
+    fclose(f);
+
+    snprintf(topo, sizeof(topo), "%s/ok.net", dir);
+    f = fopen(topo, "w");
+    fprintf(f, "# comment\n\nmachine a forward.bin\n"
+               "machine b  forward.bin # two\n"
+               "link a:1 -> b:0x10 7\nlink b:1 -> a:0\n");
+    fclose(f);
+
+    net_init(&net);
+    ASSERT(net_load(&net, topo), "Topology not loaded!");
+    ASSERT(net.count == 2 && net.link_count == 2, "Wrong topology!");
+    ASSERT(net.machines[1].m.mem[2] == 0xd3, "Program not loaded!");
+    ASSERT(net.links[0].to_port == 0x10 && net.links[0].ring.mask == 7,
+           "Wrong link!");
+    ASSERT(net.machines[1].in[0x10] == &net.links[0], "Port not linked!");
+    net_release(&net);
+    unlink(topo);
+
+    snprintf(topo, sizeof(topo), "%s/bad.net", dir);
+    f = fopen(topo, "w");
+    fprintf(f, "machine a forward.bin\nlink a:1 -> c:0\n");
+    fclose(f);
+
+    net_init(&net);
+    ASSERT(!net_load(&net, topo), "Unknown machine accepted!");
+    net_release(&net);
+
+    f = fopen(topo, "w");
+    fprintf(f, "machine a forward.bin\nlink a:1 a:0\n");
+    fclose(f);
+
+    net_init(&net);
+    ASSERT(!net_load(&net, topo), "Link without arrow accepted!");
+    net_release(&net);
+
+    unlink(topo);
+    unlink(path);
+    rmdir(dir);
+
+    return TEST_OK;
+}
+
+/* ------------------------------------------------------------------------ */
+
+char *run_tests(void)
+{
+    RUN_TEST(test_net_ring);
+    RUN_TEST(test_net_pipeline);
+    RUN_TEST(test_net_stops);
+    RUN_TEST(test_net_load);
+
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    return ut_main(argc, argv, run_tests);
+}
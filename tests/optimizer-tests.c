@@ -0,0 +1,226 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "unittest.h"
+#include "globals.h"
+#include "vnsasm.h"
+
+unsigned int tests_run = 0;
+
+static vnsasm_configuration config;
+static vnsasm_context ctx;
+
+/* ------------------------------------------------------------------------
+ *                            helpers
+ * ------------------------------------------------------------------------ */
+
+static void start(void)
+{
+    config.optimize = TRUE;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.config = &config;
+    ctx.infile_name = "test.asm";
+    ctx.out = fopen("/dev/null", "w");
+    ctx.err = ctx.out;
+    asm_init(&ctx);
+}
+
+static void finish(void)
+{
+    asm_release(&ctx);
+    fclose(ctx.out);
+}
+
+static void ins(const char *mnemonic, argtype at1, argtype at2,
+                uint8_t i, const char *label)
+{
+    const char *s = NULL != label ? asm_intern(&ctx, label) : NULL;
+
+    prc_ins(&ctx, mnemonic, at1, at2, i, s, 1);
+}
+
+static void label(const char *name)
+{
+    prc_label_decl(&ctx, asm_intern(&ctx, name));
+}
+
+static int program_is(const uint8_t *expected, unsigned int size)
+{
+    unsigned int i;
+
+    for (i = 0; i < size; i++) {
+        if (ctx.program.data[i] != expected[i] || !ctx.program.used[i]) {
+            return FALSE;
+        }
+    }
+    return !ctx.program.used[size];
+}
+
+/* ------------------------------------------------------------------------
+ *                            test optimizer
+ * ------------------------------------------------------------------------ */
+
+TEST(test_opt_stores)
+{
+    /* MVI A,5 is dead, flags are rewritten by IN before anybody reads
+     * them, the second MVI L is redundant */
+    const uint8_t expected[] = {0xaf, 0x2e, 0x80, 0x77, 0xdb, 0x00,
+                                0x86, 0x76};
+
+    start();
+    ins("MVI", AT_REG_A, AT_INT, 5, NULL);
+    ins("MVI", AT_REG_A, AT_INT, 0, NULL);
+    ins("MVI", AT_REG_L, AT_INT, 0x80, NULL);
+    ins("MOV", AT_MEM, AT_REG_A, 0, NULL);
+    ins("IN", AT_INT, AT_NONE, 0, NULL);
+    ins("MVI", AT_REG_L, AT_INT, 0x80, NULL);
+    ins("ADD", AT_MEM, AT_NONE, 0, NULL);
+    ins("HLT", AT_NONE, AT_NONE, 0, NULL);
+
+    ASSERT(asm_optimize(&ctx), "Optimizing failed!");
+    ASSERT(program_is(expected, sizeof(expected)), "Wrong rewrites!");
+    finish();
+
+    return TEST_OK;
+}
+
+TEST(test_opt_flags)
+{
+    /* the flags of XRA A would reach JZ, a label ends the block */
+    const uint8_t expected[] = {0x3e, 0x00, 0xca, 0x06, 0xd3, 0x00,
+                                0x3e, 0x00, 0x76};
+
+    start();
+    ins("MVI", AT_REG_A, AT_INT, 0, NULL);
+    ins("JZ", AT_LABEL, AT_NONE, 0, "skip");
+    ins("OUT", AT_INT, AT_NONE, 0, NULL);
+    label("skip");
+    ins("MVI", AT_REG_A, AT_INT, 0, NULL);
+    ins("HLT", AT_NONE, AT_NONE, 0, NULL);
+
+    ASSERT(asm_optimize(&ctx), "Optimizing failed!");
+    ASSERT(program_is(expected, sizeof(expected)), "Unsafe rewrite!");
+    finish();
+
+    return TEST_OK;
+}
+
+TEST(test_opt_flow)
+{
+    /* CALL f; RET becomes JMP f, which is dropped as f follows; the
+     * jump chain is threaded and every JMP to RET becomes RET */
+    const uint8_t expected[] = {0xcd, 0x04, 0x76, 0xc9, 0xd3, 0x00,
+                                0xc9, 0xc9, 0xc9, 0xc9};
+    vnsasm_label *l;
+
+    start();
+    ins("CALL", AT_LABEL, AT_NONE, 0, "main");
+    ins("HLT", AT_NONE, AT_NONE, 0, NULL);
+    ins("RET", AT_NONE, AT_NONE, 0, NULL);
+    label("main");
+    ins("CALL", AT_LABEL, AT_NONE, 0, "f");
+    ins("RET", AT_NONE, AT_NONE, 0, NULL);
+    label("f");
+    ins("OUT", AT_INT, AT_NONE, 0, NULL);
+    ins("JMP", AT_LABEL, AT_NONE, 0, "j1");
+    label("j1");
+    ins("JMP", AT_LABEL, AT_NONE, 0, "j2");
+    label("j2");
+    ins("RET", AT_NONE, AT_NONE, 0, NULL);
+    label("j3");
+    ins("JMP", AT_LABEL, AT_NONE, 0, "j1");
+
+    ASSERT(asm_optimize(&ctx), "Optimizing failed!");
+    ASSERT(program_is(expected, sizeof(expected)), "Wrong rewrites!");
+    l = sym_find(&ctx.program.symbols, "j3");
+    ASSERT(NULL != l && 0x09 == l->addr, "Label not moved!");
+    finish();
+
+    return TEST_OK;
+}
+
+TEST(test_opt_locked)
+{
+    /* LDA 0x01 reads code, nothing may move */
+    const uint8_t expected[] = {0x3e, 0x05, 0x3e, 0x00, 0x3a, 0x01,
+                                0x76};
+
+    start();
+    ins("MVI", AT_REG_A, AT_INT, 5, NULL);
+    ins("MVI", AT_REG_A, AT_INT, 0, NULL);
+    ins("LDA", AT_INT, AT_NONE, 1, NULL);
+    ins("HLT", AT_NONE, AT_NONE, 0, NULL);
+
+    ASSERT(asm_optimize(&ctx), "Optimizing failed!");
+    ASSERT(program_is(expected, sizeof(expected)), "Locked code moved!");
+    finish();
+
+    return TEST_OK;
+}
+
+TEST(test_asm_banks)
+{
+    /* bank 1 jumps to a label declared later in bank 0 */
+    unsigned int bank1 = MEMORY_UNIT_SIZE;
+
+    start();
+    ins("HLT", AT_NONE, AT_NONE, 0, NULL);
+    prc_bank(&ctx, 1);
+    prc_offset(&ctx, 0x80);
+    ins("JMP", AT_LABEL, AT_NONE, 0, "back");
+    prc_bank(&ctx, 0);
+    prc_offset(&ctx, 0x80);
+    label("back");
+    ins("NOP", AT_NONE, AT_NONE, 0, NULL);
+
+    ASSERT(ctx.program.bank_count == 2, "Wrong bank count!");
+    ASSERT(ctx.program.data[0x80] == 0x00 && ctx.program.used[0x80],
+           "Bank 0 window wrong!");
+    ASSERT(ctx.program.data[bank1] == 0xc3 && ctx.program.used[bank1 + 1],
+           "Bank 1 wrong!");
+    ASSERT(ctx.program.data[bank1 + 1] == 0x80, "Label not backpatched!");
+    ASSERT(!ctx.program.used[0x81] && !ctx.program.used[bank1 + 2],
+           "Bytes leaked between banks!");
+    finish();
+
+    return TEST_OK;
+}
+
+/* ------------------------------------------------------------------------ */
+
+char *run_tests(void)
+{
+    RUN_TEST(test_opt_stores);
+    RUN_TEST(test_opt_flags);
+    RUN_TEST(test_opt_flow);
+    RUN_TEST(test_opt_locked);
+    RUN_TEST(test_asm_banks);
+
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    return ut_main(argc, argv, run_tests);
+}
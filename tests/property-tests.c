@@ -0,0 +1,697 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+#include "unittest.h"
+#include "proptest.h"
+#include "globals.h"
+#include "instructionset.h"
+#include "disasm.h"
+#include "vnsem.h"
+
+unsigned int tests_run = 0;
+
+/* ------------------------------------------------------------------------
+ *                            reference model
+ * ------------------------------------------------------------------------
+ *
+ * A second implementation of the machine, written from the instruction
+ * table instead of the opcode switch of vnsem.c. Each mnemonic is one
+ * generic operation on operand places; the flags an instruction may
+ * change are taken from the table, their values from plain arithmetic
+ * (carry is an unsigned overflow or borrow).
+ */
+
+/* operand places */
+#define P_NONE      0
+#define P_A         1
+#define P_L         2
+#define P_SP        3
+#define P_FL        4
+#define P_M         5   // memory at L
+#define P_IMM       6   // the operand byte
+#define P_DIRECT    7   // memory at the operand byte
+
+/* generic operations */
+#define R_ILLEGAL   0
+#define R_NOP       1
+#define R_HALT      2
+#define R_EI        3
+#define R_DI        4
+#define R_MOVE      5
+#define R_PUSH      6
+#define R_POP       7
+#define R_IN        8
+#define R_OUT       9
+#define R_ADD       10
+#define R_SUB       11
+#define R_CMP       12
+#define R_AND       13
+#define R_OR        14
+#define R_XOR       15
+#define R_INC       16
+#define R_DEC       17
+#define R_JUMP      18
+#define R_CALL      19
+#define R_RET       20
+
+typedef struct _ref_mnemonic {
+    const char *name;
+    uint8_t op;
+    uint8_t cond;               // flag tested by conditional branches
+    uint8_t when;               // required state of that flag
+} ref_mnemonic;
+
+static const ref_mnemonic ref_mnemonics[] = {
+    { "NOP", R_NOP, 0, 0 },     { "HLT", R_HALT, 0, 0 },
+    { "EI", R_EI, 0, 0 },       { "DI", R_DI, 0, 0 },
+    { "MOV", R_MOVE, 0, 0 },    { "MVI", R_MOVE, 0, 0 },
+    { "LDA", R_MOVE, 0, 0 },    { "STA", R_MOVE, 0, 0 },
+    { "LXI", R_MOVE, 0, 0 },    { "PUSH", R_PUSH, 0, 0 },
+    { "POP", R_POP, 0, 0 },     { "IN", R_IN, 0, 0 },
+    { "OUT", R_OUT, 0, 0 },     { "ADD", R_ADD, 0, 0 },
+    { "ADI", R_ADD, 0, 0 },     { "SUB", R_SUB, 0, 0 },
+    { "SUI", R_SUB, 0, 0 },     { "CMP", R_CMP, 0, 0 },
+    { "CPI", R_CMP, 0, 0 },     { "ANA", R_AND, 0, 0 },
+    { "ANI", R_AND, 0, 0 },     { "ORA", R_OR, 0, 0 },
+    { "ORI", R_OR, 0, 0 },      { "XRA", R_XOR, 0, 0 },
+    { "XRI", R_XOR, 0, 0 },     { "INR", R_INC, 0, 0 },
+    { "DCR", R_DEC, 0, 0 },     { "JMP", R_JUMP, 0, 0 },
+    { "JZ", R_JUMP, IS_F_Z, 1 },  { "JNZ", R_JUMP, IS_F_Z, 0 },
+    { "JC", R_JUMP, IS_F_C, 1 },  { "JNC", R_JUMP, IS_F_C, 0 },
+    { "CALL", R_CALL, 0, 0 },
+    { "CZ", R_CALL, IS_F_Z, 1 },  { "CNZ", R_CALL, IS_F_Z, 0 },
+    { "CC", R_CALL, IS_F_C, 1 },  { "CNC", R_CALL, IS_F_C, 0 },
+    { "RET", R_RET, 0, 0 },
+};
+
+/* one opcode, decoded */
+typedef struct _ref_op {
+    uint8_t op;
+    uint8_t dst;
+    uint8_t src;
+    uint8_t cond;
+    uint8_t when;
+    uint8_t length;
+    uint8_t written;
+} ref_op;
+
+typedef struct _ref_machine {
+    uint8_t mem[256];
+    uint8_t pc, a, l, sp, fl;
+    uint8_t halted, ie;
+} ref_machine;
+
+static ref_op ref_ops[256];
+
+/* legal opcodes, the instructions of generated streams */
+static uint8_t legal[256];
+static unsigned int legal_count;
+
+/* deliberately wrong compare, to check that failures are found */
+static int ref_mutant = FALSE;
+
+static uint8_t ref_place(argtype at)
+{
+    switch (at) {
+        case AT_REG_A:  return P_A;
+        case AT_REG_L:  return P_L;
+        case AT_REG_SP: return P_SP;
+        case AT_REG_FL: return P_FL;
+        case AT_MEM:    return P_M;
+        case AT_INT:
+        case AT_ADDR:   return P_IMM;
+    }
+    return P_NONE;
+}
+
+static void ref_init(void)
+{
+    const vns_instruction *ins;
+    const ref_mnemonic *mn;
+    unsigned int i, j;
+    ref_op *op;
+
+    memset(ref_ops, 0, sizeof(ref_ops));
+    legal_count = 0;
+
+    for (i = 0; i < 256; i++) {
+        if (NULL == (ins = is_find_opcode(i))) {
+            continue;
+        }
+        for (j = 0, mn = NULL; j < sizeof(ref_mnemonics) /
+                                   sizeof(*ref_mnemonics); j++) {
+            if (0 == strcmp(ref_mnemonics[j].name, ins->mnemonic)) {
+                mn = &ref_mnemonics[j];
+            }
+        }
+        if (NULL == mn) {
+            continue;
+        }
+
+        op = &ref_ops[i];
+        op->op = mn->op;
+        op->cond = mn->cond;
+        op->when = mn->when;
+        op->length = ins->length;
+        op->written = ins->flags_written;
+
+        switch (mn->op) {
+            case R_MOVE:
+                op->dst = ref_place(ins->at1);
+                op->src = ref_place(ins->at2);
+                if (0 == strcmp(mn->name, "LDA")) {
+                    op->dst = P_A;
+                    op->src = P_DIRECT;
+                } else if (0 == strcmp(mn->name, "STA")) {
+                    op->dst = P_DIRECT;
+                    op->src = P_A;
+                }
+                break;
+            case R_ADD: case R_SUB: case R_CMP:
+            case R_AND: case R_OR: case R_XOR:
+                op->dst = P_A;
+                op->src = ref_place(ins->at1);
+                break;
+            case R_POP: case R_INC: case R_DEC:
+                op->dst = ref_place(ins->at1);
+                break;
+            default:
+                op->src = ref_place(ins->at1);
+                break;
+        }
+
+        legal[legal_count++] = i;
+    }
+}
+
+static uint8_t ref_get(ref_machine *r, uint8_t place, uint8_t arg)
+{
+    switch (place) {
+        case P_A:       return r->a;
+        case P_L:       return r->l;
+        case P_SP:      return r->sp;
+        case P_FL:      return r->fl;
+        case P_M:       return r->mem[r->l];
+        case P_IMM:     return arg;
+        case P_DIRECT:  return r->mem[arg];
+    }
+    return 0;
+}
+
+static void ref_set(ref_machine *r, uint8_t place, uint8_t arg, uint8_t v)
+{
+    switch (place) {
+        case P_A:       r->a = v;           break;
+        case P_L:       r->l = v;           break;
+        case P_SP:      r->sp = v;          break;
+        case P_FL:      r->fl = v;          break;
+        case P_M:       r->mem[r->l] = v;   break;
+        case P_DIRECT:  r->mem[arg] = v;    break;
+    }
+}
+
+/**
+ * Set the flags the instruction writes from a result and its carry.
+ */
+static void ref_flags(ref_machine *r, const ref_op *op, unsigned int value,
+                      int carry)
+{
+    uint8_t f = 0;
+
+    if (0 == (value & 0xff)) {
+        f |= IS_F_Z;
+    }
+    if (value & 0x80) {
+        f |= IS_F_S;
+    }
+    if (carry) {
+        f |= IS_F_C;
+    }
+
+    r->fl = (r->fl & ~op->written) | (f & op->written);
+}
+
+/* I/O of one case */
+typedef struct _pt_io {
+    const uint8_t *inputs;
+    unsigned int input_count;
+    unsigned int in;
+    unsigned int out;
+    uint8_t outputs[32];
+} pt_io;
+
+static int pt_input(uint8_t port, uint8_t *value, void *ctx)
+{
+    pt_io *io = (pt_io*)ctx;
+
+    if (io->in == io->input_count) {
+        return FALSE;
+    }
+    *value = io->inputs[io->in++];
+    return TRUE;
+}
+
+static void pt_output(uint8_t port, uint8_t value, void *ctx)
+{
+    pt_io *io = (pt_io*)ctx;
+
+    if (io->out + 2 <= sizeof(io->outputs)) {
+        io->outputs[io->out++] = port;
+        io->outputs[io->out++] = value;
+    }
+}
+
+/**
+ * Execute one instruction, returns 0 or one of the ERR_* codes.
+ */
+static int ref_step(ref_machine *r, pt_io *io)
+{
+    const ref_op *op = &ref_ops[r->mem[r->pc]];
+    uint8_t arg = r->mem[(uint8_t)(r->pc + 1)];
+    unsigned int a = r->a, b, v;
+
+    if (R_ILLEGAL == op->op) {
+        r->pc++;
+        return ERR_ILLEGAL_INSTRUCTION;
+    }
+
+    r->pc += op->length;
+    b = ref_get(r, op->src, arg);
+
+    switch (op->op) {
+        case R_HALT:  r->halted = TRUE;                             break;
+        case R_EI:    r->ie = TRUE;                                 break;
+        case R_DI:    r->ie = FALSE;                                break;
+        case R_MOVE:  ref_set(r, op->dst, arg, b);                  break;
+        case R_PUSH:  r->mem[--r->sp] = b;                          break;
+        case R_POP:   ref_set(r, op->dst, arg, r->mem[r->sp++]);    break;
+        case R_OUT:   pt_output(b, r->a, io);                       break;
+        case R_IN:
+            if (!pt_input(b, &r->a, io)) {
+                return ERR_NO_INPUT;
+            }
+            ref_flags(r, op, r->a, FALSE);
+            break;
+        case R_ADD:
+            r->a = a + b;
+            ref_flags(r, op, a + b, a + b > 0xff);
+            break;
+        case R_SUB:
+            r->a = a - b;
+            ref_flags(r, op, a - b, a < b);
+            break;
+        case R_CMP:
+            ref_flags(r, op, a - b, ref_mutant ? a <= b : a < b);
+            break;
+        case R_AND:   r->a = a & b; ref_flags(r, op, r->a, FALSE);  break;
+        case R_OR:    r->a = a | b; ref_flags(r, op, r->a, FALSE);  break;
+        case R_XOR:   r->a = a ^ b; ref_flags(r, op, r->a, FALSE);  break;
+        case R_INC:
+            v = ref_get(r, op->dst, arg);
+            ref_set(r, op->dst, arg, v + 1);
+            ref_flags(r, op, v + 1, v == 0xff);
+            break;
+        case R_DEC:
+            v = ref_get(r, op->dst, arg);
+            ref_set(r, op->dst, arg, v - 1);
+            ref_flags(r, op, v - 1, v == 0);
+            break;
+        case R_JUMP:
+            if (!op->cond || !(r->fl & op->cond) == !op->when) {
+                r->pc = b;
+            }
+            break;
+        case R_CALL:
+            if (!op->cond || !(r->fl & op->cond) == !op->when) {
+                r->mem[--r->sp] = r->pc;
+                r->pc = b;
+            }
+            break;
+        case R_RET:   r->pc = r->mem[r->sp++];                      break;
+    }
+
+    return 0;
+}
+
+/* ------------------------------------------------------------------------
+ *                            the property
+ * ------------------------------------------------------------------------ */
+
+#define PT_MAX_STEPS    8
+#define PT_MAX_INPUTS   4
+
+/**
+ * A random machine state with a random instruction stream at the
+ * program counter. The rest of memory is random too, so jumps and
+ * returns may land on anything.
+ */
+typedef struct _pt_case {
+    uint8_t mem[256];
+    uint8_t pc, accu, reg_l, sp, flags, int_active;
+    uint8_t steps;
+    uint8_t input_count;
+    uint8_t inputs[PT_MAX_INPUTS];
+} pt_case;
+
+/* machine state after running a case */
+typedef struct _pt_outcome {
+    uint8_t mem[256];
+    uint8_t pc, accu, reg_l, sp, flags, int_active, halted;
+    uint8_t steps;
+    int error;
+    pt_io io;
+} pt_outcome;
+
+static void run_emulator(const pt_case *c, pt_outcome *out)
+{
+    vnsem_io hooks = { pt_input, pt_output, &out->io };
+    vnsem_machine m;
+    unsigned int i;
+
+    memset(&m, 0, sizeof(m));
+    memcpy(m.mem, c->mem, sizeof(m.mem));
+    m.pc = c->pc;
+    m.accu = c->accu;
+    m.reg_l = c->reg_l;
+    m.sp = c->sp;
+    m.flags = c->flags;
+    m.int_active = c->int_active;
+    m.io = &hooks;
+
+    for (i = 0; i < c->steps && !m.halted && !out->error; i++) {
+        out->error = step_machine(&m);
+    }
+
+    memcpy(out->mem, m.mem, sizeof(out->mem));
+    out->pc = m.pc;
+    out->accu = m.accu;
+    out->reg_l = m.reg_l;
+    out->sp = m.sp;
+    out->flags = m.flags;
+    out->int_active = m.int_active;
+    out->halted = m.halted;
+    out->steps = m.step_count;
+}
+
+static void run_reference(const pt_case *c, pt_outcome *out)
+{
+    ref_machine r;
+    unsigned int i;
+
+    memcpy(r.mem, c->mem, sizeof(r.mem));
+    r.pc = c->pc;
+    r.a = c->accu;
+    r.l = c->reg_l;
+    r.sp = c->sp;
+    r.fl = c->flags;
+    r.ie = c->int_active;
+    r.halted = FALSE;
+
+    for (i = 0; i < c->steps && !r.halted && !out->error; i++) {
+        out->error = ref_step(&r, &out->io);
+    }
+
+    memcpy(out->mem, r.mem, sizeof(out->mem));
+    out->pc = r.pc;
+    out->accu = r.a;
+    out->reg_l = r.l;
+    out->sp = r.sp;
+    out->flags = r.fl;
+    out->int_active = r.ie;
+    out->halted = r.halted;
+    out->steps = i;
+}
+
+static void run_case(const pt_case *c, pt_outcome *out,
+                     void (*run)(const pt_case *c, pt_outcome *out))
+{
+    memset(out, 0, sizeof(*out));
+    out->io.inputs = c->inputs;
+    out->io.input_count = c->input_count;
+    run(c, out);
+}
+
+/* values at the edges of the ALU, picked more often than others */
+static const uint8_t pt_edges[] = { 0x00, 0x01, 0x7f, 0x80, 0xfe, 0xff };
+
+static uint8_t pt_byte(prop_rng *rng)
+{
+    uint64_t r = prop_next(rng);
+
+    if (0 == (r & 3)) {
+        return pt_edges[(r >> 8) % sizeof(pt_edges)];
+    }
+    return r >> 16;
+}
+
+static void pt_generate(prop_rng *rng, void *arg)
+{
+    pt_case *c = (pt_case*)arg;
+    uint64_t word;
+    unsigned int i, j;
+    uint8_t addr, op;
+
+    for (i = 0; i < sizeof(c->mem); i += 8) {
+        word = prop_next(rng);
+        memcpy(&c->mem[i], &word, 8);
+    }
+
+    c->pc = pt_byte(rng);
+    c->accu = pt_byte(rng);
+    c->reg_l = pt_byte(rng);
+    c->sp = pt_byte(rng);
+    c->flags = pt_byte(rng);
+    c->int_active = prop_below(rng, 2);
+    c->steps = 1 + prop_below(rng, PT_MAX_STEPS);
+    c->input_count = prop_below(rng, PT_MAX_INPUTS + 1);
+    for (i = 0; i < PT_MAX_INPUTS; i++) {
+        c->inputs[i] = i < c->input_count ? pt_byte(rng) : 0;
+    }
+
+    for (i = 0, addr = c->pc; i < c->steps; i++) {
+        op = legal[prop_below(rng, legal_count)];
+        c->mem[addr++] = op;
+        for (j = 1; j < ref_ops[op].length; j++) {
+            c->mem[addr++] = pt_byte(rng);
+        }
+    }
+}
+
+static int pt_holds(const void *arg)
+{
+    const pt_case *c = (const pt_case*)arg;
+    pt_outcome emu, ref;
+
+    run_case(c, &emu, run_emulator);
+    run_case(c, &ref, run_reference);
+
+    return 0 == memcmp(&emu, &ref, sizeof(emu));
+}
+
+/**
+ * Simpler variants of a case: fewer steps, starting one instruction
+ * later, fewer inputs, then every byte cleared and halved. A cleared
+ * memory cell is a NOP.
+ */
+static const size_t pt_fields[] = {
+    offsetof(pt_case, pc), offsetof(pt_case, accu), offsetof(pt_case, reg_l),
+    offsetof(pt_case, sp), offsetof(pt_case, flags),
+    offsetof(pt_case, int_active)
+};
+
+static int pt_shrink(const void *arg, unsigned int i, void *out)
+{
+    const pt_case *c = (const pt_case*)arg;
+    pt_case *s = (pt_case*)out;
+    uint8_t *field;
+
+    memcpy(s, c, sizeof(*s));
+
+    if (0 == i--) {
+        s->steps -= s->steps > 1;
+        return TRUE;
+    }
+    if (0 == i--) {
+        if (s->steps > 1) {
+            s->pc += NULL != is_find_opcode(s->mem[s->pc]) ?
+                     ref_ops[s->mem[s->pc]].length : 1;
+            s->steps--;
+        }
+        return TRUE;
+    }
+    if (0 == i--) {
+        s->input_count -= s->input_count > 0;
+        return TRUE;
+    }
+
+    /* every byte of the case but steps and input count */
+    if (i < 2 * 256) {
+        field = &s->mem[i / 2];
+    } else if ((i -= 2 * 256) < 2 * sizeof(pt_fields) / sizeof(*pt_fields)) {
+        field = (uint8_t*)s + pt_fields[i / 2];
+    } else if ((i -= 2 * sizeof(pt_fields) / sizeof(*pt_fields)) <
+               2 * PT_MAX_INPUTS) {
+        field = &s->inputs[i / 2];
+    } else {
+        return FALSE;
+    }
+
+    *field = (i & 1) ? *field >> 1 : 0;
+    return TRUE;
+}
+
+static const prop_spec pt_spec = {
+    sizeof(pt_case), pt_generate, pt_holds, pt_shrink
+};
+
+static void pt_print_outcome(const char *name, const pt_outcome *o)
+{
+    unsigned int i;
+
+    printf("  %-9s A=%.2X L=%.2X SP=%.2X FL=%.2X PC=%.2X IE=%u halted=%u "
+           "error=%i steps=%u inputs=%u\n", name, o->accu, o->reg_l, o->sp,
+           o->flags, o->pc, o->int_active, o->halted, o->error, o->steps,
+           o->io.in);
+    for (i = 0; i < o->io.out; i += 2) {
+        printf("            output [%.2X] %.2X\n", o->io.outputs[i],
+               o->io.outputs[i + 1]);
+    }
+}
+
+/**
+ * Print a counterexample: the start state, the instruction stream,
+ * all other non-zero memory and where the two models part.
+ */
+static void pt_print(const pt_case *c)
+{
+    pt_outcome emu, ref;
+    const vns_instruction *ins;
+    uint8_t stream[256] = { 0 };
+    uint8_t addr = c->pc;
+    unsigned int i, j;
+    char buf[32];
+
+    printf("  start     A=%.2X L=%.2X SP=%.2X FL=%.2X PC=%.2X IE=%u "
+           "steps=%u inputs=", c->accu, c->reg_l, c->sp, c->flags, c->pc,
+           c->int_active, c->steps);
+    for (i = 0; i < c->input_count; i++) {
+        printf("%s%.2X", i ? "," : "", c->inputs[i]);
+    }
+    printf("%s\n", c->input_count ? "" : "none");
+
+    for (i = 0; i < c->steps; i++) {
+        dis_format(c->mem, addr, NULL, buf, sizeof(buf));
+        printf("  %.2X: %s\n", addr, buf);
+        ins = is_find_opcode(c->mem[addr]);
+        for (j = 0; j < (NULL != ins ? ins->length : 1); j++) {
+            stream[addr++] = TRUE;
+        }
+    }
+    for (i = 0; i < 256; i++) {
+        if (!stream[i] && c->mem[i]) {
+            printf("  [%.2X] = %.2X\n", i, c->mem[i]);
+        }
+    }
+
+    run_case(c, &emu, run_emulator);
+    run_case(c, &ref, run_reference);
+    pt_print_outcome("emulator", &emu);
+    pt_print_outcome("reference", &ref);
+    for (i = 0; i < 256; i++) {
+        if (emu.mem[i] != ref.mem[i]) {
+            printf("  memory [%.2X] emulator %.2X, reference %.2X\n",
+                   i, emu.mem[i], ref.mem[i]);
+        }
+    }
+}
+
+/* ------------------------------------------------------------------------
+ *                            tests
+ * ------------------------------------------------------------------------ */
+
+TEST(test_prop_reference)
+{
+    prop_result result;
+    pt_case c;
+    int held;
+
+    ref_init();
+    ASSERT(legal_count > 50, "Instruction table not decoded!");
+
+    held = prop_check(&pt_spec, 0, 0x564e53, &c, &result);
+    if (!held) {
+        printf("\n  case %lu, shrunk %u times:\n", result.failed_case,
+               result.shrinks);
+        pt_print(&c);
+    }
+    printf("  %lu cases in %.2fs (%.0f per second)\n  ", result.cases,
+           result.elapsed, result.cases / (result.elapsed + 1e-9));
+    ASSERT(held, "Emulator disagrees with the reference model!");
+
+    return TEST_OK;
+}
+
+TEST(test_prop_shrink)
+{
+    const vns_instruction *ins;
+    prop_result result;
+    unsigned int i, cells = 0;
+    pt_case c;
+    int held;
+
+    ref_init();
+
+    // a reference with a wrong carry on equal compares must be caught
+    // and boiled down to a single compare
+    ref_mutant = TRUE;
+    held = prop_check(&pt_spec, 100000, 1, &c, &result);
+    ref_mutant = FALSE;
+
+    ASSERT(!held, "Broken reference model not detected!");
+    for (i = 0; i < 256; i++) {
+        cells += 0 != c.mem[i];
+    }
+    ins = is_find_opcode(c.mem[c.pc]);
+    ASSERT(1 == c.steps && 0 == c.input_count, "Case not shrunk!");
+    ASSERT(1 == cells && NULL != ins && (0 == strcmp(ins->mnemonic, "CMP") ||
+                                         0 == strcmp(ins->mnemonic, "CPI")),
+           "Case not shrunk to a single compare!");
+
+    return TEST_OK;
+}
+
+/* ------------------------------------------------------------------------ */
+
+char *run_tests(void)
+{
+    RUN_TEST(test_prop_reference);
+    RUN_TEST(test_prop_shrink);
+
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    return ut_main(argc, argv, run_tests);
+}
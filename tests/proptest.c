@@ -0,0 +1,183 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "globals.h"
+#include "proptest.h"
+
+#define PROP_DEFAULT_CASES  1000000
+#define PROP_BLOCK          4096    // cases a worker takes at once
+#define PROP_MAX_THREADS    64
+
+typedef struct _prop_run {
+    const prop_spec *spec;
+    uint64_t seed;
+    unsigned long cases;
+    unsigned long next;         // first case not handed out yet
+    unsigned long failed;       // lowest failing case, cases if none
+    pthread_mutex_t lock;
+} prop_run;
+
+/**
+ * Every case gets its own generator, derived from the seed and the
+ * case number with splitmix64, so any case can be regenerated alone.
+ */
+static void prop_seed(prop_rng *rng, uint64_t seed, unsigned long index)
+{
+    uint64_t z = seed + (index + 1) * 0x9e3779b97f4a7c15ull;
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    z ^= z >> 31;
+
+    rng->state = z ? z : 1;
+}
+
+static void *prop_worker(void *arg)
+{
+    prop_run *run = (prop_run*)arg;
+    const prop_spec *spec = run->spec;
+    unsigned long first, last, i;
+    prop_rng rng;
+    void *c;
+
+    if (NULL == (c = malloc(spec->size))) {
+        return NULL;
+    }
+
+    for (;;) {
+        pthread_mutex_lock(&run->lock);
+        first = run->next;
+        /* no need to go past a failure that is already known */
+        if (first >= run->failed) {
+            pthread_mutex_unlock(&run->lock);
+            break;
+        }
+        last = first + PROP_BLOCK < run->failed ? first + PROP_BLOCK
+                                                : run->failed;
+        run->next = last;
+        pthread_mutex_unlock(&run->lock);
+
+        for (i = first; i < last; i++) {
+            prop_seed(&rng, run->seed, i);
+            spec->generate(&rng, c);
+            if (!spec->holds(c)) {
+                pthread_mutex_lock(&run->lock);
+                if (i < run->failed) {
+                    run->failed = i;
+                }
+                pthread_mutex_unlock(&run->lock);
+                break;
+            }
+        }
+    }
+
+    free(c);
+    return NULL;
+}
+
+/**
+ * Replace c by simpler failing variants as long as there are any.
+ * Variants equal to c are skipped, so the shrinker only has to make
+ * sure that every variant is at most as complex as c. Returns the
+ * number of simplifications.
+ */
+static unsigned int prop_shrink(const prop_spec *spec, void *c, void *tmp)
+{
+    unsigned int i, shrinks = 0;
+
+    for (i = 0; spec->shrink(c, i, tmp); i++) {
+        if (0 != memcmp(c, tmp, spec->size) && !spec->holds(tmp)) {
+            memcpy(c, tmp, spec->size);
+            shrinks++;
+            i = -1;             // start over with the simpler case
+        }
+    }
+
+    return shrinks;
+}
+
+static unsigned long prop_env(const char *name, unsigned long fallback)
+{
+    const char *value = getenv(name);
+
+    return NULL != value && *value ? strtoul(value, NULL, 0) : fallback;
+}
+
+int prop_check(const prop_spec *spec, unsigned long cases, uint64_t seed,
+               void *failed, prop_result *result)
+{
+    pthread_t threads[PROP_MAX_THREADS];
+    struct timespec start, end;
+    unsigned int i, count;
+    prop_run run;
+    prop_rng rng;
+    void *tmp;
+    long cpus;
+
+    memset(result, 0, sizeof(*result));
+    run.spec = spec;
+    run.seed = prop_env("PROP_SEED", seed);
+    run.cases = prop_env("PROP_CASES", cases ? cases : PROP_DEFAULT_CASES);
+    run.next = 0;
+    run.failed = run.cases;
+    pthread_mutex_init(&run.lock, NULL);
+
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    count = cpus < 1 ? 1 : cpus > PROP_MAX_THREADS ? PROP_MAX_THREADS : cpus;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < count; i++) {
+        if (0 != pthread_create(&threads[i], NULL, prop_worker, &run)) {
+            break;
+        }
+    }
+    if (0 == (count = i)) {
+        prop_worker(&run);
+    }
+    for (i = 0; i < count; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    pthread_mutex_destroy(&run.lock);
+
+    result->elapsed = (end.tv_sec - start.tv_sec) +
+                      (end.tv_nsec - start.tv_nsec) / 1e9;
+    result->cases = run.failed < run.cases ? run.failed + 1 : run.cases;
+    result->failed_case = run.failed;
+
+    if (run.failed == run.cases) {
+        return TRUE;
+    }
+
+    prop_seed(&rng, run.seed, run.failed);
+    spec->generate(&rng, failed);
+    if (NULL != (tmp = malloc(spec->size))) {
+        result->shrinks = prop_shrink(spec, failed, tmp);
+        free(tmp);
+    }
+
+    return FALSE;
+}
@@ -0,0 +1,81 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef PROPTEST_H
+#define PROPTEST_H 1
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Property-based testing. A property is described by a generator for
+ * random cases, a predicate that has to hold for every case and a
+ * shrinker proposing simpler variants of a case. prop_check() runs the
+ * cases on all CPUs; the first failure (by case number, so a run is
+ * reproducible from its seed) is shrunk greedily until no simpler
+ * variant fails any more.
+ *
+ * PROP_CASES and PROP_SEED in the environment override the number of
+ * cases and the seed of a run.
+ */
+
+typedef struct _prop_rng {
+    uint64_t state;
+} prop_rng;
+
+typedef struct _prop_spec {
+    size_t size;                                    // bytes per case
+    void (*generate)(prop_rng *rng, void *c);
+    int (*holds)(const void *c);
+    /* write the i-th simpler variant of c to out, FALSE if there is none */
+    int (*shrink)(const void *c, unsigned int i, void *out);
+} prop_spec;
+
+typedef struct _prop_result {
+    unsigned long cases;        // cases run
+    unsigned long failed_case;  // number of the first failing case
+    unsigned int shrinks;       // simplifications applied to it
+    double elapsed;             // seconds spent running cases
+} prop_result;
+
+/* xorshift64*, state must not be zero */
+static inline uint64_t prop_next(prop_rng *rng)
+{
+    rng->state ^= rng->state >> 12;
+    rng->state ^= rng->state << 25;
+    rng->state ^= rng->state >> 27;
+    return rng->state * 2685821657736338717ull;
+}
+
+/* uniform enough below n for test generation */
+static inline unsigned int prop_below(prop_rng *rng, unsigned int n)
+{
+    return (unsigned int)((prop_next(rng) >> 32) * n >> 32);
+}
+
+/**
+ * Check the property on cases random cases (0: PROP_CASES or a
+ * default). Returns TRUE if it held for all of them. Otherwise the
+ * shrunk counterexample is stored in failed, which must hold
+ * spec->size bytes.
+ */
+int prop_check(const prop_spec *spec, unsigned long cases, uint64_t seed,
+               void *failed, prop_result *result);
+
+#endif /* PROPTEST_H */
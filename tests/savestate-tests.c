@@ -0,0 +1,177 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "unittest.h"
+#include "globals.h"
+#include "vnsem.h"
+#include "savestate.h"
+
+unsigned int tests_run = 0;
+
+static char _path[] = "/tmp/savestate-tests-XXXXXX";
+
+static int _input(uint8_t port, uint8_t *value, void *ctx)
+{
+    return FALSE;
+}
+
+static void _output(uint8_t port, uint8_t value, void *ctx)
+{
+}
+
+static const vnsem_io _io = { _input, _output, NULL };
+
+static void _machine(vnsem_machine *m)
+{
+    int i;
+
+    memset(m, 0, sizeof(*m));
+    for (i = 0; i < 256; ++i) {
+        m->mem[i] = i * 7;
+    }
+    m->step_count = 123456;
+    m->step_mode = STEP_LINE;
+    m->step_line = 42;
+    m->int_active = TRUE;
+    m->break_enabled = TRUE;
+    m->break_point = 0x30;
+    m->pc = 0x12;
+    m->reg_l = 0x34;
+    m->sp = 0xfe;
+    m->accu = 0x56;
+    m->flags = F_CARRY | F_SIGN;
+}
+
+/* flip one byte of the state file at *pos* */
+static void _corrupt(long pos)
+{
+    FILE *f = fopen(_path, "r+b");
+    int c;
+
+    fseek(f, pos, SEEK_SET);
+    c = fgetc(f);
+    fseek(f, pos, SEEK_SET);
+    fputc(c ^ 0xff, f);
+    fclose(f);
+}
+
+/* ------------------------------------------------------------------------
+ *                            test save states
+ * ------------------------------------------------------------------------ */
+
+TEST(test_ss_roundtrip)
+{
+    vnsem_machine m, r;
+    dt_inputs in, out;
+    vnsem_stats stats;
+    char tmp[64];
+
+    _machine(&m);
+    in.count = 3;
+    in.values[0] = 1;
+    in.values[1] = 2;
+    in.values[2] = 255;
+
+    ASSERT(ss_save(_path, &m, &in), "Saving state failed!");
+    snprintf(tmp, sizeof(tmp), "%s.tmp", _path);
+    ASSERT(-1 == access(tmp, F_OK), "Temporary file left behind!");
+
+    // the hooks of the restoring machine stay in place
+    memset(&r, 0, sizeof(r));
+    r.io = &_io;
+    r.stats = &stats;
+    out.count = 0;
+    ASSERT(ss_restore(_path, &r, &out), "Restoring state failed!");
+    ASSERT(r.io == &_io && r.stats == &stats, "Hooks replaced!");
+    r.io = NULL;
+    r.stats = NULL;
+    ASSERT(0 == memcmp(&m, &r, sizeof(m)), "Machine not restored!");
+    ASSERT(out.count == 3 && out.values[0] == 1 && out.values[1] == 2 &&
+           out.values[2] == 255, "Pending input not restored!");
+
+    // no pending input at all
+    ASSERT(ss_save(_path, &m, NULL), "Saving without input failed!");
+    ASSERT(ss_restore(_path, &r, &out), "Restoring without input failed!");
+    ASSERT(out.count == 0, "Pending input left over!");
+
+    return TEST_OK;
+}
+
+TEST(test_ss_invalid)
+{
+    vnsem_machine m, r, before;
+    dt_inputs in;
+    FILE *f;
+
+    _machine(&m);
+    in.count = 1;
+    in.values[0] = 9;
+
+    // any change fails the checksum, the machine is left alone
+    ASSERT(ss_save(_path, &m, &in), "Saving state failed!");
+    _corrupt(sizeof(ss_header) - 1);
+    memset(&r, 0x5a, sizeof(r));
+    before = r;
+    ASSERT(!ss_restore(_path, &r, &in), "Corrupt state restored!");
+    ASSERT(0 == memcmp(&r, &before, sizeof(r)), "Machine changed!");
+    ASSERT(in.count == 1, "Input changed!");
+
+    ASSERT(ss_save(_path, &m, &in), "Saving state failed!");
+    _corrupt(4);
+    ASSERT(!ss_restore(_path, &r, &in), "Wrong version restored!");
+
+    // truncated and empty files
+    ASSERT(ss_save(_path, &m, &in), "Saving state failed!");
+    ASSERT(0 == truncate(_path, sizeof(ss_header)), "Truncating failed!");
+    ASSERT(!ss_restore(_path, &r, &in), "Truncated state restored!");
+    f = fopen(_path, "w");
+    fclose(f);
+    ASSERT(!ss_restore(_path, &r, &in), "Empty state restored!");
+
+    ASSERT(!ss_restore("/nonexistent/state", &r, &in),
+           "Missing state restored!");
+    ASSERT(!ss_save("/nonexistent/state", &m, &in),
+           "State saved to missing directory!");
+
+    return TEST_OK;
+}
+
+/* ------------------------------------------------------------------------ */
+
+char *run_tests(void)
+{
+    close(mkstemp(_path));
+
+    RUN_TEST(test_ss_roundtrip);
+    RUN_TEST(test_ss_invalid);
+
+    unlink(_path);
+
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    return ut_main(argc, argv, run_tests);
+}
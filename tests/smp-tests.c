@@ -0,0 +1,213 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+
+#include "unittest.h"
+#include "globals.h"
+#include "vnsem.h"
+#include "smp.h"
+
+unsigned int tests_run = 0;
+
+// examples/peterson.asm: two CPUs count to 100 at 0x80 under a lock
+static const uint8_t _peterson[] = {
+    0xdb, 0xff, 0xc6, 0x88, 0x6f, 0x3e, 0x32, 0x77, 0xdb, 0xff, 0xc6, 0x84,
+    0x6f, 0x3e, 0x01, 0x77, 0xdb, 0xff, 0xee, 0x01, 0x32, 0x82, 0xdb, 0xff,
+    0xee, 0x01, 0xc6, 0x84, 0x6f, 0x7e, 0xfe, 0x00, 0xca, 0x2c, 0x3a, 0x82,
+    0x6f, 0xdb, 0xff, 0xee, 0x01, 0xbd, 0xca, 0x16, 0x3a, 0x80, 0x3c, 0x32,
+    0x80, 0xdb, 0xff, 0xc6, 0x84, 0x6f, 0x3e, 0x00, 0x77, 0xdb, 0xff, 0xc6,
+    0x88, 0x6f, 0x7e, 0x3d, 0x77, 0xc2, 0x08, 0x3a, 0x80, 0xd3, 0x00, 0x76
+};
+
+static void _load(vnsem_machine *m, const uint8_t *code, size_t size)
+{
+    memset(m, 0, sizeof(*m));
+    memcpy(m->mem, code, size);
+}
+
+static uint32_t _next(uint32_t *x)
+{
+    *x ^= *x << 13;
+    *x ^= *x >> 17;
+    *x ^= *x << 5;
+    return *x;
+}
+
+// inputs of the reference interpreter, the CPU port reads CPU 0
+static const dt_inputs *_ref_inputs;
+static int _ref_next;
+
+static int _ref_input(uint8_t port, uint8_t *value, void *ctx)
+{
+    if (SMP_CPU_PORT == port) {
+        *value = 0;
+        return TRUE;
+    }
+    if (_ref_next >= _ref_inputs->count) {
+        return FALSE;
+    }
+    *value = _ref_inputs->values[_ref_next++];
+    return TRUE;
+}
+
+static void _ref_output(uint8_t port, uint8_t value, void *ctx)
+{
+}
+
+static const vnsem_io _ref_io = { _ref_input, _ref_output, NULL };
+
+/* ------------------------------------------------------------------------
+ *                            test multiprocessor
+ * ------------------------------------------------------------------------ */
+
+TEST(test_smp_reference)
+{
+    /* a single CPU must behave exactly like the reference interpreter,
+     * run both from random memory and registers */
+    static smp_system s;
+    static dt_inputs inputs;
+    uint32_t x = 0x2545f491;
+    vnsem_machine m;
+    smp_cpu *c;
+    int run, i, result;
+
+    for (run = 0; run < 20000; ++run) {
+        memset(&m, 0, sizeof(m));
+        for (i = 0; i < 256; ++i) {
+            m.mem[i] = _next(&x);
+        }
+        m.pc = _next(&x);
+        m.sp = _next(&x);
+        m.reg_l = _next(&x);
+        m.accu = _next(&x);
+        m.flags = _next(&x);
+        inputs.count = _next(&x) % 4;
+        for (i = 0; i < inputs.count; ++i) {
+            inputs.values[i] = _next(&x);
+        }
+
+        smp_init(&s, &m, 1, SMP_ROUND_ROBIN);
+        s.inputs = &inputs;
+        s.quiet = TRUE;
+        c = &s.cpus[0];
+
+        m.io = &_ref_io;
+        _ref_inputs = &inputs;
+        _ref_next = 0;
+
+        for (i = 0; i < 32 && !m.halted; ++i) {
+            result = step_machine(&m);
+            ASSERT(result == smp_step(&s, c), "Result differs!");
+            if (result) {
+                break;
+            }
+        }
+
+        ASSERT(c->pc == m.pc && c->sp == m.sp && c->reg_l == m.reg_l &&
+               c->accu == m.accu && c->flags == m.flags &&
+               c->int_active == m.int_active &&
+               (SMP_HALTED == c->state) == m.halted, "Registers differ!");
+        for (i = 0; i < 256; ++i) {
+            ASSERT(s.mem[i] == m.mem[i], "Memory differs!");
+        }
+    }
+
+    return TEST_OK;
+}
+
+TEST(test_smp_conflicts)
+{
+    /* IN 0xFF; STA 0x80; HLT on two CPUs in turn: CPU 1 overwrites
+     * the value of CPU 0 */
+    static const uint8_t code[] = { 0xdb, 0xff, 0x32, 0x80, 0x76 };
+    static smp_system s;
+    vnsem_machine m;
+
+    _load(&m, code, sizeof(code));
+    smp_init(&s, &m, 2, SMP_ROUND_ROBIN);
+
+    ASSERT(smp_run(&s), "CPUs did not halt!");
+    ASSERT(s.mem[0x80] == 1, "Stores not interleaved!");
+    ASSERT(s.cpus[0].steps == 3 && s.cpus[1].steps == 3, "Wrong steps!");
+    ASSERT(s.cpus[0].stores == 1 && s.cpus[0].conflicts == 0,
+           "CPU 0 conflict counted!");
+    ASSERT(s.cpus[1].stores == 1 && s.cpus[1].conflicts == 1,
+           "CPU 1 conflict not counted!");
+    ASSERT(s.cpus[0].cycles == s.cpus[1].cycles, "Wrong cycles!");
+
+    /* the step limit stops a CPU */
+    smp_init(&s, &m, 2, SMP_CYCLES);
+    s.max_steps = 2;
+    ASSERT(!smp_run(&s), "Step limit ignored!");
+    ASSERT(SMP_STEP_LIMIT == s.cpus[1].state && s.cpus[1].steps == 2,
+           "Wrong state at step limit!");
+
+    return TEST_OK;
+}
+
+TEST(test_smp_schedulers)
+{
+    static smp_system s;
+    vnsem_machine m;
+    int sched, runs;
+
+    _load(&m, _peterson, sizeof(_peterson));
+
+    for (sched = SMP_ROUND_ROBIN; sched <= SMP_THREADS; ++sched) {
+        for (runs = 0; runs < (SMP_THREADS == sched ? 50 : 1); ++runs) {
+            smp_init(&s, &m, 2, sched);
+            s.quiet = TRUE;
+            ASSERT(smp_run(&s), "CPUs did not halt!");
+            ASSERT(s.mem[0x80] == 100, "Mutual exclusion violated!");
+            ASSERT(s.cpus[0].outputs == 1 && s.cpus[1].outputs == 1,
+                   "Output missing!");
+        }
+    }
+
+    /* the deterministic schedulers always interleave the same way */
+    smp_init(&s, &m, 2, SMP_CYCLES);
+    s.quiet = TRUE;
+    smp_run(&s);
+    runs = s.cpus[1].steps;
+    smp_init(&s, &m, 2, SMP_CYCLES);
+    s.quiet = TRUE;
+    smp_run(&s);
+    ASSERT(runs == s.cpus[1].steps, "Cycle scheduler not deterministic!");
+
+    return TEST_OK;
+}
+
+/* ------------------------------------------------------------------------ */
+
+char *run_tests(void)
+{
+    RUN_TEST(test_smp_reference);
+    RUN_TEST(test_smp_conflicts);
+    RUN_TEST(test_smp_schedulers);
+
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    return ut_main(argc, argv, run_tests);
+}
@@ -0,0 +1,146 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "unittest.h"
+#include "globals.h"
+#include "vnsem.h"
+#include "superopt.h"
+
+unsigned int tests_run = 0;
+
+extern int process_instruction(uint8_t, vnsem_machine*);
+
+#define ARG_ADDR    0x10
+
+/* ------------------------------------------------------------------------
+ *                            test superoptimizer
+ * ------------------------------------------------------------------------ */
+
+/**
+ * The interpreter of the search has to agree with the emulator on
+ * every instruction it may use.
+ */
+TEST(test_so_interpreter)
+{
+    static vnsem_machine m;
+    static so_state state;
+    const vns_instruction *ins;
+    so_sequence seq;
+    unsigned int op, i, j;
+
+    srand(42);
+    for (op = 0; op < 256; op++) {
+        ins = is_find_opcode(op);
+        if (!so_usable(ins)) {
+            continue;
+        }
+        for (i = 0; i < 200; i++) {
+            memset(&m, 0, sizeof(m));
+            for (j = 0; j < sizeof(m.mem); j++) {
+                m.mem[j] = rand();
+            }
+            m.accu = i < 100 ? rand() : (i & 1 ? 0xff : 0x00);
+            m.reg_l = rand();
+            m.flags = rand();
+            m.pc = ARG_ADDR;
+
+            state.a = m.accu;
+            state.l = m.reg_l;
+            state.flags = m.flags;
+            memcpy(state.mem, m.mem, sizeof(state.mem));
+
+            memset(&seq, 0, sizeof(seq));
+            so_append(&seq, ins, m.mem[ARG_ADDR]);
+
+            process_instruction(op, &m);
+            so_run(&state, &seq);
+
+            ASSERT(m.accu == state.a && m.reg_l == state.l &&
+                   m.flags == state.flags &&
+                   0 == memcmp(m.mem, state.mem, sizeof(m.mem)),
+                   "Interpreter differs from the emulator!");
+        }
+    }
+
+    return TEST_OK;
+}
+
+TEST(test_so_equivalent)
+{
+    so_sequence x, y;
+
+    memset(&x, 0, sizeof(x));
+    memset(&y, 0, sizeof(y));
+    so_append(&x, is_find_opcode(0x3e), 0x00);      // MVI A,0
+    so_append(&y, is_find_opcode(0xaf), 0x00);      // XRA A
+
+    ASSERT(!so_equivalent(&x, &y, SO_LIVE_ALL), "Flags were ignored!");
+    ASSERT(so_equivalent(&x, &y, SO_LIVE_A | SO_LIVE_L),
+           "Equivalent sequences rejected!");
+
+    memset(&x, 0, sizeof(x));
+    memset(&y, 0, sizeof(y));
+    so_append(&x, is_find_opcode(0x77), 0x00);      // MOV M,A
+    so_append(&y, is_find_opcode(0x32), 0x80);      // STA 0x80
+
+    ASSERT(!so_equivalent(&x, &y, SO_LIVE_ALL), "Stores were ignored!");
+
+    return TEST_OK;
+}
+
+TEST(test_so_search)
+{
+    so_search search;
+
+    memset(&search, 0, sizeof(search));
+    so_append(&search.target, is_find_opcode(0x3e), 0x00);    // MVI A,0
+    so_append(&search.target, is_find_opcode(0x85), 0x00);    // ADD L
+    search.live = SO_LIVE_A | SO_LIVE_L;
+    search.max_length = 2;
+    search.threads = 2;
+
+    ASSERT(so_search_run(&search), "Search failed!");
+    ASSERT(search.result_count > 0 && 1 == search.results[0].length &&
+           0x7d == search.results[0].code[0].ins->opcode,
+           "MOV A,L not found!");
+    so_search_release(&search);
+
+    return TEST_OK;
+}
+
+/* ------------------------------------------------------------------------ */
+
+char *run_tests(void)
+{
+    RUN_TEST(test_so_interpreter);
+    RUN_TEST(test_so_equivalent);
+    RUN_TEST(test_so_search);
+
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    return ut_main(argc, argv, run_tests);
+}
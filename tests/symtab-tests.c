@@ -0,0 +1,146 @@
+/**
+ * This file is part of hwprak-vns.
+ * Copyright 2013-2015 (c) René Küttner <rene@spaceshore.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "unittest.h"
+#include "globals.h"
+#include "symtab.h"
+
+unsigned int tests_run = 0;
+
+/* ------------------------------------------------------------------------
+ *                            test symbol table
+ * ------------------------------------------------------------------------ */
+
+TEST(test_sym_intern)
+{
+    symtab st;
+    const char *a, *b;
+    char buf[] = "loop";
+
+    sym_init(&st);
+
+    a = sym_intern(&st, "loop");
+    b = sym_intern(&st, buf);
+    ASSERT(NULL != a && a == b, "Equal names not interned to one pointer!");
+    ASSERT(a != buf && 0 == strcmp(a, "loop"), "Interned copy wrong!");
+    ASSERT(sym_intern(&st, "LOOP") != a, "Names must be case sensitive!");
+    ASSERT(NULL == sym_find(&st, "loop"), "Interned name became a label!");
+
+    sym_destroy(&st);
+
+    return TEST_OK;
+}
+
+TEST(test_sym_labels)
+{
+    uint8_t data[256];
+    vnsasm_label *label;
+    sym_fixup *first, *second;
+    symtab st;
+
+    sym_init(&st);
+    memset(data, 0, sizeof(data));
+
+    // two forward references, then the declaration
+    label = sym_label(&st, "end");
+    ASSERT(-1 == label->addr, "New label not pending!");
+    ASSERT(sym_add_fixup(&st, label, 0x01), "Adding fixup failed!");
+    label = sym_label(&st, "end");
+    ASSERT(sym_add_fixup(&st, label, 0x11), "Adding fixup failed!");
+    first = label->fixups;
+    second = first->next;
+
+    label->addr = 0x42;
+    sym_backpatch(&st, label, data);
+    ASSERT(data[0x01] == 0x42 && data[0x11] == 0x42, "Backpatch missed!");
+    ASSERT(data[0x00] == 0 && data[0x02] == 0, "Backpatch wrote too much!");
+    ASSERT(NULL == label->fixups, "Fixups not released!");
+
+    // released records are reused
+    label = sym_label(&st, "other");
+    ASSERT(sym_add_fixup(&st, label, 0x20), "Adding fixup failed!");
+    ASSERT(label->fixups == first || label->fixups == second,
+           "Released fixup not reused!");
+
+    label = sym_find(&st, "end");
+    ASSERT(NULL != label && label->addr == 0x42, "Label lost!");
+    ASSERT(st.label_count == 2, "Wrong label count!");
+    ASSERT(0 == strcmp(st.labels[0]->name, "end"), "Labels out of order!");
+
+    sym_destroy(&st);
+
+    return TEST_OK;
+}
+
+TEST(test_sym_many)
+{
+    vnsasm_label *label, *first = NULL;
+    char name[32];
+    symtab st;
+    int i;
+
+    sym_init(&st);
+
+    // enough names to force several rehashes and arena chunks
+    for (i = 0; i < 20000; i++) {
+        sprintf(name, "label_%i", i);
+        label = sym_label(&st, name);
+        ASSERT(NULL != label, "Adding label failed!");
+        label->addr = i & 0xff;
+        if (0 == i) {
+            first = label;
+        }
+    }
+
+    ASSERT(first == sym_find(&st, "label_0"), "Label moved!");
+    ASSERT(st.label_count == 20000, "Wrong label count!");
+    for (i = 0; i < 20000; i++) {
+        sprintf(name, "label_%i", i);
+        label = sym_find(&st, name);
+        ASSERT(NULL != label && label->addr == (i & 0xff), "Label lost!");
+        ASSERT(label == st.labels[i] && label->index == (unsigned int)i,
+               "Labels out of order!");
+    }
+    ASSERT(NULL == sym_find(&st, "label_20000"), "Unknown label found!");
+
+    sym_destroy(&st);
+
+    return TEST_OK;
+}
+
+/* ------------------------------------------------------------------------ */
+
+char *run_tests(void)
+{
+    RUN_TEST(test_sym_intern);
+    RUN_TEST(test_sym_labels);
+    RUN_TEST(test_sym_many);
+
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    return ut_main(argc, argv, run_tests);
+}
@@ -3,26 +3,528 @@
 
 // plain simple test "framework" inspired by MinUnit
 // at http://www.jera.com/techinfo/jtns/jtn002.html
+//
+// RUN_TEST only registers a test, ut_main() runs all of them in forked
+// workers (one per CPU), prints the results in order with timings and
+// optionally writes JUnit XML and JSON reports. Tests registered with
+// RUN_BENCH run one at a time after all others, so BENCH timings are
+// not disturbed by parallel tests.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
 
 #define ASSERT(cond, message) \
     do { \
          if (!(cond)) return message; \
        } while (0);
 #define TEST(test) char *test(void)
-#define RUN_TEST(test) \
-    do { \
-         printf("Running %-63s ", #test); \
-         fflush(stdout); \
-         char *message = test(); \
-         tests_run++; \
-         if (NULL != message) { \
-             printf("\033[1;31mFAIL\033[m\n"); \
-             return message; \
-         } \
-         printf("\033[1;32mPASS\033[m\n"); \
-       } while(0)
+#define RUN_TEST(test) ut_register(#test, test, 0)
+#define RUN_BENCH(test) ut_register(#test, test, 1)
 #define TEST_OK NULL
 
+// BENCH(name, iterations) { body } runs body iterations times per
+// round, one warmup round and UT_BENCH_ROUNDS measured ones, and
+// reports the nanoseconds per iteration. BENCH_KEEP(value) keeps the
+// compiler from optimizing away a result.
+#define BENCH(name, iterations) \
+    for (ut_bench _bench = ut_bench_start(name, iterations); \
+         ut_bench_round(&_bench); ) \
+        for (unsigned long _iter = 0; _iter < _bench.iters; _iter++)
+#define BENCH_KEEP(value) __asm__ volatile("" : : "g"(value) : "memory")
+
+#define UT_MAX_TESTS    256
+#define UT_MAX_BENCHES  16
+#define UT_NAME_SIZE    64
+#define UT_MESSAGE_SIZE 256
+#define UT_BENCH_ROUNDS 5
+
+#define UT_PENDING      0
+#define UT_PASS         1
+#define UT_FAIL         2
+
+typedef char *ut_func(void);
+
+typedef struct _ut_bench_result {
+    char name[UT_NAME_SIZE];
+    unsigned long iters;
+    double mean, stddev, min, max;      // nanoseconds per iteration
+} ut_bench_result;
+
+// written by the worker, lives in memory shared with the runner
+typedef struct _ut_result {
+    int status;
+    double elapsed;                     // seconds
+    char message[UT_MESSAGE_SIZE];
+    unsigned int bench_count;
+    ut_bench_result benches[UT_MAX_BENCHES];
+} ut_result;
+
+typedef struct _ut_test {
+    const char *name;
+    ut_func *func;
+    int serial;
+    ut_result *result;
+    FILE *output;                       // captured stdout and stderr
+    pid_t pid;
+    int done;
+} ut_test;
+
+typedef struct _ut_bench {
+    ut_bench_result *result;
+    unsigned long iters;
+    unsigned int round;
+    double start;
+    double samples[UT_BENCH_ROUNDS];
+} ut_bench;
+
 extern unsigned int tests_run;
 
+static ut_test ut_tests[UT_MAX_TESTS];
+static unsigned int ut_test_count;
+static ut_result *ut_current;
+static ut_bench_result ut_bench_scratch;
+
+static inline double ut_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static inline void ut_register(const char *name, ut_func *func, int serial)
+{
+    if (ut_test_count < UT_MAX_TESTS) {
+        ut_tests[ut_test_count].name = name;
+        ut_tests[ut_test_count].func = func;
+        ut_tests[ut_test_count].serial = serial;
+        ut_test_count++;
+    }
+}
+
+static inline ut_bench ut_bench_start(const char *name, unsigned long iters)
+{
+    ut_bench b;
+
+    memset(&b, 0, sizeof(b));
+    b.iters = iters ? iters : 1;
+    b.result = &ut_bench_scratch;
+    if (NULL != ut_current && ut_current->bench_count < UT_MAX_BENCHES) {
+        b.result = &ut_current->benches[ut_current->bench_count++];
+    }
+    snprintf(b.result->name, UT_NAME_SIZE, "%s", name);
+    b.result->iters = b.iters;
+
+    return b;
+}
+
+// Newton's method, spares the tests a dependency on libm
+static inline double ut_sqrt(double x)
+{
+    double r = x > 1 ? x : 1;
+    int i;
+
+    for (i = 0; i < 64 && x > 0; i++) {
+        r = (r + x / r) / 2;
+    }
+    return x > 0 ? r : 0;
+}
+
+/**
+ * Called before every round of a BENCH loop. Stores the time of the
+ * round just finished (round 0 is the warmup) and returns 0 after the
+ * last one, when the statistics are complete.
+ */
+static inline int ut_bench_round(ut_bench *b)
+{
+    ut_bench_result *r = b->result;
+    double now = ut_now(), var = 0;
+    unsigned int i;
+
+    if (b->round >= 2) {
+        b->samples[b->round - 2] = (now - b->start) * 1e9 / b->iters;
+    }
+    if (b->round++ <= UT_BENCH_ROUNDS) {
+        b->start = ut_now();
+        return 1;
+    }
+
+    r->mean = 0;
+    r->min = r->max = b->samples[0];
+    for (i = 0; i < UT_BENCH_ROUNDS; i++) {
+        r->mean += b->samples[i] / UT_BENCH_ROUNDS;
+        r->min = b->samples[i] < r->min ? b->samples[i] : r->min;
+        r->max = b->samples[i] > r->max ? b->samples[i] : r->max;
+    }
+    for (i = 0; i < UT_BENCH_ROUNDS; i++) {
+        var += (b->samples[i] - r->mean) * (b->samples[i] - r->mean);
+    }
+    r->stddev = ut_sqrt(var / (UT_BENCH_ROUNDS - 1));
+
+    printf("\n  %-30s %10.2f ns/iter  +- %5.1f%%  (min %.2f, max %.2f)",
+           r->name, r->mean, r->mean > 0 ? 100 * r->stddev / r->mean : 0,
+           r->min, r->max);
+
+    return 0;
+}
+
+static inline void ut_run(ut_test *t)
+{
+    char *message;
+    double start;
+
+    ut_current = t->result;
+    start = ut_now();
+    message = t->func();
+    t->result->elapsed = ut_now() - start;
+    t->result->status = NULL == message ? UT_PASS : UT_FAIL;
+    if (NULL != message) {
+        snprintf(t->result->message, UT_MESSAGE_SIZE, "%s", message);
+    }
+    ut_current = NULL;
+}
+
+/**
+ * Fork a worker for the test, its output goes to a temporary file. If
+ * there is no worker, the test runs right here.
+ */
+static inline void ut_start(ut_test *t)
+{
+    fflush(stdout);
+    fflush(stderr);
+
+    t->output = tmpfile();
+    t->pid = fork();
+
+    if (0 == t->pid) {
+        if (NULL != t->output) {
+            dup2(fileno(t->output), STDOUT_FILENO);
+            dup2(fileno(t->output), STDERR_FILENO);
+        }
+        ut_run(t);
+        fflush(stdout);
+        fflush(stderr);
+        _exit(0);
+    }
+
+    if (t->pid < 0) {
+        if (NULL != t->output) {
+            fclose(t->output);
+            t->output = NULL;
+        }
+        ut_run(t);
+        t->done = 1;
+    }
+}
+
+static inline void ut_finish(ut_test *t, int status)
+{
+    if (UT_PENDING != t->result->status) {
+        t->done = 1;
+        return;
+    }
+
+    t->result->status = UT_FAIL;
+    if (WIFSIGNALED(status)) {
+        snprintf(t->result->message, UT_MESSAGE_SIZE,
+                 "Crashed with signal %i!", WTERMSIG(status));
+    } else {
+        snprintf(t->result->message, UT_MESSAGE_SIZE,
+                 "Exited without result!");
+    }
+    t->done = 1;
+}
+
+static inline void ut_print(ut_test *t, int announce)
+{
+    ut_result *r = t->result;
+    char buf[4096];
+    size_t n;
+
+    if (announce) {
+        printf("Running %-63s ", t->name);
+    }
+    if (NULL != t->output) {
+        rewind(t->output);
+        while (0 < (n = fread(buf, 1, sizeof(buf), t->output))) {
+            fwrite(buf, 1, n, stdout);
+        }
+        fclose(t->output);
+        t->output = NULL;
+    }
+    if (r->bench_count) {
+        // benchmark lines end unterminated, line up the status again
+        printf("\n%-71s ", "");
+    }
+
+    if (UT_PASS == r->status) {
+        printf("\033[1;32mPASS\033[m %9.3f ms\n", r->elapsed * 1e3);
+    } else {
+        printf("\033[1;31mFAIL\033[m %9.3f ms\n", r->elapsed * 1e3);
+        printf("  \033[1;31m%s\033[m\n", r->message);
+    }
+    fflush(stdout);
+}
+
+/**
+ * Run the tests of one phase with up to jobs workers at a time and
+ * print them in order as soon as they are done. Without workers the
+ * name of a test is printed before it runs, so its output follows.
+ */
+static inline void ut_run_phase(int serial, unsigned int jobs, int fork_tests)
+{
+    unsigned int i, next = 0, printed = 0, running = 0;
+    ut_test *t;
+    int status;
+    pid_t pid;
+
+    while (printed < ut_test_count) {
+        while (next < ut_test_count && running < jobs) {
+            t = &ut_tests[next++];
+            if (t->serial != serial) {
+                t->done = 1;
+            } else if (fork_tests) {
+                ut_start(t);
+                running += !t->done;
+            } else {
+                printf("Running %-63s ", t->name);
+                fflush(stdout);
+                ut_run(t);
+                t->done = 1;
+                break;
+            }
+        }
+
+        while (printed < ut_test_count && ut_tests[printed].done) {
+            if (ut_tests[printed].serial == serial) {
+                ut_print(&ut_tests[printed], fork_tests);
+            }
+            printed++;
+        }
+
+        if (running && 0 < (pid = wait(&status))) {
+            for (i = 0; i < ut_test_count; i++) {
+                if (ut_tests[i].pid == pid && !ut_tests[i].done) {
+                    ut_finish(&ut_tests[i], status);
+                    running--;
+                }
+            }
+        }
+    }
+}
+
+static inline void ut_xml_escape(FILE *f, const char *str)
+{
+    for (; *str; str++) {
+        switch (*str) {
+            case '&':  fputs("&amp;", f);   break;
+            case '<':  fputs("&lt;", f);    break;
+            case '>':  fputs("&gt;", f);    break;
+            case '"':  fputs("&quot;", f);  break;
+            default:   fputc(*str, f);      break;
+        }
+    }
+}
+
+static inline void ut_json_escape(FILE *f, const char *str)
+{
+    fputc('"', f);
+    for (; *str; str++) {
+        if ('"' == *str || '\\' == *str) {
+            fputc('\\', f);
+        }
+        if ((unsigned char)*str >= 0x20) {
+            fputc(*str, f);
+        }
+    }
+    fputc('"', f);
+}
+
+static inline int ut_write_junit(const char *path, const char *suite,
+                                 unsigned int failed, double total)
+{
+    FILE *f = fopen(path, "w");
+    ut_bench_result *b;
+    ut_result *r;
+    unsigned int i, j;
+
+    if (NULL == f) {
+        perror(path);
+        return 0;
+    }
+
+    fprintf(f, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+    fprintf(f, "<testsuite name=\"%s\" tests=\"%u\" failures=\"%u\" "
+               "time=\"%.6f\">\n", suite, ut_test_count, failed, total);
+    for (i = 0; i < ut_test_count; i++) {
+        r = ut_tests[i].result;
+        fprintf(f, "  <testcase classname=\"%s\" name=\"%s\" time=\"%.6f\">\n",
+                suite, ut_tests[i].name, r->elapsed);
+        if (r->bench_count) {
+            fprintf(f, "    <properties>\n");
+        }
+        for (j = 0; j < r->bench_count; j++) {
+            b = &r->benches[j];
+            fprintf(f, "      <property name=\"");
+            ut_xml_escape(f, b->name);
+            fprintf(f, "\" value=\"%.3f ns/iter\"/>\n", b->mean);
+        }
+        if (r->bench_count) {
+            fprintf(f, "    </properties>\n");
+        }
+        if (UT_PASS != r->status) {
+            fprintf(f, "    <failure message=\"");
+            ut_xml_escape(f, r->message);
+            fprintf(f, "\"/>\n");
+        }
+        fprintf(f, "  </testcase>\n");
+    }
+    fprintf(f, "</testsuite>\n");
+
+    return 0 == fclose(f);
+}
+
+static inline int ut_write_json(const char *path, const char *suite,
+                                unsigned int failed, double total)
+{
+    FILE *f = fopen(path, "w");
+    ut_bench_result *b;
+    ut_result *r;
+    unsigned int i, j;
+
+    if (NULL == f) {
+        perror(path);
+        return 0;
+    }
+
+    fprintf(f, "{ \"suite\": \"%s\", \"tests\": %u, \"failures\": %u, "
+               "\"time\": %.6f,\n  \"results\": [", suite, ut_test_count,
+            failed, total);
+    for (i = 0; i < ut_test_count; i++) {
+        r = ut_tests[i].result;
+        fprintf(f, "%s\n    { \"name\": \"%s\", \"status\": \"%s\", "
+                   "\"time\": %.6f", i ? "," : "", ut_tests[i].name,
+                UT_PASS == r->status ? "pass" : "fail", r->elapsed);
+        if (UT_PASS != r->status) {
+            fprintf(f, ", \"message\": ");
+            ut_json_escape(f, r->message);
+        }
+        if (r->bench_count) {
+            fprintf(f, ",\n      \"benchmarks\": [");
+        }
+        for (j = 0; j < r->bench_count; j++) {
+            b = &r->benches[j];
+            fprintf(f, "%s\n        { \"name\": ", j ? "," : "");
+            ut_json_escape(f, b->name);
+            fprintf(f, ", \"iterations\": %lu, \"rounds\": %u,\n"
+                       "          \"ns_per_iter\": { \"mean\": %.3f, "
+                       "\"stddev\": %.3f, \"min\": %.3f, \"max\": %.3f } }",
+                    b->iters, UT_BENCH_ROUNDS, b->mean, b->stddev,
+                    b->min, b->max);
+        }
+        if (r->bench_count) {
+            fprintf(f, " ]");
+        }
+        fprintf(f, " }");
+    }
+    fprintf(f, " ]\n}\n");
+
+    return 0 == fclose(f);
+}
+
+/**
+ * Register the tests with run_tests() and run them. Returns the exit
+ * code of the test program.
+ */
+static inline int ut_main(int argc, char **argv, ut_func *run_tests)
+{
+    const char *junit = NULL, *json = NULL, *suite = strrchr(argv[0], '/');
+    unsigned int i, failed = 0, jobs = 0;
+    int opt, fork_tests = 1;
+    ut_result *results;
+    double start;
+    long cpus;
+
+    while ((opt = getopt(argc, argv, "hj:sx:o:")) != -1) {
+        switch (opt) {
+            case 'j':
+                jobs = strtoul(optarg, NULL, 0);
+                break;
+            case 's':
+                fork_tests = 0;
+                break;
+            case 'x':
+                junit = optarg;
+                break;
+            case 'o':
+                json = optarg;
+                break;
+            default:
+                printf("Usage: %s [-s] [-j <n>] [-x <junit.xml>] "
+                       "[-o <results.json>]\n\n", argv[0]);
+                printf("  -s             Run the tests in this process, "
+                       "one after another.\n");
+                printf("  -j <n>         Run up to <n> tests in parallel "
+                       "(default: one per CPU).\n");
+                printf("  -x <file>      Write a JUnit XML report.\n");
+                printf("  -o <file>      Write results and benchmarks "
+                       "as JSON.\n");
+                return 'h' == opt ? 0 : -1;
+        }
+    }
+
+    suite = NULL != suite ? suite + 1 : argv[0];
+    if (0 == jobs) {
+        cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        jobs = cpus > 0 ? cpus : 1;
+    }
+
+    run_tests();
+
+    results = mmap(NULL, sizeof(*results) * (ut_test_count + 1),
+                   PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == results) {
+        perror(suite);
+        return -1;
+    }
+    for (i = 0; i < ut_test_count; i++) {
+        ut_tests[i].result = &results[i];
+    }
+
+    start = ut_now();
+    ut_run_phase(0, jobs, fork_tests);
+    for (i = 0; i < ut_test_count; i++) {
+        ut_tests[i].done = 0;
+    }
+    ut_run_phase(1, 1, fork_tests);
+
+    for (i = 0; i < ut_test_count; i++) {
+        failed += UT_PASS != results[i].status;
+    }
+    tests_run = ut_test_count;
+
+    if (failed) {
+        printf("\033[1;31m%u OF %u TESTS FAILED\033[m\n", failed, tests_run);
+    } else {
+        printf("\033[1;32mALL TESTS PASSED\033[m\n");
+    }
+    printf("Tests run: %d\n", tests_run);
+
+    if ((NULL != junit &&
+            !ut_write_junit(junit, suite, failed, ut_now() - start)) ||
+        (NULL != json &&
+            !ut_write_json(json, suite, failed, ut_now() - start))) {
+        failed++;
+    }
+
+    munmap(results, sizeof(*results) * (ut_test_count + 1));
+
+    return failed ? -1 : 0;
+}
+
 #endif /* UNITTEST_H */